@@ -0,0 +1,557 @@
+// Microbenchmarks dos caminhos quentes do firmware (env:native_bench)
+//
+// Inclui src/main.cpp direto para acessar o codeStore e os handlers.
+// Cada caso roda em vários tamanhos de armazenamento e imprime uma linha JSON:
+// ns/op, alocações/op (wrappers de malloc do firmware), bytes de resposta HTTP/op e custo NVS/op
+// (fake do Preferences).
+//
+//   .pio/build/native_bench/program [--sizes 1,10,25,50] [--min-ms 200] [--filter nome] [--label v1.2]
+//   .pio/build/native_bench/program --stress 2000 [--readers 8] [--writers 2]
+#include "../../src/main.cpp"
+
+#include <time.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "sim.h"
+
+struct BenchOptions {
+  int sizes[8];
+  int sizeCount;
+  uint32_t minMs;
+  const char* filter;
+  const char* label;
+  uint32_t stressMs;  // 0 = benchmarks normais
+  int stressReaders;
+  int stressWriters;
+};
+
+struct BenchCounters {
+  uint64_t allocs;
+  uint64_t reallocs;
+  uint64_t allocBytes;
+  uint64_t responseBytes;
+  NvsSimStats nvs;
+};
+
+static BenchOptions options;
+static uint64_t responseBytesTotal;  // Cabeçalhos + corpo de cada benchRequest()
+
+// Impede o compilador de eliminar chamadas cujo resultado não é usado
+template <typename T>
+static inline void doNotOptimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+static uint64_t nowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static BenchCounters snapshotCounters() {
+  BenchCounters counters;
+  memset(&counters, 0, sizeof(counters));
+  for (int tag = 0; tag < HEAP_TAG_COUNT; tag++) {
+    counters.allocs += heapTagStats[tag].allocs;
+    counters.reallocs += heapTagStats[tag].reallocs;
+    counters.allocBytes += heapTagStats[tag].bytes;
+  }
+  counters.responseBytes = responseBytesTotal;
+  counters.nvs = Preferences::simStats();
+  return counters;
+}
+
+// Armazenamento sintético com nomes e protocolos variados
+static void fillStore(int size) {
+  static const IRProtocol protocols[] = {PROTOCOL_NEC, PROTOCOL_SAMSUNG, PROTOCOL_SONY, PROTOCOL_LG, PROTOCOL_RC5};
+  CodeStoreWriter store;
+  memset(store->codes, 0, sizeof(store->codes));
+  store->count = size;
+  store->payloadUsed = 0;
+  for (int i = 0; i < size; i++) {
+    IRCode& code = store->codes[i];
+    snprintf(code.device, sizeof(code.device), "Dispositivo %02d", i / 8);
+    snprintf(code.button, sizeof(code.button), "Botao %02d", i);
+    code.protocol = protocols[i % 5];
+    code.address = (uint16_t)(0x0400 + i);
+    code.command = (uint16_t)(0x10 + i);
+    code.code = ((uint64_t)code.address << 16) | code.command;
+    code.bits = 32;
+    code.repeats = 0;
+  }
+  store.publish();
+}
+
+// Pedido HTTP em processo; a String é reaproveitada entre chamadas para não contar no handler
+static int benchRequest(HTTPMethod method, const char* uri, const char* body) {
+  static String response;
+  response = "";
+  int code = server.simRequest(method, uri, body, &response);
+  requestArenaReset();  // simRequest() não passa por handleClient()
+  responseBytesTotal += response.length();
+  return code;
+}
+
+// Estado de ar-condicionado (280 bits) como o IRremote decodifica, com os tempos medidos variando
+// algumas dezenas de µs a cada captura
+static IRData longFrame(int capture) {
+  static const uint16_t jitter[] = {0, 24, 48, 16, 40, 8};
+  IRData frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.protocol = PULSE_DISTANCE;
+  frame.numberOfBits = 280;
+  for (int i = 0; i < 5; i++) {
+    frame.decodedRawDataArray[i] = 0xC3A5F00F12345678ULL + (uint64_t)i * 0x0101010101010101ULL;
+  }
+  uint16_t delta = jitter[capture % 6];
+  frame.DistanceWidthTimingInfo = {(uint16_t)(3500 + delta), (uint16_t)(1700 - delta), (uint16_t)(430 + delta),
+                                   (uint16_t)(1300 - delta), (uint16_t)(430 + delta), (uint16_t)(430 - delta)};
+  frame.decodedRawData = frame.decodedRawDataArray[0];
+  return frame;
+}
+
+// NDJSON de /api/codes/import com o armazenamento atual; variant muda os nomes para a gravação no NVS não
+// ser ignorada por valor igual
+static String importBody(int variant) {
+  CodeStoreReader codes;
+  String body;
+  char line[256];
+  snprintf(line, sizeof(line), "{\"type\":\"header\",\"format\":\"%s\",\"version\":%d,\"count\":%d}\n",
+           CODES_EXPORT_FORMAT, CODES_EXPORT_VERSION, codes->count);
+  body += line;
+  for (int i = 0; i < codes->count; i++) {
+    const IRCode& code = codes->codes[i];
+    snprintf(line, sizeof(line),
+             "{\"type\":\"code\",\"device\":\"%s%s\",\"button\":\"%s\",\"protocol\":\"%s\",\"code\":\"0x%llX\","
+             "\"bits\":%d,\"address\":%d,\"command\":%d,\"repeats\":%d}\n",
+             code.device, variant ? "+" : "", code.button, getProtocolName(code.protocol), (unsigned long long)code.code, code.bits,
+             code.address, code.command, code.repeats);
+    body += line;
+  }
+  return body;
+}
+
+// Corpo de uma resposta de simRequest() (cabeçalhos + corpo, chunked ou não)
+static String responseBody(const String& response) {
+  const char* p = strstr(response.c_str(), "\r\n\r\n");
+  if (!p) {
+    return String();
+  }
+  p += 4;
+  if (!strstr(response.c_str(), "Transfer-Encoding: chunked")) {
+    return String(p);
+  }
+  String body;
+  for (;;) {
+    char* end;
+    unsigned long size = strtoul(p, &end, 16);
+    if (size == 0 || strncmp(end, "\r\n", 2) != 0) {
+      return body;
+    }
+    body.concat(end + 2, (unsigned)size);
+    p = end + 2 + size + 2;
+  }
+}
+
+static bool benchSelected(const char* name) {
+  return options.filter == NULL || strstr(name, options.filter) != NULL;
+}
+
+// Roda fn em lotes crescentes até somar options.minMs e imprime o resultado por operação
+template <typename Fn>
+static void runBench(const char* name, int size, Fn fn) {
+  if (!benchSelected(name)) {
+    return;
+  }
+  for (int i = 0; i < 8; i++) {
+    fn(i);  // Aquecimento
+  }
+
+  uint64_t iterations = 0;
+  uint64_t elapsedNs = 0;
+  uint64_t batch = 16;
+  BenchCounters before = snapshotCounters();
+  while (elapsedNs < (uint64_t)options.minMs * 1000000ULL) {
+    uint64_t start = nowNs();
+    for (uint64_t i = 0; i < batch; i++) {
+      fn((int)(iterations + i));
+    }
+    elapsedNs += nowNs() - start;
+    iterations += batch;
+    batch *= 2;
+  }
+  BenchCounters after = snapshotCounters();
+
+  double ops = (double)iterations;
+  printf("{\"type\":\"bench\",\"bench\":\"%s\",\"size\":%d,\"iterations\":%llu,\"ns_per_op\":%.1f,"
+         "\"allocs_per_op\":%.2f,\"reallocs_per_op\":%.2f,\"alloc_bytes_per_op\":%.1f,"
+         "\"response_bytes_per_op\":%.1f,\"nvs_puts_per_op\":%.2f,\"nvs_bytes_per_op\":%.1f,\"nvs_erases_per_op\":%.4f,\"flash_us_per_op\":%.1f}\n",
+         name, size, (unsigned long long)iterations, elapsedNs / ops,
+         (after.allocs - before.allocs) / ops, (after.reallocs - before.reallocs) / ops,
+         (after.allocBytes - before.allocBytes) / ops, (after.responseBytes - before.responseBytes) / ops,
+         (after.nvs.puts - before.nvs.puts) / ops, (after.nvs.bytesWritten - before.nvs.bytesWritten) / ops,
+         (after.nvs.pageErases - before.nvs.pageErases) / ops,
+         (after.nvs.flashTimeUs - before.nvs.flashTimeUs) / ops);
+  fflush(stdout);
+}
+
+static void runSuite(int size) {
+  fillStore(size);
+  {
+    CodeStoreReader codes;
+    saveCodesToPreferences(*codes.data);
+  }
+
+  // Edição típica: um código muda, o armazenamento inteiro é regravado e a cópia é publicada
+  runBench("save_codes", size, [size](int i) {
+    CodeStoreWriter store;
+    store->codes[i % size].command ^= 1;
+    saveCodesToPreferences(*store.data);
+    store.publish();
+  });
+  runBench("save_codes_unchanged", size, [](int) {
+    CodeStoreReader codes;
+    saveCodesToPreferences(*codes.data);
+  });
+  runBench("load_codes", size, [](int) {
+    prefs.end();
+    loadCodesFromPreferences();
+  });
+
+  runBench("find_code_index_hit", size, [size](int i) {
+    CodeStoreReader codes;
+    const IRCode& code = codes->codes[i % size];
+    int index = findCodeIndex(*codes.data, code.device, code.button);
+    if (index < 0) {
+      abort();
+    }
+    doNotOptimize(index);
+  });
+  runBench("find_code_index_miss", size, [](int) {
+    CodeStoreReader codes;
+    int index = findCodeIndex(*codes.data, "Dispositivo 99", "Inexistente");
+    if (index >= 0) {
+      abort();
+    }
+    doNotOptimize(index);
+  });
+  // Detecção de duplicata no learn/save: tabela de assinaturas em vez de varrer o armazenamento
+  runBench("find_code_signature_hit", size, [size](int i) {
+    CodeStoreReader codes;
+    IRCode probe = codes->codes[i % size];
+    int index = findCodeBySignature(*codes.data, probe);
+    if (index != i % size) {
+      abort();
+    }
+    doNotOptimize(index);
+  });
+  runBench("find_code_signature_miss", size, [](int) {
+    CodeStoreReader codes;
+    IRCode probe = codes->codes[0];
+    probe.command = 0xFFFF;
+    int index = findCodeBySignature(*codes.data, probe);
+    if (index >= 0) {
+      abort();
+    }
+    doNotOptimize(index);
+  });
+
+  runBench("list_codes_json", size, [](int) {
+    benchRequest(HTTP_GET, "/api/codes", NULL);
+  });
+
+  char body[64];
+  runBench("code_send_by_id", size, [size, &body](int i) {
+    snprintf(body, sizeof(body), "{\"id\":%d}", i % size);
+    benchRequest(HTTP_POST, "/api/code/send", body);
+  });
+  runBench("code_send_by_hex", size, [](int) {
+    benchRequest(HTTP_POST, "/api/code/send", "{\"code\":\"0x20DF10EF\"}");
+  });
+
+  // Backup/clonagem: exportação em NDJSON e importação do armazenamento inteiro (uma publicação, uma gravação)
+  runBench("codes_export", size, [](int) {
+    benchRequest(HTTP_GET, "/api/codes/export", NULL);
+  });
+  // A staging (CodeImport) ocupa a maior parte da arena: as linhas precisam caber no resto, sem heap
+  String bodies[2] = {importBody(1), importBody(0)};
+  runBench("codes_import", size, [&bodies](int i) {
+    uint32_t fallbacks = requestArena.fallbacks;
+    if (benchRequest(HTTP_POST, "/api/codes/import", bodies[i & 1].c_str()) != 200 ||
+        requestArena.fallbacks != fallbacks) {
+      abort();
+    }
+  });
+
+  // Respostas de telemetria: /api/metrics e /api/heap passam do buffer do writer (chunked)
+  runBench("status_json", size, [](int) {
+    benchRequest(HTTP_GET, "/api/status", NULL);
+  });
+  runBench("metrics_json", size, [](int) {
+    benchRequest(HTTP_GET, "/api/metrics", NULL);
+  });
+  runBench("heap_json", size, [](int) {
+    benchRequest(HTTP_GET, "/api/heap", NULL);
+  });
+  runBench("error_json", size, [](int) {
+    benchRequest(HTTP_POST, "/api/code/edit", "{");
+  });
+
+  // Backup e restauração: o armazenamento aceita nomes repetidos (on_duplicate=alias com o mesmo device e
+  // button), então o que /api/codes/export gera tem de voltar inteiro por /api/codes/import
+  {
+    CodeStoreWriter store;
+    store->codes[size - 1] = store->codes[0];
+    store.publish();
+  }
+  String exported;
+  runBench("codes_export_import", size, [size, &exported](int) {
+    String response;
+    server.simRequest(HTTP_GET, "/api/codes/export", nullptr, &response);
+    requestArenaReset();
+    exported = responseBody(response);
+    if (benchRequest(HTTP_POST, "/api/codes/import", exported.c_str()) != 200) {
+      abort();
+    }
+    CodeStoreReader codes;
+    if (codes->count != size || findCodeIndex(*codes.data, codes->codes[size - 1].device, codes->codes[size - 1].button) != 0) {
+      abort();
+    }
+  });
+
+  // Reaprender o mesmo quadro longo com outros tempos medidos: a assinatura ignora os tempos e dá duplicata
+  {
+    handleReceivedIR(longFrame(0));
+    CodeStoreWriter store;
+    IRCode& code = store->codes[size - 1];
+    code.protocol = lastReceivedProtocol;
+    code.code = lastReceivedCode;
+    code.bits = lastReceivedBits;
+    code.address = lastReceivedAddress;
+    code.command = lastReceivedCommand;
+    if (!codeStoreAddPayload(*store.data, code, lastReceivedPayload)) {
+      abort();
+    }
+    store.publish();
+  }
+  runBench("learn_save_long_duplicate", size, [](int i) {
+    handleReceivedIR(longFrame(i + 1));
+    if (benchRequest(HTTP_POST, "/api/learn/save", "{\"device\":\"AC\",\"button\":\"Cool 22\"}") != 409) {
+      abort();
+    }
+  });
+}
+
+// Estresse do codeStore: leitores copiam e procuram em snapshots enquanto escritores regravam,
+// acrescentam e removem (o laço de deslocamento de handleCodeDelete()). Toda cópia publicada segue
+// invariantes que uma leitura rasgada quebraria: mesma geração em todas as entradas, commands
+// crescentes e nomes/código derivados deles.
+struct StressStats {
+  std::atomic<uint64_t> reads;
+  std::atomic<uint64_t> readNs;
+  std::atomic<uint64_t> readMaxNs;
+  std::atomic<uint64_t> writes;
+  std::atomic<uint64_t> violations;
+};
+
+static StressStats stress;
+static std::atomic<bool> stressRunning;
+static uint32_t stressGeneration;  // Só com o writeLock
+
+static void stressFillCode(IRCode& code, uint16_t generation, uint16_t command) {
+  memset(&code, 0, sizeof(code));
+  snprintf(code.device, sizeof(code.device), "Geracao %05u", generation);
+  snprintf(code.button, sizeof(code.button), "Botao %05u", command);
+  code.protocol = PROTOCOL_NEC;
+  code.address = generation;
+  code.command = command;
+  code.code = ((uint64_t)generation << 16) | command;
+  code.bits = 32;
+}
+
+static bool stressCheck(const CodeStoreData& store, uint32_t pick) {
+  if (store.count < 0 || store.count > MAX_CODES) {
+    return false;
+  }
+  char expected[32];
+  for (int i = 0; i < store.count; i++) {
+    const IRCode& code = store.codes[i];
+    if (code.address != store.codes[0].address || (i > 0 && code.command <= store.codes[i - 1].command) ||
+        code.code != (((uint64_t)code.address << 16) | code.command)) {
+      return false;
+    }
+    snprintf(expected, sizeof(expected), "Geracao %05u", code.address);
+    if (strcmp(code.device, expected) != 0) {
+      return false;
+    }
+    snprintf(expected, sizeof(expected), "Botao %05u", code.command);
+    if (strcmp(code.button, expected) != 0) {
+      return false;
+    }
+  }
+  if (store.count > 0) {
+    int index = (int)(pick % (uint32_t)store.count);
+    const IRCode& code = store.codes[index];
+    if (findCodeIndex(store, code.device, code.button) != index) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void stressReader(uint32_t seed) {
+  uint64_t reads = 0;
+  uint64_t totalNs = 0;
+  uint64_t maxNs = 0;
+  while (stressRunning.load(std::memory_order_relaxed)) {
+    seed = seed * 1103515245u + 12345u;
+    uint64_t start = nowNs();
+    bool ok;
+    {
+      CodeStoreReader codes;
+      ok = stressCheck(*codes.data, seed >> 8);
+    }
+    uint64_t elapsed = nowNs() - start;
+    totalNs += elapsed;
+    maxNs = elapsed > maxNs ? elapsed : maxNs;
+    reads++;
+    if (!ok) {
+      stress.violations++;
+    }
+  }
+  stress.reads += reads;
+  stress.readNs += totalNs;
+  uint64_t seen = stress.readMaxNs.load();
+  while (maxNs > seen && !stress.readMaxNs.compare_exchange_weak(seen, maxNs)) {
+  }
+}
+
+static void stressWriter(uint32_t seed) {
+  while (stressRunning.load(std::memory_order_relaxed)) {
+    seed = seed * 1103515245u + 12345u;
+    uint32_t op = (seed >> 8) % 4;
+    CodeStoreWriter store;
+    int count = store->count;
+    if (count < 4 || op == 0) {
+      // Regrava tudo numa geração nova (edição em massa)
+      uint16_t generation = (uint16_t)++stressGeneration;
+      int newCount = 4 + (int)((seed >> 16) % (MAX_CODES - 3));
+      for (int i = 0; i < newCount; i++) {
+        stressFillCode(store->codes[i], generation, (uint16_t)(i * 2));
+      }
+      store->count = newCount;
+    } else if (op == 1 && count < MAX_CODES) {
+      // Acrescenta no fim, como handleLearnSave()
+      const IRCode& last = store->codes[count - 1];
+      stressFillCode(store->codes[count], last.address, (uint16_t)(last.command + 1));
+      store->count = count + 1;
+    } else {
+      // Remove deslocando o resto, como handleCodeDelete()
+      int id = (int)((seed >> 16) % (uint32_t)count);
+      for (int i = id; i < count - 1; i++) {
+        store->codes[i] = store->codes[i + 1];
+      }
+      store->count = count - 1;
+    }
+    store.publish();
+    stress.writes++;
+  }
+}
+
+static int runStress() {
+  fillStore(0);
+  stressRunning = true;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < options.stressWriters; i++) {
+    threads.push_back(std::thread(stressWriter, 0x9E3779B9u * (i + 1)));
+  }
+  for (int i = 0; i < options.stressReaders; i++) {
+    threads.push_back(std::thread(stressReader, 0x85EBCA6Bu * (i + 1)));
+  }
+  delay(options.stressMs);
+  stressRunning = false;
+  for (size_t i = 0; i < threads.size(); i++) {
+    threads[i].join();
+  }
+
+  uint64_t reads = stress.reads.load();
+  printf("{\"type\":\"stress\",\"label\":\"%s\",\"ms\":%u,\"readers\":%d,\"writers\":%d,\"reads\":%llu,"
+         "\"writes\":%llu,\"read_ns_avg\":%.1f,\"read_ns_max\":%llu,\"writer_waits\":%u,"
+         "\"writer_wait_max_us\":%u,\"violations\":%llu}\n",
+         options.label, options.stressMs, options.stressReaders, options.stressWriters,
+         (unsigned long long)reads, (unsigned long long)stress.writes.load(),
+         reads ? (double)stress.readNs.load() / reads : 0.0, (unsigned long long)stress.readMaxNs.load(),
+         codeStore.writerWaits, codeStore.writerWaitMaxUs, (unsigned long long)stress.violations.load());
+  return stress.violations.load() == 0 ? 0 : 1;
+}
+
+static void parseOptions(int argc, char** argv) {
+  static const int defaultSizes[] = {1, 10, 25, MAX_CODES};
+  options.sizeCount = 4;
+  memcpy(options.sizes, defaultSizes, sizeof(defaultSizes));
+  options.minMs = 200;
+  options.filter = NULL;
+  options.label = "";
+  options.stressMs = 0;
+  options.stressReaders = 8;
+  options.stressWriters = 2;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--sizes") == 0) {
+      options.sizeCount = 0;
+      char* token = strtok(argv[i + 1], ",");
+      while (token && options.sizeCount < 8) {
+        int size = atoi(token);
+        if (size >= 1 && size <= MAX_CODES) {
+          options.sizes[options.sizeCount++] = size;
+        }
+        token = strtok(NULL, ",");
+      }
+    } else if (strcmp(argv[i], "--min-ms") == 0) {
+      options.minMs = (uint32_t)atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "--filter") == 0) {
+      options.filter = argv[i + 1];
+    } else if (strcmp(argv[i], "--label") == 0) {
+      options.label = argv[i + 1];
+    } else if (strcmp(argv[i], "--stress") == 0) {
+      options.stressMs = (uint32_t)atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "--readers") == 0) {
+      options.stressReaders = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "--writers") == 0) {
+      options.stressWriters = atoi(argv[i + 1]);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  parseOptions(argc, argv);
+
+  // Sem Serial, sem tempo de ar do IR e NVS só em memória: só o custo da lógica do firmware
+  simLoadConfigFromEnv();
+  simConfig().serialEnabled = false;
+  simConfig().irRealtime = false;
+  simConfig().irTxLog = NULL;
+  simConfig().nvsFile = NULL;
+
+  currentHeapTag = HEAP_TAG_LOOP;
+  initLogger();
+  initRequestArena();
+  IrSender.begin();
+  initCodeStore();
+  if (options.stressMs > 0) {
+    return runStress();
+  }
+  loadCodesFromPreferences();
+  setupRoutes();
+
+  printf("{\"type\":\"meta\",\"suite\":\"firmware\",\"label\":\"%s\",\"time\":%ld,\"min_ms\":%u,"
+         "\"alloc_tracking\":%s,\"max_codes\":%d}\n",
+         options.label, (long)time(NULL), options.minMs, HEAP_ALLOC_TRACKING ? "true" : "false", MAX_CODES);
+  for (int i = 0; i < options.sizeCount; i++) {
+    runSuite(options.sizes[i]);
+  }
+  return 0;
+}
@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""Compara duas execuções do benchmark (JSON lines) e aponta regressões.
+
+Uso: compare.py base.jsonl novo.jsonl [--threshold 10]
+Sai com código 1 se alguma métrica piorar mais que o limite (%).
+Alocações e bytes gravados no NVS são determinísticos: qualquer aumento conta.
+"""
+import argparse
+import json
+import sys
+
+# (métrica, aplica a tolerância): tempo varia entre execuções, contadores não
+METRICS = [
+    ("ns_per_op", True),
+    ("allocs_per_op", False),
+    ("alloc_bytes_per_op", False),
+    ("response_bytes_per_op", False),  # Bytes no socket (cabeçalhos + corpo)
+    ("nvs_bytes_per_op", False),
+    ("flash_us_per_op", True),  # Inclui apagamentos de página amortizados
+]
+
+
+def load(path):
+    results = {}
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line:
+                continue
+            row = json.loads(line)
+            if row.get("type") == "bench":
+                results[(row["bench"], row["size"])] = row
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("base")
+    parser.add_argument("new")
+    parser.add_argument("--threshold", type=float, default=10.0, help="tolerância de ns/op em %%")
+    args = parser.parse_args()
+
+    base = load(args.base)
+    new = load(args.new)
+    regressions = 0
+
+    print("%-24s %5s  %-20s %14s %14s %9s" % ("bench", "size", "métrica", "base", "novo", "delta"))
+    for key in sorted(new):
+        if key not in base:
+            continue
+        for metric, timing in METRICS:
+            if metric not in base[key] or metric not in new[key]:
+                continue  # Métrica que uma das versões ainda não gravava
+            old_value = base[key].get(metric, 0.0)
+            new_value = new[key].get(metric, 0.0)
+            if old_value == new_value:
+                continue
+            delta = (new_value - old_value) / old_value * 100.0 if old_value else float("inf")
+            limit = args.threshold if timing else 0.0
+            flag = ""
+            if delta > limit:
+                flag = "  << regressão"
+                regressions += 1
+            if timing and abs(delta) < args.threshold and not flag:
+                continue
+            print("%-24s %5d  %-20s %14.1f %14.1f %8.1f%%%s" % (key[0], key[1], metric, old_value, new_value, delta, flag))
+
+    missing = sorted(set(base) - set(new))
+    for key in missing:
+        print("%-24s %5d  ausente na execução nova" % key)
+
+    print("\n%d regressão(ões)" % regressions)
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,39 @@
+// Simulação host: IPAddress (IPv4) compatível com o core Arduino-ESP32
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "WString.h"
+
+class IPAddress {
+ public:
+  IPAddress() : addr_(0) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+      : addr_((uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24)) {}
+  IPAddress(uint32_t address) : addr_(address) {}
+
+  operator uint32_t() const { return addr_; }
+  bool operator==(const IPAddress& other) const { return addr_ == other.addr_; }
+  bool operator!=(const IPAddress& other) const { return addr_ != other.addr_; }
+  uint8_t operator[](int index) const { return (uint8_t)(addr_ >> (index * 8)); }
+
+  String toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+    return String(buf);
+  }
+
+  bool fromString(const char* address) {
+    unsigned a, b, c, d;
+    if (!address || sscanf(address, "%u.%u.%u.%u", &a, &b, &c, &d) != 4) return false;
+    if (a > 255 || b > 255 || c > 255 || d > 255) return false;
+    *this = IPAddress((uint8_t)a, (uint8_t)b, (uint8_t)c, (uint8_t)d);
+    return true;
+  }
+
+ private:
+  uint32_t addr_;
+};
+
+extern const IPAddress INADDR_NONE;
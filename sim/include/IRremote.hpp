@@ -0,0 +1,169 @@
+// Simulação host: IRremote com gravação e reprodução de formas de onda
+//
+// IrSender gera as marcas/espaços de cada protocolo, espera o tempo de ar do
+// quadro (SIM_IR_REALTIME) e grava uma linha por quadro em SIM_IR_TX_LOG.
+// IrReceiver reproduz quadros de SIM_IR_RX_FILE (mesmo formato do log de TX)
+// e, com SIM_IR_LOOPBACK=1, recebe de volta o que foi transmitido.
+#pragma once
+
+#include <Arduino.h>
+
+// No IRremote real tudo é compilado na unidade do sketch; aqui sim/src/IRremote.cpp é outra unidade,
+// então o padrão tem de ser o mesmo que src/main.cpp define (IRData com o mesmo layout nas duas)
+#ifndef RAW_BUFFER_LENGTH
+#define RAW_BUFFER_LENGTH 750
+#endif
+
+#define MICROS_PER_TICK 50
+#define MICROS_IN_ONE_MILLI 1000
+
+typedef uint64_t IRDecodedRawDataType;
+typedef uint16_t IRRawbufType;
+typedef uint16_t IRRawlenType;
+
+#define BITS_IN_RAW_DATA_TYPE 64
+#define RAW_DATA_ARRAY_SIZE ((((RAW_BUFFER_LENGTH - 2) - 1) / (2 * BITS_IN_RAW_DATA_TYPE)) + 1)
+
+typedef enum {
+  UNKNOWN = 0,
+  PULSE_WIDTH,
+  PULSE_DISTANCE,
+  APPLE,
+  DENON,
+  JVC,
+  LG,
+  LG2,
+  NEC,
+  NEC2,
+  ONKYO,
+  PANASONIC,
+  KASEIKYO,
+  KASEIKYO_DENON,
+  KASEIKYO_SHARP,
+  KASEIKYO_JVC,
+  KASEIKYO_MITSUBISHI,
+  RC5,
+  RC6,
+  SAMSUNG,
+  SAMSUNGLG,
+  SAMSUNG48,
+  SHARP,
+  SONY,
+  BANG_OLUFSEN,
+  BOSEWAVE,
+  LEGO_PF,
+  MAGIQUEST,
+  WHYNTER,
+  FAST
+} decode_type_t;
+
+#define IRDATA_FLAGS_EMPTY 0x00
+#define IRDATA_FLAGS_IS_REPEAT 0x01
+#define IRDATA_FLAGS_IS_AUTO_REPEAT 0x02
+#define IRDATA_FLAGS_PARITY_FAILED 0x04
+#define IRDATA_FLAGS_TOGGLE_BIT 0x08
+#define IRDATA_FLAGS_EXTRA_INFO 0x10
+#define IRDATA_FLAGS_IS_PROTOCOL_WITH_DIFFERENT_REPEAT 0x20
+#define IRDATA_FLAGS_WAS_OVERFLOW 0x40
+#define IRDATA_FLAGS_IS_MSB_FIRST 0x80
+
+#define PROTOCOL_IS_LSB_FIRST false
+#define PROTOCOL_IS_MSB_FIRST true
+#define SIRCS_12_PROTOCOL 12
+#define SIRCS_15_PROTOCOL 15
+#define SIRCS_20_PROTOCOL 20
+
+struct DistanceWidthTimingInfoStruct {
+  uint16_t HeaderMarkMicros;
+  uint16_t HeaderSpaceMicros;
+  uint16_t OneMarkMicros;
+  uint16_t OneSpaceMicros;
+  uint16_t ZeroMarkMicros;
+  uint16_t ZeroSpaceMicros;
+};
+
+struct irparams_struct {
+  IRRawlenType rawlen;
+  IRRawbufType rawbuf[RAW_BUFFER_LENGTH];
+};
+
+struct IRData {
+  decode_type_t protocol;
+  uint16_t address;
+  uint16_t command;
+  uint16_t extra;
+  IRDecodedRawDataType decodedRawData;
+  DistanceWidthTimingInfoStruct DistanceWidthTimingInfo;
+  IRDecodedRawDataType decodedRawDataArray[RAW_DATA_ARRAY_SIZE];
+  uint16_t numberOfBits;
+  uint8_t flags;
+  irparams_struct* rawDataPtr;
+};
+
+const char* getProtocolString(decode_type_t aProtocol);
+
+class IRsend {
+ public:
+  void begin();
+  void begin(uint_fast8_t aSendPin);
+
+  void sendNEC(uint16_t aAddress, uint8_t aCommand, int_fast8_t aNumberOfRepeats);
+  void sendNEC2(uint16_t aAddress, uint8_t aCommand, int_fast8_t aNumberOfRepeats);
+  void sendNECRepeat();
+  void sendApple(uint8_t aAddress, uint8_t aCommand, int_fast8_t aNumberOfRepeats);
+  void sendOnkyo(uint16_t aAddress, uint16_t aCommand, int_fast8_t aNumberOfRepeats);
+  void sendSamsung(uint16_t aAddress, uint16_t aCommand, int_fast8_t aNumberOfRepeats);
+  void sendSamsung48(uint16_t aAddress, uint32_t aCommand, int_fast8_t aNumberOfRepeats);
+  void sendSamsungLG(uint16_t aAddress, uint16_t aCommand, int_fast8_t aNumberOfRepeats);
+  void sendSamsungLGRepeat();
+  void sendSony(uint16_t aAddress, uint8_t aCommand, int_fast8_t aNumberOfRepeats,
+                uint8_t numberOfBits = SIRCS_12_PROTOCOL);
+  void sendRC5(uint8_t aAddress, uint8_t aCommand, int_fast8_t aNumberOfRepeats, bool aEnableAutomaticToggle = true);
+  void sendRC6(uint8_t aAddress, uint8_t aCommand, int_fast8_t aNumberOfRepeats, bool aEnableAutomaticToggle = true);
+  void sendPanasonic(uint16_t aAddress, uint8_t aCommand, int_fast8_t aNumberOfRepeats);
+  void sendKaseikyo(uint16_t aAddress, uint8_t aData, int_fast8_t aNumberOfRepeats, uint16_t aVendorCode);
+  void sendKaseikyo_Denon(uint16_t aAddress, uint8_t aData, int_fast8_t aNumberOfRepeats);
+  void sendKaseikyo_Sharp(uint16_t aAddress, uint8_t aData, int_fast8_t aNumberOfRepeats);
+  void sendKaseikyo_JVC(uint16_t aAddress, uint8_t aData, int_fast8_t aNumberOfRepeats);
+  void sendKaseikyo_Mitsubishi(uint16_t aAddress, uint8_t aData, int_fast8_t aNumberOfRepeats);
+  void sendLG(uint8_t aAddress, uint16_t aCommand, int_fast8_t aNumberOfRepeats);
+  void sendLG2(uint8_t aAddress, uint16_t aCommand, int_fast8_t aNumberOfRepeats);
+  void sendLGRepeat();
+  void sendDenon(uint8_t aAddress, uint8_t aCommand, int_fast8_t aNumberOfRepeats, uint8_t aSendSharpFrameMarker = 0);
+  void sendSharp(uint8_t aAddress, uint8_t aCommand, int_fast8_t aNumberOfRepeats);
+  void sendJVC(uint8_t aAddress, uint8_t aCommand, int_fast8_t aNumberOfRepeats);
+  void sendBoseWave(uint8_t aCommand, int_fast8_t aNumberOfRepeats);
+  void sendLegoPowerFunctions(uint8_t aChannel, uint8_t tCommand, uint8_t aMode, bool aDoSend5Times = true);
+  void sendMagiQuest(uint32_t aWandId, uint16_t aMagnitude);
+  void sendWhynter(uint32_t aData, uint8_t aNumberOfBitsToSend);
+  void sendFAST(uint8_t aCommand, int_fast8_t aNumberOfRepeats);
+  void sendBangOlufsen(uint16_t aHeader, uint8_t aData, int_fast8_t aNumberOfRepeats = 0, int8_t aNumberOfHeaderBits = 8);
+
+  void sendRaw(const uint16_t aBufferWithMicroseconds[], uint_fast16_t aLengthOfBuffer, uint_fast8_t aIRFrequencyKilohertz);
+  void sendRaw(const uint8_t aBufferWithTicks[], uint_fast16_t aLengthOfBuffer, uint_fast8_t aIRFrequencyKilohertz);
+  void sendPulseDistanceWidthFromArray(uint_fast8_t aFrequencyKHz, DistanceWidthTimingInfoStruct* aDistanceWidthTimingInfo,
+                                       IRDecodedRawDataType* aDecodedRawDataArray, uint16_t aNumberOfBits,
+                                       uint8_t aFlags, uint16_t aRepeatPeriodMillis, int_fast8_t aNumberOfRepeats);
+  void sendPulseDistanceWidth(uint_fast8_t aFrequencyKHz, DistanceWidthTimingInfoStruct* aDistanceWidthTimingInfo,
+                              IRDecodedRawDataType aData, uint_fast8_t aNumberOfBits, uint8_t aFlags,
+                              uint16_t aRepeatPeriodMillis, int_fast8_t aNumberOfRepeats);
+  size_t write(IRData* aIRSendData, int_fast8_t aNumberOfRepeats = 0);
+};
+
+class IRrecv {
+ public:
+  IRData decodedIRData;
+
+  void begin(uint_fast8_t aReceivePin, bool aEnableLEDFeedback = false, uint_fast8_t aFeedbackLEDPin = 0);
+  void start();
+  void stop();
+  void enableIRIn() { start(); }
+  void disableIRIn() { stop(); }
+  bool isIdle();
+  bool available();
+  bool decode();
+  void resume();
+};
+
+extern IRsend IrSender;
+extern IRrecv IrReceiver;
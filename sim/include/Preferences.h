@@ -0,0 +1,76 @@
+// Simulação host: Preferences persistido em arquivo com modelo de custo do NVS
+//
+// Cada namespace/chave vira uma entrada tipada, como no NVS. O modelo de custo
+// conta entradas de 32 bytes gravadas, apagamentos de página (a cada 126
+// entradas) e o tempo de flash equivalente; gravações com valor idêntico são
+// ignoradas, como faz o NVS do ESP-IDF.
+#pragma once
+
+#include <Arduino.h>
+
+struct NvsSimStats {
+  uint32_t puts;             // chamadas put*()
+  uint32_t putsUnchanged;    // put*() ignorados por valor idêntico
+  uint32_t gets;             // chamadas get*()
+  uint32_t entriesWritten;   // entradas de 32 bytes gravadas
+  uint32_t bytesWritten;     // bytes gravados em flash (entradas * 32)
+  uint32_t pageErases;       // páginas de 4 KB apagadas
+  uint64_t flashTimeUs;      // tempo de flash emulado
+};
+
+class Preferences {
+ public:
+  Preferences();
+  ~Preferences();
+
+  bool begin(const char* name, bool readOnly = false, const char* partitionLabel = nullptr);
+  void end();
+  bool clear();
+  bool remove(const char* key);
+  bool isKey(const char* key);
+
+  size_t putChar(const char* key, int8_t value);
+  size_t putUChar(const char* key, uint8_t value);
+  size_t putShort(const char* key, int16_t value);
+  size_t putUShort(const char* key, uint16_t value);
+  size_t putInt(const char* key, int32_t value);
+  size_t putUInt(const char* key, uint32_t value);
+  size_t putLong(const char* key, int32_t value) { return putInt(key, value); }
+  size_t putULong(const char* key, uint32_t value) { return putUInt(key, value); }
+  size_t putLong64(const char* key, int64_t value);
+  size_t putULong64(const char* key, uint64_t value);
+  size_t putBool(const char* key, bool value) { return putUChar(key, value ? 1 : 0); }
+  size_t putString(const char* key, const char* value);
+  size_t putString(const char* key, const String& value) { return putString(key, value.c_str()); }
+  size_t putBytes(const char* key, const void* value, size_t len);
+
+  int8_t getChar(const char* key, int8_t defaultValue = 0);
+  uint8_t getUChar(const char* key, uint8_t defaultValue = 0);
+  int16_t getShort(const char* key, int16_t defaultValue = 0);
+  uint16_t getUShort(const char* key, uint16_t defaultValue = 0);
+  int32_t getInt(const char* key, int32_t defaultValue = 0);
+  uint32_t getUInt(const char* key, uint32_t defaultValue = 0);
+  int32_t getLong(const char* key, int32_t defaultValue = 0) { return getInt(key, defaultValue); }
+  uint32_t getULong(const char* key, uint32_t defaultValue = 0) { return getUInt(key, defaultValue); }
+  int64_t getLong64(const char* key, int64_t defaultValue = 0);
+  uint64_t getULong64(const char* key, uint64_t defaultValue = 0);
+  bool getBool(const char* key, bool defaultValue = false) { return getUChar(key, defaultValue ? 1 : 0) != 0; }
+  size_t getString(const char* key, char* value, size_t maxLen);
+  String getString(const char* key, const String& defaultValue = String());
+  size_t getBytesLength(const char* key);
+  size_t getBytes(const char* key, void* buf, size_t maxLen);
+  size_t freeEntries();
+
+  // Extensões da simulação
+  static NvsSimStats simStats();
+  static void simResetStats();
+  static void simFlushToFile();
+
+ private:
+  char namespace_[16];
+  bool started_;
+  bool readOnly_;
+
+  size_t putTyped(const char* key, uint8_t type, const void* data, size_t len);
+  bool getTyped(const char* key, uint8_t type, void* out, size_t len);
+};
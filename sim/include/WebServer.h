@@ -0,0 +1,122 @@
+// Simulação host: WebServer sobre sockets TCP reais do Linux
+// Mantém a API síncrona do WebServer do Arduino-ESP32: uma conexão por vez,
+// handler chamado dentro de handleClient() e "Connection: close" ao final.
+#pragma once
+
+#include <Arduino.h>
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum HTTPMethod {
+  HTTP_ANY,
+  HTTP_GET,
+  HTTP_HEAD,
+  HTTP_POST,
+  HTTP_PUT,
+  HTTP_PATCH,
+  HTTP_DELETE,
+  HTTP_OPTIONS
+};
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define CONTENT_LENGTH_NOT_SET ((size_t)-2)
+
+// Corpo entregue em pedaços ao ufn da rota (como no core 2.x) em vez de ir para arg("plain")
+enum HTTPRawStatus { RAW_START, RAW_WRITE, RAW_END, RAW_ABORTED };
+
+#define HTTP_RAW_BUFLEN 1436
+
+struct HTTPRaw {
+  HTTPRawStatus status;
+  size_t totalSize;    // Bytes entregues até agora
+  size_t currentSize;  // Bytes em buf nesta chamada
+  uint8_t buf[HTTP_RAW_BUFLEN];
+  void* data;
+};
+
+class WebServer {
+ public:
+  typedef std::function<void(void)> THandlerFunction;
+
+  explicit WebServer(int port = 80);
+  ~WebServer();
+
+  void begin();
+  void begin(uint16_t port);
+  void close();
+  void stop() { close(); }
+  void handleClient();
+
+  void on(const String& uri, THandlerFunction handler);
+  void on(const String& uri, HTTPMethod method, THandlerFunction fn);
+  void on(const String& uri, HTTPMethod method, THandlerFunction fn, THandlerFunction ufn);
+  void onNotFound(THandlerFunction fn) { notFoundHandler_ = fn; }
+
+  String uri() const { return String(uri_.c_str()); }
+  HTTPMethod method() const { return method_; }
+  String arg(const String& name) const;
+  String arg(int i) const;
+  String argName(int i) const;
+  int args() const { return (int)args_.size(); }
+  bool hasArg(const String& name) const;
+  String header(const String& name) const;
+  bool hasHeader(const String& name) const;
+  HTTPRaw& raw() { return raw_; }
+
+  void send(int code, const char* contentType = nullptr, const String& content = String(""));
+  void send(int code, const char* contentType, const char* content);
+  void send(int code, const String& contentType, const String& content);
+  void send_P(int code, const char* contentType, const char* content) { send(code, contentType, content); }
+  void send_P(int code, const char* contentType, const char* content, size_t contentLength);
+  void sendHeader(const String& name, const String& value, bool first = false);
+  void setContentLength(size_t contentLength) { contentLength_ = contentLength; }
+  void sendContent(const String& content) { sendContent(content.c_str(), content.length()); }
+  void sendContent(const char* content, size_t size);
+  void sendContent_P(const char* content) { sendContent(content, strlen(content)); }
+
+  // Extensão da simulação: executa uma requisição em processo, sem socket,
+  // e devolve a resposta HTTP completa (usado pelos benchmarks).
+  int simRequest(HTTPMethod method, const char* uri, const char* body, String* response);
+  // Último WebServer construído (o firmware tem um só), para a simulação consultar a API
+  static WebServer* simInstance();
+
+ private:
+  struct Route {
+    std::string uri;
+    HTTPMethod method;
+    THandlerFunction fn;
+    THandlerFunction ufn;
+  };
+
+  int port_;
+  int listenFd_;
+  int clientFd_;
+  std::vector<Route> routes_;
+  THandlerFunction notFoundHandler_;
+
+  // Estado da requisição corrente
+  HTTPMethod method_;
+  std::string uri_;
+  std::vector<std::pair<std::string, std::string> > args_;
+  std::vector<std::pair<std::string, std::string> > headers_;
+  std::vector<std::pair<std::string, std::string> > responseHeaders_;
+  size_t contentLength_;
+  bool headersSent_;
+  bool chunked_;
+  int responseCode_;
+  String* capture_;
+  HTTPRaw raw_;
+
+  void resetRequestState();
+  const Route* findRoute() const;
+  bool streamRaw(const Route& route, const char* initial, size_t initialSize, int fd, size_t bodyLength);
+  bool readRequest(int fd);
+  void parseArgs(const std::string& query);
+  void dispatch();
+  void finishResponse();
+  void writeOut(const char* data, size_t size);
+  void sendHeaders(int code, const char* contentType, size_t contentLength);
+};
@@ -0,0 +1,33 @@
+// Simulação host: WiFiUDP sobre um socket UDP real do Linux, não bloqueante
+// Só o lado de recepção que o firmware usa: begin(), parsePacket(), read(), remoteIP()/remotePort().
+#pragma once
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+class WiFiUDP {
+ public:
+  WiFiUDP() : fd_(-1), length_(0), offset_(0), remoteIP_(0), remotePort_(0) {}
+  ~WiFiUDP() { stop(); }
+
+  // A porta do firmware recebe o deslocamento SIM_UDP_PORT_OFFSET (várias instâncias em paralelo)
+  uint8_t begin(uint16_t port);
+  void stop();
+
+  // Próximo datagrama pendente; 0 quando não há nenhum
+  int parsePacket();
+  int available() { return (int)(length_ - offset_); }
+  int read();
+  int read(uint8_t* buffer, size_t size);
+  int read(char* buffer, size_t size) { return read((uint8_t*)buffer, size); }
+  IPAddress remoteIP() const { return remoteIP_; }
+  uint16_t remotePort() const { return remotePort_; }
+
+ private:
+  int fd_;
+  uint8_t packet_[1460];
+  size_t length_;
+  size_t offset_;
+  IPAddress remoteIP_;
+  uint16_t remotePort_;
+};
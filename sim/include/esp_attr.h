@@ -0,0 +1,7 @@
+// Simulação host: atributos de seção do ESP-IDF viram no-ops
+#pragma once
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
@@ -0,0 +1,28 @@
+// Simulação host: subconjunto de esp_pm.h (IDF 4.4). Não há sono de verdade; a configuração e
+// os locks ficam registrados para o firmware consultar. SIM_PM_LIGHT_SLEEP=0 emula um build sem
+// CONFIG_FREERTOS_USE_TICKLESS_IDLE (light_sleep_enable devolve ESP_ERR_NOT_SUPPORTED).
+#pragma once
+
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+typedef struct {
+  int max_freq_mhz;
+  int min_freq_mhz;
+  bool light_sleep_enable;
+} esp_pm_config_esp32_t;
+
+typedef enum {
+  ESP_PM_CPU_FREQ_MAX,
+  ESP_PM_APB_FREQ_MAX,
+  ESP_PM_NO_LIGHT_SLEEP,
+} esp_pm_lock_type_t;
+
+typedef struct esp_pm_lock* esp_pm_lock_handle_t;
+
+esp_err_t esp_pm_configure(const void* config);
+esp_err_t esp_pm_get_configuration(void* config);
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char* name, esp_pm_lock_handle_t* out_handle);
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle);
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle);
@@ -0,0 +1,6 @@
+// Simulação host: subconjunto de esp_sleep.h (IDF 4.4)
+#pragma once
+
+#include "esp_err.h"
+
+esp_err_t esp_sleep_enable_gpio_wakeup(void);
@@ -0,0 +1,6 @@
+// Simulação host: relógio monotônico em microssegundos
+#pragma once
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
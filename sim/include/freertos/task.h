@@ -0,0 +1,19 @@
+// Simulação host: tasks do FreeRTOS como threads
+#pragma once
+
+#include "FreeRTOS.h"
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+void vTaskDelay(TickType_t ticks);
+
+// Cada task vira uma thread do host; o core só é registrado (xPortGetCoreID), não há afinidade real.
+// A thread principal (setup/loop) conta como core 1, como a loopTask do Arduino.
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char* pcName, uint32_t usStackDepth,
+                                   void* pvParameters, UBaseType_t uxPriority, TaskHandle_t* pvCreatedTask,
+                                   BaseType_t xCoreID);
+BaseType_t xPortGetCoreID(void);
+
+// Notificação direta (contador), usada para acordar uma task a partir de uma ISR
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait);
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify);
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t* pxHigherPriorityTaskWoken);
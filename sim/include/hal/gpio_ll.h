@@ -0,0 +1,24 @@
+// Simulação host: acesso direto ao tipo de interrupção (seguro em ISR, como o gpio_ll do IDF)
+#pragma once
+
+#include <stdint.h>
+
+#include "driver/gpio.h"
+
+typedef struct gpio_dev_s gpio_dev_t;
+
+#define GPIO_PORT_0 0
+#define GPIO_LL_GET_HW(num) ((gpio_dev_t*)nullptr)
+
+void simGpioSetIntrType(gpio_num_t gpio_num, gpio_int_type_t intr_type);
+int digitalRead(uint8_t pin);
+
+static inline void gpio_ll_set_intr_type(gpio_dev_t* hw, gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+  (void)hw;
+  simGpioSetIntrType(gpio_num, intr_type);
+}
+
+static inline int gpio_ll_get_level(gpio_dev_t* hw, gpio_num_t gpio_num) {
+  (void)hw;
+  return digitalRead((uint8_t)gpio_num);
+}
@@ -0,0 +1,44 @@
+// Simulação host: configuração e ganchos internos das fakes (não incluído pelo firmware)
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_system.h"
+
+struct SimConfig {
+  int httpPort;              // SIM_HTTP_PORT (padrão 8080; 80 exige root)
+  int udpPortOffset;         // SIM_UDP_PORT_OFFSET: somado às portas de WiFiUDP::begin()
+  bool serialEnabled;        // SIM_SERIAL=0 silencia o Serial
+  uint32_t serialBaud;       // SIM_SERIAL_BAUD: write() bloqueia como a UART com FIFO de 128 bytes (0 = não)
+  size_t heapSize;           // SIM_HEAP_SIZE: heap emulado em bytes
+  size_t heapBaseline;       // bytes já em uso no host antes do setup()
+  esp_reset_reason_t resetReason;  // SIM_RESET_REASON: valor de esp_reset_reason_t (padrão power-on)
+  const char* nvsFile;       // SIM_NVS_FILE: arquivo que persiste o Preferences
+  bool nvsRealtime;          // SIM_NVS_REALTIME=1 dorme o custo emulado de flash
+  const char* irTxLog;       // SIM_IR_TX_LOG: grava as formas de onda enviadas
+  const char* irRxFile;      // SIM_IR_RX_FILE: reproduz quadros recebidos
+  bool irLoopback;           // SIM_IR_LOOPBACK=1 ecoa o TX no receptor
+  bool irRealtime;           // SIM_IR_REALTIME=0 não espera o tempo de ar do quadro
+  const char* wifiFailSsid;  // SIM_WIFI_FAIL_SSID: SSID que nunca conecta
+  uint32_t wifiConnectMs;    // SIM_WIFI_CONNECT_MS: tempo até WL_CONNECTED (varredura + associação + DHCP)
+  uint32_t wifiScanMs;       // SIM_WIFI_SCAN_MS: parte da conexão economizada pelo join direto
+  uint32_t wifiDhcpMs;       // SIM_WIFI_DHCP_MS: parte da conexão economizada pelo IP fixo
+  int32_t wifiChannel;       // SIM_WIFI_CHANNEL: canal do AP (mudar invalida o cache do firmware)
+  const char* wifiNetworks;  // SIM_WIFI_NETWORKS: "ssid:rssi:canal[:rssi_depois:apos_ms],..."
+  uint32_t wifiDropMs;       // SIM_WIFI_DROP_MS: derruba a STA após N ms conectada (0 = nunca)
+  const char* traceFile;     // SIM_TRACE_FILE: exporta /api/trace em formato Chrome ao sair
+  bool pmLightSleep;         // SIM_PM_LIGHT_SLEEP=0: esp_pm_configure recusa light sleep automático
+  const char* buttonEvents;  // SIM_BUTTON_EVENTS: "inicio_ms:duracao_ms,..." pressiona o botão
+  uint8_t buttonPin;         // SIM_BUTTON_PIN: GPIO do botão (padrão 32)
+  int buttonBounce;          // SIM_BUTTON_BOUNCE: repiques extras em cada transição do botão
+};
+
+SimConfig& simConfig();
+void simLoadConfigFromEnv();
+void simRequestRestart();
+bool simRestartRequested();
+void simSetPinLevel(uint8_t pin, uint8_t level);
+void simWiFiDrop(uint8_t reason);
+// Agenda uma mudança de nível num pino (thread própria, dispara a ISR como o hardware)
+void simSchedulePinLevel(uint8_t pin, uint8_t level, uint64_t atUs);
@@ -0,0 +1,369 @@
+#!/usr/bin/env python3
+"""Gerador de carga HTTP e soak test para o firmware (simulado ou na placa).
+
+Reproduz a mistura real de tráfego:
+  - clientes "ui": a página aberta no navegador, com polling de
+    /api/learn/captured a cada 500 ms, /api/status a cada 5 s e /api/codes
+    ao carregar (e a cada --codes-every);
+  - clientes "automação": POST /api/code/send a uma taxa fixa.
+
+O agendamento é em malha aberta: cada requisição tem horário marcado e a
+latência é medida a partir dele, então atrasos do firmware não escondem a
+fila (coordinated omission). A cada --report-every imprime vazão, latências
+p50/p90/p99/máx e erros por endpoint, mais o heap de /api/heap; no final,
+resume tudo e estima o crescimento do heap por hora.
+
+Com --ap-mode sta|hybrid fixa o AP de configuração (POST /api/wifi/ap) antes
+de começar, para comparar vazão e latência só STA contra AP+STA. Na placa,
+use o IP da STA em --url: fechar o AP derruba quem estiver nele.
+
+Com --power-profile performance|balanced|low_power troca o perfil de energia
+(POST /api/power) antes de começar; o resumo final inclui a latência de wake e
+o tempo ocioso de /api/power, para comparar o custo de cada perfil.
+
+Exemplos:
+  sim/loadgen.py --url http://127.0.0.1:8080 --ui-clients 2 --automation-clients 1 --send-rate 2 --duration 10m
+  sim/loadgen.py --duration 4h --report-every 5m --json soak.jsonl
+  sim/loadgen.py --url http://192.168.1.50 --ap-mode hybrid --duration 5m --json hibrido.jsonl
+  sim/loadgen.py --power-profile low_power --duration 5m --json low_power.jsonl
+"""
+import argparse
+import http.client
+import json
+import math
+import random
+import sys
+import threading
+import time
+import urllib.parse
+
+ENDPOINTS = ["status", "codes", "captured", "send"]
+
+
+def parse_duration(text):
+    units = {"s": 1, "m": 60, "h": 3600}
+    text = text.strip()
+    if text and text[-1] in units:
+        return float(text[:-1]) * units[text[-1]]
+    return float(text)
+
+
+class LatencyHistogram:
+    """Buckets logarítmicos de 2% para percentis com memória constante em horas de teste."""
+
+    RATIO = math.log(1.02)
+
+    def __init__(self):
+        self.buckets = {}
+        self.count = 0
+        self.max_ms = 0.0
+        self.total_ms = 0.0
+
+    def record(self, ms):
+        bucket = int(math.log(max(ms, 0.01) * 100) / self.RATIO)
+        self.buckets[bucket] = self.buckets.get(bucket, 0) + 1
+        self.count += 1
+        self.total_ms += ms
+        self.max_ms = max(self.max_ms, ms)
+
+    def percentile(self, percent):
+        if not self.count:
+            return 0.0
+        target = math.ceil(self.count * percent / 100.0)
+        seen = 0
+        for bucket in sorted(self.buckets):
+            seen += self.buckets[bucket]
+            if seen >= target:
+                return min(math.exp((bucket + 1) * self.RATIO) / 100.0, self.max_ms)
+        return self.max_ms
+
+
+class EndpointStats:
+    def __init__(self):
+        self.latency = LatencyHistogram()
+        self.errors = 0
+        self.error_kinds = {}
+
+    def error(self, kind):
+        self.errors += 1
+        self.error_kinds[kind] = self.error_kinds.get(kind, 0) + 1
+
+
+class Recorder:
+    """Estatísticas do intervalo atual e do total, protegidas por lock."""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.interval = {name: EndpointStats() for name in ENDPOINTS}
+        self.total = {name: EndpointStats() for name in ENDPOINTS}
+
+    def record(self, endpoint, ms, error):
+        with self.lock:
+            for stats in (self.interval[endpoint], self.total[endpoint]):
+                stats.latency.record(ms)
+                if error:
+                    stats.error(error)
+
+    def swap_interval(self):
+        with self.lock:
+            snapshot = self.interval
+            self.interval = {name: EndpointStats() for name in ENDPOINTS}
+        return snapshot
+
+
+class Client(threading.Thread):
+    """Um cliente com agenda própria; uma conexão nova por requisição (o WebServer fecha a cada resposta)."""
+
+    def __init__(self, args, recorder, stop, schedule, code_ids):
+        super().__init__(daemon=True)
+        self.args = args
+        self.recorder = recorder
+        self.stop = stop
+        self.schedule = schedule  # lista de (endpoint, período em s)
+        self.code_ids = code_ids
+        self.url = urllib.parse.urlparse(args.url)
+
+    def request(self, endpoint):
+        if endpoint == "status":
+            return "GET", "/api/status", None
+        if endpoint == "codes":
+            return "GET", "/api/codes", None
+        if endpoint == "captured":
+            return "GET", "/api/learn/captured", None
+        if self.code_ids:
+            body = {"id": random.choice(self.code_ids)}
+        else:
+            body = {"code": self.args.send_code}
+        return "POST", "/api/code/send", json.dumps(body)
+
+    def fire(self, endpoint, scheduled_at):
+        method, path, body = self.request(endpoint)
+        error = None
+        try:
+            conn = http.client.HTTPConnection(self.url.hostname, self.url.port or 80, timeout=self.args.timeout)
+            headers = {"Content-Type": "application/json"} if body else {}
+            conn.request(method, path, body=body, headers=headers)
+            response = conn.getresponse()
+            response.read()
+            conn.close()
+            if response.status >= 400:
+                error = "http_%d" % response.status
+        except (OSError, http.client.HTTPException) as exc:
+            error = type(exc).__name__
+        self.recorder.record(endpoint, (time.monotonic() - scheduled_at) * 1000.0, error)
+
+    def run(self):
+        now = time.monotonic()
+        # Fases aleatórias para os clientes não dispararem juntos
+        next_at = {endpoint: now + random.uniform(0, period) for endpoint, period in self.schedule}
+        periods = dict(self.schedule)
+        while not self.stop.is_set():
+            endpoint = min(next_at, key=next_at.get)
+            scheduled_at = next_at[endpoint]
+            delay = scheduled_at - time.monotonic()
+            if delay > 0 and self.stop.wait(delay):
+                break
+            self.fire(endpoint, scheduled_at)
+            next_at[endpoint] = scheduled_at + periods[endpoint]
+
+
+def http_json(args, method, path, body=None):
+    url = urllib.parse.urlparse(args.url)
+    conn = http.client.HTTPConnection(url.hostname, url.port or 80, timeout=args.timeout)
+    if method == "POST" and body is None:
+        body = "{}"
+    conn.request(method, path, headers={"Content-Type": "application/json"}, body=body)
+    response = conn.getresponse()
+    data = response.read()
+    conn.close()
+    return json.loads(data) if data else None
+
+
+def fetch_heap(args):
+    try:
+        heap = http_json(args, "GET", "/api/heap")
+        return {key: heap.get(key) for key in ("free", "min_free", "largest_block", "fragmentation_pct")}
+    except (OSError, ValueError, http.client.HTTPException):
+        return None
+
+
+def slope_per_hour(points):
+    """Inclinação por mínimos quadrados de [(t_s, valor)], em unidades por hora."""
+    if len(points) < 2:
+        return 0.0
+    n = float(len(points))
+    mean_t = sum(t for t, _ in points) / n
+    mean_v = sum(v for _, v in points) / n
+    var = sum((t - mean_t) ** 2 for t, _ in points)
+    if var == 0:
+        return 0.0
+    cov = sum((t - mean_t) * (v - mean_v) for t, v in points)
+    return cov / var * 3600.0
+
+
+def summarize(stats, elapsed):
+    summary = {}
+    for endpoint, s in stats.items():
+        if not s.latency.count:
+            continue
+        summary[endpoint] = {
+            "requests": s.latency.count,
+            "rps": round(s.latency.count / elapsed, 2) if elapsed else 0.0,
+            "errors": s.errors,
+            "error_rate": round(s.errors / float(s.latency.count), 4),
+            "error_kinds": s.error_kinds,
+            "avg_ms": round(s.latency.total_ms / s.latency.count, 2),
+            "p50_ms": round(s.latency.percentile(50), 2),
+            "p90_ms": round(s.latency.percentile(90), 2),
+            "p99_ms": round(s.latency.percentile(99), 2),
+            "max_ms": round(s.latency.max_ms, 2),
+        }
+    return summary
+
+
+def print_summary(title, summary, heap):
+    print("\n== %s ==" % title)
+    print("%-9s %9s %8s %7s %9s %9s %9s %9s" % ("endpoint", "reqs", "req/s", "erros", "p50 ms", "p90 ms", "p99 ms", "máx ms"))
+    for endpoint in ENDPOINTS:
+        if endpoint not in summary:
+            continue
+        s = summary[endpoint]
+        print("%-9s %9d %8.2f %7d %9.1f %9.1f %9.1f %9.1f" % (
+            endpoint, s["requests"], s["rps"], s["errors"], s["p50_ms"], s["p90_ms"], s["p99_ms"], s["max_ms"]))
+    if heap:
+        print("heap: livre=%s mín=%s maior bloco=%s frag=%s%%" % (
+            heap["free"], heap["min_free"], heap["largest_block"], heap["fragmentation_pct"]))
+    sys.stdout.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--url", default="http://127.0.0.1:8080")
+    parser.add_argument("--duration", default="60s", help="ex.: 90s, 10m, 4h")
+    parser.add_argument("--report-every", default="10s")
+    parser.add_argument("--ui-clients", type=int, default=1)
+    parser.add_argument("--automation-clients", type=int, default=1)
+    parser.add_argument("--send-rate", type=float, default=1.0, help="envios/s por cliente de automação")
+    parser.add_argument("--send-code", default="0x20DF10EF", help="código usado se não houver códigos salvos")
+    parser.add_argument("--captured-every", type=float, default=0.5)
+    parser.add_argument("--status-every", type=float, default=5.0)
+    parser.add_argument("--codes-every", type=float, default=60.0)
+    parser.add_argument("--learning", action="store_true", help="liga o modo aprendizado durante o teste")
+    parser.add_argument("--timeout", type=float, default=10.0)
+    parser.add_argument("--json", help="grava um JSON por intervalo e o resumo final neste arquivo")
+    parser.add_argument("--ap-mode", choices=["sta", "hybrid"], help="fixa o AP de configuração durante o teste")
+    parser.add_argument("--power-profile", choices=["performance", "balanced", "low_power"],
+                        help="perfil de energia durante o teste")
+    args = parser.parse_args()
+
+    duration = parse_duration(args.duration)
+    report_every = parse_duration(args.report_every)
+    out = open(args.json, "w") if args.json else None
+
+    try:
+        code_ids = [code["id"] for code in http_json(args, "GET", "/api/codes")]
+    except (OSError, ValueError, TypeError, KeyError, http.client.HTTPException) as exc:
+        print("✗ Firmware inacessível em %s: %s" % (args.url, exc))
+        return 2
+    if args.learning:
+        http_json(args, "POST", "/api/learn/start")
+    if args.ap_mode:
+        # A janela cobre o teste inteiro; em "sta" o firmware recusa se a STA não estiver conectada
+        minutes = int(math.ceil(duration / 60.0)) + 1
+        body = json.dumps({"enable": args.ap_mode == "hybrid", "minutes": minutes})
+        ap = http_json(args, "POST", "/api/wifi/ap", body)
+        if not ap or ap.get("status") == "error":
+            print("✗ Não foi possível fixar o modo %s: %s" % (args.ap_mode, ap))
+            return 2
+        print("→ AP de configuração: %s" % ("ativo" if ap.get("active") else "desligado"))
+    if args.power_profile:
+        power = http_json(args, "POST", "/api/power", json.dumps({"profile": args.power_profile}))
+        if not power or power.get("status") == "error":
+            print("✗ Não foi possível trocar o perfil de energia: %s" % power)
+            return 2
+        print("→ Energia: %s (light sleep %s)" % (power["profile"], "ativo" if power.get("light_sleep") else "desligado"))
+
+    recorder = Recorder()
+    stop = threading.Event()
+    clients = []
+    ui_schedule = [("captured", args.captured_every), ("status", args.status_every), ("codes", args.codes_every)]
+    for _ in range(args.ui_clients):
+        clients.append(Client(args, recorder, stop, ui_schedule, code_ids))
+    if args.send_rate > 0:
+        for _ in range(args.automation_clients):
+            clients.append(Client(args, recorder, stop, [("send", 1.0 / args.send_rate)], code_ids))
+
+    heap_start = fetch_heap(args)
+    heap_points = []
+    if heap_start:
+        heap_points.append((0.0, heap_start["free"]))
+    print("→ %d cliente(s) UI, %d de automação (%.2f envios/s), %d códigos, duração %ds" % (
+        args.ui_clients, args.automation_clients, args.send_rate, len(code_ids), duration))
+
+    started = time.monotonic()
+    for client in clients:
+        client.start()
+
+    try:
+        while True:
+            elapsed = time.monotonic() - started
+            if elapsed >= duration:
+                break
+            time.sleep(min(report_every, duration - elapsed))
+            elapsed = time.monotonic() - started
+            interval = summarize(recorder.swap_interval(), report_every)
+            heap = fetch_heap(args)
+            if heap:
+                heap_points.append((elapsed, heap["free"]))
+            print_summary("t=%ds" % elapsed, interval, heap)
+            if out:
+                out.write(json.dumps({"type": "interval", "t_s": round(elapsed, 1), "endpoints": interval, "heap": heap}) + "\n")
+                out.flush()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        stop.set()
+        for client in clients:
+            client.join(args.timeout + 1)
+        if args.learning:
+            try:
+                http_json(args, "POST", "/api/learn/stop")
+            except (OSError, ValueError, http.client.HTTPException):
+                pass
+
+    elapsed = time.monotonic() - started
+    total = summarize(recorder.total, elapsed)
+    heap_end = fetch_heap(args)
+    print_summary("TOTAL (%ds)" % elapsed, total, heap_end)
+    heap_growth = None
+    if heap_start and heap_end:
+        heap_growth = {
+            "free_start": heap_start["free"],
+            "free_end": heap_end["free"],
+            "min_free_end": heap_end["min_free"],
+            "largest_block_start": heap_start["largest_block"],
+            "largest_block_end": heap_end["largest_block"],
+            "free_slope_bytes_per_hour": round(slope_per_hour(heap_points), 1),
+        }
+        print("heap: livre %d → %d, maior bloco %d → %d, tendência %+.0f bytes/h" % (
+            heap_growth["free_start"], heap_growth["free_end"], heap_growth["largest_block_start"],
+            heap_growth["largest_block_end"], heap_growth["free_slope_bytes_per_hour"]))
+    power = None
+    if args.power_profile:
+        try:
+            power = http_json(args, "GET", "/api/power")
+        except (OSError, ValueError, http.client.HTTPException):
+            pass
+        if power:
+            print("energia: %s, ocioso %.1f%%, wakes %s" % (power["profile"], power["idle_pct"], power["wakes"]))
+    if out:
+        out.write(json.dumps({"type": "summary", "duration_s": round(elapsed, 1), "ap_mode": args.ap_mode,
+                              "power": power, "endpoints": total, "heap": heap_growth}) + "\n")
+        out.close()
+
+    errors = sum(s["errors"] for s in total.values())
+    return 1 if errors else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,493 @@
+// Simulação host: tempo, GPIO, Serial e ESP emulados sobre Linux
+#include <Arduino.h>
+
+#include <driver/gpio.h>
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <hal/gpio_ll.h>
+#include <malloc.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "sim.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+const IPAddress INADDR_NONE(0, 0, 0, 0);
+
+static uint64_t monotonicNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static const uint64_t bootNs = monotonicNs();
+
+unsigned long millis() {
+  return (unsigned long)((monotonicNs() - bootNs) / 1000000ULL);
+}
+
+unsigned long micros() {
+  return (unsigned long)((monotonicNs() - bootNs) / 1000ULL);
+}
+
+int64_t esp_timer_get_time(void) {
+  return (int64_t)((monotonicNs() - bootNs) / 1000ULL);
+}
+
+void delay(uint32_t ms) {
+  if (ms == 0) {
+    sched_yield();
+    return;
+  }
+  usleep((useconds_t)ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us) {
+  uint64_t until = monotonicNs() + (uint64_t)us * 1000ULL;
+  while (monotonicNs() < until) {
+  }
+}
+
+void yield() {
+  sched_yield();
+}
+
+// Como no core sem randomSeed(): números do RNG do sistema
+long random(long howbig) {
+  if (howbig <= 0) return 0;
+  return (long)((unsigned long)rand() % (unsigned long)howbig);
+}
+
+long random(long howsmall, long howbig) {
+  if (howsmall >= howbig) return howsmall;
+  return howsmall + random(howbig - howsmall);
+}
+
+// Watchdog da loopTask: sem efeito na simulação
+void enableLoopWDT() {}
+void disableLoopWDT() {}
+void feedLoopWDT() {}
+
+// ----------------------------------------------------------------------------
+// GPIO: entradas com pull-up leem HIGH até que a simulação injete outro nível
+// ----------------------------------------------------------------------------
+
+static const int SIM_GPIO_COUNT = 40;
+static uint8_t pinModes[SIM_GPIO_COUNT];
+static uint8_t pinLevels[SIM_GPIO_COUNT];
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin >= SIM_GPIO_COUNT) return;
+  pinModes[pin] = mode;
+  if (mode == INPUT_PULLUP) pinLevels[pin] = HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  if (pin < SIM_GPIO_COUNT) pinLevels[pin] = val ? HIGH : LOW;
+}
+
+int digitalRead(uint8_t pin) {
+  return pin < SIM_GPIO_COUNT ? pinLevels[pin] : LOW;
+}
+
+// Interrupções: o tipo (borda ou nível) segue o gpio_int_type_t do IDF. Nível dispara uma vez a
+// cada mudança ou rearme com a condição verdadeira; a ISR deve desarmar o pino, como no hardware.
+static void (*pinHandlers[SIM_GPIO_COUNT])(void);
+static gpio_int_type_t pinIntrTypes[SIM_GPIO_COUNT];
+
+static std::recursive_mutex& gpioMutex() {
+  static std::recursive_mutex* mutex = new std::recursive_mutex();
+  return *mutex;
+}
+
+static bool levelMatches(gpio_int_type_t type, uint8_t level) {
+  return (type == GPIO_INTR_LOW_LEVEL && level == LOW) || (type == GPIO_INTR_HIGH_LEVEL && level == HIGH);
+}
+
+static void fireIfDue(uint8_t pin, uint8_t oldLevel, uint8_t newLevel, bool rearm) {
+  void (*handler)(void) = pinHandlers[pin];
+  gpio_int_type_t type = pinIntrTypes[pin];
+  if (!handler || type == GPIO_INTR_DISABLE) return;
+  bool edge = oldLevel != newLevel;
+  bool fire = levelMatches(type, newLevel) && (edge || rearm);
+  fire = fire || (edge && type == GPIO_INTR_ANYEDGE);
+  fire = fire || (edge && type == GPIO_INTR_POSEDGE && newLevel == HIGH);
+  fire = fire || (edge && type == GPIO_INTR_NEGEDGE && newLevel == LOW);
+  if (fire) handler();
+}
+
+void simSetPinLevel(uint8_t pin, uint8_t level) {
+  if (pin >= SIM_GPIO_COUNT) return;
+  std::lock_guard<std::recursive_mutex> lock(gpioMutex());
+  uint8_t oldLevel = pinLevels[pin];
+  pinLevels[pin] = level ? HIGH : LOW;
+  fireIfDue(pin, oldLevel, pinLevels[pin], false);
+}
+
+void simGpioSetIntrType(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+  if (gpio_num < 0 || gpio_num >= SIM_GPIO_COUNT) return;
+  std::lock_guard<std::recursive_mutex> lock(gpioMutex());
+  pinIntrTypes[gpio_num] = intr_type;
+  fireIfDue((uint8_t)gpio_num, pinLevels[gpio_num], pinLevels[gpio_num], true);
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+  if (gpio_num < 0 || gpio_num >= SIM_GPIO_COUNT) return ESP_ERR_INVALID_ARG;
+  simGpioSetIntrType(gpio_num, intr_type);
+  return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+  if (intr_type != GPIO_INTR_LOW_LEVEL && intr_type != GPIO_INTR_HIGH_LEVEL) return ESP_ERR_INVALID_ARG;
+  return gpio_set_intr_type(gpio_num, intr_type);
+}
+
+// Como no IDF: só tira o pino das fontes de wake, o tipo de interrupção continua
+esp_err_t gpio_wakeup_disable(gpio_num_t gpio_num) {
+  if (gpio_num < 0 || gpio_num >= SIM_GPIO_COUNT) return ESP_ERR_INVALID_ARG;
+  return ESP_OK;
+}
+
+void attachInterrupt(uint8_t pin, void (*handler)(void), int mode) {
+  if (pin >= SIM_GPIO_COUNT) return;
+  static const gpio_int_type_t types[] = {GPIO_INTR_DISABLE, GPIO_INTR_POSEDGE, GPIO_INTR_NEGEDGE,
+                                          GPIO_INTR_ANYEDGE, GPIO_INTR_LOW_LEVEL, GPIO_INTR_HIGH_LEVEL};
+  std::lock_guard<std::recursive_mutex> lock(gpioMutex());
+  pinHandlers[pin] = handler;
+  simGpioSetIntrType(pin, (mode >= 0 && mode <= ONHIGH) ? types[mode] : GPIO_INTR_DISABLE);
+}
+
+void detachInterrupt(uint8_t pin) {
+  if (pin >= SIM_GPIO_COUNT) return;
+  std::lock_guard<std::recursive_mutex> lock(gpioMutex());
+  pinHandlers[pin] = nullptr;
+  pinIntrTypes[pin] = GPIO_INTR_DISABLE;
+}
+
+// Mudanças de nível agendadas (quadros IR, toques no botão) saem de uma thread, como um sinal externo
+struct SimPinChange {
+  uint8_t pin;
+  uint8_t level;
+};
+
+static std::mutex scheduleMutex;
+static std::condition_variable scheduleCv;
+static std::multimap<uint64_t, SimPinChange>* scheduledChanges = nullptr;
+
+static void pinScheduleThread() {
+  std::unique_lock<std::mutex> lock(scheduleMutex);
+  for (;;) {
+    if (scheduledChanges->empty()) {
+      scheduleCv.wait(lock);
+      continue;
+    }
+    uint64_t dueUs = scheduledChanges->begin()->first;
+    uint64_t nowUs = (uint64_t)micros();
+    if (dueUs > nowUs) {
+      scheduleCv.wait_for(lock, std::chrono::microseconds(dueUs - nowUs));
+      continue;
+    }
+    SimPinChange change = scheduledChanges->begin()->second;
+    scheduledChanges->erase(scheduledChanges->begin());
+    lock.unlock();
+    simSetPinLevel(change.pin, change.level);
+    lock.lock();
+  }
+}
+
+void simSchedulePinLevel(uint8_t pin, uint8_t level, uint64_t atUs) {
+  std::lock_guard<std::mutex> lock(scheduleMutex);
+  if (!scheduledChanges) {
+    scheduledChanges = new std::multimap<uint64_t, SimPinChange>();
+    std::thread(pinScheduleThread).detach();
+  }
+  SimPinChange change = {pin, level};
+  scheduledChanges->insert(std::make_pair(atUs, change));
+  scheduleCv.notify_one();
+}
+
+// ----------------------------------------------------------------------------
+// Energia: frequência da CPU e esp_pm apenas registrados (o host não dorme)
+// ----------------------------------------------------------------------------
+
+static uint32_t cpuFrequencyMhz = 240;
+static esp_pm_config_esp32_t pmConfig = {240, 240, false};
+
+bool setCpuFrequencyMhz(uint32_t cpu_freq_mhz) {
+  if (cpu_freq_mhz != 240 && cpu_freq_mhz != 160 && cpu_freq_mhz != 80 && cpu_freq_mhz != 40) return false;
+  cpuFrequencyMhz = cpu_freq_mhz;
+  return true;
+}
+
+uint32_t getCpuFrequencyMhz() {
+  return cpuFrequencyMhz;
+}
+
+esp_err_t esp_pm_configure(const void* config) {
+  const esp_pm_config_esp32_t* pm = (const esp_pm_config_esp32_t*)config;
+  if (!pm || pm->min_freq_mhz > pm->max_freq_mhz || !setCpuFrequencyMhz((uint32_t)pm->max_freq_mhz)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (pm->light_sleep_enable && !simConfig().pmLightSleep) return ESP_ERR_NOT_SUPPORTED;
+  pmConfig = *pm;
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_get_configuration(void* config) {
+  if (!config) return ESP_ERR_INVALID_ARG;
+  *(esp_pm_config_esp32_t*)config = pmConfig;
+  return ESP_OK;
+}
+
+struct esp_pm_lock {
+  esp_pm_lock_type_t type;
+  int count;
+};
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char* name, esp_pm_lock_handle_t* out_handle) {
+  (void)arg;
+  (void)name;
+  if (!out_handle) return ESP_ERR_INVALID_ARG;
+  *out_handle = new esp_pm_lock{lock_type, 0};
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle) {
+  if (!handle) return ESP_ERR_INVALID_ARG;
+  handle->count++;
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle) {
+  if (!handle || handle->count == 0) return ESP_ERR_INVALID_STATE;
+  handle->count--;
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup(void) {
+  return ESP_OK;
+}
+
+// ----------------------------------------------------------------------------
+// Serial -> stdout (silenciável com SIM_SERIAL=0 para benchmarks)
+// ----------------------------------------------------------------------------
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t n = 0;
+  while (size--) n += write(*buffer++);
+  return n;
+}
+
+size_t Print::printf(const char* format, ...) {
+  // Mesmo tamanho do core ESP32: mensagens maiores que 64 bytes alocam no heap
+  char stackBuf[64];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(stackBuf, sizeof(stackBuf), format, args);
+  va_end(args);
+  if (len < 0) return 0;
+  if ((size_t)len < sizeof(stackBuf)) return write((const uint8_t*)stackBuf, (size_t)len);
+
+  char* heapBuf = (char*)malloc((size_t)len + 1);
+  if (!heapBuf) return 0;
+  va_start(args, format);
+  vsnprintf(heapBuf, (size_t)len + 1, format, args);
+  va_end(args);
+  size_t written = write((const uint8_t*)heapBuf, (size_t)len);
+  free(heapBuf);
+  return written;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+// UART do core 2.x sem buffer de TX: write() só retorna quando o resto cabe na FIFO de 128 bytes
+static void serialPace(size_t size) {
+  static std::mutex mutex;
+  static uint64_t fifoEmptyAtNs = 0;
+  const uint64_t byteNs = 10ULL * 1000000000ULL / simConfig().serialBaud;  // 8N1: 10 bits por byte
+  uint64_t waitUntilNs;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t now = monotonicNs();
+    fifoEmptyAtNs = std::max(fifoEmptyAtNs, now) + size * byteNs;
+    waitUntilNs = fifoEmptyAtNs - std::min<uint64_t>(fifoEmptyAtNs, 128 * byteNs);
+  }
+  uint64_t now = monotonicNs();
+  if (waitUntilNs > now) {
+    std::this_thread::sleep_for(std::chrono::nanoseconds(waitUntilNs - now));
+  }
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  if (!simConfig().serialEnabled) return size;
+  if (simConfig().serialBaud != 0) serialPace(size);
+  return fwrite(buffer, 1, size, stdout);
+}
+
+// ----------------------------------------------------------------------------
+// Heap: capacidade emulada (SIM_HEAP_SIZE) menos o que o alocador do host tem em uso
+// ----------------------------------------------------------------------------
+
+static size_t minFreeHeap = (size_t)-1;
+
+static size_t hostBytesInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  return mallinfo2().uordblks;
+#else
+  return (size_t)mallinfo().uordblks;
+#endif
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+  (void)caps;
+  size_t capacity = simConfig().heapSize;
+  size_t used = hostBytesInUse() - simConfig().heapBaseline;
+  size_t freeBytes = used < capacity ? capacity - used : 0;
+  if (freeBytes < minFreeHeap) minFreeHeap = freeBytes;
+  return freeBytes;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+  heap_caps_get_free_size(caps);
+  return minFreeHeap;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+  // O host não fragmenta como o heap do ESP32; devolvemos o maior bloco possível
+  return heap_caps_get_free_size(caps);
+}
+
+uint32_t EspClass::getHeapSize() { return (uint32_t)simConfig().heapSize; }
+uint32_t EspClass::getFreeHeap() { return (uint32_t)heap_caps_get_free_size(MALLOC_CAP_DEFAULT); }
+uint32_t EspClass::getMinFreeHeap() { return (uint32_t)heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT); }
+uint32_t EspClass::getMaxAllocHeap() { return (uint32_t)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT); }
+
+uint32_t EspClass::getCycleCount() {
+  // Emula um contador de ciclos a 240 MHz
+  return (uint32_t)((monotonicNs() - bootNs) * 240ULL / 1000ULL);
+}
+
+void EspClass::restart() {
+  simRequestRestart();
+}
+
+esp_reset_reason_t esp_reset_reason(void) {
+  return simConfig().resetReason;
+}
+
+// FreeRTOS: cada thread do host é uma "task"; o handle é o endereço de uma variável thread_local
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+  static thread_local char taskMarker;
+  return &taskMarker;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  delay(ticks * portTICK_PERIOD_MS);
+}
+
+static thread_local BaseType_t taskCore = 1;
+
+BaseType_t xPortGetCoreID(void) {
+  return taskCore;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char* pcName, uint32_t usStackDepth,
+                                   void* pvParameters, UBaseType_t uxPriority, TaskHandle_t* pvCreatedTask,
+                                   BaseType_t xCoreID) {
+  (void)pcName;
+  (void)usStackDepth;
+  (void)uxPriority;
+  std::mutex mutex;
+  std::condition_variable cv;
+  TaskHandle_t handle = nullptr;
+  std::thread([&, pvTaskCode, pvParameters, xCoreID]() {
+    taskCore = xCoreID == tskNO_AFFINITY ? 0 : xCoreID;
+    {
+      // Notifica com o mutex: o criador só retorna (destruindo mutex/cv) depois deste bloco
+      std::lock_guard<std::mutex> lock(mutex);
+      handle = xTaskGetCurrentTaskHandle();
+      cv.notify_all();
+    }
+    pvTaskCode(pvParameters);
+  }).detach();
+  std::unique_lock<std::mutex> lock(mutex);
+  cv.wait(lock, [&handle] { return handle != nullptr; });
+  if (pvCreatedTask) *pvCreatedTask = handle;
+  return pdPASS;
+}
+
+// Mutex: sem herança de prioridade (as threads do host não têm prioridade de task)
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+  return new std::timed_mutex();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xTicksToWait) {
+  std::timed_mutex* mutex = static_cast<std::timed_mutex*>(xSemaphore);
+  if (xTicksToWait == portMAX_DELAY) {
+    mutex->lock();
+    return pdTRUE;
+  }
+  return mutex->try_lock_for(std::chrono::milliseconds(xTicksToWait * portTICK_PERIOD_MS)) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore) {
+  static_cast<std::timed_mutex*>(xSemaphore)->unlock();
+  return pdTRUE;
+}
+
+// Notificações: contador por task protegido por mutex/condvar
+struct SimTaskNotify {
+  std::mutex mutex;
+  std::condition_variable cv;
+  uint32_t count = 0;
+};
+
+static SimTaskNotify& taskNotify(TaskHandle_t task) {
+  static std::mutex mapMutex;
+  static std::map<TaskHandle_t, SimTaskNotify*>* notifies = new std::map<TaskHandle_t, SimTaskNotify*>();
+  std::lock_guard<std::mutex> lock(mapMutex);
+  SimTaskNotify*& notify = (*notifies)[task];
+  if (!notify) notify = new SimTaskNotify();
+  return *notify;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait) {
+  SimTaskNotify& notify = taskNotify(xTaskGetCurrentTaskHandle());
+  std::unique_lock<std::mutex> lock(notify.mutex);
+  if (notify.count == 0 && xTicksToWait != 0) {
+    if (xTicksToWait == portMAX_DELAY) {
+      notify.cv.wait(lock, [&notify] { return notify.count != 0; });
+    } else {
+      notify.cv.wait_for(lock, std::chrono::milliseconds(xTicksToWait * portTICK_PERIOD_MS),
+                         [&notify] { return notify.count != 0; });
+    }
+  }
+  uint32_t value = notify.count;
+  if (value != 0) notify.count = xClearCountOnExit ? 0 : value - 1;
+  return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify) {
+  SimTaskNotify& notify = taskNotify(xTaskToNotify);
+  {
+    std::lock_guard<std::mutex> lock(notify.mutex);
+    notify.count++;
+  }
+  notify.cv.notify_all();
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t* pxHigherPriorityTaskWoken) {
+  xTaskNotifyGive(xTaskToNotify);
+  if (pxHigherPriorityTaskWoken) *pxHigherPriorityTaskWoken = pdTRUE;
+}
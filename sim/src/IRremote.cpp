@@ -0,0 +1,676 @@
+// Simulação host: IRremote com gravação e reprodução de formas de onda
+#include <IRremote.hpp>
+
+#include <time.h>
+#include <unistd.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "sim.h"
+
+IRsend IrSender;
+IRrecv IrReceiver;
+
+static const char* const protocolNames[] = {
+    "UNKNOWN", "PulseWidth", "PulseDistance", "Apple", "Denon", "JVC", "LG", "LG2", "NEC", "NEC2",
+    "Onkyo", "Panasonic", "Kaseikyo", "Kaseikyo_Denon", "Kaseikyo_Sharp", "Kaseikyo_JVC",
+    "Kaseikyo_Mitsubishi", "RC5", "RC6", "Samsung", "SamsungLG", "Samsung48", "Sharp", "Sony",
+    "Bang&Olufsen", "BoseWave", "Lego", "MagiQuest", "Whynter", "FAST"};
+
+const char* getProtocolString(decode_type_t aProtocol) {
+  int index = (int)aProtocol;
+  if (index < 0 || index >= (int)(sizeof(protocolNames) / sizeof(protocolNames[0]))) return "UNKNOWN";
+  return protocolNames[index];
+}
+
+static decode_type_t protocolFromString(const char* name) {
+  for (int i = 0; i < (int)(sizeof(protocolNames) / sizeof(protocolNames[0])); i++) {
+    if (strcmp(protocolNames[i], name) == 0) return (decode_type_t)i;
+  }
+  return UNKNOWN;
+}
+
+// ----------------------------------------------------------------------------
+// Quadro IR: durações com sinal (+marca, -espaço) e os dados decodificados
+// ----------------------------------------------------------------------------
+
+struct SimFrame {
+  std::vector<int32_t> timings;
+  IRData data;
+};
+
+struct SimQueuedFrame {
+  uint64_t releaseUs;
+  IRData data;
+  std::vector<int32_t> timings;
+};
+
+static std::deque<SimQueuedFrame>& rxQueue() {
+  static std::deque<SimQueuedFrame> q;
+  return q;
+}
+
+static int rxPin = -1;  // Pino de IrReceiver.begin(): recebe o nível do quadro (LOW durante o quadro)
+
+static uint64_t timingsDurationUs(const std::vector<int32_t>& timings) {
+  uint64_t total = 0;
+  for (size_t i = 0; i < timings.size(); i++) {
+    total += (uint64_t)(timings[i] < 0 ? -timings[i] : timings[i]);
+  }
+  return total;
+}
+
+// Enfileira para o decode() e, com o receptor ligado, leva o pino a LOW do início ao fim do
+// quadro (dispara a ISR de borda do firmware no instante certo)
+static void queueRxFrame(const SimQueuedFrame& queued) {
+  rxQueue().push_back(queued);
+  if (rxPin < 0) return;
+  uint64_t durationUs = timingsDurationUs(queued.timings);
+  uint64_t startUs = queued.releaseUs > durationUs ? queued.releaseUs - durationUs : 0;
+  simSchedulePinLevel((uint8_t)rxPin, LOW, startUs);
+  simSchedulePinLevel((uint8_t)rxPin, HIGH, queued.releaseUs);
+}
+
+static FILE* txLog = nullptr;
+static bool txLogOpened = false;
+
+static void initFrame(SimFrame& f, decode_type_t protocol, uint16_t address, uint16_t command, uint16_t bits) {
+  memset(&f.data, 0, sizeof(f.data));
+  f.data.protocol = protocol;
+  f.data.address = address;
+  f.data.command = command;
+  f.data.numberOfBits = bits;
+  f.timings.clear();
+}
+
+static void mark(SimFrame& f, uint32_t us) {
+  if (!f.timings.empty() && f.timings.back() > 0) {
+    f.timings.back() += (int32_t)us;
+  } else {
+    f.timings.push_back((int32_t)us);
+  }
+}
+
+static void space(SimFrame& f, uint32_t us) {
+  if (f.timings.empty()) return;
+  if (f.timings.back() < 0) {
+    f.timings.back() -= (int32_t)us;
+  } else {
+    f.timings.push_back(-(int32_t)us);
+  }
+}
+
+static void pulseDistance(SimFrame& f, const DistanceWidthTimingInfoStruct& t, uint64_t data, int bits,
+                          bool msbFirst, bool stopBit, bool trimTrailingSpace = true) {
+  if (t.HeaderMarkMicros) {
+    mark(f, t.HeaderMarkMicros);
+    space(f, t.HeaderSpaceMicros);
+  }
+  for (int i = 0; i < bits; i++) {
+    int bitIndex = msbFirst ? bits - 1 - i : i;
+    bool one = (data >> bitIndex) & 1ULL;
+    mark(f, one ? t.OneMarkMicros : t.ZeroMarkMicros);
+    space(f, one ? t.OneSpaceMicros : t.ZeroSpaceMicros);
+  }
+  if (stopBit) mark(f, t.ZeroMarkMicros);
+  if (trimTrailingSpace && !f.timings.empty() && f.timings.back() < 0) f.timings.pop_back();
+}
+
+static void manchester(SimFrame& f, uint32_t unit, uint64_t data, int bits, bool oneIsMarkFirst) {
+  for (int i = bits - 1; i >= 0; i--) {
+    bool one = (data >> i) & 1ULL;
+    if (one == oneIsMarkFirst) {
+      mark(f, unit);
+      space(f, unit);
+    } else {
+      space(f, unit);
+      mark(f, unit);
+    }
+  }
+  if (!f.timings.empty() && f.timings.back() < 0) f.timings.pop_back();
+}
+
+static uint64_t frameDurationUs(const SimFrame& f) {
+  return timingsDurationUs(f.timings);
+}
+
+static void sleepUs(uint64_t us) {
+  if (!simConfig().irRealtime || us == 0) return;
+  struct timespec ts;
+  ts.tv_sec = (time_t)(us / 1000000ULL);
+  ts.tv_nsec = (long)((us % 1000000ULL) * 1000ULL);
+  nanosleep(&ts, nullptr);
+}
+
+static void logFrame(const SimFrame& f, unsigned long atMs) {
+  if (!txLogOpened) {
+    txLogOpened = true;
+    if (simConfig().irTxLog) txLog = fopen(simConfig().irTxLog, "a");
+  }
+  if (!txLog) return;
+  fprintf(txLog, "%lu %s 0x%X 0x%X %u 0x%llX 0x%X |", atMs, getProtocolString(f.data.protocol), f.data.address,
+          f.data.command, f.data.numberOfBits, (unsigned long long)f.data.decodedRawData, f.data.flags);
+  for (size_t i = 0; i < f.timings.size(); i++) fprintf(txLog, " %+d", f.timings[i]);
+  fputc('\n', txLog);
+  fflush(txLog);
+}
+
+// Transmite um quadro (bloqueando pelo tempo de ar, como o IrSender real) e
+// completa o período de repetição quando houver outro quadro em seguida
+static void transmit(const SimFrame& f, uint32_t periodMs, bool moreFollow) {
+  unsigned long atMs = millis();
+  logFrame(f, atMs);
+  if (simConfig().irLoopback) {
+    SimQueuedFrame queued;
+    queued.releaseUs = (uint64_t)micros() + frameDurationUs(f);
+    queued.data = f.data;
+    queued.timings = f.timings;
+    queueRxFrame(queued);
+  }
+  uint64_t duration = frameDurationUs(f);
+  if (moreFollow && periodMs * 1000ULL > duration) duration = periodMs * 1000ULL;
+  sleepUs(duration);
+}
+
+static void transmitWithRepeats(SimFrame& f, int_fast8_t repeats, uint32_t periodMs, const SimFrame* repeatFrame) {
+  transmit(f, periodMs, repeats > 0);
+  for (int i = 0; i < repeats; i++) {
+    if (repeatFrame) {
+      transmit(*repeatFrame, periodMs, i + 1 < repeats);
+    } else {
+      f.data.flags |= IRDATA_FLAGS_IS_REPEAT;
+      transmit(f, periodMs, i + 1 < repeats);
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+// IRsend
+// ----------------------------------------------------------------------------
+
+static const DistanceWidthTimingInfoStruct NEC_TIMING = {9000, 4500, 560, 1690, 560, 560};
+static const DistanceWidthTimingInfoStruct SAMSUNG_TIMING = {4500, 4500, 560, 1690, 560, 560};
+static const DistanceWidthTimingInfoStruct KASEIKYO_TIMING = {3456, 1728, 432, 1296, 432, 432};
+static const DistanceWidthTimingInfoStruct LG_TIMING = {8500, 4250, 560, 1580, 560, 560};
+static const DistanceWidthTimingInfoStruct LG2_TIMING = {3200, 9900, 560, 1580, 560, 560};
+static const DistanceWidthTimingInfoStruct SONY_TIMING = {2400, 600, 1200, 600, 600, 600};
+static const DistanceWidthTimingInfoStruct DENON_TIMING = {0, 0, 260, 1820, 260, 780};
+static const DistanceWidthTimingInfoStruct JVC_TIMING = {8400, 4200, 526, 1578, 526, 526};
+static const DistanceWidthTimingInfoStruct BOSE_TIMING = {1060, 1450, 534, 1468, 534, 484};
+static const DistanceWidthTimingInfoStruct GENERIC_TIMING = {2000, 1000, 500, 1500, 500, 500};
+
+static void buildNecRepeat(SimFrame& r, decode_type_t protocol, uint16_t address, uint16_t command) {
+  initFrame(r, protocol, address, command, 0);
+  r.data.flags = IRDATA_FLAGS_IS_REPEAT;
+  mark(r, 9000);
+  space(r, 2250);
+  mark(r, 560);
+}
+
+static uint64_t necRawData(uint16_t address, uint16_t command) {
+  uint64_t raw;
+  if (address > 0xFF) {
+    raw = address;
+  } else {
+    raw = (uint64_t)(address & 0xFF) | ((uint64_t)(~address & 0xFF) << 8);
+  }
+  return raw | ((uint64_t)(command & 0xFF) << 16) | ((uint64_t)(~command & 0xFF) << 24);
+}
+
+void IRsend::begin() {}
+void IRsend::begin(uint_fast8_t aSendPin) { (void)aSendPin; }
+
+void IRsend::sendNEC(uint16_t aAddress, uint8_t aCommand, int_fast8_t aNumberOfRepeats) {
+  SimFrame f, r;
+  initFrame(f, NEC, aAddress, aCommand, 32);
+  f.data.decodedRawData = necRawData(aAddress, aCommand);
+  pulseDistance(f, NEC_TIMING, f.data.decodedRawData, 32, false, true);
+  buildNecRepeat(r, NEC, aAddress, aCommand);
+  transmitWithRepeats(f, aNumberOfRepeats, 110, &r);
+}
+
+void IRsend::sendNEC2(uint16_t aAddress, uint8_t aCommand, int_fast8_t aNumberOfRepeats) {
+  SimFrame f;
+  initFrame(f, NEC2, aAddress, aCommand, 32);
+  f.data.decodedRawData = necRawData(aAddress, aCommand);
+  pulseDistance(f, NEC_TIMING, f.data.decodedRawData, 32, false, true);
+  transmitWithRepeats(f, aNumberOfRepeats, 110, nullptr);
+}
+
+void IRsend::sendNECRepeat() {
+  SimFrame r;
+  buildNecRepeat(r, NEC, 0, 0);
+  transmit(r, 110, false);
+}
+
+void IRsend::sendApple(uint8_t aAddress, uint8_t aCommand, int_fast8_t aNumberOfRepeats) {
+  SimFrame f, r;
+  initFrame(f, APPLE, aAddress, aCommand, 32);
+  f.data.decodedRawData = 0x87EEULL | ((uint64_t)aCommand << 16) | ((uint64_t)aAddress << 24);
+  pulseDistance(f, NEC_TIMING, f.data.decodedRawData, 32, false, true);
+  buildNecRepeat(r, APPLE, aAddress, aCommand);
+  transmitWithRepeats(f, aNumberOfRepeats, 110, &r);
+}
+
+void IRsend::sendOnkyo(uint16_t aAddress, uint16_t aCommand, int_fast8_t aNumberOfRepeats) {
+  SimFrame f, r;
+  initFrame(f, ONKYO, aAddress, aCommand, 32);
+  f.data.decodedRawData = (uint64_t)aAddress | ((uint64_t)aCommand << 16);
+  pulseDistance(f, NEC_TIMING, f.data.decodedRawData, 32, false, true);
+  buildNecRepeat(r, ONKYO, aAddress, aCommand);
+  transmitWithRepeats(f, aNumberOfRepeats, 110, &r);
+}
+
+void IRsend::sendSamsung(uint16_t aAddress, uint16_t aCommand, int_fast8_t aNumberOfRepeats) {
+  SimFrame f;
+  initFrame(f, SAMSUNG, aAddress, aCommand, 32);
+  uint64_t cmd = aCommand > 0xFF ? aCommand : ((uint64_t)(aCommand & 0xFF) | ((uint64_t)(~aCommand & 0xFF) << 8));
+  f.data.decodedRawData = (uint64_t)aAddress | (cmd << 16);
+  pulseDistance(f, SAMSUNG_TIMING, f.data.decodedRawData, 32, false, true);
+  transmitWithRepeats(f, aNumberOfRepeats, 110, nullptr);
+}
+
+void IRsend::sendSamsung48(uint16_t aAddress, uint32_t aCommand, int_fast8_t aNumberOfRepeats) {
+  SimFrame f;
+  initFrame(f, SAMSUNG48, aAddress, (uint16_t)aCommand, 48);
+  f.data.decodedRawData = (uint64_t)aAddress | ((uint64_t)aCommand << 16);
+  pulseDistance(f, SAMSUNG_TIMING, f.data.decodedRawData, 48, false, true);
+  transmitWithRepeats(f, aNumberOfRepeats, 110, nullptr);
+}
+
+void IRsend::sendSamsungLG(uint16_t aAddress, uint16_t aCommand, int_fast8_t aNumberOfRepeats) {
+  SimFrame f, r;
+  initFrame(f, SAMSUNGLG, aAddress, aCommand, 32);
+  f.data.decodedRawData = (uint64_t)aAddress | ((uint64_t)(aCommand & 0xFF) << 16) | ((uint64_t)(~aCommand & 0xFF) << 24);
+  pulseDistance(f, SAMSUNG_TIMING, f.data.decodedRawData, 32, false, true);
+  initFrame(r, SAMSUNGLG, aAddress, aCommand, 0);
+  r.data.flags = IRDATA_FLAGS_IS_REPEAT;
+  mark(r, 4500);
+  space(r, 4500);
+  mark(r, 560);
+  space(r, 1690);
+  mark(r, 560);
+  transmitWithRepeats(f, aNumberOfRepeats, 110, &r);
+}
+
+void IRsend::sendSamsungLGRepeat() {
+  SimFrame r;
+  initFrame(r, SAMSUNGLG, 0, 0, 0);
+  r.data.flags = IRDATA_FLAGS_IS_REPEAT;
+  mark(r, 4500);
+  space(r, 4500);
+  mark(r, 560);
+  space(r, 1690);
+  mark(r, 560);
+  transmit(r, 110, false);
+}
+
+void IRsend::sendSony(uint16_t aAddress, uint8_t aCommand, int_fast8_t aNumberOfRepeats, uint8_t numberOfBits) {
+  SimFrame f;
+  initFrame(f, SONY, aAddress, aCommand, numberOfBits);
+  f.data.decodedRawData = (uint64_t)(aCommand & 0x7F) | ((uint64_t)aAddress << 7);
+  pulseDistance(f, SONY_TIMING, f.data.decodedRawData, numberOfBits, false, false);
+  transmitWithRepeats(f, aNumberOfRepeats, 45, nullptr);
+}
+
+void IRsend::sendRC5(uint8_t aAddress, uint8_t aCommand, int_fast8_t aNumberOfRepeats, bool aEnableAutomaticToggle) {
+  static bool toggle = false;
+  if (aEnableAutomaticToggle) toggle = !toggle;
+  SimFrame f;
+  initFrame(f, RC5, aAddress, aCommand, 13);
+  uint64_t data = 1ULL << 13;                                // bit de start
+  if (aCommand < 0x40) data |= 1ULL << 12;                   // bit de campo
+  if (toggle) data |= 1ULL << 11;
+  data |= (uint64_t)(aAddress & 0x1F) << 6;
+  data |= (uint64_t)(aCommand & 0x3F);
+  f.data.decodedRawData = data & 0x1FFF;
+  if (toggle) f.data.flags |= IRDATA_FLAGS_TOGGLE_BIT;
+  manchester(f, 889, data, 14, false);
+  transmitWithRepeats(f, aNumberOfRepeats, 114, nullptr);
+}
+
+void IRsend::sendRC6(uint8_t aAddress, uint8_t aCommand, int_fast8_t aNumberOfRepeats, bool aEnableAutomaticToggle) {
+  static bool toggle = false;
+  if (aEnableAutomaticToggle) toggle = !toggle;
+  SimFrame f;
+  initFrame(f, RC6, aAddress, aCommand, 20);
+  mark(f, 2666);
+  space(f, 889);
+  manchester(f, 444, 0x8, 4, true);  // bit de start + modo 000
+  if (toggle) {
+    mark(f, 889);
+    space(f, 889);
+  } else {
+    space(f, 889);
+    mark(f, 889);
+  }
+  uint64_t data = ((uint64_t)aAddress << 8) | aCommand;
+  f.data.decodedRawData = data;
+  if (toggle) f.data.flags |= IRDATA_FLAGS_TOGGLE_BIT;
+  manchester(f, 444, data, 16, true);
+  transmitWithRepeats(f, aNumberOfRepeats, 107, nullptr);
+}
+
+void IRsend::sendKaseikyo(uint16_t aAddress, uint8_t aData, int_fast8_t aNumberOfRepeats, uint16_t aVendorCode) {
+  // O decoder do IRremote devolve o fabricante pelo vendor code; só vendors sem nome ficam KASEIKYO
+  decode_type_t protocol = KASEIKYO;
+  switch (aVendorCode) {
+    case 0x2002: protocol = PANASONIC; break;
+    case 0x3254: protocol = KASEIKYO_DENON; break;
+    case 0x5AAA: protocol = KASEIKYO_SHARP; break;
+    case 0x0103: protocol = KASEIKYO_JVC; break;
+    case 0xCB23: protocol = KASEIKYO_MITSUBISHI; break;
+  }
+  SimFrame f;
+  initFrame(f, protocol, aAddress, aData, 48);
+  uint8_t vendorParity = (uint8_t)(aVendorCode ^ (aVendorCode >> 8));
+  vendorParity = (vendorParity ^ (vendorParity >> 4)) & 0xF;
+  uint64_t frame = (uint64_t)aVendorCode | ((uint64_t)vendorParity << 16) | ((uint64_t)(aAddress & 0xFFF) << 20) |
+                   ((uint64_t)aData << 32);
+  uint8_t parity = (uint8_t)((aAddress & 0xFF) ^ (aAddress >> 8) ^ vendorParity ^ aData);
+  frame |= (uint64_t)parity << 40;
+  f.data.decodedRawData = frame >> 16;
+  f.data.extra = aVendorCode;
+  pulseDistance(f, KASEIKYO_TIMING, frame, 48, false, true);
+  transmitWithRepeats(f, aNumberOfRepeats, 130, nullptr);
+}
+
+void IRsend::sendPanasonic(uint16_t aAddress, uint8_t aCommand, int_fast8_t aNumberOfRepeats) {
+  sendKaseikyo(aAddress, aCommand, aNumberOfRepeats, 0x2002);
+}
+
+void IRsend::sendKaseikyo_Denon(uint16_t aAddress, uint8_t aData, int_fast8_t aNumberOfRepeats) {
+  sendKaseikyo(aAddress, aData, aNumberOfRepeats, 0x3254);
+}
+
+void IRsend::sendKaseikyo_Sharp(uint16_t aAddress, uint8_t aData, int_fast8_t aNumberOfRepeats) {
+  sendKaseikyo(aAddress, aData, aNumberOfRepeats, 0x5AAA);
+}
+
+void IRsend::sendKaseikyo_JVC(uint16_t aAddress, uint8_t aData, int_fast8_t aNumberOfRepeats) {
+  sendKaseikyo(aAddress, aData, aNumberOfRepeats, 0x0103);
+}
+
+void IRsend::sendKaseikyo_Mitsubishi(uint16_t aAddress, uint8_t aData, int_fast8_t aNumberOfRepeats) {
+  sendKaseikyo(aAddress, aData, aNumberOfRepeats, 0xCB23);
+}
+
+static void sendLGFrame(decode_type_t protocol, const DistanceWidthTimingInfoStruct& timing, uint8_t aAddress,
+                        uint16_t aCommand, int_fast8_t aNumberOfRepeats) {
+  SimFrame f, r;
+  initFrame(f, protocol, aAddress, aCommand, 28);
+  uint8_t checksum = 0;
+  for (int i = 0; i < 4; i++) checksum += (uint8_t)((aCommand >> (i * 4)) & 0xF);
+  uint64_t data = ((uint64_t)aAddress << 20) | ((uint64_t)aCommand << 4) | (checksum & 0xF);
+  f.data.decodedRawData = data;
+  pulseDistance(f, timing, data, 28, true, true);
+  initFrame(r, protocol, aAddress, aCommand, 0);
+  r.data.flags = IRDATA_FLAGS_IS_REPEAT;
+  mark(r, timing.HeaderMarkMicros);
+  space(r, 2250);
+  mark(r, 560);
+  transmitWithRepeats(f, aNumberOfRepeats, 110, &r);
+}
+
+void IRsend::sendLG(uint8_t aAddress, uint16_t aCommand, int_fast8_t aNumberOfRepeats) {
+  sendLGFrame(LG, LG_TIMING, aAddress, aCommand, aNumberOfRepeats);
+}
+
+void IRsend::sendLG2(uint8_t aAddress, uint16_t aCommand, int_fast8_t aNumberOfRepeats) {
+  sendLGFrame(LG2, LG2_TIMING, aAddress, aCommand, aNumberOfRepeats);
+}
+
+void IRsend::sendLGRepeat() {
+  SimFrame r;
+  initFrame(r, LG, 0, 0, 0);
+  r.data.flags = IRDATA_FLAGS_IS_REPEAT;
+  mark(r, 8500);
+  space(r, 2250);
+  mark(r, 560);
+  transmit(r, 110, false);
+}
+
+void IRsend::sendDenon(uint8_t aAddress, uint8_t aCommand, int_fast8_t aNumberOfRepeats, uint8_t aSendSharpFrameMarker) {
+  decode_type_t protocol = aSendSharpFrameMarker ? SHARP : DENON;
+  uint64_t data = (uint64_t)(aAddress & 0x1F) | ((uint64_t)aCommand << 5) | ((uint64_t)(aSendSharpFrameMarker & 0x3) << 13);
+  uint64_t inverted = (uint64_t)(aAddress & 0x1F) | ((uint64_t)(~aCommand & 0xFF) << 5) |
+                      ((uint64_t)(~aSendSharpFrameMarker & 0x3) << 13);
+  for (int i = 0; i <= aNumberOfRepeats; i++) {
+    SimFrame f, g;
+    initFrame(f, protocol, aAddress, aCommand, 15);
+    f.data.decodedRawData = data;
+    if (i > 0) f.data.flags |= IRDATA_FLAGS_IS_REPEAT;
+    pulseDistance(f, DENON_TIMING, data, 15, false, true);
+    transmit(f, 65, true);
+    initFrame(g, protocol, aAddress, aCommand, 15);
+    g.data.decodedRawData = inverted;
+    g.data.flags = IRDATA_FLAGS_IS_AUTO_REPEAT;
+    pulseDistance(g, DENON_TIMING, inverted, 15, false, true);
+    transmit(g, 65, i < aNumberOfRepeats);
+  }
+}
+
+void IRsend::sendSharp(uint8_t aAddress, uint8_t aCommand, int_fast8_t aNumberOfRepeats) {
+  sendDenon(aAddress, aCommand, aNumberOfRepeats, 1);
+}
+
+void IRsend::sendJVC(uint8_t aAddress, uint8_t aCommand, int_fast8_t aNumberOfRepeats) {
+  SimFrame f, r;
+  initFrame(f, JVC, aAddress, aCommand, 16);
+  f.data.decodedRawData = (uint64_t)aAddress | ((uint64_t)aCommand << 8);
+  pulseDistance(f, JVC_TIMING, f.data.decodedRawData, 16, false, true);
+  DistanceWidthTimingInfoStruct noHeader = JVC_TIMING;
+  noHeader.HeaderMarkMicros = 0;
+  noHeader.HeaderSpaceMicros = 0;
+  initFrame(r, JVC, aAddress, aCommand, 16);
+  r.data.decodedRawData = f.data.decodedRawData;
+  r.data.flags = IRDATA_FLAGS_IS_REPEAT;
+  pulseDistance(r, noHeader, r.data.decodedRawData, 16, false, true);
+  transmitWithRepeats(f, aNumberOfRepeats, 55, &r);
+}
+
+void IRsend::sendBoseWave(uint8_t aCommand, int_fast8_t aNumberOfRepeats) {
+  SimFrame f;
+  initFrame(f, BOSEWAVE, 0, aCommand, 16);
+  f.data.decodedRawData = (uint64_t)aCommand | ((uint64_t)(~aCommand & 0xFF) << 8);
+  pulseDistance(f, BOSE_TIMING, f.data.decodedRawData, 16, false, true);
+  transmitWithRepeats(f, aNumberOfRepeats, 75, nullptr);
+}
+
+static void sendGeneric(decode_type_t protocol, uint16_t address, uint16_t command, uint64_t data, int bits,
+                        int_fast8_t repeats, uint32_t periodMs) {
+  SimFrame f;
+  initFrame(f, protocol, address, command, (uint16_t)bits);
+  f.data.decodedRawData = data;
+  pulseDistance(f, GENERIC_TIMING, data, bits, true, true);
+  transmitWithRepeats(f, repeats, periodMs, nullptr);
+}
+
+void IRsend::sendLegoPowerFunctions(uint8_t aChannel, uint8_t tCommand, uint8_t aMode, bool aDoSend5Times) {
+  uint64_t data = ((uint64_t)(aChannel & 0x3) << 12) | ((uint64_t)(aMode & 0x7) << 8) | ((uint64_t)tCommand << 4);
+  sendGeneric(LEGO_PF, aChannel, tCommand, data, 16, aDoSend5Times ? 4 : 0, 100);
+}
+
+void IRsend::sendMagiQuest(uint32_t aWandId, uint16_t aMagnitude) {
+  sendGeneric(MAGIQUEST, (uint16_t)(aWandId >> 16), aMagnitude, ((uint64_t)aWandId << 16) | aMagnitude, 56, 0, 0);
+}
+
+void IRsend::sendWhynter(uint32_t aData, uint8_t aNumberOfBitsToSend) {
+  sendGeneric(WHYNTER, 0, (uint16_t)aData, aData, aNumberOfBitsToSend, 0, 0);
+}
+
+void IRsend::sendFAST(uint8_t aCommand, int_fast8_t aNumberOfRepeats) {
+  sendGeneric(FAST, 0, aCommand, (uint64_t)aCommand | ((uint64_t)(~aCommand & 0xFF) << 8), 16, aNumberOfRepeats, 50);
+}
+
+void IRsend::sendBangOlufsen(uint16_t aHeader, uint8_t aData, int_fast8_t aNumberOfRepeats, int8_t aNumberOfHeaderBits) {
+  sendGeneric(BANG_OLUFSEN, aHeader, aData, ((uint64_t)aHeader << 8) | aData, 8 + aNumberOfHeaderBits,
+              aNumberOfRepeats, 100);
+}
+
+void IRsend::sendRaw(const uint16_t aBufferWithMicroseconds[], uint_fast16_t aLengthOfBuffer,
+                     uint_fast8_t aIRFrequencyKilohertz) {
+  (void)aIRFrequencyKilohertz;
+  SimFrame f;
+  initFrame(f, UNKNOWN, 0, 0, 0);
+  for (uint_fast16_t i = 0; i < aLengthOfBuffer; i++) {
+    if (i % 2 == 0) {
+      mark(f, aBufferWithMicroseconds[i]);
+    } else {
+      space(f, aBufferWithMicroseconds[i]);
+    }
+  }
+  f.data.numberOfBits = (uint16_t)(aLengthOfBuffer / 2);
+  transmit(f, 0, false);
+}
+
+void IRsend::sendRaw(const uint8_t aBufferWithTicks[], uint_fast16_t aLengthOfBuffer, uint_fast8_t aIRFrequencyKilohertz) {
+  (void)aIRFrequencyKilohertz;
+  SimFrame f;
+  initFrame(f, UNKNOWN, 0, 0, 0);
+  for (uint_fast16_t i = 0; i < aLengthOfBuffer; i++) {
+    uint32_t us = (uint32_t)aBufferWithTicks[i] * MICROS_PER_TICK;
+    if (i % 2 == 0) {
+      mark(f, us);
+    } else {
+      space(f, us);
+    }
+  }
+  f.data.numberOfBits = (uint16_t)(aLengthOfBuffer / 2);
+  transmit(f, 0, false);
+}
+
+void IRsend::sendPulseDistanceWidthFromArray(uint_fast8_t aFrequencyKHz, DistanceWidthTimingInfoStruct* aDistanceWidthTimingInfo,
+                                             IRDecodedRawDataType* aDecodedRawDataArray, uint16_t aNumberOfBits,
+                                             uint8_t aFlags, uint16_t aRepeatPeriodMillis, int_fast8_t aNumberOfRepeats) {
+  (void)aFrequencyKHz;
+  if (!aDistanceWidthTimingInfo || !aDecodedRawDataArray) return;
+  bool msbFirst = (aFlags & IRDATA_FLAGS_IS_MSB_FIRST) != 0;
+  SimFrame f;
+  initFrame(f, PULSE_DISTANCE, 0, 0, aNumberOfBits);
+  f.data.flags |= aFlags & IRDATA_FLAGS_IS_MSB_FIRST;  // O decoder marca a ordem que reconheceu
+  f.data.DistanceWidthTimingInfo = *aDistanceWidthTimingInfo;
+  mark(f, aDistanceWidthTimingInfo->HeaderMarkMicros);
+  space(f, aDistanceWidthTimingInfo->HeaderSpaceMicros);
+  DistanceWidthTimingInfoStruct bitsOnly = *aDistanceWidthTimingInfo;
+  bitsOnly.HeaderMarkMicros = 0;
+  bitsOnly.HeaderSpaceMicros = 0;
+  uint16_t remaining = aNumberOfBits;
+  for (int word = 0; remaining > 0; word++) {
+    uint16_t bits = remaining > BITS_IN_RAW_DATA_TYPE ? BITS_IN_RAW_DATA_TYPE : remaining;
+    if (word < RAW_DATA_ARRAY_SIZE) f.data.decodedRawDataArray[word] = aDecodedRawDataArray[word];
+    pulseDistance(f, bitsOnly, aDecodedRawDataArray[word], bits, msbFirst, false, false);
+    remaining -= bits;
+  }
+  mark(f, aDistanceWidthTimingInfo->ZeroMarkMicros);
+  f.data.decodedRawData = aDecodedRawDataArray[0];
+  transmitWithRepeats(f, aNumberOfRepeats, aRepeatPeriodMillis, nullptr);
+}
+
+void IRsend::sendPulseDistanceWidth(uint_fast8_t aFrequencyKHz, DistanceWidthTimingInfoStruct* aDistanceWidthTimingInfo,
+                                    IRDecodedRawDataType aData, uint_fast8_t aNumberOfBits, uint8_t aFlags,
+                                    uint16_t aRepeatPeriodMillis, int_fast8_t aNumberOfRepeats) {
+  sendPulseDistanceWidthFromArray(aFrequencyKHz, aDistanceWidthTimingInfo, &aData, aNumberOfBits, aFlags,
+                                  aRepeatPeriodMillis, aNumberOfRepeats);
+}
+
+size_t IRsend::write(IRData* aIRSendData, int_fast8_t aNumberOfRepeats) {
+  if (!aIRSendData) return 0;
+  switch (aIRSendData->protocol) {
+    case NEC: sendNEC(aIRSendData->address, (uint8_t)aIRSendData->command, aNumberOfRepeats); break;
+    case SAMSUNG: sendSamsung(aIRSendData->address, aIRSendData->command, aNumberOfRepeats); break;
+    case SONY: sendSony(aIRSendData->address, (uint8_t)aIRSendData->command, aNumberOfRepeats, (uint8_t)aIRSendData->numberOfBits); break;
+    default: return 0;
+  }
+  return 1;
+}
+
+// ----------------------------------------------------------------------------
+// IRrecv: reprodução de quadros gravados
+// ----------------------------------------------------------------------------
+
+static irparams_struct rawParams;
+static bool receiverEnabled = false;
+static uint64_t receiverStartUs = 0;
+
+static void loadReplayFile() {
+  const char* path = simConfig().irRxFile;
+  if (!path) return;
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    fprintf(stderr, "sim: não foi possível abrir SIM_IR_RX_FILE=%s\n", path);
+    return;
+  }
+  char line[8192];
+  while (fgets(line, sizeof(line), f)) {
+    if (line[0] == '#' || line[0] == '\n') continue;
+    unsigned long atMs = 0;
+    char proto[32];
+    unsigned address = 0, command = 0, bits = 0, flags = 0;
+    unsigned long long raw = 0;
+    int fields = sscanf(line, "%lu %31s %x %x %u %llx %x", &atMs, proto, &address, &command, &bits, &raw, &flags);
+    if (fields < 5) continue;
+    SimQueuedFrame queued;
+    memset(&queued.data, 0, sizeof(queued.data));
+    queued.releaseUs = receiverStartUs + (uint64_t)atMs * 1000ULL;
+    queued.data.protocol = protocolFromString(proto);
+    queued.data.address = (uint16_t)address;
+    queued.data.command = (uint16_t)command;
+    queued.data.numberOfBits = (uint16_t)bits;
+    queued.data.decodedRawData = raw;
+    queued.data.flags = (uint8_t)flags;
+    const char* timings = strchr(line, '|');
+    if (timings) {
+      char* cursor = (char*)timings + 1;
+      for (;;) {
+        char* end;
+        long value = strtol(cursor, &end, 10);
+        if (end == cursor) break;
+        queued.timings.push_back((int32_t)value);
+        cursor = end;
+      }
+    }
+    queueRxFrame(queued);
+  }
+  fclose(f);
+}
+
+void IRrecv::begin(uint_fast8_t aReceivePin, bool aEnableLEDFeedback, uint_fast8_t aFeedbackLEDPin) {
+  (void)aEnableLEDFeedback;
+  (void)aFeedbackLEDPin;
+  rxPin = aReceivePin;
+  simSetPinLevel((uint8_t)rxPin, HIGH);  // Saída do receptor em repouso
+  receiverStartUs = micros();
+  receiverEnabled = true;
+  loadReplayFile();
+}
+
+void IRrecv::start() { receiverEnabled = true; }
+void IRrecv::stop() { receiverEnabled = false; }
+bool IRrecv::isIdle() { return true; }
+
+bool IRrecv::available() {
+  return receiverEnabled && !rxQueue().empty() && rxQueue().front().releaseUs <= (uint64_t)micros();
+}
+
+bool IRrecv::decode() {
+  if (!available()) return false;
+  SimQueuedFrame frame = rxQueue().front();
+  rxQueue().pop_front();
+  decodedIRData = frame.data;
+
+  // rawbuf em ticks de 50 µs, começando pelo intervalo antes do quadro
+  rawParams.rawlen = 1;
+  rawParams.rawbuf[0] = 0xFFFF;
+  for (size_t i = 0; i < frame.timings.size() && rawParams.rawlen < RAW_BUFFER_LENGTH; i++) {
+    int32_t us = frame.timings[i] < 0 ? -frame.timings[i] : frame.timings[i];
+    rawParams.rawbuf[rawParams.rawlen++] = (IRRawbufType)((us + MICROS_PER_TICK / 2) / MICROS_PER_TICK);
+  }
+  if (frame.timings.size() + 1 > RAW_BUFFER_LENGTH) decodedIRData.flags |= IRDATA_FLAGS_WAS_OVERFLOW;
+  decodedIRData.rawDataPtr = &rawParams;
+  return true;
+}
+
+void IRrecv::resume() {}
@@ -0,0 +1,287 @@
+// Simulação host: Preferences persistido em arquivo com modelo de custo do NVS
+#include <Preferences.h>
+
+#include <time.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+
+#include "sim.h"
+
+// Geometria e tempos aproximados do NVS em flash SPI do ESP32
+static const size_t NVS_ENTRY_SIZE = 32;
+static const uint32_t NVS_ENTRIES_PER_PAGE = 126;
+static const size_t NVS_MAX_KEY_LENGTH = 15;
+static const uint32_t NVS_TOTAL_ENTRIES = 126 * 5;  // partição nvs padrão de 20 KB
+static const uint32_t FLASH_WRITE_US_PER_ENTRY = 70;
+static const uint32_t FLASH_READ_US_PER_ENTRY = 4;
+static const uint32_t FLASH_PAGE_ERASE_US = 22000;
+
+enum NvsType : uint8_t {
+  NVS_U8 = 0x01,
+  NVS_I8 = 0x11,
+  NVS_U16 = 0x02,
+  NVS_I16 = 0x12,
+  NVS_U32 = 0x04,
+  NVS_I32 = 0x14,
+  NVS_U64 = 0x08,
+  NVS_I64 = 0x18,
+  NVS_STR = 0x21,
+  NVS_BLOB = 0x42,
+};
+
+struct NvsEntry {
+  uint8_t type;
+  std::string data;
+};
+
+typedef std::map<std::string, NvsEntry> NvsNamespace;
+
+// Nunca destruído: objetos Preferences globais ainda chamam end() durante o exit()
+static std::map<std::string, NvsNamespace>& store() {
+  static std::map<std::string, NvsNamespace>* s = new std::map<std::string, NvsNamespace>();
+  return *s;
+}
+
+static NvsSimStats stats;
+static uint32_t entriesSinceErase = 0;
+static bool loaded = false;
+static bool dirty = false;
+
+static uint32_t entriesFor(uint8_t type, size_t len) {
+  if (type != NVS_STR && type != NVS_BLOB) return 1;
+  // Cabeçalho + dados em blocos de 32 bytes
+  return 1 + (uint32_t)((len + NVS_ENTRY_SIZE - 1) / NVS_ENTRY_SIZE);
+}
+
+static void chargeFlash(uint64_t us) {
+  stats.flashTimeUs += us;
+  if (simConfig().nvsRealtime && us > 0) usleep((useconds_t)us);
+}
+
+static void loadFromFile() {
+  if (loaded) return;
+  loaded = true;
+  const char* path = simConfig().nvsFile;
+  if (!path) return;
+  FILE* f = fopen(path, "r");
+  if (!f) return;
+  char line[4096];
+  while (fgets(line, sizeof(line), f)) {
+    char ns[32], key[32], hex[4000];
+    unsigned type;
+    hex[0] = '\0';
+    if (sscanf(line, "%31s %31s %x %3999s", ns, key, &type, hex) < 3) continue;
+    NvsEntry entry;
+    entry.type = (uint8_t)type;
+    for (size_t i = 0; hex[i] && hex[i + 1]; i += 2) {
+      char byteStr[3] = {hex[i], hex[i + 1], 0};
+      entry.data += (char)strtoul(byteStr, nullptr, 16);
+    }
+    if (strcmp(hex, "-") == 0) entry.data.clear();
+    store()[ns][key] = entry;
+  }
+  fclose(f);
+}
+
+void Preferences::simFlushToFile() {
+  const char* path = simConfig().nvsFile;
+  if (!dirty || !path) return;
+  std::string tmp = std::string(path) + ".tmp";
+  FILE* f = fopen(tmp.c_str(), "w");
+  if (!f) return;
+  for (std::map<std::string, NvsNamespace>::const_iterator ns = store().begin(); ns != store().end(); ++ns) {
+    for (NvsNamespace::const_iterator it = ns->second.begin(); it != ns->second.end(); ++it) {
+      fprintf(f, "%s %s %02x ", ns->first.c_str(), it->first.c_str(), it->second.type);
+      if (it->second.data.empty()) fputc('-', f);
+      for (size_t i = 0; i < it->second.data.size(); i++) fprintf(f, "%02x", (uint8_t)it->second.data[i]);
+      fputc('\n', f);
+    }
+  }
+  fclose(f);
+  rename(tmp.c_str(), path);
+  dirty = false;
+}
+
+NvsSimStats Preferences::simStats() {
+  return stats;
+}
+
+void Preferences::simResetStats() {
+  memset(&stats, 0, sizeof(stats));
+}
+
+Preferences::Preferences() : started_(false), readOnly_(false) {
+  namespace_[0] = '\0';
+}
+
+Preferences::~Preferences() {
+  end();
+}
+
+bool Preferences::begin(const char* name, bool readOnly, const char* partitionLabel) {
+  (void)partitionLabel;
+  if (started_ || !name || strlen(name) > NVS_MAX_KEY_LENGTH) return false;
+  loadFromFile();
+  strncpy(namespace_, name, sizeof(namespace_) - 1);
+  namespace_[sizeof(namespace_) - 1] = '\0';
+  readOnly_ = readOnly;
+  started_ = true;
+  if (!readOnly) store()[namespace_];
+  return true;
+}
+
+void Preferences::end() {
+  if (!started_) return;
+  started_ = false;
+  simFlushToFile();
+}
+
+bool Preferences::clear() {
+  if (!started_ || readOnly_) return false;
+  store()[namespace_].clear();
+  dirty = true;
+  return true;
+}
+
+bool Preferences::remove(const char* key) {
+  if (!started_ || readOnly_ || !key) return false;
+  NvsNamespace& ns = store()[namespace_];
+  NvsNamespace::iterator it = ns.find(key);
+  if (it == ns.end()) return false;
+  ns.erase(it);
+  dirty = true;
+  return true;
+}
+
+bool Preferences::isKey(const char* key) {
+  if (!started_ || !key) return false;
+  NvsNamespace& ns = store()[namespace_];
+  return ns.find(key) != ns.end();
+}
+
+size_t Preferences::freeEntries() {
+  uint32_t used = 0;
+  for (std::map<std::string, NvsNamespace>::const_iterator ns = store().begin(); ns != store().end(); ++ns) {
+    for (NvsNamespace::const_iterator it = ns->second.begin(); it != ns->second.end(); ++it) {
+      used += entriesFor(it->second.type, it->second.data.size());
+    }
+  }
+  return used < NVS_TOTAL_ENTRIES ? NVS_TOTAL_ENTRIES - used : 0;
+}
+
+size_t Preferences::putTyped(const char* key, uint8_t type, const void* data, size_t len) {
+  if (!started_ || readOnly_ || !key) return 0;
+  if (strlen(key) > NVS_MAX_KEY_LENGTH) {
+    fprintf(stderr, "sim: chave NVS longa demais (>15): %s\n", key);
+    return 0;
+  }
+  stats.puts++;
+  NvsNamespace& ns = store()[namespace_];
+  std::string value((const char*)data, len);
+  NvsNamespace::iterator it = ns.find(key);
+  if (it != ns.end() && it->second.type == type && it->second.data == value) {
+    // O NVS compara com o item existente e não regrava valores idênticos
+    stats.putsUnchanged++;
+    chargeFlash(FLASH_READ_US_PER_ENTRY * entriesFor(type, len));
+    return len;
+  }
+
+  uint32_t entries = entriesFor(type, len);
+  stats.entriesWritten += entries;
+  stats.bytesWritten += entries * (uint32_t)NVS_ENTRY_SIZE;
+  uint64_t cost = (uint64_t)entries * FLASH_WRITE_US_PER_ENTRY;
+  entriesSinceErase += entries;
+  while (entriesSinceErase >= NVS_ENTRIES_PER_PAGE) {
+    entriesSinceErase -= NVS_ENTRIES_PER_PAGE;
+    stats.pageErases++;
+    cost += FLASH_PAGE_ERASE_US;
+  }
+  chargeFlash(cost);
+
+  NvsEntry entry;
+  entry.type = type;
+  entry.data = value;
+  ns[key] = entry;
+  dirty = true;
+  return len;
+}
+
+bool Preferences::getTyped(const char* key, uint8_t type, void* out, size_t len) {
+  if (!started_ || !key) return false;
+  stats.gets++;
+  NvsNamespace& ns = store()[namespace_];
+  NvsNamespace::const_iterator it = ns.find(key);
+  // Tipo diferente do gravado falha como no NVS (ESP_ERR_NVS_TYPE_MISMATCH)
+  if (it == ns.end() || it->second.type != type || it->second.data.size() != len) return false;
+  chargeFlash(FLASH_READ_US_PER_ENTRY);
+  memcpy(out, it->second.data.data(), len);
+  return true;
+}
+
+#define PREFS_SCALAR(Name, CType, Tag)                                        \
+  size_t Preferences::put##Name(const char* key, CType value) {               \
+    return putTyped(key, Tag, &value, sizeof(value));                         \
+  }                                                                           \
+  CType Preferences::get##Name(const char* key, CType defaultValue) {         \
+    CType value;                                                              \
+    return getTyped(key, Tag, &value, sizeof(value)) ? value : defaultValue;  \
+  }
+
+PREFS_SCALAR(Char, int8_t, NVS_I8)
+PREFS_SCALAR(UChar, uint8_t, NVS_U8)
+PREFS_SCALAR(Short, int16_t, NVS_I16)
+PREFS_SCALAR(UShort, uint16_t, NVS_U16)
+PREFS_SCALAR(Int, int32_t, NVS_I32)
+PREFS_SCALAR(UInt, uint32_t, NVS_U32)
+PREFS_SCALAR(Long64, int64_t, NVS_I64)
+PREFS_SCALAR(ULong64, uint64_t, NVS_U64)
+
+size_t Preferences::putString(const char* key, const char* value) {
+  if (!value) return 0;
+  // O NVS guarda o terminador junto com a string
+  return putTyped(key, NVS_STR, value, strlen(value) + 1) ? strlen(value) : 0;
+}
+
+size_t Preferences::getString(const char* key, char* value, size_t maxLen) {
+  if (!started_ || !key) return 0;
+  stats.gets++;
+  NvsNamespace& ns = store()[namespace_];
+  NvsNamespace::const_iterator it = ns.find(key);
+  if (it == ns.end() || it->second.type != NVS_STR) return 0;
+  size_t len = it->second.data.size();
+  if (!value || len > maxLen) return 0;
+  chargeFlash(FLASH_READ_US_PER_ENTRY * entriesFor(NVS_STR, len));
+  memcpy(value, it->second.data.data(), len);
+  return len;
+}
+
+String Preferences::getString(const char* key, const String& defaultValue) {
+  char buf[4000];
+  size_t len = getString(key, buf, sizeof(buf));
+  return len ? String(buf) : defaultValue;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+  if (!value || !len) return 0;
+  return putTyped(key, NVS_BLOB, value, len);
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+  if (!started_ || !key) return 0;
+  NvsNamespace& ns = store()[namespace_];
+  NvsNamespace::const_iterator it = ns.find(key);
+  return (it == ns.end() || it->second.type != NVS_BLOB) ? 0 : it->second.data.size();
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen) {
+  if (!started_ || !key || !buf) return 0;
+  stats.gets++;
+  NvsNamespace& ns = store()[namespace_];
+  NvsNamespace::const_iterator it = ns.find(key);
+  if (it == ns.end() || it->second.type != NVS_BLOB || it->second.data.size() > maxLen) return 0;
+  chargeFlash(FLASH_READ_US_PER_ENTRY * entriesFor(NVS_BLOB, it->second.data.size()));
+  memcpy(buf, it->second.data.data(), it->second.data.size());
+  return it->second.data.size();
+}
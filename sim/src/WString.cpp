@@ -0,0 +1,270 @@
+// Simulação host: implementação da String (aloca via malloc/realloc como o core real)
+#include "WString.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+String::String(const char* cstr) : buffer_(nullptr), capacity_(0), len_(0) {
+  if (cstr) copy(cstr, strlen(cstr));
+}
+
+String::String(const String& str) : buffer_(nullptr), capacity_(0), len_(0) {
+  *this = str;
+}
+
+String::String(String&& str) : buffer_(str.buffer_), capacity_(str.capacity_), len_(str.len_) {
+  str.buffer_ = nullptr;
+  str.capacity_ = 0;
+  str.len_ = 0;
+}
+
+String::String(char c) : buffer_(nullptr), capacity_(0), len_(0) {
+  char buf[2] = {c, 0};
+  copy(buf, 1);
+}
+
+static void formatNumber(char* buf, size_t size, unsigned long long value, bool negative, unsigned char base) {
+  char tmp[72];
+  int pos = 0;
+  if (base < 2 || base > 36) base = 10;
+  do {
+    int digit = (int)(value % base);
+    tmp[pos++] = (char)(digit < 10 ? '0' + digit : 'a' + digit - 10);
+    value /= base;
+  } while (value && pos < (int)sizeof(tmp) - 1);
+  size_t out = 0;
+  if (negative && out < size - 1) buf[out++] = '-';
+  while (pos > 0 && out < size - 1) buf[out++] = tmp[--pos];
+  buf[out] = '\0';
+}
+
+#define STRING_FROM_UNSIGNED(type)                                            \
+  String::String(type value, unsigned char base) : buffer_(nullptr), capacity_(0), len_(0) { \
+    char buf[72];                                                             \
+    formatNumber(buf, sizeof(buf), (unsigned long long)value, false, base);   \
+    copy(buf, strlen(buf));                                                   \
+  }
+#define STRING_FROM_SIGNED(type)                                              \
+  String::String(type value, unsigned char base) : buffer_(nullptr), capacity_(0), len_(0) { \
+    char buf[72];                                                             \
+    bool negative = (base == 10 && value < 0);                                \
+    unsigned long long magnitude = negative ? (unsigned long long)(-(long long)value) \
+                                            : (unsigned long long)value;      \
+    if (base != 10) magnitude &= (sizeof(type) == 8) ? ~0ULL : ((1ULL << (sizeof(type) * 8)) - 1); \
+    formatNumber(buf, sizeof(buf), magnitude, negative, base);                \
+    copy(buf, strlen(buf));                                                   \
+  }
+
+STRING_FROM_UNSIGNED(unsigned char)
+STRING_FROM_UNSIGNED(unsigned int)
+STRING_FROM_UNSIGNED(unsigned long)
+STRING_FROM_UNSIGNED(unsigned long long)
+STRING_FROM_SIGNED(int)
+STRING_FROM_SIGNED(long)
+STRING_FROM_SIGNED(long long)
+
+String::String(float value, unsigned int decimalPlaces) : buffer_(nullptr), capacity_(0), len_(0) {
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%.*f", (int)decimalPlaces, (double)value);
+  copy(buf, strlen(buf));
+}
+
+String::String(double value, unsigned int decimalPlaces) : buffer_(nullptr), capacity_(0), len_(0) {
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%.*f", (int)decimalPlaces, value);
+  copy(buf, strlen(buf));
+}
+
+String::~String() {
+  free(buffer_);
+}
+
+void String::invalidate() {
+  free(buffer_);
+  buffer_ = nullptr;
+  capacity_ = 0;
+  len_ = 0;
+}
+
+bool String::reserve(unsigned int size) {
+  if (buffer_ && capacity_ >= size) return true;
+  char* grown = (char*)realloc(buffer_, size + 1);
+  if (!grown) return false;
+  if (!buffer_) grown[0] = '\0';
+  buffer_ = grown;
+  capacity_ = size;
+  return true;
+}
+
+bool String::copy(const char* cstr, unsigned int length) {
+  if (!reserve(length)) {
+    invalidate();
+    return false;
+  }
+  len_ = length;
+  memcpy(buffer_, cstr, length);
+  buffer_[length] = '\0';
+  return true;
+}
+
+String& String::operator=(const String& rhs) {
+  if (this == &rhs) return *this;
+  if (rhs.buffer_) {
+    copy(rhs.buffer_, rhs.len_);
+  } else {
+    invalidate();
+  }
+  return *this;
+}
+
+String& String::operator=(String&& rhs) {
+  if (this != &rhs) {
+    free(buffer_);
+    buffer_ = rhs.buffer_;
+    capacity_ = rhs.capacity_;
+    len_ = rhs.len_;
+    rhs.buffer_ = nullptr;
+    rhs.capacity_ = 0;
+    rhs.len_ = 0;
+  }
+  return *this;
+}
+
+String& String::operator=(const char* cstr) {
+  if (cstr) {
+    copy(cstr, strlen(cstr));
+  } else {
+    invalidate();
+  }
+  return *this;
+}
+
+bool String::concat(const char* cstr, unsigned int length) {
+  if (!cstr) return false;
+  if (length == 0) return true;
+  unsigned int newLen = len_ + length;
+  if (!reserve(newLen)) return false;
+  memmove(buffer_ + len_, cstr, length);
+  len_ = newLen;
+  buffer_[len_] = '\0';
+  return true;
+}
+
+bool String::concat(const String& str) {
+  if (&str == this) {
+    String copyOfSelf(str);
+    return concat(copyOfSelf.c_str(), copyOfSelf.len_);
+  }
+  return concat(str.c_str(), str.len_);
+}
+
+bool String::concat(const char* cstr) {
+  return cstr ? concat(cstr, strlen(cstr)) : false;
+}
+
+bool String::concat(char c) {
+  return concat(&c, 1);
+}
+
+bool String::concat(int num) { return concat(String(num)); }
+bool String::concat(unsigned int num) { return concat(String(num)); }
+bool String::concat(long num) { return concat(String(num)); }
+bool String::concat(unsigned long num) { return concat(String(num)); }
+
+StringSumHelper& operator+(const StringSumHelper& lhs, const String& rhs) {
+  StringSumHelper& a = const_cast<StringSumHelper&>(lhs);
+  a.concat(rhs);
+  return a;
+}
+
+StringSumHelper& operator+(const StringSumHelper& lhs, const char* cstr) {
+  StringSumHelper& a = const_cast<StringSumHelper&>(lhs);
+  a.concat(cstr);
+  return a;
+}
+
+StringSumHelper& operator+(const StringSumHelper& lhs, char c) {
+  StringSumHelper& a = const_cast<StringSumHelper&>(lhs);
+  a.concat(c);
+  return a;
+}
+
+StringSumHelper& operator+(const StringSumHelper& lhs, int num) {
+  StringSumHelper& a = const_cast<StringSumHelper&>(lhs);
+  a.concat(num);
+  return a;
+}
+
+StringSumHelper& operator+(const StringSumHelper& lhs, unsigned int num) {
+  StringSumHelper& a = const_cast<StringSumHelper&>(lhs);
+  a.concat(num);
+  return a;
+}
+
+StringSumHelper& operator+(const StringSumHelper& lhs, long num) {
+  StringSumHelper& a = const_cast<StringSumHelper&>(lhs);
+  a.concat(num);
+  return a;
+}
+
+StringSumHelper& operator+(const StringSumHelper& lhs, unsigned long num) {
+  StringSumHelper& a = const_cast<StringSumHelper&>(lhs);
+  a.concat(num);
+  return a;
+}
+
+bool String::equals(const String& s) const {
+  return len_ == s.len_ && strcmp(c_str(), s.c_str()) == 0;
+}
+
+bool String::equals(const char* cstr) const {
+  if (!cstr) return len_ == 0;
+  return strcmp(c_str(), cstr) == 0;
+}
+
+int String::indexOf(char ch, unsigned int fromIndex) const {
+  if (fromIndex >= len_) return -1;
+  const char* found = strchr(buffer_ + fromIndex, ch);
+  return found ? (int)(found - buffer_) : -1;
+}
+
+int String::indexOf(const char* str, unsigned int fromIndex) const {
+  if (!str || fromIndex >= len_) return -1;
+  const char* found = strstr(buffer_ + fromIndex, str);
+  return found ? (int)(found - buffer_) : -1;
+}
+
+bool String::startsWith(const char* prefix) const {
+  size_t n = strlen(prefix);
+  return n <= len_ && strncmp(c_str(), prefix, n) == 0;
+}
+
+String String::substring(unsigned int beginIndex, unsigned int endIndex) const {
+  if (beginIndex > endIndex) {
+    unsigned int tmp = beginIndex;
+    beginIndex = endIndex;
+    endIndex = tmp;
+  }
+  String out;
+  if (beginIndex >= len_) return out;
+  if (endIndex > len_) endIndex = len_;
+  out.copy(buffer_ + beginIndex, endIndex - beginIndex);
+  return out;
+}
+
+void String::trim() {
+  if (!buffer_ || len_ == 0) return;
+  char* begin = buffer_;
+  while (isspace((unsigned char)*begin)) begin++;
+  char* end = buffer_ + len_ - 1;
+  while (end >= begin && isspace((unsigned char)*end)) end--;
+  len_ = (unsigned int)(end + 1 - begin);
+  if (begin > buffer_) memmove(buffer_, begin, len_);
+  buffer_[len_] = '\0';
+}
+
+long String::toInt() const {
+  return buffer_ ? atol(buffer_) : 0;
+}
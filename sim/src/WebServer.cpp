@@ -0,0 +1,479 @@
+// Simulação host: WebServer sobre sockets TCP reais
+#include <WebServer.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+static const size_t MAX_REQUEST_BYTES = 256 * 1024;
+static const int CLIENT_READ_TIMEOUT_MS = 2000;
+
+static const char* statusText(int code) {
+  switch (code) {
+    case 200: return "OK";
+    case 201: return "Created";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 409: return "Conflict";
+    case 413: return "Payload Too Large";
+    case 429: return "Too Many Requests";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+    default: return "";
+  }
+}
+
+static std::string urlDecode(const std::string& in) {
+  std::string out;
+  out.reserve(in.size());
+  for (size_t i = 0; i < in.size(); i++) {
+    if (in[i] == '+') {
+      out += ' ';
+    } else if (in[i] == '%' && i + 2 < in.size()) {
+      char hex[3] = {in[i + 1], in[i + 2], 0};
+      out += (char)strtol(hex, nullptr, 16);
+      i += 2;
+    } else {
+      out += in[i];
+    }
+  }
+  return out;
+}
+
+static WebServer* lastInstance = nullptr;
+
+WebServer::WebServer(int port)
+    : port_(port), listenFd_(-1), clientFd_(-1), method_(HTTP_ANY), contentLength_(CONTENT_LENGTH_NOT_SET),
+      headersSent_(false), chunked_(false), responseCode_(0), capture_(nullptr) {
+  lastInstance = this;
+}
+
+WebServer::~WebServer() {
+  close();
+  if (lastInstance == this) lastInstance = nullptr;
+}
+
+WebServer* WebServer::simInstance() {
+  return lastInstance;
+}
+
+void WebServer::begin() {
+  // A porta do firmware (80) é remapeada para SIM_HTTP_PORT para rodar sem root
+  begin((uint16_t)(port_ == 80 ? simConfig().httpPort : port_));
+}
+
+void WebServer::begin(uint16_t port) {
+  close();
+  listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (listenFd_ < 0) {
+    perror("sim: socket");
+    return;
+  }
+  int yes = 1;
+  setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(listenFd_, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenFd_, 16) < 0) {
+    perror("sim: bind/listen");
+    ::close(listenFd_);
+    listenFd_ = -1;
+    return;
+  }
+  fcntl(listenFd_, F_SETFL, fcntl(listenFd_, F_GETFL, 0) | O_NONBLOCK);
+  fprintf(stderr, "sim: WebServer escutando em http://127.0.0.1:%u\n", port);
+}
+
+void WebServer::close() {
+  if (listenFd_ >= 0) {
+    ::close(listenFd_);
+    listenFd_ = -1;
+  }
+}
+
+void WebServer::on(const String& uri, THandlerFunction handler) {
+  on(uri, HTTP_ANY, handler);
+}
+
+void WebServer::on(const String& uri, HTTPMethod method, THandlerFunction fn) {
+  on(uri, method, fn, THandlerFunction());
+}
+
+void WebServer::on(const String& uri, HTTPMethod method, THandlerFunction fn, THandlerFunction ufn) {
+  Route route;
+  route.uri = uri.c_str();
+  route.method = method;
+  route.fn = fn;
+  route.ufn = ufn;
+  routes_.push_back(route);
+}
+
+void WebServer::resetRequestState() {
+  method_ = HTTP_ANY;
+  uri_.clear();
+  args_.clear();
+  headers_.clear();
+  responseHeaders_.clear();
+  contentLength_ = CONTENT_LENGTH_NOT_SET;
+  headersSent_ = false;
+  chunked_ = false;
+  responseCode_ = 0;
+}
+
+void WebServer::handleClient() {
+  if (listenFd_ < 0) return;
+  struct pollfd pfd;
+  pfd.fd = listenFd_;
+  pfd.events = POLLIN;
+  // Espera curta para não girar a CPU do host a 100% entre iterações do loop()
+  if (poll(&pfd, 1, 1) <= 0) return;
+
+  int fd = accept(listenFd_, nullptr, nullptr);
+  if (fd < 0) return;
+  int yes = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+  resetRequestState();
+  clientFd_ = fd;
+  if (readRequest(fd)) {
+    dispatch();
+  }
+  ::close(fd);
+  clientFd_ = -1;
+}
+
+bool WebServer::readRequest(int fd) {
+  std::string data;
+  size_t headerEnd = std::string::npos;
+  size_t bodyLength = 0;
+  char buf[4096];
+
+  for (;;) {
+    if (headerEnd != std::string::npos && data.size() >= headerEnd + 4 + bodyLength) break;
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, CLIENT_READ_TIMEOUT_MS) <= 0) return false;
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) return false;
+    data.append(buf, (size_t)n);
+    if (data.size() > MAX_REQUEST_BYTES) return false;
+
+    if (headerEnd == std::string::npos) {
+      headerEnd = data.find("\r\n\r\n");
+      if (headerEnd == std::string::npos) continue;
+
+      size_t lineEnd = data.find("\r\n");
+      std::string requestLine = data.substr(0, lineEnd);
+      size_t sp1 = requestLine.find(' ');
+      size_t sp2 = requestLine.find(' ', sp1 + 1);
+      if (sp1 == std::string::npos || sp2 == std::string::npos) return false;
+      std::string methodStr = requestLine.substr(0, sp1);
+      std::string target = requestLine.substr(sp1 + 1, sp2 - sp1 - 1);
+
+      if (methodStr == "GET") method_ = HTTP_GET;
+      else if (methodStr == "POST") method_ = HTTP_POST;
+      else if (methodStr == "PUT") method_ = HTTP_PUT;
+      else if (methodStr == "DELETE") method_ = HTTP_DELETE;
+      else if (methodStr == "PATCH") method_ = HTTP_PATCH;
+      else if (methodStr == "HEAD") method_ = HTTP_HEAD;
+      else if (methodStr == "OPTIONS") method_ = HTTP_OPTIONS;
+
+      size_t q = target.find('?');
+      uri_ = target.substr(0, q);
+      if (q != std::string::npos) parseArgs(target.substr(q + 1));
+
+      size_t pos = lineEnd + 2;
+      while (pos < headerEnd) {
+        size_t eol = data.find("\r\n", pos);
+        std::string line = data.substr(pos, eol - pos);
+        size_t colon = line.find(':');
+        if (colon != std::string::npos) {
+          std::string name = line.substr(0, colon);
+          std::string value = line.substr(colon + 1);
+          while (!value.empty() && value[0] == ' ') value.erase(0, 1);
+          headers_.push_back(std::make_pair(name, value));
+          if (strcasecmp(name.c_str(), "Content-Length") == 0) bodyLength = (size_t)strtoul(value.c_str(), nullptr, 10);
+        }
+        pos = eol + 2;
+      }
+      if (bodyLength > MAX_REQUEST_BYTES) return false;
+
+      // Como no core: só multipart fica fora do raw (form-urlencoded também vai para o ufn)
+      const Route* route = findRoute();
+      if (route && route->ufn && !header("Content-Type").startsWith("multipart/")) {
+        size_t initial = data.size() - (headerEnd + 4);
+        if (initial > bodyLength) initial = bodyLength;
+        return streamRaw(*route, data.data() + headerEnd + 4, initial, fd, bodyLength);
+      }
+    }
+  }
+
+  std::string body = data.substr(headerEnd + 4, bodyLength);
+  if (!body.empty()) {
+    String contentType = header("Content-Type");
+    if (contentType.startsWith("application/x-www-form-urlencoded")) {
+      parseArgs(body);
+    } else {
+      args_.push_back(std::make_pair(std::string("plain"), body));
+    }
+  }
+  return true;
+}
+
+void WebServer::parseArgs(const std::string& query) {
+  size_t pos = 0;
+  while (pos <= query.size()) {
+    size_t amp = query.find('&', pos);
+    if (amp == std::string::npos) amp = query.size();
+    std::string pair = query.substr(pos, amp - pos);
+    if (!pair.empty()) {
+      size_t eq = pair.find('=');
+      std::string name = urlDecode(pair.substr(0, eq));
+      std::string value = eq == std::string::npos ? std::string() : urlDecode(pair.substr(eq + 1));
+      args_.push_back(std::make_pair(name, value));
+    }
+    pos = amp + 1;
+  }
+}
+
+const WebServer::Route* WebServer::findRoute() const {
+  for (size_t i = 0; i < routes_.size(); i++) {
+    const Route& route = routes_[i];
+    if (route.uri == uri_ && (route.method == HTTP_ANY || route.method == method_)) {
+      return &route;
+    }
+  }
+  return nullptr;
+}
+
+// Corpo em pedaços de até HTTP_RAW_BUFLEN para o ufn da rota, na ordem do Parsing.cpp do core 2.x.
+// initial: o que já veio junto com os cabeçalhos; fd < 0 = só initial (simRequest)
+bool WebServer::streamRaw(const Route& route, const char* initial, size_t initialSize, int fd, size_t bodyLength) {
+  raw_.status = RAW_START;
+  raw_.totalSize = 0;
+  raw_.currentSize = 0;
+  raw_.data = nullptr;
+  route.ufn();
+  raw_.status = RAW_WRITE;
+  while (raw_.totalSize < bodyLength) {
+    size_t want = bodyLength - raw_.totalSize;
+    if (want > HTTP_RAW_BUFLEN) want = HTTP_RAW_BUFLEN;
+    size_t got = 0;
+    if (initialSize > 0) {
+      got = want < initialSize ? want : initialSize;
+      memcpy(raw_.buf, initial, got);
+      initial += got;
+      initialSize -= got;
+    } else if (fd >= 0) {
+      struct pollfd pfd;
+      pfd.fd = fd;
+      pfd.events = POLLIN;
+      if (poll(&pfd, 1, CLIENT_READ_TIMEOUT_MS) > 0) {
+        ssize_t n = recv(fd, raw_.buf, want, 0);
+        if (n > 0) got = (size_t)n;
+      }
+    }
+    if (got == 0) {
+      raw_.status = RAW_ABORTED;
+      raw_.currentSize = 0;
+      route.ufn();
+      return false;
+    }
+    raw_.currentSize = got;
+    raw_.totalSize += got;
+    route.ufn();
+  }
+  raw_.status = RAW_END;
+  raw_.currentSize = 0;
+  route.ufn();
+  return true;
+}
+
+void WebServer::dispatch() {
+  const Route* route = findRoute();
+  if (route) {
+    route->fn();
+    finishResponse();
+    return;
+  }
+  if (notFoundHandler_) {
+    notFoundHandler_();
+  } else {
+    String message = "Not found: ";
+    message += uri_.c_str();
+    send(404, "text/plain", message);
+  }
+  finishResponse();
+}
+
+void WebServer::finishResponse() {
+  if (chunked_) {
+    writeOut("0\r\n\r\n", 5);
+    chunked_ = false;
+  }
+}
+
+String WebServer::arg(const String& name) const {
+  for (size_t i = 0; i < args_.size(); i++) {
+    if (name == args_[i].first.c_str()) return String(args_[i].second.c_str());
+  }
+  return String();
+}
+
+String WebServer::arg(int i) const {
+  return (i >= 0 && i < (int)args_.size()) ? String(args_[i].second.c_str()) : String();
+}
+
+String WebServer::argName(int i) const {
+  return (i >= 0 && i < (int)args_.size()) ? String(args_[i].first.c_str()) : String();
+}
+
+bool WebServer::hasArg(const String& name) const {
+  for (size_t i = 0; i < args_.size(); i++) {
+    if (name == args_[i].first.c_str()) return true;
+  }
+  return false;
+}
+
+String WebServer::header(const String& name) const {
+  for (size_t i = 0; i < headers_.size(); i++) {
+    if (strcasecmp(name.c_str(), headers_[i].first.c_str()) == 0) return String(headers_[i].second.c_str());
+  }
+  return String();
+}
+
+bool WebServer::hasHeader(const String& name) const {
+  for (size_t i = 0; i < headers_.size(); i++) {
+    if (strcasecmp(name.c_str(), headers_[i].first.c_str()) == 0) return true;
+  }
+  return false;
+}
+
+void WebServer::writeOut(const char* data, size_t size) {
+  if (capture_) {
+    capture_->concat(data, (unsigned int)size);
+    return;
+  }
+  if (clientFd_ < 0) return;
+  while (size > 0) {
+    ssize_t n = ::send(clientFd_, data, size, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return;
+    }
+    data += n;
+    size -= (size_t)n;
+  }
+}
+
+void WebServer::sendHeader(const String& name, const String& value, bool first) {
+  std::pair<std::string, std::string> header(name.c_str(), value.c_str());
+  if (first) {
+    responseHeaders_.insert(responseHeaders_.begin(), header);
+  } else {
+    responseHeaders_.push_back(header);
+  }
+}
+
+void WebServer::sendHeaders(int code, const char* contentType, size_t contentLength) {
+  std::string head = "HTTP/1.1 ";
+  char num[32];
+  snprintf(num, sizeof(num), "%d ", code);
+  head += num;
+  head += statusText(code);
+  head += "\r\n";
+  head += "Content-Type: ";
+  head += contentType ? contentType : "text/html";
+  head += "\r\n";
+  if (contentLength == CONTENT_LENGTH_UNKNOWN) {
+    head += "Transfer-Encoding: chunked\r\n";
+    chunked_ = true;
+  } else {
+    snprintf(num, sizeof(num), "%zu", contentLength);
+    head += "Content-Length: ";
+    head += num;
+    head += "\r\n";
+  }
+  for (size_t i = 0; i < responseHeaders_.size(); i++) {
+    head += responseHeaders_[i].first + ": " + responseHeaders_[i].second + "\r\n";
+  }
+  head += "Connection: close\r\n\r\n";
+  writeOut(head.data(), head.size());
+  headersSent_ = true;
+  responseCode_ = code;
+  responseHeaders_.clear();
+}
+
+void WebServer::send(int code, const char* contentType, const String& content) {
+  send(code, contentType, content.c_str());
+}
+
+void WebServer::send(int code, const String& contentType, const String& content) {
+  send(code, contentType.c_str(), content.c_str());
+}
+
+void WebServer::send(int code, const char* contentType, const char* content) {
+  send_P(code, contentType, content, content ? strlen(content) : 0);
+}
+
+void WebServer::send_P(int code, const char* contentType, const char* content, size_t length) {
+  if (headersSent_) return;
+  if (contentLength_ == CONTENT_LENGTH_UNKNOWN) {
+    sendHeaders(code, contentType, CONTENT_LENGTH_UNKNOWN);
+    if (length) sendContent(content, length);
+  } else {
+    sendHeaders(code, contentType, contentLength_ == CONTENT_LENGTH_NOT_SET ? length : contentLength_);
+    if (length) writeOut(content, length);
+  }
+}
+
+void WebServer::sendContent(const char* content, size_t size) {
+  if (!chunked_) {
+    writeOut(content, size);
+    return;
+  }
+  if (size == 0) {
+    finishResponse();
+    return;
+  }
+  char prefix[16];
+  int n = snprintf(prefix, sizeof(prefix), "%zx\r\n", size);
+  writeOut(prefix, (size_t)n);
+  writeOut(content, size);
+  writeOut("\r\n", 2);
+}
+
+int WebServer::simRequest(HTTPMethod method, const char* uri, const char* body, String* response) {
+  resetRequestState();
+  method_ = method;
+  std::string target = uri ? uri : "/";
+  size_t q = target.find('?');
+  uri_ = target.substr(0, q);
+  if (q != std::string::npos) parseArgs(target.substr(q + 1));
+  const Route* route = findRoute();
+  if (route && route->ufn) {
+    if (!streamRaw(*route, body, body ? strlen(body) : 0, -1, body ? strlen(body) : 0)) return 0;
+  } else if (body && body[0]) {
+    args_.push_back(std::make_pair(std::string("plain"), std::string(body)));
+  }
+
+  String sink;
+  capture_ = response ? response : &sink;
+  dispatch();
+  capture_ = nullptr;
+  return responseCode_;
+}
@@ -0,0 +1,535 @@
+// Simulação host: rádio WiFi emulado
+#include <WiFi.h>
+
+#include <string.h>
+#include <unistd.h>
+
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "sim.h"
+
+WiFiClass WiFi;
+
+static wifi_mode_t currentMode = WIFI_MODE_NULL;
+static bool apActive = false;
+static char staSsid[33];
+static bool staRequested = false;
+static unsigned long staBeginMs = 0;
+static bool staFailing = false;
+static IPAddress staticIP;
+static uint32_t staConnectMs = 0;  // Tempo desta tentativa: varredura + associação + DHCP
+static int staAp = -1;             // AP emulado escolhido por begin()
+
+// ----------------------------------------------------------------------------
+// APs emulados. SIM_WIFI_NETWORKS="ssid:rssi:canal[:rssi_depois:apos_ms],..."; vazio = um AP
+// "SimNet" no canal SIM_WIFI_CHANNEL que aceita qualquer SSID
+// ----------------------------------------------------------------------------
+
+struct SimAP {
+  char ssid[33];
+  uint8_t bssid[6];
+  int32_t channel;
+  int rssi;
+  int rssiAfter;          // RSSI a partir de afterMs (testa roaming)
+  unsigned long afterMs;  // 0 = RSSI fixo
+  bool wildcard;
+};
+
+static std::vector<SimAP>& simAPs() {
+  static std::vector<SimAP>* aps = nullptr;
+  if (aps) return *aps;
+  aps = new std::vector<SimAP>();
+  const char* spec = simConfig().wifiNetworks;
+  char buffer[512];
+  strncpy(buffer, spec ? spec : "", sizeof(buffer) - 1);
+  buffer[sizeof(buffer) - 1] = '\0';
+  char* save = nullptr;
+  for (char* item = strtok_r(buffer, ",", &save); item; item = strtok_r(nullptr, ",", &save)) {
+    SimAP ap;
+    memset(&ap, 0, sizeof(ap));
+    char* field = strchr(item, ':');
+    if (field) *field++ = '\0';
+    strncpy(ap.ssid, item, sizeof(ap.ssid) - 1);
+    ap.rssi = field ? atoi(field) : -55;
+    field = field ? strchr(field, ':') : nullptr;
+    ap.channel = field ? atoi(++field) : 6;
+    field = field ? strchr(field, ':') : nullptr;
+    ap.rssiAfter = field ? atoi(++field) : ap.rssi;
+    field = field ? strchr(field, ':') : nullptr;
+    ap.afterMs = field ? strtoul(++field, nullptr, 10) : 0;
+    uint8_t bssid[6] = {0x02, 0x00, 0x5E, 0x10, 0x00, (uint8_t)(aps->size() + 1)};
+    memcpy(ap.bssid, bssid, sizeof(bssid));
+    aps->push_back(ap);
+  }
+  if (aps->empty()) {
+    SimAP ap;
+    memset(&ap, 0, sizeof(ap));
+    strcpy(ap.ssid, "SimNet");
+    uint8_t bssid[6] = {0x02, 0x00, 0x5E, 0x10, 0x00, 0x01};
+    memcpy(ap.bssid, bssid, sizeof(bssid));
+    ap.channel = simConfig().wifiChannel;
+    ap.rssi = ap.rssiAfter = -55;
+    ap.wildcard = true;
+    aps->push_back(ap);
+  }
+  return *aps;
+}
+
+static int apRssi(const SimAP& ap) {
+  return (ap.afterMs && millis() >= ap.afterMs) ? ap.rssiAfter : ap.rssi;
+}
+
+// AP mais forte com esse SSID; com canal + BSSID, só aquele AP exato
+static int findAp(const char* ssid, int32_t channel, const uint8_t* bssidHint) {
+  std::vector<SimAP>& aps = simAPs();
+  int best = -1;
+  for (size_t i = 0; i < aps.size(); i++) {
+    if (!aps[i].wildcard && strcmp(aps[i].ssid, ssid) != 0) continue;
+    if (channel > 0 && bssidHint && (channel != aps[i].channel || memcmp(bssidHint, aps[i].bssid, 6) != 0)) continue;
+    if (best < 0 || apRssi(aps[i]) > apRssi(aps[best])) best = (int)i;
+  }
+  return best;
+}
+
+// Varredura: dura SIM_WIFI_SCAN_MS; os resultados são uma foto dos APs no fim
+struct SimScanResult {
+  SimAP ap;
+  int rssi;
+};
+static bool scanRunning = false;
+static bool scanHasResults = false;
+static unsigned long scanStartedMs = 0;
+static std::vector<SimScanResult>& scanResults() {
+  static std::vector<SimScanResult>* results = new std::vector<SimScanResult>();
+  return *results;
+}
+
+// Chamado com o mutex; devolve true quando a varredura acabou agora
+static bool finishScanIfDue() {
+  if (!scanRunning || millis() - scanStartedMs < simConfig().wifiScanMs) return false;
+  scanRunning = false;
+  scanHasResults = true;
+  scanResults().clear();
+  std::vector<SimAP>& aps = simAPs();
+  for (size_t i = 0; i < aps.size(); i++) {
+    SimScanResult result;
+    result.ap = aps[i];
+    result.rssi = apRssi(aps[i]);
+    scanResults().push_back(result);
+  }
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+// Eventos: uma thread compara o estado emulado a cada 10 ms e dispara os callbacks,
+// como a task de eventos do core (assíncrona em relação ao loop())
+// ----------------------------------------------------------------------------
+
+struct SimEventHandler {
+  WiFiEventCb cb;
+  WiFiEventFuncCb funcCb;
+  arduino_event_id_t event;
+  bool active;
+};
+
+struct SimPendingEvent {
+  arduino_event_id_t event;
+  arduino_event_info_t info;
+};
+
+static std::recursive_mutex& wifiMutex() {
+  static std::recursive_mutex* mutex = new std::recursive_mutex();  // Nunca destruído: a thread roda até o exit
+  return *mutex;
+}
+
+static std::vector<SimEventHandler>& eventHandlers() {
+  static std::vector<SimEventHandler>* handlers = new std::vector<SimEventHandler>();
+  return *handlers;
+}
+
+static bool staLinkUp = false;        // GOT_IP já foi entregue
+static bool staFailReported = false;  // Tentativa com SIM_WIFI_FAIL_SSID já terminou
+static unsigned long staLinkUpMs = 0;
+static int pendingDisconnectReason = 0;  // disconnect()/simWiFiDrop() aguardando a thread
+static unsigned long staDhcpStartMs = 0;  // config() sem IP com o enlace no ar: DHCP em andamento (0 = nenhum)
+
+static void pushDisconnected(std::vector<SimPendingEvent>& out, uint8_t reason) {
+  SimPendingEvent pending;
+  memset(&pending, 0, sizeof(pending));
+  pending.event = ARDUINO_EVENT_WIFI_STA_DISCONNECTED;
+  wifi_event_sta_disconnected_t& info = pending.info.wifi_sta_disconnected;
+  info.ssid_len = (uint8_t)strlen(staSsid);
+  memcpy(info.ssid, staSsid, info.ssid_len);
+  if (staAp >= 0) memcpy(info.bssid, simAPs()[staAp].bssid, 6);
+  info.reason = reason;
+  out.push_back(pending);
+}
+
+static void pushGotIp(std::vector<SimPendingEvent>& out) {
+  SimPendingEvent pending;
+  memset(&pending, 0, sizeof(pending));
+  pending.event = ARDUINO_EVENT_WIFI_STA_GOT_IP;
+  IPAddress ip = staticIP != IPAddress() ? staticIP : IPAddress(127, 0, 0, 1);
+  pending.info.got_ip.ip_info.ip.addr = (uint32_t)ip;
+  pending.info.got_ip.ip_info.netmask.addr = (uint32_t)IPAddress(255, 0, 0, 0);
+  pending.info.got_ip.ip_info.gw.addr = (uint32_t)IPAddress(127, 0, 0, 1);
+  out.push_back(pending);
+}
+
+static void pushConnected(std::vector<SimPendingEvent>& out) {
+  SimPendingEvent pending;
+  memset(&pending, 0, sizeof(pending));
+  pending.event = ARDUINO_EVENT_WIFI_STA_CONNECTED;
+  wifi_event_sta_connected_t& info = pending.info.wifi_sta_connected;
+  info.ssid_len = (uint8_t)strlen(staSsid);
+  memcpy(info.ssid, staSsid, info.ssid_len);
+  memcpy(info.bssid, simAPs()[staAp].bssid, 6);
+  info.channel = (uint8_t)simAPs()[staAp].channel;
+  out.push_back(pending);
+  pushGotIp(out);
+}
+
+static void collectEvents(std::vector<SimPendingEvent>& out) {
+  std::lock_guard<std::recursive_mutex> lock(wifiMutex());
+  unsigned long now = millis();
+  if (finishScanIfDue()) {
+    SimPendingEvent pending;
+    memset(&pending, 0, sizeof(pending));
+    pending.event = ARDUINO_EVENT_WIFI_SCAN_DONE;
+    out.push_back(pending);
+  }
+  if (pendingDisconnectReason) {
+    pushDisconnected(out, (uint8_t)pendingDisconnectReason);
+    pendingDisconnectReason = 0;
+    staLinkUp = false;
+  }
+  if (!staRequested) return;
+  if (staFailing) {
+    if (!staFailReported && now - staBeginMs > 3000) {
+      staFailReported = true;
+      pushDisconnected(out, WIFI_REASON_NO_AP_FOUND);
+    }
+    return;
+  }
+  if (!staLinkUp && now - staBeginMs >= staConnectMs) {
+    staLinkUp = true;
+    staLinkUpMs = now;
+    staDhcpStartMs = 0;
+    pushConnected(out);
+  } else if (staLinkUp && staDhcpStartMs && now - staDhcpStartMs >= simConfig().wifiDhcpMs) {
+    staDhcpStartMs = 0;
+    pushGotIp(out);
+  } else if (staLinkUp && simConfig().wifiDropMs && now - staLinkUpMs >= simConfig().wifiDropMs) {
+    staLinkUp = false;
+    staRequested = false;
+    pushDisconnected(out, WIFI_REASON_BEACON_TIMEOUT);
+  }
+}
+
+static void eventThread() {
+  std::vector<SimPendingEvent> pending;
+  for (;;) {
+    pending.clear();
+    collectEvents(pending);
+    for (size_t i = 0; i < pending.size(); i++) {
+      std::vector<SimEventHandler> handlers;
+      {
+        std::lock_guard<std::recursive_mutex> lock(wifiMutex());
+        handlers = eventHandlers();
+      }
+      for (size_t h = 0; h < handlers.size(); h++) {
+        const SimEventHandler& handler = handlers[h];
+        if (!handler.active) continue;
+        if (handler.event != ARDUINO_EVENT_MAX && handler.event != pending[i].event) continue;
+        if (handler.cb) handler.cb(pending[i].event);
+        if (handler.funcCb) handler.funcCb(pending[i].event, pending[i].info);
+      }
+    }
+    usleep(10000);
+  }
+}
+
+static void startEventThread() {
+  static bool started = false;
+  if (started) return;
+  started = true;
+  std::thread(eventThread).detach();
+}
+
+static wifi_event_id_t addHandler(WiFiEventCb cb, WiFiEventFuncCb funcCb, arduino_event_id_t event) {
+  std::lock_guard<std::recursive_mutex> lock(wifiMutex());
+  SimEventHandler handler;
+  handler.cb = cb;
+  handler.funcCb = funcCb;
+  handler.event = event;
+  handler.active = true;
+  eventHandlers().push_back(handler);
+  startEventThread();
+  return eventHandlers().size();
+}
+
+wifi_event_id_t WiFiClass::onEvent(WiFiEventCb cbEvent, arduino_event_id_t event) {
+  return addHandler(cbEvent, WiFiEventFuncCb(), event);
+}
+
+wifi_event_id_t WiFiClass::onEvent(WiFiEventFuncCb cbEvent, arduino_event_id_t event) {
+  return addHandler(nullptr, cbEvent, event);
+}
+
+void WiFiClass::removeEvent(wifi_event_id_t id) {
+  std::lock_guard<std::recursive_mutex> lock(wifiMutex());
+  if (id >= 1 && id <= eventHandlers().size()) eventHandlers()[id - 1].active = false;
+}
+
+void simWiFiDrop(uint8_t reason) {
+  std::lock_guard<std::recursive_mutex> lock(wifiMutex());
+  if (!staLinkUp) return;
+  staRequested = false;
+  pendingDisconnectReason = reason;
+}
+
+bool WiFiClass::mode(wifi_mode_t m) {
+  std::lock_guard<std::recursive_mutex> lock(wifiMutex());
+  currentMode = m;
+  if (m != WIFI_MODE_AP && m != WIFI_MODE_APSTA) apActive = false;
+  if (m != WIFI_MODE_STA && m != WIFI_MODE_APSTA) {
+    if (staLinkUp) pendingDisconnectReason = WIFI_REASON_ASSOC_LEAVE;
+    staRequested = false;
+  }
+  return true;
+}
+
+wifi_mode_t WiFiClass::getMode() {
+  return currentMode;
+}
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* passphrase, int32_t channel,
+                             const uint8_t* bssidHint, bool connect) {
+  (void)passphrase;
+  std::lock_guard<std::recursive_mutex> lock(wifiMutex());
+  startEventThread();
+  // Como no ESP32: uma associação ativa é desfeita (ASSOC_LEAVE) antes da nova tentativa
+  if (staLinkUp) pendingDisconnectReason = WIFI_REASON_ASSOC_LEAVE;
+  if (currentMode == WIFI_MODE_NULL) currentMode = WIFI_MODE_STA;
+  if (currentMode == WIFI_MODE_AP) currentMode = WIFI_MODE_APSTA;
+  strncpy(staSsid, ssid ? ssid : "", sizeof(staSsid) - 1);
+  staSsid[sizeof(staSsid) - 1] = '\0';
+  const char* failSsid = simConfig().wifiFailSsid;
+  staFailing = (staSsid[0] == '\0') || (failSsid && strcmp(failSsid, staSsid) == 0);
+  // Join direto (canal + BSSID) pula a varredura; só acha o AP se o cache estiver certo
+  staAp = findAp(staSsid, channel, bssidHint);
+  if (staAp < 0) staFailing = true;
+  uint32_t connectMs = simConfig().wifiConnectMs;
+  if (channel > 0 && bssidHint) {
+    connectMs = connectMs > simConfig().wifiScanMs ? connectMs - simConfig().wifiScanMs : 0;
+  }
+  // IP fixo pula o DHCP
+  if (staticIP != IPAddress()) {
+    connectMs = connectMs > simConfig().wifiDhcpMs ? connectMs - simConfig().wifiDhcpMs : 0;
+  }
+  staConnectMs = connectMs;
+  staRequested = connect;
+  staBeginMs = millis();
+  staFailReported = false;
+  return status();
+}
+
+bool WiFiClass::config(IPAddress localIP, IPAddress gateway, IPAddress subnet, IPAddress dns1,
+                       IPAddress dns2) {
+  (void)gateway;
+  (void)subnet;
+  (void)dns1;
+  (void)dns2;
+  std::lock_guard<std::recursive_mutex> lock(wifiMutex());
+  // Como no core: trocar o IP fixo por DHCP com o enlace no ar inicia o cliente DHCP, que entrega outro GOT_IP
+  if (staLinkUp && staticIP != IPAddress() && localIP == IPAddress()) {
+    staDhcpStartMs = millis();
+  }
+  staticIP = localIP;
+  return true;
+}
+
+bool WiFiClass::disconnect(bool wifioff, bool eraseap) {
+  (void)eraseap;
+  std::lock_guard<std::recursive_mutex> lock(wifiMutex());
+  if (staLinkUp) pendingDisconnectReason = WIFI_REASON_ASSOC_LEAVE;
+  staRequested = false;
+  if (wifioff) currentMode = apActive ? WIFI_MODE_AP : WIFI_MODE_NULL;
+  return true;
+}
+
+bool WiFiClass::reconnect() {
+  std::lock_guard<std::recursive_mutex> lock(wifiMutex());
+  if (staSsid[0] == '\0') return false;
+  staConnectMs = simConfig().wifiConnectMs;
+  startEventThread();
+  if (staLinkUp) pendingDisconnectReason = WIFI_REASON_ASSOC_LEAVE;
+  staRequested = true;
+  staBeginMs = millis();
+  staFailReported = false;
+  return true;
+}
+
+wl_status_t WiFiClass::status() {
+  std::lock_guard<std::recursive_mutex> lock(wifiMutex());
+  if (!staRequested) return WL_DISCONNECTED;
+  if (staFailing) return staFailReported ? WL_NO_SSID_AVAIL : WL_DISCONNECTED;
+  // Só conectado depois que a thread de eventos entregou GOT_IP, como no core
+  return staLinkUp ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+IPAddress WiFiClass::localIP() {
+  if (status() != WL_CONNECTED) return IPAddress();
+  return staticIP != IPAddress() ? staticIP : IPAddress(127, 0, 0, 1);
+}
+
+IPAddress WiFiClass::gatewayIP() { return status() == WL_CONNECTED ? IPAddress(127, 0, 0, 1) : IPAddress(); }
+IPAddress WiFiClass::subnetMask() { return status() == WL_CONNECTED ? IPAddress(255, 0, 0, 0) : IPAddress(); }
+IPAddress WiFiClass::dnsIP(uint8_t index) { (void)index; return gatewayIP(); }
+String WiFiClass::macAddress() { return String("02:00:5E:10:00:02"); }
+uint8_t* WiFiClass::macAddress(uint8_t* mac) {
+  static const uint8_t STA_MAC[6] = {0x02, 0x00, 0x5E, 0x10, 0x00, 0x02};
+  memcpy(mac, STA_MAC, sizeof(STA_MAC));
+  return mac;
+}
+String WiFiClass::SSID() { return status() == WL_CONNECTED ? String(staSsid) : String(); }
+int8_t WiFiClass::RSSI() { return status() == WL_CONNECTED ? (int8_t)apRssi(simAPs()[staAp]) : 0; }
+uint8_t* WiFiClass::BSSID() { return status() == WL_CONNECTED ? simAPs()[staAp].bssid : nullptr; }
+int32_t WiFiClass::channel() { return status() == WL_CONNECTED ? simAPs()[staAp].channel : 0; }
+
+static String formatBssid(const uint8_t* bssid) {
+  char buf[18];
+  snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X", bssid[0], bssid[1], bssid[2], bssid[3], bssid[4], bssid[5]);
+  return String(buf);
+}
+
+String WiFiClass::BSSIDstr() { return status() == WL_CONNECTED ? formatBssid(simAPs()[staAp].bssid) : String(); }
+
+int16_t WiFiClass::scanNetworks(bool async, bool show_hidden, bool passive, uint32_t max_ms_per_chan, uint8_t channel) {
+  (void)show_hidden;
+  (void)passive;
+  (void)max_ms_per_chan;
+  (void)channel;
+  {
+    std::lock_guard<std::recursive_mutex> lock(wifiMutex());
+    if (scanRunning) return WIFI_SCAN_RUNNING;
+    if (currentMode == WIFI_MODE_NULL) currentMode = WIFI_MODE_STA;
+    if (currentMode == WIFI_MODE_AP) currentMode = WIFI_MODE_APSTA;
+    startEventThread();
+    scanRunning = true;
+    scanHasResults = false;
+    scanStartedMs = millis();
+    if (async) return WIFI_SCAN_RUNNING;
+  }
+  usleep((useconds_t)simConfig().wifiScanMs * 1000);
+  return scanComplete();
+}
+
+int16_t WiFiClass::scanComplete() {
+  std::lock_guard<std::recursive_mutex> lock(wifiMutex());
+  finishScanIfDue();
+  if (scanRunning) return WIFI_SCAN_RUNNING;
+  return scanHasResults ? (int16_t)scanResults().size() : WIFI_SCAN_FAILED;
+}
+
+void WiFiClass::scanDelete() {
+  std::lock_guard<std::recursive_mutex> lock(wifiMutex());
+  scanHasResults = false;
+  scanResults().clear();
+}
+
+static const SimScanResult* scanItem(uint8_t index) {
+  return (scanHasResults && index < scanResults().size()) ? &scanResults()[index] : nullptr;
+}
+
+String WiFiClass::SSID(uint8_t networkItem) {
+  std::lock_guard<std::recursive_mutex> lock(wifiMutex());
+  const SimScanResult* item = scanItem(networkItem);
+  return item ? String(item->ap.ssid) : String();
+}
+
+int32_t WiFiClass::RSSI(uint8_t networkItem) {
+  std::lock_guard<std::recursive_mutex> lock(wifiMutex());
+  const SimScanResult* item = scanItem(networkItem);
+  return item ? item->rssi : 0;
+}
+
+uint8_t* WiFiClass::BSSID(uint8_t networkItem) {
+  std::lock_guard<std::recursive_mutex> lock(wifiMutex());
+  const SimScanResult* item = scanItem(networkItem);
+  return item ? const_cast<uint8_t*>(item->ap.bssid) : nullptr;
+}
+
+String WiFiClass::BSSIDstr(uint8_t networkItem) {
+  std::lock_guard<std::recursive_mutex> lock(wifiMutex());
+  const SimScanResult* item = scanItem(networkItem);
+  return item ? formatBssid(item->ap.bssid) : String();
+}
+
+int32_t WiFiClass::channel(uint8_t networkItem) {
+  std::lock_guard<std::recursive_mutex> lock(wifiMutex());
+  const SimScanResult* item = scanItem(networkItem);
+  return item ? item->ap.channel : 0;
+}
+
+wifi_auth_mode_t WiFiClass::encryptionType(uint8_t networkItem) {
+  std::lock_guard<std::recursive_mutex> lock(wifiMutex());
+  return scanItem(networkItem) ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN;
+}
+
+// esp_wifi.h: o AP emulado é sempre 802.11n HT20
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t* ap_info) {
+  std::lock_guard<std::recursive_mutex> lock(wifiMutex());
+  if (!ap_info || !staLinkUp || staAp < 0) return ESP_FAIL;
+  const SimAP& ap = simAPs()[staAp];
+  memset(ap_info, 0, sizeof(*ap_info));
+  memcpy(ap_info->bssid, ap.bssid, 6);
+  strncpy((char*)ap_info->ssid, staSsid, sizeof(ap_info->ssid) - 1);
+  ap_info->primary = (uint8_t)ap.channel;
+  ap_info->rssi = (int8_t)apRssi(ap);
+  ap_info->authmode = WIFI_AUTH_WPA2_PSK;
+  ap_info->phy_11b = 1;
+  ap_info->phy_11g = 1;
+  ap_info->phy_11n = 1;
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_bandwidth(wifi_interface_t ifx, wifi_bandwidth_t* bw) {
+  (void)ifx;
+  if (!bw) return ESP_ERR_INVALID_ARG;
+  *bw = WIFI_BW_HT20;
+  return ESP_OK;
+}
+
+bool WiFiClass::softAP(const char* ssid, const char* passphrase, int channel, int ssidHidden,
+                       int maxConnection) {
+  (void)ssid;
+  (void)passphrase;
+  (void)channel;
+  (void)ssidHidden;
+  (void)maxConnection;
+  if (currentMode == WIFI_MODE_NULL) currentMode = WIFI_MODE_AP;
+  if (currentMode == WIFI_MODE_STA) currentMode = WIFI_MODE_APSTA;
+  apActive = true;
+  return true;
+}
+
+bool WiFiClass::softAPConfig(IPAddress localIP, IPAddress gateway, IPAddress subnet) {
+  (void)localIP;
+  (void)gateway;
+  (void)subnet;
+  return apActive;
+}
+
+bool WiFiClass::softAPdisconnect(bool wifioff) {
+  apActive = false;
+  if (currentMode == WIFI_MODE_APSTA) currentMode = WIFI_MODE_STA;
+  else if (currentMode == WIFI_MODE_AP || wifioff) currentMode = WIFI_MODE_NULL;
+  return true;
+}
+
+IPAddress WiFiClass::softAPIP() { return apActive ? IPAddress(192, 168, 4, 1) : IPAddress(); }
+String WiFiClass::softAPmacAddress() { return String("02:00:5E:10:00:03"); }
+uint8_t WiFiClass::softAPgetStationNum() { return 0; }
@@ -0,0 +1,76 @@
+// Simulação host: WiFiUDP sobre um socket UDP real, não bloqueante
+#include <WiFiUdp.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+uint8_t WiFiUDP::begin(uint16_t port) {
+  stop();
+  port = (uint16_t)(port + simConfig().udpPortOffset);
+  fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd_ < 0) {
+    perror("sim: socket udp");
+    return 0;
+  }
+  int yes = 1;
+  setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(fd_, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    perror("sim: bind udp");
+    ::close(fd_);
+    fd_ = -1;
+    return 0;
+  }
+  fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL, 0) | O_NONBLOCK);
+  fprintf(stderr, "sim: WiFiUDP escutando em udp://127.0.0.1:%u\n", port);
+  return 1;
+}
+
+void WiFiUDP::stop() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+  length_ = offset_ = 0;
+}
+
+int WiFiUDP::parsePacket() {
+  length_ = offset_ = 0;
+  if (fd_ < 0) {
+    return 0;
+  }
+  struct sockaddr_in from;
+  socklen_t fromLength = sizeof(from);
+  ssize_t received = recvfrom(fd_, packet_, sizeof(packet_), 0, (struct sockaddr*)&from, &fromLength);
+  if (received <= 0) {
+    return 0;  // EAGAIN: nada pendente
+  }
+  length_ = (size_t)received;
+  remoteIP_ = IPAddress((uint32_t)from.sin_addr.s_addr);
+  remotePort_ = ntohs(from.sin_port);
+  return (int)length_;
+}
+
+int WiFiUDP::read() {
+  return offset_ < length_ ? packet_[offset_++] : -1;
+}
+
+int WiFiUDP::read(uint8_t* buffer, size_t size) {
+  size_t count = length_ - offset_;
+  if (count > size) {
+    count = size;
+  }
+  memcpy(buffer, packet_ + offset_, count);
+  offset_ += count;
+  return (int)count;
+}
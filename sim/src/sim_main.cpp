@@ -0,0 +1,141 @@
+// Simulação host: ponto de entrada que roda setup()/loop() do firmware sem alterações
+#include <Arduino.h>
+#include <Preferences.h>
+#include <WebServer.h>
+
+#include <signal.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+void setup();
+void loop();
+
+static SimConfig config;
+static bool restartRequested = false;
+
+SimConfig& simConfig() {
+  return config;
+}
+
+static const char* envString(const char* name, const char* fallback) {
+  const char* value = getenv(name);
+  return (value && value[0]) ? value : fallback;
+}
+
+static long envLong(const char* name, long fallback) {
+  const char* value = getenv(name);
+  return (value && value[0]) ? strtol(value, nullptr, 10) : fallback;
+}
+
+void simLoadConfigFromEnv() {
+  config.httpPort = (int)envLong("SIM_HTTP_PORT", 8080);
+  config.udpPortOffset = (int)envLong("SIM_UDP_PORT_OFFSET", 0);
+  config.serialEnabled = envLong("SIM_SERIAL", 1) != 0;
+  config.serialBaud = (uint32_t)envLong("SIM_SERIAL_BAUD", 0);
+  config.heapSize = (size_t)envLong("SIM_HEAP_SIZE", 200 * 1024);
+  config.heapBaseline = 0;
+  config.resetReason = (esp_reset_reason_t)envLong("SIM_RESET_REASON", ESP_RST_POWERON);
+  config.nvsFile = envString("SIM_NVS_FILE", "sim_nvs.txt");
+  config.nvsRealtime = envLong("SIM_NVS_REALTIME", 0) != 0;
+  config.irTxLog = envString("SIM_IR_TX_LOG", nullptr);
+  config.irRxFile = envString("SIM_IR_RX_FILE", nullptr);
+  config.irLoopback = envLong("SIM_IR_LOOPBACK", 0) != 0;
+  config.irRealtime = envLong("SIM_IR_REALTIME", 1) != 0;
+  config.wifiFailSsid = envString("SIM_WIFI_FAIL_SSID", nullptr);
+  config.wifiConnectMs = (uint32_t)envLong("SIM_WIFI_CONNECT_MS", 1500);
+  config.wifiScanMs = (uint32_t)envLong("SIM_WIFI_SCAN_MS", 900);
+  config.wifiDhcpMs = (uint32_t)envLong("SIM_WIFI_DHCP_MS", 400);
+  config.wifiChannel = (int32_t)envLong("SIM_WIFI_CHANNEL", 6);
+  config.wifiNetworks = envString("SIM_WIFI_NETWORKS", nullptr);
+  config.wifiDropMs = (uint32_t)envLong("SIM_WIFI_DROP_MS", 0);
+  config.traceFile = envString("SIM_TRACE_FILE", nullptr);
+  config.pmLightSleep = envLong("SIM_PM_LIGHT_SLEEP", 1) != 0;
+  config.buttonEvents = envString("SIM_BUTTON_EVENTS", nullptr);
+  config.buttonPin = (uint8_t)envLong("SIM_BUTTON_PIN", 32);
+  config.buttonBounce = (int)envLong("SIM_BUTTON_BOUNCE", 0);
+}
+
+void simRequestRestart() {
+  restartRequested = true;
+}
+
+bool simRestartRequested() {
+  return restartRequested;
+}
+
+#ifndef SIM_NO_MAIN
+// O bench (SIM_NO_MAIN) tem o próprio main(): estes auxiliares só existem no executável do simulador
+static volatile sig_atomic_t stopRequested = 0;
+
+// Toques no botão a partir do boot: nível LOW em inicio_ms, HIGH em inicio_ms + duracao_ms
+// Transição com repique de contato: alterna o nível a cada 300 µs e termina em `level`
+static void scheduleButtonLevel(uint8_t level, uint64_t atUs) {
+  for (int i = config.buttonBounce; i > 0; i--) {
+    simSchedulePinLevel(config.buttonPin, level, atUs);
+    simSchedulePinLevel(config.buttonPin, level == LOW ? HIGH : LOW, atUs + 150);
+    atUs += 300;
+  }
+  simSchedulePinLevel(config.buttonPin, level, atUs);
+}
+
+static void scheduleButtonEvents() {
+  if (!config.buttonEvents) return;
+  char buffer[512];
+  strncpy(buffer, config.buttonEvents, sizeof(buffer) - 1);
+  buffer[sizeof(buffer) - 1] = '\0';
+  char* save = nullptr;
+  for (char* item = strtok_r(buffer, ",", &save); item; item = strtok_r(nullptr, ",", &save)) {
+    char* duration = strchr(item, ':');
+    uint64_t startUs = strtoull(item, nullptr, 10) * 1000ULL;
+    uint64_t durationUs = (duration ? strtoull(duration + 1, nullptr, 10) : 100) * 1000ULL;
+    scheduleButtonLevel(LOW, startUs);
+    scheduleButtonLevel(HIGH, startUs + durationUs);
+  }
+}
+
+// Grava os spans do firmware (GET /api/trace?format=chrome) para abrir no Perfetto/chrome://tracing
+static void exportTrace() {
+  WebServer* server = WebServer::simInstance();
+  if (!config.traceFile || !server) return;
+  String response;
+  if (server->simRequest(HTTP_GET, "/api/trace?format=chrome", nullptr, &response) != 200) return;
+  const char* json = strstr(response.c_str(), "\r\n\r\n");  // simRequest devolve cabeçalhos + corpo
+  if (!json) return;
+  json += 4;
+  FILE* f = fopen(config.traceFile, "w");
+  if (!f) return;
+  fputs(json, f);
+  fclose(f);
+  fprintf(stderr, "sim: trace exportado em %s\n", config.traceFile);
+}
+
+static void onSignal(int) {
+  stopRequested = 1;
+}
+
+int main() {
+  simLoadConfigFromEnv();
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  signal(SIGPIPE, SIG_IGN);
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+
+  setup();
+  scheduleButtonEvents();
+  unsigned long lastFlush = millis();
+  while (!stopRequested && !restartRequested) {
+    loop();
+    if (millis() - lastFlush > 1000) {
+      Preferences::simFlushToFile();
+      lastFlush = millis();
+    }
+  }
+  Preferences::simFlushToFile();
+  exportTrace();
+  fprintf(stderr, "\nsim: encerrado%s\n", restartRequested ? " (ESP.restart)" : "");
+  // Threads destacadas (GPIO, tasks) seguem esperando em condvars estáticas: sem destrutores globais
+  fflush(nullptr);
+  _exit(0);
+}
+#endif
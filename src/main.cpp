@@ -1,8 +1,16 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <WebServer.h>
+#include <WiFiUdp.h>
 #include <Preferences.h>
 #include <ArduinoJson.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_wifi.h>
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <driver/gpio.h>
+#include <hal/gpio_ll.h>
 
 // ============================================================================
 // CONFIGURAÇÕES
@@ -26,6 +34,12 @@ const int BUTTON_LEARNING = 32;
 
 // Constantes de validação
 const int MAX_CODES = 50;
+const int CODE_SIGNATURE_SLOTS = 128;  // Potência de 2, ≥ 2 × MAX_CODES (carga ≤ 50%)
+// Bytes para os quadros longos (ar-condicionado) de todos os códigos, em cada cópia do armazenamento.
+// Cada código ocupa só o que o seu quadro usa: ~50 bytes para 280 bits.
+#ifndef CODE_PAYLOAD_POOL_SIZE
+#define CODE_PAYLOAD_POOL_SIZE 2048
+#endif
 const int MAX_SSID_LENGTH = 32;
 const int MAX_PASSWORD_LENGTH = 64;
 const int MAX_DEVICE_NAME = 19;
@@ -33,13 +47,20 @@ const int MAX_BUTTON_NAME = 29;
 
 // Define o pino de envio IR antes de incluir a biblioteca
 #define IR_SEND_PIN IR_EMITTER_PIN
+// Quadros de estado de ar-condicionado passam de 200 marcas/espaços (padrão do IRremote):
+// 750 cobre até 384 bits em decodedRawDataArray
+#ifndef RAW_BUFFER_LENGTH
+#define RAW_BUFFER_LENGTH 750
+#endif
 #include <IRremote.hpp>
 
 // ============================================================================
 // STRUCTS E VARIÁVEIS GLOBAIS
 // ============================================================================
 
-// Enum de protocolos IR suportados
+// Protocolos IR. O valor é o que fica gravado em "protocolN" no Preferences e no NDJSON de backup
+// vai pelo nome: nunca renumerar nem reaproveitar um valor; protocolo novo pega o próximo livre e
+// ganha uma linha em IR_PROTOCOLS (logo abaixo)
 enum IRProtocol {
   PROTOCOL_UNKNOWN = 0,
   PROTOCOL_NEC = 1,
@@ -50,6 +71,23 @@ enum IRProtocol {
   PROTOCOL_PANASONIC = 6,
   PROTOCOL_LG = 7,
   PROTOCOL_BOSE = 8,  // BoseWave protocol
+  PROTOCOL_DENON = 9,
+  PROTOCOL_JVC = 10,
+  PROTOCOL_SHARP = 11,
+  PROTOCOL_KASEIKYO_DENON = 12,
+  PROTOCOL_KASEIKYO_SHARP = 13,
+  PROTOCOL_KASEIKYO_JVC = 14,
+  PROTOCOL_KASEIKYO_MITSUBISHI = 15,
+  PROTOCOL_NEC2 = 16,
+  PROTOCOL_APPLE = 17,
+  PROTOCOL_ONKYO = 18,
+  PROTOCOL_LG2 = 19,
+  PROTOCOL_SAMSUNG_LG = 20,
+  PROTOCOL_SAMSUNG48 = 21,
+  PROTOCOL_WHYNTER = 22,
+  PROTOCOL_FAST = 23,
+  PROTOCOL_PULSE_DISTANCE = 24,  // Quadro longo genérico (ar-condicionado), em IRPayload
+  PROTOCOL_PULSE_WIDTH = 25,
   PROTOCOL_RAW = 99   // Para protocolos não suportados
 };
 
@@ -62,579 +100,4115 @@ struct IRCode {
   uint16_t address;     // Address (para protocolos que usam)
   uint16_t command;     // Command (para protocolos que usam)
   uint8_t repeats;      // Número de repetições (padrão: 0)
+  uint16_t payload;     // Quadro longo: posição + 1 em CodeStoreData.payloads (0 = sem)
 };
 
-IRCode storedCodes[MAX_CODES];
-int codeCount = 0;
+// Quadro longo (PULSE_DISTANCE/PULSE_WIDTH do IRremote): tempos medidos e os bits de
+// decodedRawDataArray. No armazenamento vai só o cabeçalho + os (bits + 7) / 8 bytes usados.
+const int IR_PAYLOAD_MAX_BYTES = RAW_DATA_ARRAY_SIZE * sizeof(IRDecodedRawDataType);
+
+struct IRPayload {
+  uint16_t bits;
+  uint8_t flags;                          // IRDATA_FLAGS_IS_MSB_FIRST
+  uint8_t reserved;
+  DistanceWidthTimingInfoStruct timing;
+  uint8_t data[IR_PAYLOAD_MAX_BYTES];
+};
+
+const int IR_PAYLOAD_HEADER_SIZE = offsetof(IRPayload, data);
+
+uint16_t irPayloadSize(const IRPayload& payload) {
+  return IR_PAYLOAD_HEADER_SIZE + (payload.bits + 7) / 8;
+}
+
+// Registro de protocolos IR: o único lugar que liga o valor gravado ao nome, ao tipo decodificado
+// pelo IrReceiver e ao codificador do IrSender. Nome, detecção, extração de address/command, envio
+// e slots de telemetria saem desta tabela.
+enum IRCodeFields {
+  IR_FIELDS_ADDRESS_COMMAND,  // address + command identificam o código
+  IR_FIELDS_COMMAND,          // Sem address no quadro (gravado como 0)
+  IR_FIELDS_VALUE,            // Só o valor cru identifica o código (address/command informativos)
+  IR_FIELDS_PAYLOAD           // Quadro longo em IRPayload; address/command guardam o hash dele
+};
+
+struct IRProtocolInfo {
+  IRProtocol protocol;
+  const char* name;        // API, logs e NDJSON de backup
+  decode_type_t decoded;   // Tipo entregue pelo IrReceiver (UNKNOWN = nenhum)
+  IRCodeFields fields;
+  uint8_t minRepeats;      // Repetições mínimas no envio
+  void (*send)(const IRCode& code, uint8_t repeats);  // NULL = sem codificador
+  uint8_t repeatPeriodMs;  // Botão segurado: de início a início de quadro (0 = não repete)
+  void (*sendHold)(const IRCode& code, bool first);   // Quadros do botão segurado (NULL = quadro inteiro)
+};
+
+void sendNecCode(const IRCode& code, uint8_t repeats) { IrSender.sendNEC(code.address, code.command, repeats); }
+void sendSamsungCode(const IRCode& code, uint8_t repeats) { IrSender.sendSamsung(code.address, code.command, repeats); }
+void sendSonyCode(const IRCode& code, uint8_t repeats) {
+  IrSender.sendSony(code.address, code.command, repeats, code.bits);  // bits: 12, 15 ou 20
+}
+void sendRc5Code(const IRCode& code, uint8_t repeats) { IrSender.sendRC5(code.address, code.command, repeats); }
+void sendRc6Code(const IRCode& code, uint8_t repeats) { IrSender.sendRC6(code.address, code.command, repeats); }
+void sendPanasonicCode(const IRCode& code, uint8_t repeats) { IrSender.sendPanasonic(code.address, code.command, repeats); }
+void sendLgCode(const IRCode& code, uint8_t repeats) { IrSender.sendLG(code.address, code.command, repeats); }
+void sendBoseCode(const IRCode& code, uint8_t repeats) { IrSender.sendBoseWave((uint8_t)code.command, repeats); }
+void sendDenonCode(const IRCode& code, uint8_t repeats) { IrSender.sendDenon(code.address, code.command, repeats); }
+void sendJvcCode(const IRCode& code, uint8_t repeats) { IrSender.sendJVC(code.address, code.command, repeats); }
+void sendSharpCode(const IRCode& code, uint8_t repeats) { IrSender.sendSharp(code.address, code.command, repeats); }
+void sendKaseikyoDenonCode(const IRCode& code, uint8_t repeats) {
+  IrSender.sendKaseikyo_Denon(code.address, code.command, repeats);
+}
+void sendKaseikyoSharpCode(const IRCode& code, uint8_t repeats) {
+  IrSender.sendKaseikyo_Sharp(code.address, code.command, repeats);
+}
+void sendKaseikyoJvcCode(const IRCode& code, uint8_t repeats) {
+  IrSender.sendKaseikyo_JVC(code.address, code.command, repeats);
+}
+void sendKaseikyoMitsubishiCode(const IRCode& code, uint8_t repeats) {
+  IrSender.sendKaseikyo_Mitsubishi(code.address, code.command, repeats);
+}
+void sendNec2Code(const IRCode& code, uint8_t repeats) { IrSender.sendNEC2(code.address, code.command, repeats); }
+void sendAppleCode(const IRCode& code, uint8_t repeats) { IrSender.sendApple(code.address, code.command, repeats); }
+void sendOnkyoCode(const IRCode& code, uint8_t repeats) { IrSender.sendOnkyo(code.address, code.command, repeats); }
+void sendLg2Code(const IRCode& code, uint8_t repeats) { IrSender.sendLG2(code.address, code.command, repeats); }
+void sendSamsungLgCode(const IRCode& code, uint8_t repeats) { IrSender.sendSamsungLG(code.address, code.command, repeats); }
+void sendSamsung48Code(const IRCode& code, uint8_t repeats) { IrSender.sendSamsung48(code.address, code.command, repeats); }
+void sendWhynterCode(const IRCode& code, uint8_t repeats) {
+  for (uint8_t i = 0; i <= repeats; i++) {  // sendWhynter() não repete sozinho
+    IrSender.sendWhynter((uint32_t)code.code, code.bits);
+  }
+}
+void sendFastCode(const IRCode& code, uint8_t repeats) { IrSender.sendFAST((uint8_t)code.command, repeats); }
+
+// Botão segurado: depois do quadro inicial vem o quadro curto de repetição do controle original
+void holdNecFrame(const IRCode& code, bool first) {
+  if (first) {
+    sendNecCode(code, 0);
+  } else {
+    IrSender.sendNECRepeat();
+  }
+}
+void holdAppleFrame(const IRCode& code, bool first) {
+  if (first) {
+    sendAppleCode(code, 0);
+  } else {
+    IrSender.sendNECRepeat();
+  }
+}
+void holdOnkyoFrame(const IRCode& code, bool first) {
+  if (first) {
+    sendOnkyoCode(code, 0);
+  } else {
+    IrSender.sendNECRepeat();
+  }
+}
+void holdLgFrame(const IRCode& code, bool first) {
+  if (first) {
+    sendLgCode(code, 0);
+  } else {
+    IrSender.sendLGRepeat();
+  }
+}
+void holdSamsungLgFrame(const IRCode& code, bool first) {
+  if (first) {
+    sendSamsungLgCode(code, 0);
+  } else {
+    IrSender.sendSamsungLGRepeat();
+  }
+}
+// RC5/RC6: o aparelho separa tecla nova de tecla segurada pelo bit de toggle, que não pode mudar
+// durante a sessão. O IrSender só alterna o toggle ou o manda zerado, então a sessão inteira sai zerada.
+void holdRc5Frame(const IRCode& code, bool first) {
+  (void)first;
+  IrSender.sendRC5(code.address, code.command, 0, false);
+}
+void holdRc6Frame(const IRCode& code, bool first) {
+  (void)first;
+  IrSender.sendRC6(code.address, code.command, 0, false);
+}
+
+// repeatPeriodMs: o REPEAT_PERIOD de cada protocolo no IRremote (controle original com a tecla apertada)
+const IRProtocolInfo IR_PROTOCOLS[] = {
+  {PROTOCOL_UNKNOWN, "Desconhecido", UNKNOWN, IR_FIELDS_VALUE, 0, NULL, 0, NULL},
+  {PROTOCOL_NEC, "NEC", NEC, IR_FIELDS_ADDRESS_COMMAND, 0, sendNecCode, 110, holdNecFrame},
+  {PROTOCOL_SAMSUNG, "Samsung", SAMSUNG, IR_FIELDS_ADDRESS_COMMAND, 1, sendSamsungCode, 110, NULL},  // Só responde com repetição
+  {PROTOCOL_SONY, "Sony", SONY, IR_FIELDS_ADDRESS_COMMAND, 0, sendSonyCode, 45, NULL},
+  {PROTOCOL_RC5, "RC5", RC5, IR_FIELDS_ADDRESS_COMMAND, 0, sendRc5Code, 114, holdRc5Frame},
+  {PROTOCOL_RC6, "RC6", RC6, IR_FIELDS_ADDRESS_COMMAND, 0, sendRc6Code, 107, holdRc6Frame},
+  {PROTOCOL_PANASONIC, "Panasonic", PANASONIC, IR_FIELDS_ADDRESS_COMMAND, 0, sendPanasonicCode, 130, NULL},
+  {PROTOCOL_LG, "LG", LG, IR_FIELDS_ADDRESS_COMMAND, 0, sendLgCode, 110, holdLgFrame},
+  {PROTOCOL_BOSE, "Bose", BOSEWAVE, IR_FIELDS_COMMAND, 0, sendBoseCode, 75, NULL},
+  {PROTOCOL_DENON, "Denon", DENON, IR_FIELDS_ADDRESS_COMMAND, 0, sendDenonCode, 110, NULL},
+  {PROTOCOL_JVC, "JVC", JVC, IR_FIELDS_ADDRESS_COMMAND, 0, sendJvcCode, 55, NULL},  // Sem API do quadro curto
+  {PROTOCOL_SHARP, "Sharp", SHARP, IR_FIELDS_ADDRESS_COMMAND, 0, sendSharpCode, 110, NULL},
+  {PROTOCOL_KASEIKYO_DENON, "Kaseikyo-Denon", KASEIKYO_DENON, IR_FIELDS_ADDRESS_COMMAND, 0, sendKaseikyoDenonCode,
+   130, NULL},
+  {PROTOCOL_KASEIKYO_SHARP, "Kaseikyo-Sharp", KASEIKYO_SHARP, IR_FIELDS_ADDRESS_COMMAND, 0, sendKaseikyoSharpCode,
+   130, NULL},
+  {PROTOCOL_KASEIKYO_JVC, "Kaseikyo-JVC", KASEIKYO_JVC, IR_FIELDS_ADDRESS_COMMAND, 0, sendKaseikyoJvcCode,
+   130, NULL},
+  {PROTOCOL_KASEIKYO_MITSUBISHI, "Kaseikyo-Mitsubishi", KASEIKYO_MITSUBISHI, IR_FIELDS_ADDRESS_COMMAND, 0,
+   sendKaseikyoMitsubishiCode, 130, NULL},
+  {PROTOCOL_NEC2, "NEC2", NEC2, IR_FIELDS_ADDRESS_COMMAND, 0, sendNec2Code, 110, NULL},
+  {PROTOCOL_APPLE, "Apple", APPLE, IR_FIELDS_ADDRESS_COMMAND, 0, sendAppleCode, 110, holdAppleFrame},
+  {PROTOCOL_ONKYO, "Onkyo", ONKYO, IR_FIELDS_ADDRESS_COMMAND, 0, sendOnkyoCode, 110, holdOnkyoFrame},
+  {PROTOCOL_LG2, "LG2", LG2, IR_FIELDS_ADDRESS_COMMAND, 0, sendLg2Code, 110, NULL},
+  {PROTOCOL_SAMSUNG_LG, "SamsungLG", SAMSUNGLG, IR_FIELDS_ADDRESS_COMMAND, 0, sendSamsungLgCode, 110, holdSamsungLgFrame},
+  {PROTOCOL_SAMSUNG48, "Samsung48", SAMSUNG48, IR_FIELDS_ADDRESS_COMMAND, 0, sendSamsung48Code, 110, NULL},
+  {PROTOCOL_WHYNTER, "Whynter", WHYNTER, IR_FIELDS_VALUE, 0, sendWhynterCode, 0, NULL},  // Ar-condicionado
+  {PROTOCOL_FAST, "FAST", FAST, IR_FIELDS_COMMAND, 0, sendFastCode, 50, NULL},
+  {PROTOCOL_PULSE_DISTANCE, "PulseDistance", PULSE_DISTANCE, IR_FIELDS_PAYLOAD, 0, NULL, 0, NULL},  // sendIRPayload()
+  {PROTOCOL_PULSE_WIDTH, "PulseWidth", PULSE_WIDTH, IR_FIELDS_PAYLOAD, 0, NULL, 0, NULL},
+  {PROTOCOL_RAW, "RAW", UNKNOWN, IR_FIELDS_VALUE, 0, NULL, 0, NULL},  // Sem tempos gravados: não há o que emitir
+};
+
+// Slots de telemetria por protocolo: um por linha de IR_PROTOCOLS, na mesma ordem
+const int PROTOCOL_SLOTS = sizeof(IR_PROTOCOLS) / sizeof(IR_PROTOCOLS[0]);
+
+// Slot (índice em IR_PROTOCOLS) do protocolo; valores gravados que esta versão não conhece caem
+// no slot 0 (desconhecido), mas o valor em si é preservado no Preferences
+int protocolSlot(IRProtocol protocol) {
+  for (int slot = 0; slot < PROTOCOL_SLOTS; slot++) {
+    if (IR_PROTOCOLS[slot].protocol == protocol) {
+      return slot;
+    }
+  }
+  return 0;
+}
+
+const IRProtocolInfo& protocolInfo(IRProtocol protocol) {
+  return IR_PROTOCOLS[protocolSlot(protocol)];
+}
+
+bool isProtocolRegistered(IRProtocol protocol) {
+  return protocol == PROTOCOL_UNKNOWN || protocolSlot(protocol) != 0;
+}
+
+// Códigos gravados, em duas cópias (Left-Right: um RCU sem alocação). Leitores não esperam nem pegam
+// mutex: registram-se no contador da vez e leem a cópia publicada, que não muda enquanto houver leitor.
+// Escritores são serializados pelo mutex, alteram a outra cópia, publicam e esperam os leitores da
+// antiga saírem antes de sincronizá-la. Acesso só por CodeStoreReader/CodeStoreWriter.
+struct CodeStoreData {
+  IRCode codes[MAX_CODES];
+  int count;
+  // Índice de assinaturas (protocolo, address, command, bits) para achar duplicatas em O(1):
+  // endereçamento aberto com sondagem linear, id + 1 por posição (0 = vazia). Refeito a cada publicação.
+  uint8_t signatures[CODE_SIGNATURE_SLOTS];
+  // Registros IRPayload de tamanho variável, um atrás do outro na ordem dos ids; remover um código
+  // compacta os seguintes. Sem alinhamento: ler e gravar só com memcpy.
+  uint8_t payloads[CODE_PAYLOAD_POOL_SIZE];
+  uint16_t payloadUsed;
+};
+
+struct CodeStore {
+  CodeStoreData sides[2];
+  uint8_t readSide;            // Cópia publicada
+  uint8_t readerSlot;          // Contador em que novos leitores se registram
+  uint32_t readers[2];
+  SemaphoreHandle_t writeLock;
+  uint32_t version;            // Publicações desde o boot
+  uint32_t writerWaits;        // Publicações que esperaram leitores
+  uint32_t writerWaitMaxUs;
+  uint32_t duplicates;         // learn/save que achou a mesma assinatura
+};
+
+CodeStore codeStore;
 
 WebServer server(80);
+WiFiUDP holdUdp;        // Botão segurado sem HTTP (IR_HOLD_UDP_PORT)
 Preferences prefs;
 Preferences wifiPrefs;  // Namespace separado para credenciais WiFi
 
 // Variáveis para gerenciamento WiFi
-bool wifiConfigured = false;
-unsigned long lastWiFiCheck = 0;
-const unsigned long WIFI_CHECK_INTERVAL = 30000;  // Verificar a cada 30 segundos
+bool wifiConfigured = false;  // Há ao menos uma rede salva
+
+// Máquina de estados da STA: conexão e reconexão assíncronas, guiadas por eventos do WiFi
+enum WiFiState {
+  WIFI_STATE_IDLE = 0,    // Sem credenciais, só o AP de configuração
+  WIFI_STATE_SCANNING,    // Varredura assíncrona para escolher a rede
+  WIFI_STATE_CONNECTING,  // WiFi.begin() chamado, aguardando GOT_IP ou falha
+  WIFI_STATE_CONNECTED,
+  WIFI_STATE_BACKOFF      // Falhou, aguardando nextAttemptMs
+};
+
+const unsigned long WIFI_CONNECT_TIMEOUT_MS = 20000;
+const unsigned long WIFI_FAST_JOIN_TIMEOUT_MS = 5000;  // Join direto falha rápido se o AP mudou de canal
+const uint32_t WIFI_BACKOFF_MIN_MS = 2000;
+const uint32_t WIFI_BACKOFF_MAX_MS = 60000;
+// O IP em cache só é reaproveitado dentro desta janela após o último DHCP, para não subir o enlace
+// com um lease que o roteador já pode ter entregue a outro; depois de associado o DHCP renova o lease
+const unsigned long WIFI_LEASE_REUSE_MS = 3600000;
+const unsigned long WIFI_SCAN_TIMEOUT_MS = 10000;
+
+// Várias redes salvas: a varredura escolhe a de maior prioridade entre as com sinal utilizável
+// (empate: a mais forte). Conectado, RSSI médio abaixo de WIFI_ROAM_RSSI_DBM dispara uma
+// varredura em segundo plano e troca de AP se outro conhecido estiver bem mais forte.
+const int WIFI_MAX_NETWORKS = 5;
+const int WIFI_MIN_USABLE_RSSI_DBM = -80;
+const int WIFI_ROAM_RSSI_DBM = -75;
+const int WIFI_ROAM_MIN_GAIN_DB = 8;   // Histerese: evita ficar trocando entre dois APs parecidos
+const unsigned long WIFI_ROAM_SCAN_INTERVAL_MS = 120000;
+const unsigned long WIFI_RSSI_SAMPLE_MS = 5000;
+
+// Último enlace bom, gravado em "wifi-config"/"link": join direto (BSSID + canal, sem varredura)
+// e endereço sem esperar o DHCP. O IP só é reaproveitado na mesma sessão (leaseAtMs): sem relógio
+// que atravesse o reboot não há como saber se o lease gravado ainda vale.
+struct WiFiLinkCache {
+  uint8_t valid;
+  char ssid[MAX_SSID_LENGTH + 1];  // Rede do enlace: o cache só vale se ela ainda estiver salva
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+};
+
+// IP fixo opcional de cada rede (ip == 0 usa DHCP)
+struct WiFiStaticIP {
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+};
+
+// Rede salva, gravada como blob em "wifi-config"/"net0".."net4" (quantidade em "net_count")
+struct WiFiNetwork {
+  char ssid[MAX_SSID_LENGTH + 1];
+  char password[MAX_PASSWORD_LENGTH + 1];
+  uint8_t priority;  // Maior = preferida
+  WiFiStaticIP staticIp;
+};
+
+WiFiNetwork wifiNetworks[WIFI_MAX_NETWORKS];
+int wifiNetworkCount = 0;
+
+struct WiFiManager {
+  uint8_t state;
+  unsigned long stateSinceMs;
+  unsigned long nextAttemptMs;
+  uint32_t backoffMs;
+  uint16_t attempt;          // Tentativas desde a última conexão
+  uint8_t lastReason;        // wifi_err_reason_t da última falha/queda
+  uint32_t connects;
+  uint32_t disconnects;
+  uint32_t seenGotIp;        // Últimos valores de wifiEvents já tratados
+  uint32_t seenDisconnected;
+  int8_t network;            // Índice em wifiNetworks da tentativa/conexão atual (-1 = nenhuma)
+  uint8_t failedMask;        // Redes que já falharam nesta rodada de tentativas
+  WiFiLinkCache link;
+  bool fastJoin;             // Tentativa atual usa o cache (BSSID/canal)
+  bool fastJoinFailed;       // Join direto falhou: varredura completa até reconectar
+  bool leaseReused;          // Conexão atual subiu com o IP em cache; DHCP renovando o lease
+  unsigned long leaseAtMs;   // Último IP obtido por DHCP nesta sessão (0 = nenhum)
+  unsigned long droppedAtMs; // Início da queda em andamento (0 = nenhuma)
+  uint32_t reconnects;       // Quedas recuperadas
+  uint32_t lastReconnectMs;
+  uint32_t maxReconnectMs;
+  uint32_t totalReconnectMs;
+  bool lastReconnectFast;
+  uint32_t bootConnectMs;    // Uptime no primeiro GOT_IP do boot
+  // Qualidade do enlace e roaming
+  uint32_t attempts;         // Total de tentativas de associação
+  uint32_t failedAttempts;
+  float rssiAvg;             // Média móvel exponencial do RSSI da conexão atual
+  int8_t rssiMin;
+  unsigned long lastRssiSampleMs;
+  bool roamScan;             // Varredura em andamento é de roaming (STA segue conectada)
+  unsigned long scanStartedMs;
+  unsigned long lastRoamScanMs;
+  unsigned long roamStartedMs; // Troca de AP em andamento (0 = nenhuma)
+  uint32_t roams;
+  uint32_t lastRoamMs;       // Da saída do AP antigo ao GOT_IP no novo
+};
+
+// Escritos apenas pela task de eventos do WiFi
+struct WiFiEventCounters {
+  volatile uint32_t gotIp;
+  volatile uint32_t disconnected;
+  volatile uint8_t lastReason;
+};
+
+WiFiManager wifiManager;
+WiFiEventCounters wifiEvents;
+
+// AP de configuração sob demanda: sem credenciais, em falha da STA, numa janela após o boot,
+// por toque longo no botão ou via /api/wifi/ap. Com a STA conectada e o AP sem clientes,
+// ele fecha e o rádio fica só em STA (sem beacons de um AP aberto, canal livre).
+enum ConfigApReason {
+  CONFIG_AP_OFF = 0,
+  CONFIG_AP_NO_CREDENTIALS,
+  CONFIG_AP_STA_FAILURE,
+  CONFIG_AP_BOOT,
+  CONFIG_AP_BUTTON,
+  CONFIG_AP_API
+};
+
+const unsigned long CONFIG_AP_BOOT_WINDOW_MS = 60000;  // 0 desliga o AP no boot
+const unsigned long CONFIG_AP_WINDOW_MS = 600000;      // Toque longo / API
+const unsigned long CONFIG_AP_GRACE_MS = 30000;        // Após a STA conectar, para a página mostrar o resultado
+const unsigned long BUTTON_LONG_PRESS_MS = 5000;
+const unsigned long BUTTON_DEBOUNCE_MS = 50;
+const unsigned long BUTTON_DOUBLE_PRESS_MS = 350;  // Do soltar do 1º toque ao início do 2º
+
+struct ConfigAP {
+  uint8_t reason;
+  unsigned long openedAtMs;
+  unsigned long closeAtMs;   // Pode fechar a partir daqui (com STA conectada e sem clientes)
+  unsigned long lastCheckMs;
+  uint32_t opens;
+};
+
+ConfigAP configAp;
+
+// Última varredura WiFi (qualquer uma: conexão, roaming ou /api/wifi/scan), uma entrada por SSID
+// com o AP mais forte, ordenada por RSSI. A página de configuração lê daqui sem mexer no rádio.
+const int WIFI_SCAN_CACHE_SIZE = 20;
+const unsigned long WIFI_SCAN_CACHE_TTL_MS = 300000;     // Mais velho que isso: GET já dispara nova varredura
+const unsigned long WIFI_SCAN_MIN_INTERVAL_MS = 10000;   // refresh=1 não varre mais que isso
+
+struct WiFiScanEntry {
+  char ssid[MAX_SSID_LENGTH + 1];
+  int8_t rssi;
+  uint8_t channel;
+  uint8_t auth;  // wifi_auth_mode_t
+};
+
+struct WiFiScanCache {
+  WiFiScanEntry entries[WIFI_SCAN_CACHE_SIZE];
+  uint8_t count;
+  uint16_t found;            // APs vistos (antes de agrupar por SSID)
+  unsigned long updatedAtMs; // 0 = nenhuma varredura ainda
+  bool running;              // Varredura pedida pela API em andamento
+  unsigned long requestedAtMs;
+  uint32_t scans;
+};
+
+WiFiScanCache wifiScanCache;
+
+bool isLearning = false;
+uint64_t lastReceivedCode = 0;  // Atualizado para uint64_t
+uint8_t lastReceivedBits = 0;
+IRPayload lastReceivedPayload;  // Quadro longo capturado (quando o protocolo é IR_FIELDS_PAYLOAD)
+bool codeProcessed = true;  // Flag para rastrear se o código foi processado pela interface
+
+// Variáveis globais para armazenar dados do código capturado
+IRProtocol lastReceivedProtocol = PROTOCOL_UNKNOWN;
+uint16_t lastReceivedAddress = 0;
+uint16_t lastReceivedCommand = 0;
+
+// ============================================================================
+// FUNÇÕES - TELEMETRIA
+// ============================================================================
+
+// Histograma de durações em buckets log2: o bucket i conta amostras em [2^i, 2^(i+1)) µs.
+// 24 buckets cobrem de 1 µs a ~16 s ocupando ~110 bytes por histograma.
+const int HISTOGRAM_BUCKETS = 24;
+
+struct DurationHistogram {
+  uint32_t buckets[HISTOGRAM_BUCKETS];
+  uint32_t count;
+  uint64_t totalUs;
+  uint32_t maxUs;
+};
+
+struct IRTxStats {
+  uint32_t sends;      // Chamadas a sendIRCode()
+  uint32_t frames;     // Quadros emitidos (1 + repetições)
+  uint32_t repeats;    // Repetições emitidas (inclui a forçada do Samsung)
+  uint32_t failures;   // Envios recusados (sem codificador e valor cru não é NEC)
+  uint32_t fallbacks;  // Sem codificador, valor cru NEC reenviado como NEC
+  uint64_t airtimeUs;  // Tempo total com o emissor ocupado
+  DurationHistogram duration;
+};
+
+// Botão segurado (/api/hold/*): a cadência das repetições, de início a início de quadro
+struct IRHoldStats {
+  uint32_t holds;               // Sessões iniciadas
+  uint32_t repeats;             // Quadros depois do inicial
+  uint32_t keepAlives;
+  uint32_t releases;            // Encerradas pelo cliente
+  uint32_t timeouts;            // Encerradas por falta de keep-alive
+  uint32_t late;                // Repetições mais de IR_HOLD_LATE_US depois do período nativo
+  DurationHistogram start;      // Da chegada do pedido ao início do quadro inicial
+  DurationHistogram interval;   // Entre inícios de quadros consecutivos
+  DurationHistogram lateness;   // Quanto o intervalo passou do período nativo
+};
+
+struct IRRxStats {
+  uint32_t frames;                     // Quadros entregues por IrReceiver.decode()
+  uint32_t decoded[PROTOCOL_SLOTS];    // Quadros aceitos por protocolo (slot 0 = desconhecido)
+  uint32_t noiseRejects;               // Descartados pelo filtro 0x0 / 0xFFFF...
+  uint32_t repeats;                    // Quadros de repetição (botão segurado)
+  uint32_t overflows;                  // Buffer de captura estourou (quadro longo demais)
+  DurationHistogram interFrame;        // Intervalo entre quadros consecutivos
+  DurationHistogram decode;            // Duração de IrReceiver.decode()
+  DurationHistogram decodeToHandle;    // Do fim do decode até o fim de handleReceivedIR()
+  unsigned long lastFrameAtUs;
+};
+
+// Perfis de energia: modem sleep do WiFi, DFS/light sleep automático (esp_pm) e espera ociosa no
+// fim do loop(). A espera termina antes por notificação das ISRs de IR e botão; rede acorda o rádio
+// nos beacons (DTIM) e a requisição espera no máximo idleWaitMs.
+enum PowerProfile {
+  POWER_PERFORMANCE = 0,  // Como antes: rádio e CPU sempre ligados
+  POWER_BALANCED,
+  POWER_LOW,
+  POWER_PROFILE_COUNT
+};
+
+struct PowerProfileConfig {
+  const char* name;
+  wifi_ps_type_t wifiSleep;
+  uint16_t maxMhz;
+  uint16_t minMhz;     // DFS: CPU cai para cá sem locks ativos
+  bool lightSleep;     // Light sleep automático (exige CONFIG_FREERTOS_USE_TICKLESS_IDLE)
+  uint16_t idleWaitMs; // Espera no fim do loop() sem atividade (0 = só yield())
+};
+
+const PowerProfileConfig POWER_PROFILES[POWER_PROFILE_COUNT] = {
+  {"performance", WIFI_PS_NONE, 240, 240, false, 0},
+  {"balanced", WIFI_PS_MIN_MODEM, 240, 80, false, 10},
+  {"low_power", WIFI_PS_MAX_MODEM, 160, 40, true, 50},
+};
+
+// Fontes de wake medidas: da borda no GPIO (ISR) até o loop() tratar o evento
+enum PowerWakeSource {
+  POWER_WAKE_IR = 0,
+  POWER_WAKE_BUTTON,
+  POWER_WAKE_SOURCE_COUNT
+};
+
+// Após um wake o loop fica acordado (lock NO_LIGHT_SLEEP) para o quadro IR/toque terminar
+const unsigned long POWER_IR_HOLD_MS = 300;
+const unsigned long POWER_BUTTON_HOLD_MS = 100;
+
+struct PowerManager {
+  uint8_t profile;
+  bool lightSleep;           // Light sleep automático efetivamente ativo
+  int32_t pmError;           // Retorno de esp_pm_configure (0 = ok)
+  esp_pm_lock_handle_t awakeLock;
+  bool awakeLockHeld;
+  unsigned long holdUntilMs;
+  bool irArmed;              // O botão se rearma sozinho (ISR alternando o nível, ver buttonInput)
+  volatile uint32_t edgeUs[POWER_WAKE_SOURCE_COUNT];  // Escrito pela ISR, zerado pelo loop
+  uint32_t wakes[POWER_WAKE_SOURCE_COUNT];
+  DurationHistogram wakeLatency[POWER_PROFILE_COUNT][POWER_WAKE_SOURCE_COUNT];
+  uint64_t idleUs;           // Tempo em espera ociosa desde a troca de perfil
+  unsigned long profileSinceUs;
+  TaskHandle_t loopTask;
+};
+
+PowerManager power;
+
+// Filas sem lock entre tasks (e de ISR para task). Índices crescem sem parar e dão a volta em 2^32;
+// N é potência de 2. Publicação com release/acquire: o item é escrito antes do índice que o libera.
+// Um produtor, um consumidor
+template <typename T, uint8_t N>
+struct SpscQueue {
+  T items[N];
+  uint32_t head;        // Só o produtor escreve
+  uint32_t tail;        // Só o consumidor escreve
+  uint32_t drops;       // Cheia no push
+  uint32_t highWater;   // Maior ocupação vista pelo produtor
+
+  bool push(const T& item) {
+    uint32_t position = head;
+    uint32_t depth = position - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+    if (depth >= N) {
+      drops++;
+      return false;
+    }
+    items[position & (N - 1)] = item;
+    __atomic_store_n(&head, position + 1, __ATOMIC_RELEASE);
+    if (depth + 1 > highWater) {
+      highWater = depth + 1;
+    }
+    return true;
+  }
+
+  bool pop(T& item) {
+    uint32_t position = tail;
+    if (position == __atomic_load_n(&head, __ATOMIC_ACQUIRE)) {
+      return false;
+    }
+    item = items[position & (N - 1)];
+    __atomic_store_n(&tail, position + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  bool empty() const {
+    return __atomic_load_n(&tail, __ATOMIC_ACQUIRE) == __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+  }
+};
+
+// Vários produtores, um consumidor (fila limitada de Vyukov): cada célula tem um número de sequência
+// que diz de quem é a vez; produtores disputam a posição com CAS e nunca esperam uns pelos outros.
+// init() antes do primeiro uso.
+template <typename T, uint8_t N>
+struct MpscQueue {
+  struct Cell {
+    uint32_t sequence;
+    T item;
+  };
+  Cell cells[N];
+  uint32_t enqueuePos;
+  uint32_t dequeuePos;  // Só o consumidor escreve
+  uint32_t drops;
+  uint32_t highWater;
+
+  void init() {
+    for (uint32_t i = 0; i < N; i++) {
+      cells[i].sequence = i;
+    }
+    enqueuePos = dequeuePos = 0;
+  }
+
+  // position: posição global do item, que o consumidor devolve em pop() (serve de ticket)
+  bool push(const T& item, uint32_t* position) {
+    uint32_t pos = __atomic_load_n(&enqueuePos, __ATOMIC_RELAXED);
+    for (;;) {
+      Cell& cell = cells[pos & (N - 1)];
+      int32_t diff = (int32_t)(__atomic_load_n(&cell.sequence, __ATOMIC_ACQUIRE) - pos);
+      if (diff == 0) {
+        if (__atomic_compare_exchange_n(&enqueuePos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+          break;
+        }
+      } else if (diff < 0) {
+        __atomic_fetch_add(&drops, 1, __ATOMIC_RELAXED);
+        return false;
+      } else {
+        pos = __atomic_load_n(&enqueuePos, __ATOMIC_RELAXED);
+      }
+    }
+    Cell& cell = cells[pos & (N - 1)];
+    cell.item = item;
+    __atomic_store_n(&cell.sequence, pos + 1, __ATOMIC_RELEASE);
+    uint32_t depth = pos + 1 - __atomic_load_n(&dequeuePos, __ATOMIC_RELAXED);
+    if (depth > __atomic_load_n(&highWater, __ATOMIC_RELAXED)) {
+      __atomic_store_n(&highWater, depth, __ATOMIC_RELAXED);  // Aproximado com produtores concorrentes
+    }
+    if (position) {
+      *position = pos;
+    }
+    return true;
+  }
+
+  bool pop(T& item, uint32_t* position) {
+    uint32_t pos = dequeuePos;
+    Cell& cell = cells[pos & (N - 1)];
+    if ((int32_t)(__atomic_load_n(&cell.sequence, __ATOMIC_ACQUIRE) - (pos + 1)) < 0) {
+      return false;
+    }
+    item = cell.item;
+    __atomic_store_n(&cell.sequence, pos + N, __ATOMIC_RELEASE);
+    __atomic_store_n(&dequeuePos, pos + 1, __ATOMIC_RELAXED);
+    if (position) {
+      *position = pos;
+    }
+    return true;
+  }
+
+  bool empty() const {
+    return __atomic_load_n(&dequeuePos, __ATOMIC_RELAXED) == __atomic_load_n(&enqueuePos, __ATOMIC_RELAXED);
+  }
+};
+
+// Log assíncrono: Log<nível, categoria>::printf() formata a linha numa fila MPSC e uma task de
+// prioridade mínima a escreve na Serial, fora do caminho quente. Nível máximo e categorias são fixados
+// na compilação (-DLOG_MAX_LEVEL=1..4, -DLOG_CATEGORY_MASK): chamadas fora deles viram uma função
+// vazia e a string nem entra no binário. Dentro deles o nível de cada categoria muda em /api/log.
+// Até setupLogger() criar a task (durante o setup) a escrita é direta.
+enum LogLevel {
+  LOG_LVL_NONE = 0,
+  LOG_LVL_ERROR,
+  LOG_LVL_WARN,
+  LOG_LVL_INFO,
+  LOG_LVL_DEBUG,
+  LOG_LEVEL_COUNT
+};
+
+enum LogCategory {
+  LOG_SYS = 0,
+  LOG_STORAGE,
+  LOG_IR,
+  LOG_WIFI,
+  LOG_HTTP,
+  LOG_POWER,
+  LOG_BUTTON,
+  LOG_CATEGORY_COUNT
+};
+
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL 3  // info: debug fica fora do binário
+#endif
+
+#ifndef LOG_CATEGORY_MASK
+#define LOG_CATEGORY_MASK 0xFF  // Bit por LogCategory
+#endif
+
+const uint8_t LOG_QUEUE_SIZE = 32;
+const size_t LOG_LINE_MAX = 128;            // Com o '\0'; o excesso é cortado e contado
+const uint32_t LOG_TASK_STACK = 3072;
+const UBaseType_t LOG_TASK_PRIORITY = 0;    // Mesma da IDLE: só escreve quando nada mais quer a CPU
+
+struct LogLine {
+  char text[LOG_LINE_MAX];
+};
+
+struct LogStats {
+  uint32_t written;
+  uint32_t dropped[LOG_LEVEL_COUNT];  // Fila cheia, por nível
+  uint32_t truncated;
+};
+
+const char* const LOG_LEVEL_NAMES[LOG_LEVEL_COUNT] = {"none", "error", "warn", "info", "debug"};
+const char* const LOG_CATEGORY_NAMES[LOG_CATEGORY_COUNT] = {"sys", "storage", "ir", "wifi", "http", "power", "button"};
+
+MpscQueue<LogLine, LOG_QUEUE_SIZE> logQueue;
+uint8_t logLevels[LOG_CATEGORY_COUNT];  // Nível em tempo de execução, até LOG_MAX_LEVEL
+LogStats logStats;
+TaskHandle_t logTask = NULL;
+
+void logVWrite(LogLevel level, LogCategory category, const char* format, va_list args) {
+  if (level > __atomic_load_n(&logLevels[category], __ATOMIC_RELAXED)) {
+    return;
+  }
+  LogLine line;
+  int length = vsnprintf(line.text, sizeof(line.text), format, args);
+  if (length >= (int)sizeof(line.text)) {
+    __atomic_fetch_add(&logStats.truncated, 1, __ATOMIC_RELAXED);
+  }
+  if (logTask == NULL) {
+    Serial.println(line.text);
+    __atomic_fetch_add(&logStats.written, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  if (!logQueue.push(line, NULL)) {
+    __atomic_fetch_add(&logStats.dropped[level], 1, __ATOMIC_RELAXED);
+    return;
+  }
+  xTaskNotifyGive(logTask);
+}
+
+// Primeira coisa do setup(): todas as categorias no nível máximo compilado
+void initLogger() {
+  logQueue.init();
+  for (int i = 0; i < LOG_CATEGORY_COUNT; i++) {
+    logLevels[i] = LOG_MAX_LEVEL;
+  }
+}
+
+int logLevelFromName(const char* name) {
+  for (int i = 0; i < LOG_LEVEL_COUNT; i++) {
+    if (strcmp(LOG_LEVEL_NAMES[i], name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+template <LogLevel L, LogCategory C, bool Compiled = (L <= LOG_MAX_LEVEL && ((LOG_CATEGORY_MASK >> C) & 1))>
+struct Log {
+  __attribute__((format(__printf__, 1, 2))) static void printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    logVWrite(L, C, format, args);
+    va_end(args);
+  }
+};
+
+template <LogLevel L, LogCategory C>
+struct Log<L, C, false> {
+  __attribute__((format(__printf__, 1, 2))) static inline void printf(const char*, ...) {}
+};
+
+// Botão de aprendizado por interrupção. A ISR alterna o nível armado (LOW solto, HIGH pressionado),
+// o que serve também de fonte de wake do light sleep, e põe as bordas cruas numa fila SPSC. O loop
+// filtra o repique por tempo, reconhece o gesto e o enfileira; cada gesto tem uma ação configurável.
+enum ButtonGesture {
+  BUTTON_GESTURE_SHORT = 0,
+  BUTTON_GESTURE_LONG,
+  BUTTON_GESTURE_DOUBLE,
+  BUTTON_GESTURE_COUNT
+};
+
+enum ButtonAction {
+  BUTTON_ACTION_NONE = 0,
+  BUTTON_ACTION_LEARN,      // Alterna o modo aprendizado
+  BUTTON_ACTION_CONFIG_AP,  // Abre o AP de configuração (CONFIG_AP_WINDOW_MS)
+  BUTTON_ACTION_MACRO,      // Envia a sequência de códigos da macro
+  BUTTON_ACTION_COUNT
+};
+
+const uint8_t BUTTON_DEFAULT_ACTIONS[BUTTON_GESTURE_COUNT] = {
+  BUTTON_ACTION_LEARN, BUTTON_ACTION_CONFIG_AP, BUTTON_ACTION_NONE
+};
+
+const uint8_t BUTTON_EDGE_QUEUE_SIZE = 32;   // Potência de 2; cobre uma rajada de repique
+const uint8_t BUTTON_EVENT_QUEUE_SIZE = 8;
+const int MAX_MACRO_STEPS = 8;
+const unsigned long MACRO_STEP_GAP_MS = 300;  // Entre quadros, para o aparelho não ler repetição
+
+struct ButtonEdge {
+  uint32_t atUs;
+  bool down;
+};
+
+struct ButtonEvent {
+  uint8_t gesture;
+  unsigned long atMs;
+  unsigned long pressMs;   // Duração do toque (do último, no duplo)
+};
+
+struct ButtonInput {
+  // ISR → loop: só a ISR escreve edgeHead, só o loop escreve edgeTail
+  ButtonEdge edges[BUTTON_EDGE_QUEUE_SIZE];
+  volatile uint8_t edgeHead;
+  volatile uint8_t edgeTail;
+  volatile uint32_t edgeOverflows;
+  // Debounce e gestos (só o loop)
+  bool rawDown;
+  uint32_t rawAtUs;          // Última borda crua
+  bool stableDown;
+  unsigned long pressedAtMs;
+  bool longSent;
+  bool pendingShort;         // Toque curto esperando um possível 2º toque
+  unsigned long pendingUntilMs;
+  uint32_t seenOverflows;
+  SpscQueue<ButtonEvent, BUTTON_EVENT_QUEUE_SIZE> events;  // Varredura → ações (podem ser tasks diferentes)
+  // Estatísticas
+  uint32_t edgesTotal;
+  uint32_t transitions;      // Mudanças estáveis (o resto das bordas foi repique)
+  uint32_t gestures[BUTTON_GESTURE_COUNT];
+  uint8_t actions[BUTTON_GESTURE_COUNT];
+};
+
+ButtonInput buttonInput;
+
+// Macro: ids de /api/codes enviados em sequência, um por volta do loop()
+struct ButtonMacro {
+  uint8_t steps[MAX_MACRO_STEPS];
+  uint8_t count;
+  uint8_t next;              // Próximo passo; == count quando parada
+  unsigned long nextAtMs;
+  uint32_t runs;
+};
+
+ButtonMacro buttonMacro;
+
+// Backup/clonagem (/api/codes/export e /api/codes/import): NDJSON versionado, uma linha por registro.
+// Versão 1: {"type":"header"}, depois {"type":"code"} na ordem dos IDs e {"type":"button"}.
+const char* const CODES_EXPORT_FORMAT = "ir-codes";
+const int CODES_EXPORT_VERSION = 1;
+const int CODE_IMPORT_LINE_MAX = 512;   // Nomes com escapes \uXXXX cabem com folga
+
+// Importação em andamento: alocada na arena do pedido no RAW_START, liberada pelo handler
+struct CodeImport {
+  CodeStoreData staging;       // Só vira o armazenamento se o corpo inteiro for válido
+  char line[CODE_IMPORT_LINE_MAX];
+  uint16_t lineLength;
+  uint32_t lines;
+  uint32_t bytes;
+  int expected;                // "count" do cabeçalho; -1 se ausente
+  bool header;
+  bool button;
+  uint8_t actions[BUTTON_GESTURE_COUNT];
+  uint8_t macro[MAX_MACRO_STEPS];
+  uint8_t macroCount;
+  const char* error;           // Primeiro erro; o resto do corpo é ignorado
+  uint32_t errorLine;
+  unsigned long startUs;
+};
+
+CodeImport* codeImport = NULL;
+
+// Divisão em tasks (-DDUAL_CORE_TASKS=1): HTTP e WiFi numa netTask no core 0, junto da pilha
+// WiFi/lwIP; IR RX/TX, varredura do botão e energia ficam na loopTask (core 1), sem esperar a rede.
+// Os dados de cada lado só passam pelas filas: quadros recebidos e gestos (loop → net, SPSC),
+// pedidos de emissão e comandos do botão segurado (qualquer task → loop, MPSC). Com 0 tudo roda
+// no loop() e as filas não são usadas.
+#ifndef DUAL_CORE_TASKS
+#define DUAL_CORE_TASKS 0
+#endif
+
+const BaseType_t NET_TASK_CORE = 0;
+const uint32_t NET_TASK_STACK = 8192;         // Mesmo tamanho da loopTask: os handlers rodam aqui
+const UBaseType_t NET_TASK_PRIORITY = 1;      // Igual à loopTask
+const unsigned long IR_TX_WAIT_MS = 2000;     // /api/code/send responde depois da emissão
+const uint8_t IR_RX_QUEUE_SIZE = 8;
+const uint8_t IR_TX_QUEUE_SIZE = 8;
+
+// Quadro decodificado, copiado antes de IrReceiver.resume()
+struct IRFrame {
+  IRData data;
+  unsigned long decodeStartUs;
+  unsigned long decodedAtUs;
+};
+
+struct IRTxRequest {
+  IRCode code;
+  IRPayload payload;            // Cópia do quadro longo: o registro pode ser compactado antes da emissão
+  bool hasPayload;
+  unsigned long requestedAtUs;  // 0 = não medir a espera
+  TaskHandle_t waiter;          // Notificada ao concluir (NULL = sem resposta)
+};
+
+// Botão segurado: quadro inicial e repetições no período do protocolo até o cliente soltar. Sem
+// keep-alive por IR_HOLD_TIMEOUT_MS a sessão termina sozinha (soltura perdida na rede).
+const unsigned long IR_HOLD_TIMEOUT_MS = 400;
+const uint32_t IR_HOLD_LATE_US = 2000;
+const uint16_t IR_HOLD_UDP_PORT = 4210;      // Datagramas "B <id>" (início), "K" (keep-alive), "E" (fim)
+const uint8_t IR_HOLD_QUEUE_SIZE = 8;
+
+enum IRHoldAction {
+  IR_HOLD_BEGIN = 0,
+  IR_HOLD_KEEP,
+  IR_HOLD_END
+};
+
+struct IRHoldCommand {
+  uint8_t action;
+  IRCode code;                  // Só no IR_HOLD_BEGIN
+  unsigned long requestedAtUs;
+};
+
+// Sessão em curso; só o dono do emissor (loopTask com DUAL_CORE_TASKS) mexe aqui
+struct IRHoldState {
+  bool active;
+  bool ending;                  // Fim pedido; espera as repetições mínimas do protocolo
+  bool timedOut;
+  IRCode code;
+  uint32_t periodUs;
+  uint8_t repeats;              // Satura em 255: só serve para minRepeats e para o log
+  unsigned long lastFrameUs;    // Início do último quadro
+  unsigned long keepAliveAtMs;
+};
+
+enum IRTxResult {
+  IR_TX_SENT = 0,
+  IR_TX_QUEUED,    // Sem espera: entrou na fila
+  IR_TX_FAILED,
+  IR_TX_BUSY,      // Fila cheia
+  IR_TX_TIMEOUT
+};
+
+enum TaskSlot {
+  TASK_LOOP = 0,
+  TASK_NET,
+  TASK_SLOT_COUNT
+};
+
+struct TaskLoopStats {
+  uint32_t loops;
+  uint64_t idleUs;     // Bloqueada na espera ociosa
+  int8_t core;         // -1 = task não criada
+};
+
+SpscQueue<IRFrame, IR_RX_QUEUE_SIZE> irRxQueue;
+MpscQueue<IRTxRequest, IR_TX_QUEUE_SIZE> irTxQueue;
+MpscQueue<IRHoldCommand, IR_HOLD_QUEUE_SIZE> irHoldQueue;
+IRHoldState irHold;
+uint32_t irTxDone;                         // Posição do último pedido concluído + 1
+bool irTxResults[IR_TX_QUEUE_SIZE];        // Resultado por posição, lido pelo produtor que espera
+TaskHandle_t netTask = NULL;
+TaskLoopStats taskStats[TASK_SLOT_COUNT];
+unsigned long taskStatsSinceUs = 0;
+
+// Fases do loop() medidas pelo profiler. SETUP/NONE só aparecem no registro persistente.
+enum LoopPhase {
+  LOOP_PHASE_HTTP = 0,
+  LOOP_PHASE_WIFI = 1,
+  LOOP_PHASE_IR = 2,
+  LOOP_PHASE_BUTTON = 3,
+  LOOP_PHASE_COUNT = 4,
+  LOOP_PHASE_SETUP = 0xFE,
+  LOOP_PHASE_NONE = 0xFF
+};
+
+// Uma fase acima disso é registrada como travamento (a UI faz polling a cada 500 ms)
+const uint32_t LOOP_STALL_THRESHOLD_US = 500000;
+const uint32_t LOOP_STATE_MAGIC = 0x53544C4C;  // "STLL"
+
+// Watchdog da loopTask desligado por padrão.
+// Com -DLOOP_WDT_ENABLED=1 um travamento vira reset e a fase culpada sobrevive em persistentLoop.
+#ifndef LOOP_WDT_ENABLED
+#define LOOP_WDT_ENABLED 0
+#endif
+
+struct StallRecord {
+  uint8_t phase;
+  uint32_t durationUs;
+  uint32_t uptimeMs;  // Quando o travamento terminou
+};
+
+// Fica na RTC RAM sem inicialização: sobrevive a reset por watchdog, panic e ESP.restart(),
+// mas não a power-on (conteúdo aleatório, por isso o magic)
+struct PersistentLoopState {
+  uint32_t magic;
+  uint32_t bootCount;
+  uint8_t phaseInProgress;    // Fase em execução; se o reset cair no meio dela, é a culpada
+  uint32_t phaseStartedAtMs;
+  uint32_t stallCount;        // Acumulado entre boots
+  StallRecord lastStall;
+};
+
+struct LoopProfiler {
+  uint32_t loops;
+  uint32_t stalls;
+  uint8_t phase;
+  unsigned long phaseStartUs;
+  unsigned long lastLoopStartUs;
+  DurationHistogram period;   // Intervalo entre inícios de loop() consecutivos
+  DurationHistogram phases[LOOP_PHASE_COUNT];
+  StallRecord lastStall;      // Último travamento deste boot
+};
+
+RTC_NOINIT_ATTR PersistentLoopState persistentLoop;
+PersistentLoopState previousBootLoop;  // Cópia do estado do boot anterior (se válido)
+bool previousBootLoopValid = false;
+esp_reset_reason_t bootResetReason = ESP_RST_UNKNOWN;
+LoopProfiler loopProfiler;
+
+IRTxStats irTxStats[PROTOCOL_SLOTS];
+DurationHistogram irTxQueueWait;  // Da chegada do pedido até o início da emissão
+IRHoldStats irHoldStats;
+IRRxStats irRxStats;
+unsigned long telemetryResetAt = 0;
+
+// Contabilidade do heap por subsistema. Alocações são contadas pelos wrappers de malloc
+// (-DHEAP_ALLOC_TRACKING=1 com -Wl,--wrap=malloc,... no platformio.ini); sem eles só
+// o saldo de heap de cada escopo (HeapScope) é medido.
+#ifndef HEAP_ALLOC_TRACKING
+#define HEAP_ALLOC_TRACKING 0
+#endif
+
+enum HeapTag {
+  HEAP_TAG_SYSTEM = 0,      // Outras tasks (WiFi, lwIP, timers)
+  HEAP_TAG_LOOP,            // loop() fora de qualquer escopo
+  HEAP_TAG_SETUP,
+  HEAP_TAG_HTTP_SERVER,     // handleClient(): parsing de requisição e envio
+  HEAP_TAG_WIFI,
+  HEAP_TAG_IR,
+  HEAP_TAG_STORAGE,
+  HEAP_TAG_PAGE_ROOT,
+  HEAP_TAG_PAGE_CONFIG,
+  HEAP_TAG_API_STATUS,
+  HEAP_TAG_API_CODES,
+  HEAP_TAG_API_SEND,
+  HEAP_TAG_API_LEARN,
+  HEAP_TAG_API_WIFI,
+  HEAP_TAG_API_METRICS,
+  HEAP_TAG_COUNT
+};
+
+struct HeapTagStats {
+  uint32_t allocs;         // malloc/calloc (e realloc de NULL)
+  uint32_t frees;
+  uint32_t reallocs;
+  uint32_t failures;       // Alocações que retornaram NULL
+  uint32_t bytes;          // Bytes pedidos (acumulado, dá a volta em 4 GB)
+  uint32_t scopes;         // Entradas em HeapScope
+  int32_t retainedBytes;   // Soma de (livre antes - livre depois) de cada escopo
+  uint32_t largestDrop;    // Maior queda do maior bloco livre em um escopo
+};
+
+// Amostra periódica para gráficos de tendência
+struct HeapSample {
+  uint32_t uptimeS;
+  uint32_t freeBytes;
+  uint32_t minFreeBytes;
+  uint32_t largestBlock;
+};
+
+const int HEAP_SAMPLE_COUNT = 60;
+const unsigned long HEAP_SAMPLE_INTERVAL = 10000;  // 60 amostras = 10 minutos
+
+HeapTagStats heapTagStats[HEAP_TAG_COUNT];
+volatile uint8_t currentHeapTag = HEAP_TAG_SETUP;
+TaskHandle_t heapTrackedTask = NULL;  // loopTask; alocações de outras tasks vão para SYSTEM
+HeapSample heapSamples[HEAP_SAMPLE_COUNT];
+int heapSampleHead = 0;
+int heapSampleCount = 0;
+unsigned long lastHeapSample = 0;
+
+// Marca as alocações de um trecho com um subsistema e mede o heap retido por ele
+struct HeapScope {
+  uint8_t previousTag;
+  uint8_t tag;
+  uint32_t freeBefore;
+  uint32_t largestBefore;
+
+  explicit HeapScope(HeapTag scopeTag) {
+    previousTag = currentHeapTag;
+    tag = scopeTag;
+    freeBefore = ESP.getFreeHeap();
+    largestBefore = ESP.getMaxAllocHeap();
+    currentHeapTag = tag;
+  }
+
+  ~HeapScope() {
+    currentHeapTag = previousTag;
+    HeapTagStats& stats = heapTagStats[tag];
+    uint32_t largestAfter = ESP.getMaxAllocHeap();
+    stats.scopes++;
+    stats.retainedBytes += (int32_t)(freeBefore - ESP.getFreeHeap());
+    if (largestAfter < largestBefore && largestBefore - largestAfter > stats.largestDrop) {
+      stats.largestDrop = largestBefore - largestAfter;
+    }
+  }
+};
+
+// Arena por requisição: documentos JSON e respostas dos handlers saem de um bloco único
+// alocado no boot e são descartados de uma vez quando handleClient() retorna.
+// Só a task do WebServer usa; pedidos que não cabem vão para o heap (contados em fallbacks).
+#ifndef REQUEST_ARENA_SIZE
+#define REQUEST_ARENA_SIZE 12288
+#endif
+
+const size_t REQUEST_ARENA_ALIGN = 8;
+const size_t REQUEST_ARENA_HEADER = 8;  // Tamanho do bloco (para realocar copiando) e offset do anterior
+const uint32_t REQUEST_ARENA_FREED = 0x80000000;  // No tamanho: liberado fora de ordem, volta com os de cima
+
+struct RequestArena : public ArduinoJson::Allocator {
+  uint8_t* base;
+  size_t used;
+  size_t lastBlock;       // Offset do último bloco: cresce ou é liberado no lugar (SIZE = nenhum)
+  size_t highWater;       // Maior uso em uma requisição
+  uint32_t requests;      // Requisições que pediram algum bloco
+  uint32_t requestBlocks; // Blocos (arena ou heap) da requisição corrente
+  uint32_t maxRequestBlocks;
+  uint32_t allocs;        // Blocos servidos pela arena (seriam malloc)
+  uint32_t inPlace;       // Realocações/liberações resolvidas no topo da pilha
+  uint32_t fallbacks;     // Blocos que não couberam e foram para o heap
+  uint32_t fallbackBytes;
+
+  void* allocate(size_t size) override;
+  void deallocate(void* ptr) override;
+  void* reallocate(void* ptr, size_t size) override;
+};
+
+RequestArena requestArena;
+
+// Respostas JSON escritas direto no socket, sem documento nem String: o texto vai para um
+// buffer na pilha e sai com Content-Length se couber nele; senão vira chunked no 1º flush.
+#ifndef JSON_WRITER_BUFFER
+#define JSON_WRITER_BUFFER 1024
+#endif
+
+const uint8_t JSON_WRITER_MAX_DEPTH = 16;
+
+struct JsonWriterStats {
+  uint32_t responses;
+  uint32_t chunked;       // Respostas maiores que o buffer
+  uint32_t writes;        // Escritas no socket (corpo)
+  uint32_t bytes;
+  uint32_t maxBytes;
+  uint64_t cycles;        // Da criação do writer ao fim do envio
+  uint32_t maxCycles;
+};
+
+JsonWriterStats jsonWriterStats;
+
+struct JsonWriter {
+  char buffer[JSON_WRITER_BUFFER];
+  size_t length;
+  uint32_t bytes;
+  uint32_t startCycles;
+  int status;
+  const char* contentType;
+  uint16_t arrays;        // Bit n: o nível n é array
+  uint8_t depth;
+  bool comma;             // O próximo valor precisa de vírgula
+  bool streaming;         // Cabeçalhos já enviados (chunked)
+  bool finished;
+
+  explicit JsonWriter(int statusCode, const char* type = "application/json");
+  ~JsonWriter();
+
+  void beginObject(const char* key = NULL);
+  void beginArray(const char* key = NULL);
+  void end();
+  void endLine();         // NDJSON: um documento por linha
+  void finish();
+
+  template <typename T>
+  void field(const char* key, const T& value) {
+    writeKey(key);
+    writeValue(value);
+  }
+
+  template <typename T>
+  void add(const T& value) {
+    separator();
+    writeValue(value);
+  }
+
+  void writeValue(const char* value);
+  void writeValue(const String& value);
+  void writeValue(bool value);
+  void writeValue(int value) { writeSigned(value); }
+  void writeValue(long value) { writeSigned(value); }
+  void writeValue(long long value) { writeSigned(value); }
+  void writeValue(unsigned value) { writeUnsigned(value); }
+  void writeValue(unsigned long value) { writeUnsigned(value); }
+  void writeValue(unsigned long long value) { writeUnsigned(value); }
+  void writeValue(double value);
+  void writeValue(const IPAddress& value);
+
+  void separator();
+  void writeKey(const char* key);
+  void writeString(const char* text);
+  void writeSigned(long long value);
+  void writeUnsigned(unsigned long long value);
+  void write(const char* data, size_t size);
+  void flush();
+};
+
+// Spans de trace do caminho pedido HTTP → emissão IR (timestamps em µs desde o boot).
+// Ring circular; na simulação use -DTRACE_SPAN_COUNT maior para exportar execuções inteiras.
+#ifndef TRACE_SPAN_COUNT
+#define TRACE_SPAN_COUNT 128
+#endif
+
+enum TraceSpanName {
+  TRACE_HTTP_REQUEST = 0,  // Da entrada em handleClient() até a resposta enviada
+  TRACE_HTTP_ACCEPT,       // Accept e leitura de cabeçalhos/corpo dentro do WebServer
+  TRACE_JSON_PARSE,
+  TRACE_CODE_LOOKUP,
+  TRACE_IR_LOG,            // Log de sendIRCode() antes da emissão (formatação e fila)
+  TRACE_IR_FRAME,          // Portadora: início do 1º quadro até o fim da última repetição
+  TRACE_HTTP_RESPONSE
+};
+
+struct TraceSpan {
+  uint32_t traceId;
+  uint32_t startUs;
+  uint32_t durationUs;
+  uint8_t name;
+};
+
+TraceSpan traceSpans[TRACE_SPAN_COUNT];
+uint32_t traceSpanTotal = 0;  // Spans gravados desde o boot; o próximo vai em total % COUNT
+uint32_t traceNextId = 1;
+uint32_t activeTraceId = 0;   // 0 = nenhum trace aberto, traceSpan() ignora
+
+void histogramReset(DurationHistogram& histogram) {
+  memset(&histogram, 0, sizeof(histogram));
+}
+
+void histogramRecord(DurationHistogram& histogram, uint32_t us) {
+  int bucket = (us == 0) ? 0 : 31 - __builtin_clz(us);
+  if (bucket >= HISTOGRAM_BUCKETS) {
+    bucket = HISTOGRAM_BUCKETS - 1;
+  }
+  histogram.buckets[bucket]++;
+  histogram.count++;
+  histogram.totalUs += us;
+  if (us > histogram.maxUs) {
+    histogram.maxUs = us;
+  }
+}
+
+// Percentil aproximado: limite superior do bucket onde cai a amostra (nunca acima do máximo visto)
+uint32_t histogramPercentile(const DurationHistogram& histogram, uint8_t percent) {
+  if (histogram.count == 0) {
+    return 0;
+  }
+  uint32_t target = (uint32_t)(((uint64_t)histogram.count * percent + 99) / 100);
+  uint32_t seen = 0;
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    seen += histogram.buckets[i];
+    if (seen >= target) {
+      uint32_t upper = (2UL << i) - 1;
+      return (upper < histogram.maxUs) ? upper : histogram.maxUs;
+    }
+  }
+  return histogram.maxUs;
+}
+
+void histogramToJson(JsonWriter& json, const char* key, const DurationHistogram& histogram) {
+  json.beginObject(key);
+  json.field("count", histogram.count);
+  json.field("total_us", histogram.totalUs);
+  json.field("avg_us", histogram.count ? (uint32_t)(histogram.totalUs / histogram.count) : 0);
+  json.field("max_us", histogram.maxUs);
+  json.field("p50_us", histogramPercentile(histogram, 50));
+  json.field("p90_us", histogramPercentile(histogram, 90));
+  json.field("p99_us", histogramPercentile(histogram, 99));
+
+  // Buckets apenas até o último não vazio, para manter a resposta pequena
+  int lastBucket = -1;
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    if (histogram.buckets[i] != 0) {
+      lastBucket = i;
+    }
+  }
+  json.beginArray("buckets_log2_us");
+  for (int i = 0; i <= lastBucket; i++) {
+    json.add(histogram.buckets[i]);
+  }
+  json.end();
+  json.end();
+}
+
+void recordIRTransmit(IRProtocol protocol, bool ok, bool fallback, uint8_t repeats, uint32_t airtimeUs) {
+  IRTxStats& stats = irTxStats[protocolSlot(protocol)];
+  stats.sends++;
+  if (!ok) {
+    stats.failures++;
+    return;
+  }
+  if (fallback) {
+    stats.fallbacks++;
+  }
+  stats.frames += 1 + repeats;
+  stats.repeats += repeats;
+  stats.airtimeUs += airtimeUs;
+  histogramRecord(stats.duration, airtimeUs);
+}
+
+// Quadro do botão segurado. O inicial conta como um envio; as repetições entram só em frames/repeats
+// e no tempo de ar (o quadro curto distorceria o histograma de duração)
+void recordIRHoldFrame(IRProtocol protocol, bool first, uint32_t airtimeUs) {
+  if (first) {
+    recordIRTransmit(protocol, true, false, 0, airtimeUs);
+    return;
+  }
+  IRTxStats& stats = irTxStats[protocolSlot(protocol)];
+  stats.frames++;
+  stats.repeats++;
+  stats.airtimeUs += airtimeUs;
+  irHoldStats.repeats++;
+}
+
+// Classificação do quadro recebido, chamada por handleReceivedIR()
+void recordIRReceive(IRProtocol protocol, bool noise, uint8_t flags) {
+  irRxStats.frames++;
+  if (flags & IRDATA_FLAGS_WAS_OVERFLOW) {
+    irRxStats.overflows++;
+  }
+  if (noise) {
+    irRxStats.noiseRejects++;
+    return;
+  }
+  irRxStats.decoded[protocolSlot(protocol)]++;
+  if (flags & IRDATA_FLAGS_IS_REPEAT) {
+    irRxStats.repeats++;
+  }
+}
+
+// Tempos medidos no loop em volta de IrReceiver.decode() e handleReceivedIR().
+// O IRremote não marca o instante do fim do quadro, então a chegada é o retorno do decode.
+void recordIRReceiveTiming(unsigned long decodeStartUs, unsigned long decodedAtUs, unsigned long handledAtUs) {
+  if (irRxStats.lastFrameAtUs != 0) {
+    histogramRecord(irRxStats.interFrame, (uint32_t)(decodedAtUs - irRxStats.lastFrameAtUs));
+  }
+  irRxStats.lastFrameAtUs = decodedAtUs;
+  histogramRecord(irRxStats.decode, (uint32_t)(decodedAtUs - decodeStartUs));
+  histogramRecord(irRxStats.decodeToHandle, (uint32_t)(handledAtUs - decodedAtUs));
+}
+
+const char* loopPhaseName(uint8_t phase) {
+  switch (phase) {
+    case LOOP_PHASE_HTTP: return "http";
+    case LOOP_PHASE_WIFI: return "wifi";
+    case LOOP_PHASE_IR: return "ir";
+    case LOOP_PHASE_BUTTON: return "button";
+    case LOOP_PHASE_SETUP: return "setup";
+    default: return "none";
+  }
+}
+
+const char* resetReasonName(esp_reset_reason_t reason) {
+  switch (reason) {
+    case ESP_RST_POWERON: return "poweron";
+    case ESP_RST_EXT: return "external";
+    case ESP_RST_SW: return "software";
+    case ESP_RST_PANIC: return "panic";
+    case ESP_RST_INT_WDT: return "int_wdt";
+    case ESP_RST_TASK_WDT: return "task_wdt";
+    case ESP_RST_WDT: return "wdt";
+    case ESP_RST_DEEPSLEEP: return "deepsleep";
+    case ESP_RST_BROWNOUT: return "brownout";
+    case ESP_RST_SDIO: return "sdio";
+    default: return "unknown";
+  }
+}
+
+// Chamado no início de setup(): guarda o estado do boot anterior e marca a fase "setup"
+void initLoopProfiler() {
+  bootResetReason = esp_reset_reason();
+  previousBootLoopValid = (persistentLoop.magic == LOOP_STATE_MAGIC && bootResetReason != ESP_RST_POWERON);
+  
+  if (previousBootLoopValid) {
+    previousBootLoop = persistentLoop;
+    if (previousBootLoop.phaseInProgress != LOOP_PHASE_NONE) {
+      Log<LOG_LVL_WARN, LOG_SYS>::printf("⚠ Reset (%s) durante a fase '%s' (iniciada em %lu ms)",
+                                         resetReasonName(bootResetReason), loopPhaseName(previousBootLoop.phaseInProgress),
+                                         (unsigned long)previousBootLoop.phaseStartedAtMs);
+    }
+    if (previousBootLoop.lastStall.durationUs != 0) {
+      Log<LOG_LVL_WARN, LOG_SYS>::printf("⚠ Último travamento registrado: fase '%s', %lu ms",
+                                         loopPhaseName(previousBootLoop.lastStall.phase),
+                                         (unsigned long)(previousBootLoop.lastStall.durationUs / 1000));
+    }
+  } else {
+    memset(&persistentLoop, 0, sizeof(persistentLoop));
+    persistentLoop.magic = LOOP_STATE_MAGIC;
+  }
+  
+  persistentLoop.bootCount++;
+  persistentLoop.phaseInProgress = LOOP_PHASE_SETUP;
+  persistentLoop.phaseStartedAtMs = millis();
+  loopProfiler.phase = LOOP_PHASE_NONE;
+}
+
+void loopProfilerTick() {
+  unsigned long now = micros();
+  if (loopProfiler.lastLoopStartUs != 0) {
+    histogramRecord(loopProfiler.period, (uint32_t)(now - loopProfiler.lastLoopStartUs));
+  }
+  loopProfiler.lastLoopStartUs = now;
+  loopProfiler.loops++;
+}
+
+// Subsistema de heap padrão de cada fase; handlers HTTP refinam com HeapScope
+const uint8_t LOOP_PHASE_HEAP_TAGS[LOOP_PHASE_COUNT] = {
+  HEAP_TAG_HTTP_SERVER, HEAP_TAG_WIFI, HEAP_TAG_IR, HEAP_TAG_LOOP
+};
+
+void loopPhaseBegin(LoopPhase phase) {
+#if !DUAL_CORE_TASKS
+  currentHeapTag = LOOP_PHASE_HEAP_TAGS[phase];  // Com a netTask, é ela que marca o heap
+#endif
+  loopProfiler.phase = phase;
+  loopProfiler.phaseStartUs = micros();
+  persistentLoop.phaseInProgress = phase;
+  persistentLoop.phaseStartedAtMs = millis();
+}
+
+// Duração de uma fase e travamento; a netTask chama direto (sem o registro persistente da loopTask)
+void loopPhaseRecord(LoopPhase phase, uint32_t elapsedUs) {
+  histogramRecord(loopProfiler.phases[phase], elapsedUs);
+  if (elapsedUs > LOOP_STALL_THRESHOLD_US) {
+    StallRecord stall;
+    stall.phase = phase;
+    stall.durationUs = elapsedUs;
+    stall.uptimeMs = millis();
+    loopProfiler.stalls++;
+    loopProfiler.lastStall = stall;
+    persistentLoop.stallCount++;
+    persistentLoop.lastStall = stall;
+    Log<LOG_LVL_WARN, LOG_SYS>::printf("⚠ Loop travado: fase '%s' levou %lu ms", loopPhaseName(phase), (unsigned long)(elapsedUs / 1000));
+  }
+}
+
+void loopPhaseEnd() {
+  uint8_t phase = loopProfiler.phase;
+  if (phase >= LOOP_PHASE_COUNT) {
+    return;
+  }
+  uint32_t elapsedUs = (uint32_t)(micros() - loopProfiler.phaseStartUs);
+  loopProfiler.phase = LOOP_PHASE_NONE;
+#if !DUAL_CORE_TASKS
+  currentHeapTag = HEAP_TAG_LOOP;
+#endif
+  persistentLoop.phaseInProgress = LOOP_PHASE_NONE;
+  loopPhaseRecord((LoopPhase)phase, elapsedUs);
+}
+
+const char* traceSpanName(uint8_t name) {
+  switch (name) {
+    case TRACE_HTTP_REQUEST: return "http.request";
+    case TRACE_HTTP_ACCEPT: return "http.accept";
+    case TRACE_JSON_PARSE: return "json.parse";
+    case TRACE_CODE_LOOKUP: return "store.lookup";
+    case TRACE_IR_LOG: return "ir.log";
+    case TRACE_IR_FRAME: return "ir.frame";
+    case TRACE_HTTP_RESPONSE: return "http.response";
+    default: return "unknown";
+  }
+}
+
+void traceSpan(TraceSpanName name, unsigned long startUs, unsigned long endUs) {
+  if (activeTraceId == 0) {
+    return;
+  }
+  TraceSpan& span = traceSpans[traceSpanTotal % TRACE_SPAN_COUNT];
+  span.traceId = activeTraceId;
+  span.startUs = startUs;
+  span.durationUs = endUs - startUs;
+  span.name = name;
+  traceSpanTotal++;
+}
+
+// Abre um trace por requisição. O accept acontece dentro de handleClient(), antes do
+// handler; quando chamado no loop, o início da fase HTTP marca esse instante.
+struct TraceScope {
+  unsigned long startUs;
+
+  explicit TraceScope(unsigned long handlerStartUs) {
+    activeTraceId = traceNextId++;
+    startUs = (loopProfiler.phase == LOOP_PHASE_HTTP) ? loopProfiler.phaseStartUs : handlerStartUs;
+    traceSpan(TRACE_HTTP_ACCEPT, startUs, handlerStartUs);
+  }
+
+  ~TraceScope() {
+    traceSpan(TRACE_HTTP_REQUEST, startUs, micros());
+    activeTraceId = 0;
+  }
+};
+
+const char* heapTagName(uint8_t tag) {
+  switch (tag) {
+    case HEAP_TAG_SYSTEM: return "system";
+    case HEAP_TAG_LOOP: return "loop";
+    case HEAP_TAG_SETUP: return "setup";
+    case HEAP_TAG_HTTP_SERVER: return "http_server";
+    case HEAP_TAG_WIFI: return "wifi";
+    case HEAP_TAG_IR: return "ir";
+    case HEAP_TAG_STORAGE: return "storage";
+    case HEAP_TAG_PAGE_ROOT: return "page_root";
+    case HEAP_TAG_PAGE_CONFIG: return "page_config";
+    case HEAP_TAG_API_STATUS: return "api_status";
+    case HEAP_TAG_API_CODES: return "api_codes";
+    case HEAP_TAG_API_SEND: return "api_send";
+    case HEAP_TAG_API_LEARN: return "api_learn";
+    case HEAP_TAG_API_WIFI: return "api_wifi";
+    case HEAP_TAG_API_METRICS: return "api_metrics";
+    default: return "unknown";
+  }
+}
+
+// Fragmentação em %: quanto do heap livre não cabe no maior bloco contíguo
+uint8_t heapFragmentation(uint32_t freeBytes, uint32_t largestBlock) {
+  if (freeBytes == 0 || largestBlock >= freeBytes) {
+    return 0;
+  }
+  return (uint8_t)(100 - (uint64_t)largestBlock * 100 / freeBytes);
+}
+
+void sampleHeapIfDue() {
+  unsigned long now = millis();
+  if (heapSampleCount > 0 && now - lastHeapSample < HEAP_SAMPLE_INTERVAL) {
+    return;
+  }
+  lastHeapSample = now;
+  
+  HeapSample& sample = heapSamples[heapSampleHead];
+  sample.uptimeS = now / 1000;
+  sample.freeBytes = ESP.getFreeHeap();
+  sample.minFreeBytes = ESP.getMinFreeHeap();
+  sample.largestBlock = ESP.getMaxAllocHeap();
+  heapSampleHead = (heapSampleHead + 1) % HEAP_SAMPLE_COUNT;
+  if (heapSampleCount < HEAP_SAMPLE_COUNT) {
+    heapSampleCount++;
+  }
+}
+
+#if HEAP_ALLOC_TRACKING
+// Wrappers ligados com -Wl,--wrap: rodam em qualquer task (e em ISR), por isso só contadores atômicos
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+static HeapTagStats& heapCallerStats() {
+  if (heapTrackedTask != NULL && xTaskGetCurrentTaskHandle() != heapTrackedTask) {
+    return heapTagStats[HEAP_TAG_SYSTEM];
+  }
+  return heapTagStats[currentHeapTag];
+}
+
+static void heapCountAlloc(HeapTagStats& stats, void* ptr, size_t size) {
+  if (ptr == NULL) {
+    __atomic_fetch_add(&stats.failures, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  __atomic_fetch_add(&stats.allocs, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&stats.bytes, (uint32_t)size, __ATOMIC_RELAXED);
+}
+
+void* __wrap_malloc(size_t size) {
+  void* ptr = __real_malloc(size);
+  heapCountAlloc(heapCallerStats(), ptr, size);
+  return ptr;
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  void* ptr = __real_calloc(count, size);
+  heapCountAlloc(heapCallerStats(), ptr, count * size);
+  return ptr;
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  HeapTagStats& stats = heapCallerStats();
+  void* result = __real_realloc(ptr, size);
+  if (ptr == NULL) {
+    heapCountAlloc(stats, result, size);
+  } else if (size == 0) {
+    __atomic_fetch_add(&stats.frees, 1, __ATOMIC_RELAXED);
+  } else if (result == NULL) {
+    __atomic_fetch_add(&stats.failures, 1, __ATOMIC_RELAXED);
+  } else {
+    __atomic_fetch_add(&stats.reallocs, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats.bytes, (uint32_t)size, __ATOMIC_RELAXED);
+  }
+  return result;
+}
+
+void __wrap_free(void* ptr) {
+  if (ptr != NULL) {
+    __atomic_fetch_add(&heapCallerStats().frees, 1, __ATOMIC_RELAXED);
+  }
+  __real_free(ptr);
+}
+}
+#endif
+
+static size_t requestArenaBlockEnd(size_t offset, size_t size) {
+  return offset + REQUEST_ARENA_HEADER + ((size + REQUEST_ARENA_ALIGN - 1) & ~(REQUEST_ARENA_ALIGN - 1));
+}
+
+static bool requestArenaOwns(const void* ptr) {
+  const uint8_t* bytes = (const uint8_t*)ptr;
+  return requestArena.base != NULL && bytes >= requestArena.base && bytes < requestArena.base + REQUEST_ARENA_SIZE;
+}
+
+void* RequestArena::allocate(size_t size) {
+  size_t end = requestArenaBlockEnd(used, size);
+  requestBlocks++;
+  if (base == NULL || end > REQUEST_ARENA_SIZE) {
+    void* ptr = malloc(size);
+    if (ptr != NULL) {
+      fallbacks++;
+      fallbackBytes += size;
+    }
+    return ptr;
+  }
+  uint32_t* header = (uint32_t*)(base + used);
+  header[0] = (uint32_t)size;
+  header[1] = (uint32_t)lastBlock;
+  lastBlock = used;
+  used = end;
+  allocs++;
+  if (used > highWater) {
+    highWater = used;
+  }
+  return (uint8_t*)header + REQUEST_ARENA_HEADER;
+}
+
+// Pilha: o último bloco volta na hora e leva junto os de baixo já liberados. Um bloco liberado fora
+// de ordem (o JsonDocument do v7 não solta pools e strings na ordem inversa da alocação) só é
+// marcado e volta quando o topo chegar nele.
+void RequestArena::deallocate(void* ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+  if (!requestArenaOwns(ptr)) {
+    free(ptr);
+    return;
+  }
+  uint32_t* header = (uint32_t*)((uint8_t*)ptr - REQUEST_ARENA_HEADER);
+  if ((uint8_t*)header != base + lastBlock) {
+    header[0] |= REQUEST_ARENA_FREED;
+    return;
+  }
+  do {
+    header = (uint32_t*)(base + lastBlock);
+    used = lastBlock;
+    lastBlock = header[1];
+    inPlace++;
+  } while (lastBlock != REQUEST_ARENA_SIZE && (*(uint32_t*)(base + lastBlock) & REQUEST_ARENA_FREED));
+}
+
+void* RequestArena::reallocate(void* ptr, size_t size) {
+  if (ptr == NULL) {
+    return allocate(size);
+  }
+  if (!requestArenaOwns(ptr)) {
+    return realloc(ptr, size);
+  }
+  uint32_t* header = (uint32_t*)((uint8_t*)ptr - REQUEST_ARENA_HEADER);
+  size_t offset = (uint8_t*)header - base;
+  size_t end = requestArenaBlockEnd(offset, size);
+  if (offset == lastBlock && end <= REQUEST_ARENA_SIZE) {
+    header[0] = (uint32_t)size;
+    used = end;
+    inPlace++;
+    if (used > highWater) {
+      highWater = used;
+    }
+    return ptr;
+  }
+  size_t oldSize = header[0];
+  void* moved = allocate(size);
+  if (moved != NULL) {
+    memcpy(moved, ptr, oldSize < size ? oldSize : size);
+    deallocate(ptr);
+  }
+  return moved;
+}
+
+// Fim da requisição: tudo o que os handlers pegaram da arena volta de uma vez
+void requestArenaReset() {
+  if (requestArena.requestBlocks > 0) {
+    requestArena.requests++;
+    if (requestArena.requestBlocks > requestArena.maxRequestBlocks) {
+      requestArena.maxRequestBlocks = requestArena.requestBlocks;
+    }
+    requestArena.requestBlocks = 0;
+  }
+  requestArena.used = 0;
+  requestArena.lastBlock = REQUEST_ARENA_SIZE;
+}
+
+// Devolve à arena, ao sair do escopo, tudo o que foi pego dentro dele (documentos de vida curta
+// dentro de uma requisição longa, como as linhas do NDJSON de importação)
+struct RequestArenaScope {
+  size_t used;
+  size_t lastBlock;
+
+  RequestArenaScope() : used(requestArena.used), lastBlock(requestArena.lastBlock) {}
+  ~RequestArenaScope() {
+    requestArena.used = used;
+    requestArena.lastBlock = lastBlock;
+  }
+};
+
+// Um único bloco para toda a vida do firmware, pego cedo enquanto o heap ainda é contíguo
+void initRequestArena() {
+  requestArena.base = (uint8_t*)malloc(REQUEST_ARENA_SIZE);
+  requestArenaReset();
+  if (requestArena.base == NULL) {
+    Log<LOG_LVL_WARN, LOG_SYS>::printf("⚠ Sem memória para a arena HTTP (%u bytes), handlers usam o heap",
+                                       (unsigned)REQUEST_ARENA_SIZE);
+  }
+}
+
+void httpHandleClient() {
+  server.handleClient();
+  requestArenaReset();
+}
+
+void resetTaskStats() {
+  for (int i = 0; i < TASK_SLOT_COUNT; i++) {
+    taskStats[i].loops = 0;
+    taskStats[i].idleUs = 0;
+  }
+  taskStatsSinceUs = micros();
+}
+
+void resetTelemetry() {
+  memset(irTxStats, 0, sizeof(irTxStats));
+  histogramReset(irTxQueueWait);
+  memset(&irHoldStats, 0, sizeof(irHoldStats));
+  memset(&irRxStats, 0, sizeof(irRxStats));
+  histogramReset(loopProfiler.period);
+  for (int i = 0; i < LOOP_PHASE_COUNT; i++) {
+    histogramReset(loopProfiler.phases[i]);
+  }
+  loopProfiler.loops = 0;
+  loopProfiler.stalls = 0;
+  memset(&loopProfiler.lastStall, 0, sizeof(loopProfiler.lastStall));
+  memset(heapTagStats, 0, sizeof(heapTagStats));
+  requestArena.highWater = requestArena.used;
+  requestArena.requests = 0;
+  requestArena.maxRequestBlocks = 0;
+  requestArena.allocs = 0;
+  requestArena.inPlace = 0;
+  requestArena.fallbacks = 0;
+  requestArena.fallbackBytes = 0;
+  memset(&jsonWriterStats, 0, sizeof(jsonWriterStats));
+  resetTaskStats();
+  telemetryResetAt = millis();
+}
+
+// ============================================================================
+// FUNÇÕES - STORAGE / PREFERENCES
+// ============================================================================
+
+// Função auxiliar para criar chaves de Preferences sem usar String
+void makePrefKey(char* buffer, size_t size, const char* prefix, int index) {
+  snprintf(buffer, size, "%s%d", prefix, index);
+}
+
+void codeStoreCopy(CodeStoreData& dst, const CodeStoreData& src) {
+  memcpy(dst.codes, src.codes, sizeof(IRCode) * src.count);
+  dst.count = src.count;
+  memcpy(dst.signatures, src.signatures, sizeof(dst.signatures));
+  memcpy(dst.payloads, src.payloads, src.payloadUsed);
+  dst.payloadUsed = src.payloadUsed;
+}
+
+// Copia o quadro longo de code para payload; false se o código não tem (ou o registro não cabe)
+bool codeStoreLoadPayload(const CodeStoreData& store, const IRCode& code, IRPayload* payload) {
+  if (code.payload == 0) {
+    return false;
+  }
+  uint16_t offset = code.payload - 1;
+  if (offset + IR_PAYLOAD_HEADER_SIZE > store.payloadUsed) {
+    return false;
+  }
+  memcpy(payload, store.payloads + offset, IR_PAYLOAD_HEADER_SIZE);
+  uint16_t size = irPayloadSize(*payload);
+  if (payload->bits > IR_PAYLOAD_MAX_BYTES * 8 || offset + size > store.payloadUsed) {
+    return false;
+  }
+  memcpy(payload->data, store.payloads + offset + IR_PAYLOAD_HEADER_SIZE, size - IR_PAYLOAD_HEADER_SIZE);
+  return true;
+}
+
+// Acrescenta o registro no fim da área (o código novo é sempre o último id); false se não couber
+bool codeStoreAddPayload(CodeStoreData& store, IRCode& code, const IRPayload& payload) {
+  uint16_t size = irPayloadSize(payload);
+  if (store.payloadUsed + size > CODE_PAYLOAD_POOL_SIZE) {
+    return false;
+  }
+  memcpy(store.payloads + store.payloadUsed, &payload, size);
+  code.payload = store.payloadUsed + 1;
+  store.payloadUsed += size;
+  return true;
+}
+
+// Antes de tirar code da lista: fecha o buraco e corrige a posição dos registros seguintes
+void codeStoreRemovePayload(CodeStoreData& store, const IRCode& code) {
+  IRPayload payload;
+  if (!codeStoreLoadPayload(store, code, &payload)) {
+    return;
+  }
+  uint16_t offset = code.payload - 1;
+  uint16_t size = irPayloadSize(payload);
+  memmove(store.payloads + offset, store.payloads + offset + size, store.payloadUsed - offset - size);
+  store.payloadUsed -= size;
+  for (int i = 0; i < store.count; i++) {
+    if (store.codes[i].payload > code.payload) {
+      store.codes[i].payload -= size;
+    }
+  }
+}
+
+uint32_t fnv1a(uint32_t hash, const uint8_t* bytes, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+// Identidade do quadro longo (FNV-1a de bits, flags e dados), guardada em address/command dos códigos
+// com IRPayload: a assinatura de duplicatas e a lista de códigos não precisam ler a área de registros.
+// Os tempos medidos variam a cada captura do mesmo sinal e ficam de fora (só servem ao envio).
+uint32_t irPayloadHash(const IRPayload& payload) {
+  uint32_t hash = fnv1a(2166136261u, (const uint8_t*)&payload.bits, sizeof(payload.bits));
+  hash = fnv1a(hash, &payload.flags, sizeof(payload.flags));
+  return fnv1a(hash, payload.data, (payload.bits + 7) / 8);
+}
+
+// O hash em address/command pode colidir: a duplicata de um quadro longo se confirma nos bytes gravados
+bool codeStorePayloadEquals(const CodeStoreData& store, const IRCode& code, const IRPayload& payload) {
+  IRPayload stored;
+  return codeStoreLoadPayload(store, code, &stored) && stored.bits == payload.bits &&
+         stored.flags == payload.flags && memcmp(stored.data, payload.data, (payload.bits + 7) / 8) == 0;
+}
+
+// Sem decodificação (desconhecido/RAW/Whynter) address e command não identificam o código: entra o valor cru
+bool codeSignatureUsesValue(const IRCode& code) {
+  return protocolInfo(code.protocol).fields == IR_FIELDS_VALUE;
+}
+
+bool codeSignatureEquals(const IRCode& a, const IRCode& b) {
+  if (a.protocol != b.protocol || a.bits != b.bits) {
+    return false;
+  }
+  if (codeSignatureUsesValue(a)) {
+    return a.code == b.code;
+  }
+  return a.address == b.address && a.command == b.command;
+}
+
+uint32_t codeSignatureHash(const IRCode& code) {
+  // IRPayload: address/command já são o hash do quadro inteiro
+  uint64_t key = codeSignatureUsesValue(code) ? code.code : ((uint64_t)code.address << 16) | code.command;
+  key ^= ((uint64_t)code.protocol << 56) ^ ((uint64_t)code.bits << 48);
+  return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32);  // Hash multiplicativo (Fibonacci)
+}
+
+// Duplicatas já gravadas (aliases, ou de firmwares anteriores) não entram: a busca devolve o menor id
+void codeStoreIndexSignatures(CodeStoreData& store) {
+  memset(store.signatures, 0, sizeof(store.signatures));
+  for (int i = 0; i < store.count; i++) {
+    uint32_t slot = codeSignatureHash(store.codes[i]) & (CODE_SIGNATURE_SLOTS - 1);
+    while (store.signatures[slot] != 0 && !codeSignatureEquals(store.codes[store.signatures[slot] - 1], store.codes[i])) {
+      slot = (slot + 1) & (CODE_SIGNATURE_SLOTS - 1);
+    }
+    if (store.signatures[slot] == 0) {
+      store.signatures[slot] = (uint8_t)(i + 1);
+    }
+  }
+}
+
+// Índice do código com a mesma assinatura de probe, ou -1
+int findCodeBySignature(const CodeStoreData& store, const IRCode& probe) {
+  uint32_t slot = codeSignatureHash(probe) & (CODE_SIGNATURE_SLOTS - 1);
+  for (int probes = 0; probes < CODE_SIGNATURE_SLOTS; probes++) {
+    uint8_t entry = store.signatures[slot];
+    if (entry == 0) {
+      return -1;
+    }
+    if (entry <= store.count && codeSignatureEquals(store.codes[entry - 1], probe)) {
+      return entry - 1;
+    }
+    slot = (slot + 1) & (CODE_SIGNATURE_SLOTS - 1);
+  }
+  return -1;
+}
+
+void initCodeStore() {
+  memset(&codeStore, 0, sizeof(codeStore));
+  codeStore.writeLock = xSemaphoreCreateMutex();
+}
+
+// Espera os leitores registrados no contador saírem; devolve se precisou esperar
+bool codeStoreWaitReaders(uint8_t slot) {
+  if (__atomic_load_n(&codeStore.readers[slot], __ATOMIC_SEQ_CST) == 0) {
+    return false;
+  }
+  for (uint32_t spins = 0; __atomic_load_n(&codeStore.readers[slot], __ATOMIC_SEQ_CST) != 0; spins++) {
+    if (spins >= 64) {
+      vTaskDelay(1);  // Leitor longo (ex.: /api/codes em outra task)
+    }
+  }
+  return true;
+}
+
+// Chamado com writeLock: publica a cópia alterada e, sem leitores na antiga, sincroniza-a
+void codeStorePublish() {
+  unsigned long startUs = micros();
+  uint8_t next = codeStore.readSide ^ 1;
+  codeStoreIndexSignatures(codeStore.sides[next]);
+  __atomic_store_n(&codeStore.readSide, next, __ATOMIC_SEQ_CST);
+  // Leitores de antes da troca estão num dos dois contadores: alterna o contador e drena ambos
+  uint8_t slot = codeStore.readerSlot;
+  bool waited = codeStoreWaitReaders(slot ^ 1);
+  __atomic_store_n(&codeStore.readerSlot, slot ^ 1, __ATOMIC_SEQ_CST);
+  waited = codeStoreWaitReaders(slot) || waited;
+  codeStoreCopy(codeStore.sides[next ^ 1], codeStore.sides[next]);
+  __atomic_store_n(&codeStore.version, codeStore.version + 1, __ATOMIC_RELAXED);
+  if (waited) {
+    unsigned long waitUs = micros() - startUs;
+    codeStore.writerWaits++;
+    if (waitUs > codeStore.writerWaitMaxUs) {
+      codeStore.writerWaitMaxUs = waitUs;
+    }
+  }
+}
+
+// Leitura sem espera nem mutex: a cópia apontada fica estável até o destrutor. Copie o que precisar
+// e feche antes de bloquear (ex.: esperar a emissão). Não abrir um CodeStoreWriter na mesma task com
+// um leitor aberto: o escritor esperaria por ele para sempre.
+struct CodeStoreReader {
+  uint8_t slot;
+  const CodeStoreData* data;
+
+  CodeStoreReader() {
+    slot = __atomic_load_n(&codeStore.readerSlot, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&codeStore.readers[slot], 1, __ATOMIC_SEQ_CST);
+    data = &codeStore.sides[__atomic_load_n(&codeStore.readSide, __ATOMIC_SEQ_CST)];
+  }
+
+  ~CodeStoreReader() {
+    __atomic_fetch_sub(&codeStore.readers[slot], 1, __ATOMIC_RELEASE);
+  }
+
+  const CodeStoreData* operator->() const {
+    return data;
+  }
+};
+
+// Escrita serializada: data é a cópia fora de leitura, já igual à publicada. publish() a torna
+// visível; sair do escopo sem publicar descarta as alterações.
+struct CodeStoreWriter {
+  CodeStoreData* data;
+  bool published;
+
+  CodeStoreWriter() {
+    xSemaphoreTake(codeStore.writeLock, portMAX_DELAY);
+    data = &codeStore.sides[codeStore.readSide ^ 1];
+    published = false;
+  }
+
+  ~CodeStoreWriter() {
+    if (!published) {
+      codeStoreCopy(*data, codeStore.sides[codeStore.readSide]);
+    }
+    xSemaphoreGive(codeStore.writeLock);
+  }
+
+  void publish() {
+    codeStorePublish();
+    data = &codeStore.sides[codeStore.readSide];  // As duas cópias estão iguais
+    published = true;
+  }
+
+  CodeStoreData* operator->() const {
+    return data;
+  }
+};
+
+// Chamado pelo escritor com a cópia que vai publicar: gravações no NVS ficam na ordem das publicações
+void saveCodesToPreferences(const CodeStoreData& store) {
+  HeapScope heapScope(HEAP_TAG_STORAGE);
+  int count = store.count;
+  // Validação de segurança: garantir que count está dentro dos limites
+  if (count < 0 || count > MAX_CODES) {
+    Log<LOG_LVL_ERROR, LOG_STORAGE>::printf("✗ Erro: codeCount inválido: %d", count);
+    count = (count < 0) ? 0 : MAX_CODES;
+  }
+  
+  prefs.putInt("count", count);
+  
+  char keyBuffer[16];  // Buffer reutilizável para chaves
+  
+  for (int i = 0; i < count; i++) {
+    const IRCode& code = store.codes[i];
+    makePrefKey(keyBuffer, sizeof(keyBuffer), "code", i);
+    prefs.putULong64(keyBuffer, code.code);
+    
+    makePrefKey(keyBuffer, sizeof(keyBuffer), "device", i);
+    prefs.putString(keyBuffer, code.device);
+    
+    makePrefKey(keyBuffer, sizeof(keyBuffer), "button", i);
+    prefs.putString(keyBuffer, code.button);
+    
+    makePrefKey(keyBuffer, sizeof(keyBuffer), "bits", i);
+    prefs.putUChar(keyBuffer, code.bits);
+    
+    // ⭐ NOVO: Salvar protocolo e dados relacionados
+    makePrefKey(keyBuffer, sizeof(keyBuffer), "protocol", i);
+    prefs.putUChar(keyBuffer, (uint8_t)code.protocol);
+    
+    makePrefKey(keyBuffer, sizeof(keyBuffer), "address", i);
+    prefs.putUShort(keyBuffer, code.address);
+    
+    makePrefKey(keyBuffer, sizeof(keyBuffer), "command", i);
+    prefs.putUShort(keyBuffer, code.command);
+    
+    makePrefKey(keyBuffer, sizeof(keyBuffer), "repeats", i);
+    prefs.putUChar(keyBuffer, code.repeats);
+    
+    // Quadro longo: um blob do tamanho do registro; o de um código que saiu desta posição é apagado
+    makePrefKey(keyBuffer, sizeof(keyBuffer), "payload", i);
+    IRPayload payload;
+    if (codeStoreLoadPayload(store, code, &payload)) {
+      prefs.putBytes(keyBuffer, &payload, irPayloadSize(payload));
+    } else if (prefs.isKey(keyBuffer)) {
+      prefs.remove(keyBuffer);
+    }
+  }
+  
+  Log<LOG_LVL_INFO, LOG_STORAGE>::printf("✓ %d códigos salvos no Preferences", count);
+}
+
+void loadCodesFromPreferences() {
+  HeapScope heapScope(HEAP_TAG_STORAGE);
+  prefs.begin("ir-codes", false);  // Namespace "ir-codes", modo leitura/escrita
+  CodeStoreWriter store;
+  
+  // ⭐ IMPORTANTE:
+  // A limpeza "começar do zero" deve ocorrer APENAS UMA VEZ, senão todo reboot apaga seus códigos.
+  // Usamos um schema_version para controlar isso.
+  const int CURRENT_SCHEMA_VERSION = 2;
+  int schemaVersion = prefs.getInt("schema_version", 0);
+  int codeCount = prefs.getInt("count", 0);
+  
+  // Se estamos migrando de um firmware antigo (sem schema_version), limpamos uma única vez.
+  if (schemaVersion < CURRENT_SCHEMA_VERSION) {
+    Log<LOG_LVL_WARN, LOG_STORAGE>::printf("⚠ Migrando storage (schema %d -> %d). Limpando códigos antigos UMA VEZ.",
+                                           schemaVersion, CURRENT_SCHEMA_VERSION);
+    prefs.clear();
+    prefs.putInt("schema_version", CURRENT_SCHEMA_VERSION);
+    prefs.putInt("count", 0);
+    store->count = 0;
+    store.publish();
+    return;  // prefs continua aberto: saveCodesToPreferences() grava nele
+  }
+  
+  // Validação de segurança: garantir limites válidos
+  if (codeCount > MAX_CODES || codeCount < 0) {
+    Log<LOG_LVL_WARN, LOG_STORAGE>::printf("⚠ Preferences corrompidos ou vazios, iniciando sem códigos");
+    store->count = 0;
+    store.publish();
+    return;
+  }
+  
+  char keyBuffer[16];  // Buffer reutilizável para chaves
+  char tempBuffer[64];  // Buffer temporário para strings do Preferences
+  
+  for (int i = 0; i < codeCount; i++) {
+    IRCode& code = store->codes[i];
+    makePrefKey(keyBuffer, sizeof(keyBuffer), "code", i);
+    code.code = prefs.getULong64(keyBuffer, 0ULL);
+    
+    makePrefKey(keyBuffer, sizeof(keyBuffer), "device", i);
+    size_t len = prefs.getString(keyBuffer, tempBuffer, sizeof(tempBuffer));
+    if (len > 0) {
+      strncpy(code.device, tempBuffer, MAX_DEVICE_NAME);
+      code.device[MAX_DEVICE_NAME] = '\0';
+    } else {
+      code.device[0] = '\0';
+    }
+    
+    makePrefKey(keyBuffer, sizeof(keyBuffer), "button", i);
+    len = prefs.getString(keyBuffer, tempBuffer, sizeof(tempBuffer));
+    if (len > 0) {
+      strncpy(code.button, tempBuffer, MAX_BUTTON_NAME);
+      code.button[MAX_BUTTON_NAME] = '\0';
+    } else {
+      code.button[0] = '\0';
+    }
+    
+    makePrefKey(keyBuffer, sizeof(keyBuffer), "bits", i);
+    code.bits = prefs.getUChar(keyBuffer, 32);
+    
+    // ⭐ NOVO: Carregar protocolo e dados relacionados
+    makePrefKey(keyBuffer, sizeof(keyBuffer), "protocol", i);
+    code.protocol = (IRProtocol)prefs.getUChar(keyBuffer, PROTOCOL_UNKNOWN);
+    
+    makePrefKey(keyBuffer, sizeof(keyBuffer), "address", i);
+    code.address = prefs.getUShort(keyBuffer, 0);
+    
+    makePrefKey(keyBuffer, sizeof(keyBuffer), "command", i);
+    code.command = prefs.getUShort(keyBuffer, 0);
+    
+    makePrefKey(keyBuffer, sizeof(keyBuffer), "repeats", i);
+    code.repeats = prefs.getUChar(keyBuffer, 0);
+    
+    // Valor que esta versão não registra (gravado por um firmware mais novo): fica como está, para
+    // voltar intacto no próximo save; só não é enviado
+    if (!isProtocolRegistered(code.protocol)) {
+      Log<LOG_LVL_WARN, LOG_STORAGE>::printf("⚠ Código %d: protocolo %d não registrado, mantido sem envio",
+                                             i, (int)code.protocol);
+    }
+    code.payload = 0;
+    if (protocolInfo(code.protocol).fields == IR_FIELDS_PAYLOAD) {
+      IRPayload payload;
+      makePrefKey(keyBuffer, sizeof(keyBuffer), "payload", i);
+      size_t size = prefs.getBytes(keyBuffer, &payload, sizeof(payload));
+      if (size < IR_PAYLOAD_HEADER_SIZE || size != irPayloadSize(payload) ||
+          !codeStoreAddPayload(*store.data, code, payload)) {
+        Log<LOG_LVL_WARN, LOG_STORAGE>::printf("⚠ Código %d: quadro longo ausente ou inválido (%u bytes)",
+                                               i, (unsigned)size);
+      } else {
+        // Gravado com o hash antigo (que incluía os tempos): recalculado para casar com novas capturas
+        uint32_t hash = irPayloadHash(payload);
+        code.address = hash >> 16;
+        code.command = hash & 0xFFFF;
+      }
+    }
+    // Sony gravado antes do registro de protocolos ficava com address 0; o valor cru tem o address
+    // acima dos 7 bits de command
+    if (code.protocol == PROTOCOL_SONY && code.address == 0) {
+      code.address = (uint16_t)(code.code >> 7);
+    }
+  }
+  store->count = codeCount;
+  store.publish();
+  
+  Log<LOG_LVL_INFO, LOG_STORAGE>::printf("✓ %d códigos carregados do Preferences", codeCount);
+}
+
+// ============================================================================
+// FUNÇÕES - IR MANAGER
+// ============================================================================
+
+// Função auxiliar para obter nome do protocolo (para logs) - declarada antes de usar
+const char* getProtocolName(IRProtocol protocol) {
+  return protocolInfo(protocol).name;
+}
+
+// Inverso de getProtocolName() (importação)
+bool protocolFromName(const char* name, IRProtocol* protocol) {
+  for (int slot = 0; name != NULL && slot < PROTOCOL_SLOTS; slot++) {
+    if (strcmp(name, IR_PROTOCOLS[slot].name) == 0) {
+      *protocol = IR_PROTOCOLS[slot].protocol;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Função para converter protocolo da biblioteca para nosso enum
+IRProtocol detectProtocol(decode_type_t detected) {
+  for (int slot = 1; detected != UNKNOWN && slot < PROTOCOL_SLOTS; slot++) {
+    if (IR_PROTOCOLS[slot].decoded == detected) {
+      return IR_PROTOCOLS[slot].protocol;
+    }
+  }
+  return PROTOCOL_UNKNOWN;  // Decodificado pelo IRremote mas sem linha em IR_PROTOCOLS
+}
+
+// Recebe a cópia de IrReceiver.decodedIRData feita por irRxPoll() (na netTask com DUAL_CORE_TASKS)
+void handleReceivedIR(const IRData& decoded) {
+  // Segunda metade do quadro Denon/Sharp (mesmo botão, command invertido): não substitui a primeira
+  if (decoded.flags & IRDATA_FLAGS_IS_AUTO_REPEAT) {
+    recordIRReceive(detectProtocol(decoded.protocol), false, decoded.flags);
+    return;
+  }
+  lastReceivedCode = decoded.decodedRawData;
+  lastReceivedBits = decoded.numberOfBits;
+  
+  // Detectar protocolo automaticamente
+  lastReceivedProtocol = detectProtocol(decoded.protocol);
+  
+  // Extrair address e command baseado no protocolo
+  IRCodeFields fields = protocolInfo(lastReceivedProtocol).fields;
+  if (lastReceivedProtocol == PROTOCOL_UNKNOWN) {
+    // Protocolo desconhecido - tentar extrair do código raw
+    lastReceivedAddress = (lastReceivedCode >> 16) & 0xFFFF;
+    lastReceivedCommand = lastReceivedCode & 0xFFFF;
+  } else if (fields == IR_FIELDS_PAYLOAD) {
+    // Quadro longo: bits e tempos vão para lastReceivedPayload; code fica com os primeiros 64 bits
+    memset(&lastReceivedPayload, 0, sizeof(lastReceivedPayload));
+    uint16_t bits = decoded.numberOfBits;
+    if (bits > IR_PAYLOAD_MAX_BYTES * 8) {
+      bits = IR_PAYLOAD_MAX_BYTES * 8;  // Além de RAW_BUFFER_LENGTH o IRremote já marcou overflow
+    }
+    lastReceivedPayload.bits = bits;
+    lastReceivedPayload.flags = decoded.flags & IRDATA_FLAGS_IS_MSB_FIRST;
+    lastReceivedPayload.timing = decoded.DistanceWidthTimingInfo;
+    memcpy(lastReceivedPayload.data, decoded.decodedRawDataArray, (bits + 7) / 8);
+    lastReceivedCode = decoded.decodedRawDataArray[0];
+    lastReceivedBits = 0;  // Não cabe em uint8_t: o número de bits fica no IRPayload
+    uint32_t hash = irPayloadHash(lastReceivedPayload);
+    lastReceivedAddress = hash >> 16;
+    lastReceivedCommand = hash & 0xFFFF;
+  } else {
+    // Sem address no quadro (BoseWave, FAST): grava 0
+    lastReceivedAddress = (fields == IR_FIELDS_COMMAND) ? 0 : decoded.address;
+    lastReceivedCommand = decoded.command;
+  }
+  
+  // ⭐ FILTRO 0x0 - Ignorar ruído IR antes de processar
+  bool noise = (lastReceivedCode == 0ULL || lastReceivedCode == 0xFFFFFFFFFFFFFFFFULL);
+  recordIRReceive(lastReceivedProtocol, noise, decoded.flags);
+  if (noise) {
+    Log<LOG_LVL_WARN, LOG_IR>::printf("⚠ Código inválido ignorado: 0x%llX", (unsigned long long)lastReceivedCode);
+    return;
+  }
+  
+  if (isLearning) {
+    codeProcessed = false;  // Marca como não processado para a interface detectar
+    const char* protocolName = getProtocolName(lastReceivedProtocol);
+    Log<LOG_LVL_INFO, LOG_IR>::printf("📥 Código recebido (Modo Aprendizado): Protocolo=%s", protocolName);
+    Log<LOG_LVL_DEBUG, LOG_IR>::printf("   Raw: 0x%llX, Bits: %d", (unsigned long long)lastReceivedCode, lastReceivedBits);
+    if (fields == IR_FIELDS_PAYLOAD) {
+      Log<LOG_LVL_DEBUG, LOG_IR>::printf("   Quadro longo: %u bits", lastReceivedPayload.bits);
+    }
+    Log<LOG_LVL_DEBUG, LOG_IR>::printf("   Address: 0x%04X, Command: 0x%04X", lastReceivedAddress, lastReceivedCommand);
+    Log<LOG_LVL_DEBUG, LOG_IR>::printf("   decodedIRData.address: 0x%04X, decodedIRData.command: 0x%04X",
+                                       decoded.address, decoded.command);
+  } else {
+    Log<LOG_LVL_INFO, LOG_IR>::printf("📥 Código recebido: 0x%llX (%d bits)", (unsigned long long)lastReceivedCode, lastReceivedBits);
+  }
+}
+
+// Quadro NEC de 32 bits como o IRremote entrega em decodedRawData (LSB primeiro):
+// address (8 ou 16 bits), command, ~command
+bool isNecFrame(uint64_t raw, uint8_t bits) {
+  if (bits != 32) {
+    return false;
+  }
+  uint8_t command = (uint8_t)(raw >> 16);
+  uint8_t inverted = (uint8_t)(raw >> 24);
+  return (uint8_t)~command == inverted;
+}
+
+// Codificador genérico de distância/largura de pulso com os tempos capturados (38 kHz)
+void sendIRPayload(const IRPayload& payload, uint8_t repeats) {
+  IRDecodedRawDataType words[RAW_DATA_ARRAY_SIZE];
+  memset(words, 0, sizeof(words));
+  memcpy(words, payload.data, (payload.bits + 7) / 8);
+  DistanceWidthTimingInfoStruct timing = payload.timing;
+  IrSender.sendPulseDistanceWidthFromArray(38, &timing, words, payload.bits, payload.flags, 110, repeats);
+}
+
+// Função unificada para enviar código IR baseado no protocolo
+// payload: quadro longo do código (IR_FIELDS_PAYLOAD), NULL nos demais
+// requestedAtUs: micros() da chegada do pedido, para medir a espera até a emissão (0 = não medir)
+bool sendIRCode(const IRCode& code, const IRPayload* payload, unsigned long requestedAtUs = 0) {
+  unsigned long logStartUs = micros();
+  const char* protocolName = getProtocolName(code.protocol);
+  Log<LOG_LVL_INFO, LOG_IR>::printf("📤 Enviando código IR: %s - %s (Protocolo: %s)", 
+                                    code.device, code.button, protocolName);
+  Log<LOG_LVL_DEBUG, LOG_IR>::printf("   Detalhes: address=0x%04X, command=0x%04X, bits=%d, repeats=%d",
+                                     code.address, code.command, code.bits, code.repeats);
+  
+  // Tempo de emissão medido só em volta da chamada ao IrSender (sem os logs seriais)
+  bool ok = false;
+  bool fallback = false;
+  uint8_t repeatsSent = code.repeats;
+  unsigned long frameStartUs = micros();
+  unsigned long frameEndUs = frameStartUs;
+  
+  const IRProtocolInfo& info = protocolInfo(code.protocol);
+  if (info.fields == IR_FIELDS_PAYLOAD) {
+    if (payload != NULL) {
+      frameStartUs = micros();
+      sendIRPayload(*payload, code.repeats);
+      frameEndUs = micros();
+      ok = true;
+    } else {
+      Log<LOG_LVL_WARN, LOG_IR>::printf("⚠ Quadro longo ausente, código não enviado");
+    }
+  } else if (info.send != NULL) {
+    if (repeatsSent < info.minRepeats) {
+      repeatsSent = info.minRepeats;  // Samsung: sem repetição o aparelho ignora o quadro
+    }
+    frameStartUs = micros();
+    info.send(code, repeatsSent);
+    frameEndUs = micros();
+    ok = true;
+  } else if (isNecFrame(code.code, code.bits)) {
+    // Sem codificador, mas o valor cru é um quadro NEC válido (comando + inverso): reenvia como NEC
+    Log<LOG_LVL_WARN, LOG_IR>::printf("⚠ Protocolo sem codificador: %d, valor cru é NEC, enviando como NEC",
+                                      code.protocol);
+    frameStartUs = micros();
+    IrSender.sendNEC((uint16_t)(code.code & 0xFFFF), (uint8_t)(code.code >> 16), code.repeats);
+    frameEndUs = micros();
+    ok = true;
+    fallback = true;
+  } else {
+    Log<LOG_LVL_WARN, LOG_IR>::printf("⚠ Protocolo sem codificador: %d, código não enviado", code.protocol);
+  }
+  
+  if (ok && requestedAtUs != 0) {
+    histogramRecord(irTxQueueWait, (uint32_t)(frameStartUs - requestedAtUs));
+  }
+  traceSpan(TRACE_IR_LOG, logStartUs, frameStartUs);
+  if (ok) {
+    traceSpan(TRACE_IR_FRAME, frameStartUs, frameEndUs);
+  }
+  recordIRTransmit(code.protocol, ok, fallback, repeatsSent, (uint32_t)(frameEndUs - frameStartUs));
+  return ok;
+}
+
+void irRxHandle(const IRFrame& frame) {
+  handleReceivedIR(frame.data);
+  recordIRReceiveTiming(frame.decodeStartUs, frame.decodedAtUs, micros());
+}
+
+// loopTask: decodifica e libera o receptor logo; o quadro segue por cópia
+void irRxPoll() {
+  unsigned long decodeStartUs = micros();
+  if (!IrReceiver.decode()) {
+    return;
+  }
+  IRFrame frame;
+  frame.decodedAtUs = micros();
+  frame.decodeStartUs = decodeStartUs;
+  frame.data = IrReceiver.decodedIRData;
+  IrReceiver.resume(); // Habilita recepção do próximo sinal
+#if DUAL_CORE_TASKS
+  if (irRxQueue.push(frame) && netTask) {
+    xTaskNotifyGive(netTask);
+  }
+#else
+  irRxHandle(frame);
+#endif
+}
+
+// netTask: quadros recebidos; decode_to_handle passa a incluir a travessia entre cores
+void irRxDrain() {
+  IRFrame frame;
+  while (irRxQueue.pop(frame)) {
+    irRxHandle(frame);
+  }
+}
+
+// Emissão a partir de qualquer task. Sem DUAL_CORE_TASKS emite na hora; com, põe o pedido na fila
+// da loopTask e, se wait, bloqueia até a emissão terminar (ou IR_TX_WAIT_MS)
+IRTxResult irTxSubmit(const IRCode& code, const IRPayload* payload, unsigned long requestedAtUs, bool wait) {
+#if DUAL_CORE_TASKS
+  if (netTask == NULL) {
+    // Sem netTask os produtores já rodam na loopTask: esperar a fila seria esperar por si mesma
+    return sendIRCode(code, payload, requestedAtUs) ? IR_TX_SENT : IR_TX_FAILED;
+  }
+  IRTxRequest request;
+  request.code = code;
+  request.hasPayload = payload != NULL;
+  if (payload != NULL) {
+    memcpy(&request.payload, payload, irPayloadSize(*payload));
+  }
+  request.requestedAtUs = requestedAtUs;
+  request.waiter = wait ? xTaskGetCurrentTaskHandle() : NULL;
+  uint32_t position;
+  if (!irTxQueue.push(request, &position)) {
+    return IR_TX_BUSY;
+  }
+  xTaskNotifyGive(power.loopTask);
+  if (!wait) {
+    return IR_TX_QUEUED;
+  }
+  unsigned long startMs = millis();
+  // Quadros recebidos durante a espera são tratados aqui mesmo; outras notificações só fazem reconferir
+  while ((int32_t)(__atomic_load_n(&irTxDone, __ATOMIC_ACQUIRE) - position) <= 0) {
+    irRxDrain();
+    unsigned long waitedMs = millis() - startMs;
+    if (waitedMs >= IR_TX_WAIT_MS) {
+      return IR_TX_TIMEOUT;
+    }
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(IR_TX_WAIT_MS - waitedMs));
+  }
+  return irTxResults[position & (IR_TX_QUEUE_SIZE - 1)] ? IR_TX_SENT : IR_TX_FAILED;
+#else
+  (void)wait;
+  return sendIRCode(code, payload, requestedAtUs) ? IR_TX_SENT : IR_TX_FAILED;
+#endif
+}
+
+// loopTask: um pedido por volta, para o decode do receptor rodar entre quadros
+void irTxDrain() {
+  IRTxRequest request;
+  uint32_t position;
+  if (!irTxQueue.pop(request, &position)) {
+    return;
+  }
+  irTxResults[position & (IR_TX_QUEUE_SIZE - 1)] = sendIRCode(request.code, request.hasPayload ? &request.payload : NULL,
+                                                                 request.requestedAtUs);
+  __atomic_store_n(&irTxDone, position + 1, __ATOMIC_RELEASE);
+  if (request.waiter != NULL) {
+    xTaskNotifyGive(request.waiter);
+  }
+}
+
+// Um quadro da sessão; devolve o início dele (as repetições são agendadas de início a início)
+unsigned long irHoldSendFrame(bool first) {
+  const IRProtocolInfo& info = protocolInfo(irHold.code.protocol);
+  unsigned long frameStartUs = micros();
+  if (info.sendHold != NULL) {
+    info.sendHold(irHold.code, first);
+  } else {
+    info.send(irHold.code, 0);
+  }
+  unsigned long frameEndUs = micros();
+  traceSpan(TRACE_IR_FRAME, frameStartUs, frameEndUs);
+  recordIRHoldFrame(irHold.code.protocol, first, (uint32_t)(frameEndUs - frameStartUs));
+  return frameStartUs;
+}
+
+void irHoldFinish() {
+  if (irHold.timedOut) {
+    irHoldStats.timeouts++;
+  } else {
+    irHoldStats.releases++;
+  }
+  Log<LOG_LVL_INFO, LOG_IR>::printf("⏹ Botão solto: %s - %s (%u repetições%s)", irHold.code.device,
+                                    irHold.code.button, irHold.repeats, irHold.timedOut ? ", sem keep-alive" : "");
+  irHold.active = false;
+}
+
+// Dono do emissor. Um novo início encerra a sessão anterior sem esperar as repetições mínimas:
+// o quadro inicial do novo código já interrompe o que o aparelho estava recebendo.
+void irHoldApply(const IRHoldCommand& command) {
+  if (command.action == IR_HOLD_KEEP) {
+    if (irHold.active) {
+      irHold.keepAliveAtMs = millis();
+      irHoldStats.keepAlives++;
+    }
+    return;
+  }
+  if (command.action == IR_HOLD_END) {
+    irHold.ending = irHold.active;
+    return;
+  }
+  if (irHold.active) {
+    irHoldFinish();
+  }
+  irHold.code = command.code;
+  irHold.active = true;
+  irHold.ending = false;
+  irHold.timedOut = false;
+  irHold.repeats = 0;
+  irHold.periodUs = protocolInfo(command.code.protocol).repeatPeriodMs * 1000UL;
+  irHold.keepAliveAtMs = millis();
+  irHoldStats.holds++;
+  Log<LOG_LVL_INFO, LOG_IR>::printf("🔁 Botão segurado: %s - %s (repetição a cada %u ms)", irHold.code.device,
+                                    irHold.code.button, (unsigned)(irHold.periodUs / 1000));
+  irHold.lastFrameUs = irHoldSendFrame(true);
+  if (command.requestedAtUs != 0) {
+    histogramRecord(irHoldStats.start, (uint32_t)(irHold.lastFrameUs - command.requestedAtUs));
+  }
+}
+
+// Produtores (handlers HTTP e UDP). Sem DUAL_CORE_TASKS aplica na hora, como irTxSubmit()
+bool irHoldSubmit(uint8_t action, const IRCode* code, unsigned long requestedAtUs) {
+  IRHoldCommand command;
+  command.action = action;
+  if (code != NULL) {
+    command.code = *code;
+  }
+  command.requestedAtUs = requestedAtUs;
+#if DUAL_CORE_TASKS
+  if (!irHoldQueue.push(command, NULL)) {
+    return false;
+  }
+  xTaskNotifyGive(power.loopTask);
+#else
+  irHoldApply(command);
+#endif
+  return true;
+}
+
+// Início pelo id do código; NULL em sucesso, senão o erro para a resposta
+const char* irHoldBegin(int id, unsigned long requestedAtUs, uint8_t* periodMs) {
+  IRCode code;
+  {
+    CodeStoreReader codes;
+    if (id < 0 || id >= codes->count || id >= MAX_CODES) {
+      return "invalid_id";
+    }
+    code = codes->codes[id];
+  }
+  // Quadros longos (ar-condicionado) e protocolos sem período conhecido só têm envio único
+  const IRProtocolInfo& info = protocolInfo(code.protocol);
+  if (info.repeatPeriodMs == 0 || info.send == NULL) {
+    return "hold_not_supported";
+  }
+  if (!irHoldSubmit(IR_HOLD_BEGIN, &code, requestedAtUs)) {
+    return "hold_queue_full";
+  }
+  *periodMs = info.repeatPeriodMs;
+  return NULL;
+}
+
+// loopTask (ou fase IR do loop()): próxima repetição quando o período vence. O agendamento parte do
+// início real do último quadro, então um atraso nunca encurta o intervalo seguinte abaixo do nativo.
+void irHoldTick() {
+#if DUAL_CORE_TASKS
+  IRHoldCommand command;
+  while (irHoldQueue.pop(command, NULL)) {
+    irHoldApply(command);
+  }
+#endif
+  if (!irHold.active) {
+    return;
+  }
+  if (!irHold.ending && millis() - irHold.keepAliveAtMs >= IR_HOLD_TIMEOUT_MS) {
+    irHold.ending = true;
+    irHold.timedOut = true;
+  }
+  if (irHold.ending && irHold.repeats >= protocolInfo(irHold.code.protocol).minRepeats) {
+    irHoldFinish();
+    return;
+  }
+  if ((long)(micros() - (irHold.lastFrameUs + irHold.periodUs)) < 0) {
+    return;
+  }
+  unsigned long frameStartUs = irHoldSendFrame(false);
+  uint32_t intervalUs = (uint32_t)(frameStartUs - irHold.lastFrameUs);
+  uint32_t lateUs = intervalUs - irHold.periodUs;
+  histogramRecord(irHoldStats.interval, intervalUs);
+  histogramRecord(irHoldStats.lateness, lateUs);
+  if (lateUs > IR_HOLD_LATE_US) {
+    irHoldStats.late++;
+  }
+  irHold.lastFrameUs = frameStartUs;
+  if (irHold.repeats < 255) {
+    irHold.repeats++;
+  }
+}
+
+// Variante UDP, sem uma conexão HTTP por keep-alive. Sem resposta: erros só no log.
+void irHoldUdpPoll() {
+  char packet[16];
+  for (uint8_t i = 0; i < IR_HOLD_QUEUE_SIZE; i++) {
+    if (holdUdp.parsePacket() <= 0) {
+      return;
+    }
+    unsigned long receivedAtUs = micros();
+    int length = holdUdp.read(packet, sizeof(packet) - 1);
+    if (length <= 0) {
+      continue;
+    }
+    packet[length] = '\0';
+    const char* error = NULL;
+    if (packet[0] == 'B') {
+      char* end;
+      long id = strtol(packet + 1, &end, 10);
+      uint8_t periodMs;
+      error = (end == packet + 1) ? "id_required" : irHoldBegin((int)id, receivedAtUs, &periodMs);
+    } else if (packet[0] == 'K') {
+      error = irHoldSubmit(IR_HOLD_KEEP, NULL, 0) ? NULL : "hold_queue_full";
+    } else if (packet[0] == 'E') {
+      error = irHoldSubmit(IR_HOLD_END, NULL, 0) ? NULL : "hold_queue_full";
+    } else {
+      error = "unknown_command";
+    }
+    if (error != NULL) {
+      Log<LOG_LVL_WARN, LOG_HTTP>::printf("⚠ UDP %s:%u: %s", holdUdp.remoteIP().toString().c_str(),
+                                          holdUdp.remotePort(), error);
+    }
+  }
+}
+
+// Fase HTTP: servidor web e datagramas do botão segurado
+void netServeClients() {
+  httpHandleClient();
+  irHoldUdpPoll();
+}
+
+// O índice só vale para a mesma cópia (leitor ou escritor) em que foi procurado
+int findCodeIndex(const CodeStoreData& store, const char* device, const char* button) {
+  // Validação de segurança: verificar limites
+  if (!device || !button || store.count < 0 || store.count > MAX_CODES) {
+    return -1;
+  }
+  
+  for (int i = 0; i < store.count; i++) {
+    if (strcmp(store.codes[i].device, device) == 0 &&
+        strcmp(store.codes[i].button, button) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+uint64_t findCode(const CodeStoreData& store, const char* device, const char* button) {
+  int index = findCodeIndex(store, device, button);
+  return index >= 0 ? store.codes[index].code : 0ULL;
+}
+
+void toggleLearningMode() {
+  isLearning = !isLearning;
+  
+  if (isLearning) {
+    Log<LOG_LVL_INFO, LOG_IR>::printf("✓ Modo aprendizado ATIVADO (via botão físico)");
+  } else {
+    Log<LOG_LVL_INFO, LOG_IR>::printf("✗ Modo aprendizado DESATIVADO");
+  }
+}
+
+// ============================================================================
+// FUNÇÕES - CONFIG / WIFI
+// ============================================================================
+
+int findWiFiNetwork(const char* ssid) {
+  for (int i = 0; i < wifiNetworkCount; i++) {
+    if (strcmp(wifiNetworks[i].ssid, ssid) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Salvar a lista de redes no Preferences; o cache do enlace é descartado (credencial ou IP podem ter mudado)
+void saveWiFiNetworks() {
+  char keyBuffer[16];
+  wifiPrefs.begin("wifi-config", false);
+  int oldCount = wifiPrefs.getUChar("net_count", 0);
+  for (int i = 0; i < wifiNetworkCount; i++) {
+    makePrefKey(keyBuffer, sizeof(keyBuffer), "net", i);
+    wifiPrefs.putBytes(keyBuffer, &wifiNetworks[i], sizeof(WiFiNetwork));
+  }
+  for (int i = wifiNetworkCount; i < oldCount; i++) {
+    makePrefKey(keyBuffer, sizeof(keyBuffer), "net", i);
+    wifiPrefs.remove(keyBuffer);
+  }
+  wifiPrefs.putUChar("net_count", (uint8_t)wifiNetworkCount);
+  wifiPrefs.putBool("configured", wifiNetworkCount > 0);
+  wifiPrefs.remove("link");
+  wifiPrefs.end();
+  memset(&wifiManager.link, 0, sizeof(wifiManager.link));
+  wifiManager.leaseAtMs = 0;
+  Log<LOG_LVL_INFO, LOG_WIFI>::printf("✓ Redes WiFi salvas: %d", wifiNetworkCount);
+}
+
+// Carregar redes e cache do enlace; credencial única do formato antigo (ssid/password/static) vira net0
+bool loadWiFiNetworks() {
+  char keyBuffer[16];
+  wifiNetworkCount = 0;
+  memset(&wifiManager.link, 0, sizeof(wifiManager.link));
+  wifiPrefs.begin("wifi-config", true);
+  int count = min((int)wifiPrefs.getUChar("net_count", 0), WIFI_MAX_NETWORKS);
+  for (int i = 0; i < count; i++) {
+    makePrefKey(keyBuffer, sizeof(keyBuffer), "net", i);
+    if (wifiPrefs.getBytesLength(keyBuffer) == sizeof(WiFiNetwork) &&
+        wifiPrefs.getBytes(keyBuffer, &wifiNetworks[wifiNetworkCount], sizeof(WiFiNetwork)) == sizeof(WiFiNetwork)) {
+      wifiNetworks[wifiNetworkCount].ssid[MAX_SSID_LENGTH] = '\0';
+      wifiNetworks[wifiNetworkCount].password[MAX_PASSWORD_LENGTH] = '\0';
+      wifiNetworkCount++;
+    }
+  }
+  if (wifiPrefs.getBytesLength("link") == sizeof(WiFiLinkCache)) {
+    wifiPrefs.getBytes("link", &wifiManager.link, sizeof(WiFiLinkCache));
+    wifiManager.link.ssid[MAX_SSID_LENGTH] = '\0';
+  }
+
+  bool migrate = false;
+  if (count == 0 && wifiPrefs.getBool("configured", false)) {
+    String ssidStr = wifiPrefs.getString("ssid", "");
+    String passStr = wifiPrefs.getString("password", "");
+    if (ssidStr.length() > 0 && ssidStr.length() <= MAX_SSID_LENGTH && passStr.length() <= MAX_PASSWORD_LENGTH) {
+      WiFiNetwork& network = wifiNetworks[0];
+      memset(&network, 0, sizeof(network));
+      strncpy(network.ssid, ssidStr.c_str(), MAX_SSID_LENGTH);
+      strncpy(network.password, passStr.c_str(), MAX_PASSWORD_LENGTH);
+      network.priority = 1;
+      if (wifiPrefs.getBytesLength("static") == sizeof(WiFiStaticIP)) {
+        wifiPrefs.getBytes("static", &network.staticIp, sizeof(WiFiStaticIP));
+      }
+      wifiNetworkCount = 1;
+      migrate = true;
+    }
+  }
+  wifiPrefs.end();
+
+  if (migrate) {
+    saveWiFiNetworks();
+    wifiPrefs.begin("wifi-config", false);
+    wifiPrefs.remove("ssid");
+    wifiPrefs.remove("password");
+    wifiPrefs.remove("static");
+    wifiPrefs.end();
+    Log<LOG_LVL_INFO, LOG_WIFI>::printf("✓ Credencial WiFi antiga migrada para a lista de redes");
+  }
+  return wifiNetworkCount > 0;
+}
+
+// Grava só quando algo mudou: reconexões no mesmo AP não gastam flash
+void saveWiFiLinkCache(const WiFiLinkCache& link) {
+  if (memcmp(&link, &wifiManager.link, sizeof(link)) == 0) {
+    return;
+  }
+  wifiManager.link = link;
+  wifiPrefs.begin("wifi-config", false);
+  wifiPrefs.putBytes("link", &link, sizeof(link));
+  wifiPrefs.end();
+  Log<LOG_LVL_INFO, LOG_WIFI>::printf("💾 Enlace WiFi em cache: '%s' canal %u", link.ssid, link.channel);
+}
+
+// Criar Access Point para configuração inicial
+void startConfigAP() {
+  HeapScope heapScope(HEAP_TAG_WIFI);
+  // Quando em modo AP, o ESP32 cria sua própria rede isolada
+  // O gateway deve ser o próprio IP do ESP32 (não o gateway do roteador)
+  IPAddress AP_IP(AP_IP_OCTET_1, AP_IP_OCTET_2, AP_IP_OCTET_3, AP_IP_OCTET_4);
+  IPAddress gateway(AP_IP);  // Gateway é o próprio ESP32 quando em modo AP
+  IPAddress subnet(255, 255, 255, 0);
+  
+  Log<LOG_LVL_INFO, LOG_WIFI>::printf("\n📡 Modo de Configuração - Access Point");
+  Log<LOG_LVL_INFO, LOG_WIFI>::printf("  SSID: %s", AP_SSID);
+  Log<LOG_LVL_INFO, LOG_WIFI>::printf("  IP Configurado: %s", AP_IP.toString().c_str());
+  Log<LOG_LVL_INFO, LOG_WIFI>::printf("  Gateway: %s (próprio ESP32)", gateway.toString().c_str());
+  Log<LOG_LVL_INFO, LOG_WIFI>::printf("  Subnet: %s", subnet.toString().c_str());
+  Log<LOG_LVL_INFO, LOG_WIFI>::printf("  ⚠ IMPORTANTE: Conecte seu Mac ao WiFi 'ESP32-ControleRemoto' primeiro!");
+  Log<LOG_LVL_INFO, LOG_WIFI>::printf("  Depois acesse: http://%s/config", AP_IP.toString().c_str());
+  
+  WiFi.mode(WIFI_AP);
+  delay(200);
+  
+  bool apStarted = WiFi.softAP(AP_SSID, AP_PASSWORD);
+  if (!apStarted) {
+    Log<LOG_LVL_ERROR, LOG_WIFI>::printf("  ✗ ERRO: Falha ao iniciar Access Point! Status: %d", (int)WiFi.status());
+    return;
+  }
+  
+  delay(200);
+  
+  bool configOk = WiFi.softAPConfig(AP_IP, gateway, subnet);
+  if (!configOk) {
+    Log<LOG_LVL_WARN, LOG_WIFI>::printf("  ⚠ Aviso: softAPConfig retornou false, mas continuando...");
+  }
+  
+  delay(200);
+  
+  IPAddress actualIP = WiFi.softAPIP();
+  Log<LOG_LVL_INFO, LOG_WIFI>::printf("\n  ✓ AP iniciado com sucesso!");
+  Log<LOG_LVL_INFO, LOG_WIFI>::printf("  ✓ IP Real do AP: %s", actualIP.toString().c_str());
+  Log<LOG_LVL_INFO, LOG_WIFI>::printf("  ✓ MAC do AP: %s", WiFi.softAPmacAddress().c_str());
+  Log<LOG_LVL_INFO, LOG_WIFI>::printf("  ✓ Clientes conectados: %d", (int)WiFi.softAPgetStationNum());
+  
+  // Verificar se o IP está correto
+  if (actualIP != AP_IP) {
+    Log<LOG_LVL_WARN, LOG_WIFI>::printf("  ⚠ ATENÇÃO: IP real (%s) difere do configurado (%s)", actualIP.toString().c_str(),
+                                        AP_IP.toString().c_str());
+    Log<LOG_LVL_WARN, LOG_WIFI>::printf("  Use o IP real para acessar: http://%s/config", actualIP.toString().c_str());
+  }
+}
+
+const char* configApReasonName(uint8_t reason) {
+  switch (reason) {
+    case CONFIG_AP_OFF: return "off";
+    case CONFIG_AP_NO_CREDENTIALS: return "no_credentials";
+    case CONFIG_AP_STA_FAILURE: return "sta_failure";
+    case CONFIG_AP_BOOT: return "boot";
+    case CONFIG_AP_BUTTON: return "button";
+    case CONFIG_AP_API: return "api";
+    default: return "unknown";
+  }
+}
+
+// Sobe o AP de configuração sem bloquear (AP+STA se houver credenciais); windowMs = tempo mínimo aberto
+void configApOpen(ConfigApReason reason, unsigned long windowMs) {
+  HeapScope heapScope(HEAP_TAG_WIFI);
+  unsigned long now = millis();
+  if (configAp.reason == CONFIG_AP_OFF) {
+    IPAddress AP_IP(AP_IP_OCTET_1, AP_IP_OCTET_2, AP_IP_OCTET_3, AP_IP_OCTET_4);
+    IPAddress gateway(AP_IP);
+    IPAddress subnet(255, 255, 255, 0);
+    WiFi.mode(wifiConfigured ? WIFI_AP_STA : WIFI_AP);
+    WiFi.softAP(AP_SSID, AP_PASSWORD);
+    WiFi.softAPConfig(AP_IP, gateway, subnet);
+    configAp.openedAtMs = now;
+    configAp.closeAtMs = now + windowMs;
+    configAp.opens++;
+    Log<LOG_LVL_INFO, LOG_WIFI>::printf("📡 AP de configuração ativo (%s): http://%s/config", configApReasonName(reason),
+                                        WiFi.softAPIP().toString().c_str());
+  } else if ((long)(now + windowMs - configAp.closeAtMs) > 0) {
+    configAp.closeAtMs = now + windowMs;  // Já aberto: só estende a janela
+  }
+  configAp.reason = reason;
+}
+
+void configApClose() {
+  if (configAp.reason == CONFIG_AP_OFF || !wifiConfigured) {
+    return;  // Sem credenciais o AP é o único acesso
+  }
+  WiFi.softAPdisconnect(true);  // AP+STA -> STA
+  configAp.reason = CONFIG_AP_OFF;
+  Log<LOG_LVL_INFO, LOG_WIFI>::printf("📡 AP de configuração desligado, rádio só em STA");
+}
+
+// Fecha o AP quando a janela passou, a STA está conectada e não há clientes (ou o teto estourou)
+void configApTick() {
+  unsigned long now = millis();
+  if (configAp.reason == CONFIG_AP_OFF || now - configAp.lastCheckMs < 1000) {
+    return;
+  }
+  configAp.lastCheckMs = now;
+  if (wifiManager.state != WIFI_STATE_CONNECTED || (long)(now - configAp.closeAtMs) < 0) {
+    return;
+  }
+  bool idle = WiFi.softAPgetStationNum() == 0;
+  if (idle || now - configAp.closeAtMs > CONFIG_AP_WINDOW_MS) {
+    configApClose();
+  }
+}
+
+const char* wifiAuthName(uint8_t auth) {
+  switch (auth) {
+    case WIFI_AUTH_OPEN: return "open";
+    case WIFI_AUTH_WEP: return "wep";
+    case WIFI_AUTH_WPA_PSK: return "wpa";
+    case WIFI_AUTH_WPA2_PSK: return "wpa2";
+    case WIFI_AUTH_WPA_WPA2_PSK: return "wpa_wpa2";
+    case WIFI_AUTH_WPA2_ENTERPRISE: return "wpa2_enterprise";
+    case WIFI_AUTH_WPA3_PSK: return "wpa3";
+    case WIFI_AUTH_WPA2_WPA3_PSK: return "wpa2_wpa3";
+    default: return "unknown";
+  }
+}
+
+// Copia o resultado de uma varredura concluída para o cache (antes do scanDelete() de quem a pediu)
+void wifiCacheScanResults(int found) {
+  WiFiScanCache& cache = wifiScanCache;
+  cache.count = 0;
+  cache.found = (uint16_t)found;
+  for (int i = 0; i < found; i++) {
+    String ssid = WiFi.SSID(i);
+    if (ssid.length() == 0 || ssid.length() > MAX_SSID_LENGTH) {
+      continue;  // Rede oculta
+    }
+    int8_t rssi = (int8_t)WiFi.RSSI(i);
+    int existing = -1;
+    for (int j = 0; j < cache.count; j++) {
+      if (strcmp(cache.entries[j].ssid, ssid.c_str()) == 0) {
+        existing = j;
+        break;
+      }
+    }
+    if (existing >= 0 && cache.entries[existing].rssi >= rssi) {
+      continue;
+    }
+    if (existing < 0 && cache.count == WIFI_SCAN_CACHE_SIZE) {
+      if (cache.entries[cache.count - 1].rssi >= rssi) {
+        continue;
+      }
+      existing = cache.count - 1;  // Substitui o mais fraco
+    }
+    if (existing < 0) {
+      existing = cache.count++;
+    }
+    // Inserção ordenada: sobe a entrada até a posição do seu RSSI
+    int pos = existing;
+    while (pos > 0 && cache.entries[pos - 1].rssi < rssi) {
+      cache.entries[pos] = cache.entries[pos - 1];
+      pos--;
+    }
+    WiFiScanEntry& entry = cache.entries[pos];
+    memset(entry.ssid, 0, sizeof(entry.ssid));
+    strncpy(entry.ssid, ssid.c_str(), MAX_SSID_LENGTH);
+    entry.rssi = rssi;
+    entry.channel = (uint8_t)WiFi.channel(i);
+    entry.auth = (uint8_t)WiFi.encryptionType(i);
+  }
+  cache.updatedAtMs = millis();
+  cache.scans++;
+}
+
+// Varredura para /api/wifi/scan: só com o rádio livre (não atrapalha um join em andamento);
+// conectando, a varredura da própria máquina de estados atualiza o cache
+bool wifiRequestScan() {
+  unsigned long now = millis();
+  if (wifiScanCache.running || wifiManager.roamScan || wifiManager.state == WIFI_STATE_SCANNING) {
+    return true;
+  }
+  if (wifiManager.state == WIFI_STATE_CONNECTING) {
+    return false;
+  }
+  if (wifiScanCache.requestedAtMs != 0 && now - wifiScanCache.requestedAtMs < WIFI_SCAN_MIN_INTERVAL_MS) {
+    return false;
+  }
+  wifiScanCache.requestedAtMs = now;
+  if (WiFi.scanNetworks(true) == WIFI_SCAN_FAILED) {
+    return false;
+  }
+  wifiScanCache.running = true;
+  wifiManager.scanStartedMs = now;
+  return true;
+}
+
+const char* wifiStateName(uint8_t state) {
+  switch (state) {
+    case WIFI_STATE_IDLE: return "idle";
+    case WIFI_STATE_SCANNING: return "scanning";
+    case WIFI_STATE_CONNECTING: return "connecting";
+    case WIFI_STATE_CONNECTED: return "connected";
+    case WIFI_STATE_BACKOFF: return "backoff";
+    default: return "unknown";
+  }
+}
+
+void wifiSetState(WiFiState state) {
+  wifiManager.state = state;
+  wifiManager.stateSinceMs = millis();
+}
+
+// Roda na task de eventos do WiFi: só contadores com um único escritor, o loop() faz a transição
+void onWiFiEvent(WiFiEvent_t event, WiFiEventInfo_t info) {
+  switch (event) {
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+      wifiEvents.gotIp++;
+      break;
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+      wifiEvents.lastReason = info.wifi_sta_disconnected.reason;
+      wifiEvents.disconnected++;
+      break;
+    case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+      wifiEvents.lastReason = 0;
+      wifiEvents.disconnected++;
+      break;
+    default:
+      break;
+  }
+}
+
+// Dispara WiFi.begin() e volta na hora; o resultado chega por evento em wifiTick()
+// Com channel/bssid o join é direto (sem a varredura interna do driver). Do cache, reaproveita
+// também o IP de um lease recente, sem esperar o DHCP (que volta a rodar depois de associado).
+void wifiJoin(int index, int32_t channel, const uint8_t* bssid, bool fromCache) {
+  HeapScope heapScope(HEAP_TAG_WIFI);
+  const WiFiNetwork& network = wifiNetworks[index];
+  const WiFiLinkCache& link = wifiManager.link;
+  wifiManager.network = (int8_t)index;
+  wifiManager.fastJoin = fromCache;
+  wifiManager.leaseReused = false;
+  wifiManager.attempts++;
+  wifiSetState(WIFI_STATE_CONNECTING);
+
+  const WiFiStaticIP& staticIp = network.staticIp;
+  if (staticIp.ip != 0) {
+    WiFi.config(IPAddress(staticIp.ip), IPAddress(staticIp.gateway), IPAddress(staticIp.subnet), IPAddress(staticIp.dns));
+  } else if (fromCache && link.ip != 0 && wifiManager.leaseAtMs != 0 &&
+             millis() - wifiManager.leaseAtMs < WIFI_LEASE_REUSE_MS) {
+    WiFi.config(IPAddress(link.ip), IPAddress(link.gateway), IPAddress(link.subnet), IPAddress(link.dns));
+    wifiManager.leaseReused = true;
+  } else {
+    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);  // DHCP
+  }
+
+  if (bssid) {
+    WiFi.begin(network.ssid, network.password, channel, bssid);
+  } else {
+    WiFi.begin(network.ssid, network.password);
+  }
+  Log<LOG_LVL_INFO, LOG_WIFI>::printf("📡 WiFi: tentativa %u em '%s'%s%s", wifiManager.attempt, network.ssid,
+                                      fromCache ? " (join direto)" : (bssid ? "" : " (sem varredura)"),
+                                      wifiManager.leaseReused ? " (IP em cache)" : "");
+}
+
+// Rede de maior prioridade que ainda não falhou nesta rodada (-1 = todas falharam)
+int wifiNextByPriority() {
+  int best = -1;
+  for (int i = 0; i < wifiNetworkCount; i++) {
+    if (wifiManager.failedMask & (1 << i)) {
+      continue;
+    }
+    if (best < 0 || wifiNetworks[i].priority > wifiNetworks[best].priority) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+// Melhor rede conhecida na varredura: sinal utilizável primeiro, depois prioridade, depois RSSI.
+// Devolve o índice em wifiNetworks e, em scanIndex, o AP escolhido (o mais forte daquela rede).
+int wifiSelectNetwork(int found, int* scanIndex) {
+  int best = -1;
+  int bestRssi = 0;
+  for (int i = 0; i < found; i++) {
+    int index = findWiFiNetwork(WiFi.SSID(i).c_str());
+    if (index < 0 || (wifiManager.failedMask & (1 << index))) {
+      continue;
+    }
+    int rssi = WiFi.RSSI(i);
+    if (best >= 0) {
+      bool usable = rssi >= WIFI_MIN_USABLE_RSSI_DBM;
+      bool bestUsable = bestRssi >= WIFI_MIN_USABLE_RSSI_DBM;
+      uint8_t priority = wifiNetworks[index].priority;
+      uint8_t bestPriority = wifiNetworks[best].priority;
+      if (usable != bestUsable) {
+        if (!usable) continue;
+      } else if (priority != bestPriority) {
+        if (priority < bestPriority) continue;
+      } else if (rssi <= bestRssi) {
+        continue;
+      }
+    }
+    best = index;
+    bestRssi = rssi;
+    *scanIndex = i;
+  }
+  return best;
+}
+
+// Próxima tentativa: join direto pelo cache se a rede dele ainda vale; senão varredura assíncrona
+// e a escolha sai em wifiOnScanDone()
+void wifiBeginAttempt() {
+  wifiManager.attempt++;
+  const WiFiLinkCache& link = wifiManager.link;
+  int cached = link.valid ? findWiFiNetwork(link.ssid) : -1;
+  if (cached >= 0 && !wifiManager.fastJoinFailed && !(wifiManager.failedMask & (1 << cached))) {
+    wifiJoin(cached, link.channel, link.bssid, true);
+    return;
+  }
+
+  wifiManager.fastJoin = false;
+  wifiManager.roamScan = false;
+  int16_t result = WiFi.scanNetworks(true);
+  if (result == WIFI_SCAN_FAILED) {
+    int next = wifiNextByPriority();
+    wifiJoin(next >= 0 ? next : 0, 0, nullptr, false);  // Sem varredura: o driver procura sozinho
+    return;
+  }
+  wifiManager.scanStartedMs = millis();
+  wifiSetState(WIFI_STATE_SCANNING);
+}
+
+// Fim da varredura de conexão: escolhe a rede; nenhuma conhecida visível tenta a próxima por
+// prioridade sem BSSID (SSID oculto não aparece na varredura)
+void wifiOnScanDone(int found) {
+  int scanIndex = -1;
+  int index = found > 0 ? wifiSelectNetwork(found, &scanIndex) : -1;
+  if (index >= 0) {
+    Log<LOG_LVL_INFO, LOG_WIFI>::printf("📶 WiFi: %d redes visíveis, escolhida '%s' (%d dBm, canal %ld)", found, wifiNetworks[index].ssid,
+                                        (int)WiFi.RSSI(scanIndex), (long)WiFi.channel(scanIndex));
+    uint8_t bssid[6];
+    memcpy(bssid, WiFi.BSSID(scanIndex), sizeof(bssid));
+    int32_t channel = WiFi.channel(scanIndex);
+    WiFi.scanDelete();
+    wifiJoin(index, channel, bssid, false);
+    return;
+  }
+  WiFi.scanDelete();
+  index = wifiNextByPriority();
+  Log<LOG_LVL_WARN, LOG_WIFI>::printf("⚠ WiFi: nenhuma rede conhecida na varredura (%d visíveis)", max(found, 0));
+  wifiJoin(index >= 0 ? index : 0, 0, nullptr, false);
+}
+
+// Varredura de roaming: troca de AP se outro conhecido estiver WIFI_ROAM_MIN_GAIN_DB mais forte
+void wifiEvaluateRoam(int found) {
+  int current = WiFi.RSSI();
+  uint8_t currentBssid[6] = {0};
+  uint8_t* connectedBssid = WiFi.BSSID();
+  if (connectedBssid) {
+    memcpy(currentBssid, connectedBssid, sizeof(currentBssid));
+  }
+  int best = -1;
+  int bestScan = -1;
+  int bestRssi = current + WIFI_ROAM_MIN_GAIN_DB - 1;
+  for (int i = 0; i < found; i++) {
+    int index = findWiFiNetwork(WiFi.SSID(i).c_str());
+    int rssi = WiFi.RSSI(i);
+    if (index < 0 || rssi <= bestRssi || memcmp(WiFi.BSSID(i), currentBssid, sizeof(currentBssid)) == 0) {
+      continue;
+    }
+    best = index;
+    bestScan = i;
+    bestRssi = rssi;
+  }
+  if (best < 0) {
+    WiFi.scanDelete();
+    Log<LOG_LVL_INFO, LOG_WIFI>::printf("📶 WiFi: sinal fraco (%d dBm), nenhum AP melhor", current);
+    return;
+  }
+  Log<LOG_LVL_INFO, LOG_WIFI>::printf("📶 WiFi: roaming de %d dBm para '%s' %s (%d dBm)", current, wifiNetworks[best].ssid,
+                                      WiFi.BSSIDstr(bestScan).c_str(), bestRssi);
+  uint8_t bssid[6];
+  memcpy(bssid, WiFi.BSSID(bestScan), sizeof(bssid));
+  int32_t channel = WiFi.channel(bestScan);
+  WiFi.scanDelete();
+  wifiManager.roams++;
+  wifiManager.roamStartedMs = millis();
+  wifiManager.attempt = 1;
+  wifiManager.failedMask = 0;
+  wifiJoin(best, channel, bssid, false);  // begin() desassocia do AP atual (ASSOC_LEAVE, ignorado)
+}
+
+// Amostra o RSSI da conexão e, se a média cair abaixo do limiar, varre em segundo plano
+void wifiSampleLink() {
+  unsigned long now = millis();
+  if (now - wifiManager.lastRssiSampleMs < WIFI_RSSI_SAMPLE_MS) {
+    return;
+  }
+  wifiManager.lastRssiSampleMs = now;
+  int rssi = WiFi.RSSI();
+  if (rssi == 0) {
+    return;
+  }
+  wifiManager.rssiAvg = wifiManager.rssiAvg == 0 ? rssi : wifiManager.rssiAvg * 0.75f + rssi * 0.25f;
+  wifiManager.rssiMin = (int8_t)min((int)wifiManager.rssiMin, rssi);
+  if (wifiManager.roamScan || wifiManager.rssiAvg >= WIFI_ROAM_RSSI_DBM ||
+      (wifiManager.lastRoamScanMs != 0 && now - wifiManager.lastRoamScanMs < WIFI_ROAM_SCAN_INTERVAL_MS)) {
+    return;
+  }
+  wifiManager.lastRoamScanMs = now;
+  if (WiFi.scanNetworks(true) != WIFI_SCAN_FAILED) {
+    wifiManager.roamScan = true;
+    wifiManager.scanStartedMs = now;
+    Log<LOG_LVL_INFO, LOG_WIFI>::printf("📶 WiFi: RSSI médio %.0f dBm, procurando AP melhor", wifiManager.rssiAvg);
+  }
+}
+
+// Nova conexão pedida (boot, nova credencial ou /api/wifi/reconnect): zera o backoff
+void wifiStartConnect() {
+  if (!wifiConfigured) {
+    return;
+  }
+  wifiManager.attempt = 0;
+  wifiManager.backoffMs = 0;
+  wifiManager.fastJoinFailed = false;
+  wifiManager.failedMask = 0;
+  wifiManager.roamStartedMs = 0;
+  wifiBeginAttempt();
+}
+
+// Falha: tenta já a próxima rede salva; quando todas falharam, espera com backoff exponencial
+void wifiScheduleRetry(uint8_t reason) {
+  wifiManager.lastReason = reason;
+  wifiManager.failedAttempts++;
+  wifiManager.roamStartedMs = 0;
+  if (wifiManager.fastJoin) {
+    // Cache desatualizado (AP trocou de canal, lease perdido): tenta já com varredura completa
+    wifiManager.fastJoinFailed = true;
+    Log<LOG_LVL_WARN, LOG_WIFI>::printf("⚠ WiFi: join direto falhou (motivo %u), fazendo varredura", reason);
+    wifiBeginAttempt();
+    return;
+  }
+  if (wifiManager.network >= 0) {
+    wifiManager.failedMask |= 1 << wifiManager.network;
+  }
+  if (wifiNextByPriority() >= 0) {
+    Log<LOG_LVL_WARN, LOG_WIFI>::printf("⚠ WiFi: '%s' falhou (motivo %u), tentando a próxima rede",
+                                        wifiManager.network >= 0 ? wifiNetworks[wifiManager.network].ssid : "", reason);
+    wifiBeginAttempt();
+    return;
+  }
+  wifiManager.failedMask = 0;  // Rodada seguinte volta a considerar todas
+  if (wifiManager.backoffMs == 0) {
+    wifiManager.backoffMs = WIFI_BACKOFF_MIN_MS;
+  } else if (wifiManager.backoffMs < WIFI_BACKOFF_MAX_MS) {
+    wifiManager.backoffMs = min(wifiManager.backoffMs * 2, WIFI_BACKOFF_MAX_MS);
+  }
+  // Jitter de até 25% para as unidades não voltarem juntas depois de uma queda do roteador
+  uint32_t delayMs = wifiManager.backoffMs + (uint32_t)random(wifiManager.backoffMs / 4 + 1);
+  wifiManager.nextAttemptMs = millis() + delayMs;
+  wifiSetState(WIFI_STATE_BACKOFF);
+  if (configAp.reason == CONFIG_AP_OFF || configAp.reason == CONFIG_AP_BOOT) {
+    configApOpen(CONFIG_AP_STA_FAILURE, 0);  // Sem rede: AP até a STA voltar
+  }
+  Log<LOG_LVL_WARN, LOG_WIFI>::printf("⚠ WiFi: falha (motivo %u), nova tentativa em %lu ms", reason, (unsigned long)delayMs);
+}
+
+// Enlace atual (AP, canal e endereço) no cache do próximo join direto
+void wifiCacheLink() {
+  WiFiLinkCache link;
+  memset(&link, 0, sizeof(link));
+  uint8_t* bssid = WiFi.BSSID();
+  if (bssid) {
+    link.valid = 1;
+    strncpy(link.ssid, wifiNetworks[wifiManager.network].ssid, MAX_SSID_LENGTH);
+    memcpy(link.bssid, bssid, sizeof(link.bssid));
+    link.channel = (uint8_t)WiFi.channel();
+    link.ip = (uint32_t)WiFi.localIP();
+    link.gateway = (uint32_t)WiFi.gatewayIP();
+    link.subnet = (uint32_t)WiFi.subnetMask();
+    link.dns = (uint32_t)WiFi.dnsIP();
+    saveWiFiLinkCache(link);
+  }
+}
+
+void wifiOnConnected() {
+  unsigned long now = millis();
+  wifiManager.connects++;
+  wifiManager.attempt = 0;
+  wifiManager.backoffMs = 0;
+  wifiManager.lastReason = 0;
+  wifiManager.fastJoinFailed = false;
+  wifiManager.failedMask = 0;
+  wifiManager.rssiAvg = WiFi.RSSI();
+  wifiManager.rssiMin = (int8_t)wifiManager.rssiAvg;
+  wifiManager.lastRssiSampleMs = now;
+  wifiSetState(WIFI_STATE_CONNECTED);
+  if ((configAp.reason == CONFIG_AP_STA_FAILURE || configAp.reason == CONFIG_AP_NO_CREDENTIALS) &&
+      (long)(now + CONFIG_AP_GRACE_MS - configAp.closeAtMs) > 0) {
+    configAp.closeAtMs = now + CONFIG_AP_GRACE_MS;
+  }
+
+  if (wifiManager.roamStartedMs != 0) {
+    wifiManager.lastRoamMs = now - wifiManager.roamStartedMs;
+    wifiManager.roamStartedMs = 0;
+    Log<LOG_LVL_INFO, LOG_WIFI>::printf("✓ WiFi: roaming concluído em %lu ms", (unsigned long)wifiManager.lastRoamMs);
+  } else if (wifiManager.droppedAtMs != 0) {
+    uint32_t elapsedMs = now - wifiManager.droppedAtMs;
+    wifiManager.droppedAtMs = 0;
+    wifiManager.reconnects++;
+    wifiManager.lastReconnectMs = elapsedMs;
+    wifiManager.totalReconnectMs += elapsedMs;
+    wifiManager.maxReconnectMs = max(wifiManager.maxReconnectMs, elapsedMs);
+    wifiManager.lastReconnectFast = wifiManager.fastJoin;
+    Log<LOG_LVL_INFO, LOG_WIFI>::printf("✓ WiFi reconectado em %lu ms", (unsigned long)elapsedMs);
+  } else if (wifiManager.bootConnectMs == 0) {
+    wifiManager.bootConnectMs = now;
+  }
+  const WiFiNetwork& network = wifiNetworks[wifiManager.network];
+  if (network.staticIp.ip == 0 && !wifiManager.leaseReused) {
+    wifiManager.leaseAtMs = now;
+  }
+  wifiCacheLink();
+
+  Log<LOG_LVL_INFO, LOG_WIFI>::printf("✓ WiFi conectado em '%s': %s (RSSI %d dBm)", network.ssid,
+                                      WiFi.localIP().toString().c_str(), (int)WiFi.RSSI());
+  if (wifiManager.leaseReused) {
+    // O IP em cache só adiantou a subida do enlace: sem cliente DHCP o lease nunca seria renovado e o
+    // roteador poderia entregar o endereço a outro. O DHCP volta a rodar; o GOT_IP dele chega em wifiTick()
+    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+    Log<LOG_LVL_INFO, LOG_WIFI>::printf("📡 WiFi: renovando o lease do IP em cache por DHCP");
+  }
+}
+
+// DHCP concluído numa conexão que subiu com o IP em cache
+void wifiOnLeaseRenewed() {
+  wifiManager.leaseReused = false;
+  wifiManager.leaseAtMs = millis();
+  wifiCacheLink();  // O roteador pode ter dado outro endereço
+  Log<LOG_LVL_INFO, LOG_WIFI>::printf("✓ WiFi: lease renovado por DHCP: %s", WiFi.localIP().toString().c_str());
+}
+
+// Máquina de estados do WiFi, chamada a cada volta do loop(): nunca bloqueia
+void wifiTick() {
+  unsigned long now = millis();
+
+  uint32_t disconnected = wifiEvents.disconnected;
+  if (disconnected != wifiManager.seenDisconnected) {
+    wifiManager.seenDisconnected = disconnected;
+    uint8_t reason = wifiEvents.lastReason;
+    // ASSOC_LEAVE é a nossa própria desassociação ao chamar begin()/disconnect()
+    if (wifiManager.state == WIFI_STATE_CONNECTED) {
+      wifiManager.disconnects++;
+      Log<LOG_LVL_WARN, LOG_WIFI>::printf("⚠ WiFi desconectado (motivo %u)", reason);
+      wifiManager.lastReason = reason;
+      wifiManager.attempt = 0;
+      wifiManager.droppedAtMs = millis();
+      wifiManager.roamScan = false;
+      wifiBeginAttempt();  // Primeira tentativa após queda é imediata
+    } else if (wifiManager.state == WIFI_STATE_CONNECTING && reason != WIFI_REASON_ASSOC_LEAVE) {
+      wifiScheduleRetry(reason);
+    }
+  }
+
+  uint32_t gotIp = wifiEvents.gotIp;
+  if (gotIp != wifiManager.seenGotIp) {
+    wifiManager.seenGotIp = gotIp;
+    if (wifiManager.state == WIFI_STATE_CONNECTING && WiFi.status() == WL_CONNECTED) {
+      wifiOnConnected();
+    } else if (wifiManager.state == WIFI_STATE_CONNECTED && wifiManager.leaseReused) {
+      wifiOnLeaseRenewed();
+    }
+  }
+
+  if (wifiManager.state == WIFI_STATE_SCANNING || wifiManager.roamScan || wifiScanCache.running) {
+    int16_t found = WiFi.scanComplete();
+    bool timedOut = found == WIFI_SCAN_RUNNING && now - wifiManager.scanStartedMs > WIFI_SCAN_TIMEOUT_MS;
+    if (found != WIFI_SCAN_RUNNING || timedOut) {
+      if (timedOut) {
+        WiFi.scanDelete();
+        found = 0;
+      } else if (found >= 0) {
+        wifiCacheScanResults(found);
+      }
+      wifiScanCache.running = false;
+      if (wifiManager.roamScan) {
+        wifiManager.roamScan = false;
+        if (wifiManager.state == WIFI_STATE_CONNECTED) {
+          wifiEvaluateRoam(max((int)found, 0));
+        } else {
+          WiFi.scanDelete();
+        }
+      } else if (wifiManager.state == WIFI_STATE_SCANNING) {
+        wifiOnScanDone(found);
+      } else {
+        WiFi.scanDelete();
+      }
+    }
+  }
+
+  switch (wifiManager.state) {
+    case WIFI_STATE_CONNECTED:
+      wifiSampleLink();
+      break;
+    case WIFI_STATE_CONNECTING:
+      if (now - wifiManager.stateSinceMs > (wifiManager.fastJoin ? WIFI_FAST_JOIN_TIMEOUT_MS : WIFI_CONNECT_TIMEOUT_MS)) {
+        WiFi.disconnect();
+        wifiScheduleRetry(0);
+      }
+      break;
+    case WIFI_STATE_BACKOFF:
+      if ((long)(now - wifiManager.nextAttemptMs) >= 0) {
+        wifiBeginAttempt();
+      }
+      break;
+    default:
+      break;
+  }
+
+  configApTick();
+}
+
+// Configurar WiFi (tenta carregar credenciais ou cria AP)
+void setupWiFi() {
+  WiFi.onEvent(onWiFiEvent);
+  WiFi.setAutoReconnect(false);  // Reconexão fica com wifiTick(), com backoff
+
+  // Tentar carregar as redes salvas
+  wifiManager.network = -1;
+  if (loadWiFiNetworks()) {
+    Log<LOG_LVL_INFO, LOG_WIFI>::printf("📡 %d rede(s) WiFi salva(s), conectando em segundo plano...", wifiNetworkCount);
+    wifiConfigured = true;
+    if (CONFIG_AP_BOOT_WINDOW_MS > 0) {
+      configApOpen(CONFIG_AP_BOOT, CONFIG_AP_BOOT_WINDOW_MS);
+    } else {
+      WiFi.mode(WIFI_STA);
+    }
+    wifiStartConnect();
+    return;
+  }
+
+  Log<LOG_LVL_INFO, LOG_WIFI>::printf("📡 Nenhuma credencial WiFi encontrada, iniciando modo AP...");
+  startConfigAP();
+  wifiConfigured = false;
+  configAp.reason = CONFIG_AP_NO_CREDENTIALS;
+  configAp.openedAtMs = millis();
+  configAp.opens++;
+}
+
+// ============================================================================
+// FUNÇÕES - ENERGIA
+// ============================================================================
+
+const char* powerWakeSourceName(uint8_t source) {
+  switch (source) {
+    case POWER_WAKE_IR: return "ir";
+    case POWER_WAKE_BUTTON: return "button";
+    default: return "unknown";
+  }
+}
+
+// Acorda o loop da espera ociosa (powerIdle)
+void IRAM_ATTR powerNotifyFromISR() {
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(power.loopTask, &woken);
+  if (woken) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+// Marca a borda de um wake (só a primeira até o loop tratar) e acorda o loop
+void IRAM_ATTR powerWakeFromISR(uint8_t source, uint32_t edgeUs) {
+  if (power.edgeUs[source] == 0) {
+    power.edgeUs[source] = edgeUs | 1;  // Nunca 0: 0 = sem evento pendente
+  }
+  powerNotifyFromISR();
+}
+
+// ISR de nível baixo do receptor IR (ativo em LOW): o mesmo tipo que gpio_wakeup_enable() exige
+// para acordar do light sleep. Desarma o pino (senão o nível redispara durante o quadro).
+void IRAM_ATTR onIRWakeEdge() {
+  gpio_ll_set_intr_type(GPIO_LL_GET_HW(GPIO_PORT_0), (gpio_num_t)IR_RECEIVER_PIN, GPIO_INTR_DISABLE);
+  powerWakeFromISR(POWER_WAKE_IR, (uint32_t)micros());
+}
+
+void powerArmIR() {
+  power.irArmed = true;
+  gpio_set_intr_type((gpio_num_t)IR_RECEIVER_PIN, GPIO_INTR_LOW_LEVEL);
+}
+
+void powerHold(unsigned long ms) {
+  unsigned long until = millis() + ms;
+  if ((long)(until - power.holdUntilMs) > 0) {
+    power.holdUntilMs = until;
+  }
+  if (!power.awakeLockHeld && power.awakeLock != NULL) {
+    esp_pm_lock_acquire(power.awakeLock);
+    power.awakeLockHeld = true;
+  }
+}
+
+// Aplica o perfil. Sem suporte a light sleep automático no build, cai para só DFS; sem
+// CONFIG_PM_ENABLE, para frequência fixa em maxMhz.
+void powerApply(uint8_t profileIndex) {
+  const PowerProfileConfig& profile = POWER_PROFILES[profileIndex];
+  power.profile = profileIndex;
+  power.idleUs = 0;
+  power.profileSinceUs = micros();
+
+  // Em AP+STA o driver ignora o modem sleep: o AP precisa transmitir beacons
+  WiFi.setSleep(profile.wifiSleep);
+
+  esp_pm_config_esp32_t pmConfig;
+  pmConfig.max_freq_mhz = profile.maxMhz;
+  pmConfig.min_freq_mhz = profile.minMhz;
+  pmConfig.light_sleep_enable = profile.lightSleep;
+  esp_err_t err = esp_pm_configure(&pmConfig);
+  if (err != ESP_OK && profile.lightSleep) {
+    pmConfig.light_sleep_enable = false;
+    err = esp_pm_configure(&pmConfig);
+  }
+  power.pmError = err;
+  power.lightSleep = err == ESP_OK && pmConfig.light_sleep_enable;
+  if (err != ESP_OK) {
+    setCpuFrequencyMhz(profile.maxMhz);
+  }
+
+  if (power.lightSleep) {
+    // O botão acorda no nível que a ISR dele está esperando; se mudar no meio, o nível redispara
+    gpio_wakeup_enable((gpio_num_t)IR_RECEIVER_PIN, GPIO_INTR_LOW_LEVEL);
+    gpio_wakeup_enable((gpio_num_t)BUTTON_LEARNING, buttonInput.rawDown ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+    esp_sleep_enable_gpio_wakeup();
+  } else {
+    gpio_wakeup_disable((gpio_num_t)IR_RECEIVER_PIN);
+    gpio_wakeup_disable((gpio_num_t)BUTTON_LEARNING);
+  }
+  powerArmIR();
+  Log<LOG_LVL_INFO, LOG_POWER>::printf("🔋 Energia: perfil '%s' (WiFi PS %d, CPU %u-%u MHz, light sleep %s)", profile.name,
+                                       (int)profile.wifiSleep, profile.maxMhz, pmConfig.min_freq_mhz,
+                                       power.lightSleep ? "ativo" : (profile.lightSleep ? "indisponível" : "desligado"));
+}
+
+void savePowerProfile() {
+  Preferences powerPrefs;
+  powerPrefs.begin("power-config", false);
+  powerPrefs.putUChar("profile", power.profile);
+  powerPrefs.end();
+}
+
+void setupPower() {
+  power.loopTask = xTaskGetCurrentTaskHandle();
+  if (esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "wake-hold", &power.awakeLock) != ESP_OK) {
+    power.awakeLock = NULL;  // Build sem CONFIG_PM_ENABLE
+  }
+  attachInterrupt(digitalPinToInterrupt(IR_RECEIVER_PIN), onIRWakeEdge, ONLOW);
+
+  Preferences powerPrefs;
+  powerPrefs.begin("power-config", true);
+  uint8_t profile = powerPrefs.getUChar("profile", POWER_PERFORMANCE);
+  powerPrefs.end();
+  powerApply(profile < POWER_PROFILE_COUNT ? profile : (uint8_t)POWER_PERFORMANCE);
+}
+
+// Início de cada volta do loop(): mede a latência dos wakes pendentes, rearma os pinos e solta o
+// lock de acordado quando a janela passou
+void powerTick() {
+  unsigned long now = millis();
+  for (uint8_t source = 0; source < POWER_WAKE_SOURCE_COUNT; source++) {
+    uint32_t edgeUs = power.edgeUs[source];
+    if (edgeUs != 0) {
+      if (source == POWER_WAKE_IR) {
+        power.irArmed = false;
+      }
+      histogramRecord(power.wakeLatency[power.profile][source], (uint32_t)micros() - edgeUs);
+      power.edgeUs[source] = 0;
+      power.wakes[source]++;
+      powerHold(source == POWER_WAKE_IR ? POWER_IR_HOLD_MS : POWER_BUTTON_HOLD_MS);
+    }
+  }
 
-bool isLearning = false;
-uint64_t lastReceivedCode = 0;  // Atualizado para uint64_t
-uint8_t lastReceivedBits = 0;
-bool codeProcessed = true;  // Flag para rastrear se o código foi processado pela interface
+  bool holding = (long)(power.holdUntilMs - now) > 0;
+  // Só rearma com o receptor em repouso (HIGH): o próximo wake mede a próxima borda
+  if (!power.irArmed && !holding && digitalRead(IR_RECEIVER_PIN) == HIGH) {
+    powerArmIR();
+  }
+  if (power.awakeLockHeld && !holding && !isLearning) {
+    esp_pm_lock_release(power.awakeLock);
+    power.awakeLockHeld = false;
+  }
+}
 
-// Variáveis globais para armazenar dados do código capturado
-IRProtocol lastReceivedProtocol = PROTOCOL_UNKNOWN;
-uint16_t lastReceivedAddress = 0;
-uint16_t lastReceivedCommand = 0;
+// Fim do loop(): sem atividade, espera até idleWaitMs (a task fica bloqueada e o idle pode
+// baixar a frequência ou dormir); uma ISR de wake encerra a espera na hora
+void powerIdle() {
+  const PowerProfileConfig& profile = POWER_PROFILES[power.profile];
+  bool busy = isLearning || (long)(power.holdUntilMs - millis()) > 0 || !irTxQueue.empty() ||
+              irHold.active || !irHoldQueue.empty() ||
+              wifiManager.state == WIFI_STATE_SCANNING || wifiManager.state == WIFI_STATE_CONNECTING;
+  if (profile.idleWaitMs == 0 || busy) {
+    yield();
+    return;
+  }
+  unsigned long startUs = micros();
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(profile.idleWaitMs));
+  unsigned long idleUs = micros() - startUs;
+  power.idleUs += idleUs;
+  taskStats[TASK_LOOP].idleUs += idleUs;
+}
 
 // ============================================================================
-// FUNÇÕES - STORAGE / PREFERENCES
+// FUNÇÕES - BOTÃO
 // ============================================================================
 
-// Função auxiliar para criar chaves de Preferences sem usar String
-void makePrefKey(char* buffer, size_t size, const char* prefix, int index) {
-  snprintf(buffer, size, "%s%d", prefix, index);
+const char* buttonGestureName(uint8_t gesture) {
+  switch (gesture) {
+    case BUTTON_GESTURE_SHORT: return "short";
+    case BUTTON_GESTURE_LONG: return "long";
+    case BUTTON_GESTURE_DOUBLE: return "double";
+    default: return "unknown";
+  }
 }
 
-void saveCodesToPreferences() {
-  // Validação de segurança: garantir que codeCount está dentro dos limites
-  if (codeCount < 0 || codeCount > MAX_CODES) {
-    Serial.printf("✗ Erro: codeCount inválido: %d\n", codeCount);
-    codeCount = (codeCount < 0) ? 0 : MAX_CODES;
+const char* buttonActionName(uint8_t action) {
+  switch (action) {
+    case BUTTON_ACTION_NONE: return "none";
+    case BUTTON_ACTION_LEARN: return "learn";
+    case BUTTON_ACTION_CONFIG_AP: return "config_ap";
+    case BUTTON_ACTION_MACRO: return "macro";
+    default: return "unknown";
   }
-  
-  prefs.putInt("count", codeCount);
-  
-  char keyBuffer[16];  // Buffer reutilizável para chaves
-  
-  for (int i = 0; i < codeCount && i < MAX_CODES; i++) {
-    makePrefKey(keyBuffer, sizeof(keyBuffer), "code", i);
-    prefs.putULong64(keyBuffer, storedCodes[i].code);
-    
-    makePrefKey(keyBuffer, sizeof(keyBuffer), "device", i);
-    prefs.putString(keyBuffer, storedCodes[i].device);
-    
-    makePrefKey(keyBuffer, sizeof(keyBuffer), "button", i);
-    prefs.putString(keyBuffer, storedCodes[i].button);
-    
-    makePrefKey(keyBuffer, sizeof(keyBuffer), "bits", i);
-    prefs.putUChar(keyBuffer, storedCodes[i].bits);
-    
-    // ⭐ NOVO: Salvar protocolo e dados relacionados
-    makePrefKey(keyBuffer, sizeof(keyBuffer), "protocol", i);
-    prefs.putUChar(keyBuffer, (uint8_t)storedCodes[i].protocol);
-    
-    makePrefKey(keyBuffer, sizeof(keyBuffer), "address", i);
-    prefs.putUShort(keyBuffer, storedCodes[i].address);
-    
-    makePrefKey(keyBuffer, sizeof(keyBuffer), "command", i);
-    prefs.putUShort(keyBuffer, storedCodes[i].command);
-    
-    makePrefKey(keyBuffer, sizeof(keyBuffer), "repeats", i);
-    prefs.putUChar(keyBuffer, storedCodes[i].repeats);
+}
+
+int buttonActionFromName(const char* name) {
+  for (uint8_t action = 0; action < BUTTON_ACTION_COUNT; action++) {
+    if (strcmp(buttonActionName(action), name) == 0) {
+      return action;
+    }
   }
-  
-  Serial.printf("✓ %d códigos salvos no Preferences\n", codeCount);
+  return -1;
 }
 
-void loadCodesFromPreferences() {
-  prefs.begin("ir-codes", false);  // Namespace "ir-codes", modo leitura/escrita
-  
-  // ⭐ IMPORTANTE:
-  // A limpeza "começar do zero" deve ocorrer APENAS UMA VEZ, senão todo reboot apaga seus códigos.
-  // Usamos um schema_version para controlar isso.
-  const int CURRENT_SCHEMA_VERSION = 2;
-  int schemaVersion = prefs.getInt("schema_version", 0);
-  codeCount = prefs.getInt("count", 0);
-  
-  // Se estamos migrando de um firmware antigo (sem schema_version), limpamos uma única vez.
-  if (schemaVersion < CURRENT_SCHEMA_VERSION) {
-    Serial.printf("⚠ Migrando storage (schema %d -> %d). Limpando códigos antigos UMA VEZ.\n",
-                  schemaVersion, CURRENT_SCHEMA_VERSION);
-    prefs.clear();
-    prefs.putInt("schema_version", CURRENT_SCHEMA_VERSION);
-    prefs.putInt("count", 0);
-    codeCount = 0;
-    prefs.end();
-    return;
+// Cada borda dispara uma vez: lê o nível, arma o oposto (HIGH_LEVEL pressionado, LOW_LEVEL solto)
+// e enfileira. Repique gera várias bordas em sequência; quem filtra é o loop.
+void IRAM_ATTR onButtonEdge() {
+  uint32_t nowUs = (uint32_t)micros();
+  gpio_dev_t* hw = GPIO_LL_GET_HW(GPIO_PORT_0);
+  bool down = gpio_ll_get_level(hw, (gpio_num_t)BUTTON_LEARNING) == 0;
+  gpio_ll_set_intr_type(hw, (gpio_num_t)BUTTON_LEARNING, down ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+
+  uint8_t head = buttonInput.edgeHead;
+  uint8_t next = (head + 1) & (BUTTON_EDGE_QUEUE_SIZE - 1);
+  if (next == buttonInput.edgeTail) {
+    buttonInput.edgeOverflows++;  // O loop relê o pino
+  } else {
+    buttonInput.edges[head].atUs = nowUs;
+    buttonInput.edges[head].down = down;
+    buttonInput.edgeHead = next;
   }
-  
-  // Validação de segurança: garantir limites válidos
-  if (codeCount > MAX_CODES || codeCount < 0) {
-    Serial.println("⚠ Preferences corrompidos ou vazios, iniciando sem códigos");
-    codeCount = 0;
-    prefs.end();
+  if (down) {
+    powerWakeFromISR(POWER_WAKE_BUTTON, nowUs);
+  } else {
+    powerNotifyFromISR();
+  }
+}
+
+void buttonPostEvent(uint8_t gesture, unsigned long now, unsigned long pressMs) {
+  ButtonEvent event;
+  event.gesture = gesture;
+  event.atMs = now;
+  event.pressMs = pressMs;
+  if (!buttonInput.events.push(event)) {
     return;
   }
-  
-  char keyBuffer[16];  // Buffer reutilizável para chaves
-  char tempBuffer[64];  // Buffer temporário para strings do Preferences
-  
-  for (int i = 0; i < codeCount && i < MAX_CODES; i++) {
-    makePrefKey(keyBuffer, sizeof(keyBuffer), "code", i);
-    storedCodes[i].code = prefs.getULong64(keyBuffer, 0ULL);
-    
-    makePrefKey(keyBuffer, sizeof(keyBuffer), "device", i);
-    size_t len = prefs.getString(keyBuffer, tempBuffer, sizeof(tempBuffer));
-    if (len > 0) {
-      strncpy(storedCodes[i].device, tempBuffer, MAX_DEVICE_NAME);
-      storedCodes[i].device[MAX_DEVICE_NAME] = '\0';
-    } else {
-      storedCodes[i].device[0] = '\0';
-    }
-    
-    makePrefKey(keyBuffer, sizeof(keyBuffer), "button", i);
-    len = prefs.getString(keyBuffer, tempBuffer, sizeof(tempBuffer));
-    if (len > 0) {
-      strncpy(storedCodes[i].button, tempBuffer, MAX_BUTTON_NAME);
-      storedCodes[i].button[MAX_BUTTON_NAME] = '\0';
-    } else {
-      storedCodes[i].button[0] = '\0';
-    }
-    
-    makePrefKey(keyBuffer, sizeof(keyBuffer), "bits", i);
-    storedCodes[i].bits = prefs.getUChar(keyBuffer, 32);
-    
-    // ⭐ NOVO: Carregar protocolo e dados relacionados
-    makePrefKey(keyBuffer, sizeof(keyBuffer), "protocol", i);
-    storedCodes[i].protocol = (IRProtocol)prefs.getUChar(keyBuffer, PROTOCOL_UNKNOWN);
-    
-    makePrefKey(keyBuffer, sizeof(keyBuffer), "address", i);
-    storedCodes[i].address = prefs.getUShort(keyBuffer, 0);
-    
-    makePrefKey(keyBuffer, sizeof(keyBuffer), "command", i);
-    storedCodes[i].command = prefs.getUShort(keyBuffer, 0);
-    
-    makePrefKey(keyBuffer, sizeof(keyBuffer), "repeats", i);
-    storedCodes[i].repeats = prefs.getUChar(keyBuffer, 0);
+  buttonInput.gestures[gesture]++;
+#if DUAL_CORE_TASKS
+  if (netTask) {
+    xTaskNotifyGive(netTask);
   }
-  
-  Serial.printf("✓ %d códigos carregados do Preferences\n", codeCount);
+#endif
 }
 
-// ============================================================================
-// FUNÇÕES - IR MANAGER
-// ============================================================================
+// Debounce por tempo: um nível só vale depois de BUTTON_DEBOUNCE_MS sem bordas. Gestos: longo ao
+// atingir BUTTON_LONG_PRESS_MS (ainda pressionado), duplo se o 2º toque começa até
+// BUTTON_DOUBLE_PRESS_MS após soltar o 1º. Sem ação no duplo, o curto sai já ao soltar.
+void buttonScan(unsigned long now) {
+  while (buttonInput.edgeTail != buttonInput.edgeHead) {
+    const ButtonEdge& edge = buttonInput.edges[buttonInput.edgeTail];
+    buttonInput.rawDown = edge.down;
+    buttonInput.rawAtUs = edge.atUs;
+    buttonInput.edgesTotal++;
+    buttonInput.edgeTail = (buttonInput.edgeTail + 1) & (BUTTON_EDGE_QUEUE_SIZE - 1);
+  }
+  if (buttonInput.edgeOverflows != buttonInput.seenOverflows) {
+    buttonInput.seenOverflows = buttonInput.edgeOverflows;
+    buttonInput.rawDown = digitalRead(BUTTON_LEARNING) == LOW;
+    buttonInput.rawAtUs = (uint32_t)micros();
+  }
 
-// Função auxiliar para obter nome do protocolo (para logs) - declarada antes de usar
-const char* getProtocolName(IRProtocol protocol) {
-  switch(protocol) {
-    case PROTOCOL_NEC: return "NEC";
-    case PROTOCOL_SAMSUNG: return "Samsung";
-    case PROTOCOL_SONY: return "Sony";
-    case PROTOCOL_RC5: return "RC5";
-    case PROTOCOL_RC6: return "RC6";
-    case PROTOCOL_PANASONIC: return "Panasonic";
-    case PROTOCOL_LG: return "LG";
-    case PROTOCOL_BOSE: return "Bose";
-    case PROTOCOL_RAW: return "RAW";
-    default: return "Desconhecido";
+  if (buttonInput.rawDown != buttonInput.stableDown &&
+      (uint32_t)micros() - buttonInput.rawAtUs >= BUTTON_DEBOUNCE_MS * 1000UL) {
+    buttonInput.stableDown = buttonInput.rawDown;
+    buttonInput.transitions++;
+    if (buttonInput.stableDown) {
+      buttonInput.pressedAtMs = now - BUTTON_DEBOUNCE_MS;
+      buttonInput.longSent = false;
+    } else if (!buttonInput.longSent) {
+      unsigned long pressMs = now - buttonInput.pressedAtMs;
+      if (buttonInput.pendingShort) {
+        buttonInput.pendingShort = false;
+        buttonPostEvent(BUTTON_GESTURE_DOUBLE, now, pressMs);
+      } else if (buttonInput.actions[BUTTON_GESTURE_DOUBLE] == BUTTON_ACTION_NONE) {
+        buttonPostEvent(BUTTON_GESTURE_SHORT, now, pressMs);
+      } else {
+        buttonInput.pendingShort = true;
+        buttonInput.pendingUntilMs = now + BUTTON_DOUBLE_PRESS_MS;
+      }
+    }
   }
-}
 
-// Função para converter protocolo da biblioteca para nosso enum
-IRProtocol detectProtocol() {
-  decode_type_t detected = IrReceiver.decodedIRData.protocol;
-  
-  switch(detected) {
-    case NEC: return PROTOCOL_NEC;
-    case SAMSUNG: return PROTOCOL_SAMSUNG;
-    case SONY: return PROTOCOL_SONY;
-    case RC5: return PROTOCOL_RC5;
-    case RC6: return PROTOCOL_RC6;
-    case PANASONIC: return PROTOCOL_PANASONIC;
-    case LG: return PROTOCOL_LG;
-    case BOSEWAVE: return PROTOCOL_BOSE;  // BoseWave protocol
-    case UNKNOWN:
-    default: return PROTOCOL_UNKNOWN;
+  if (buttonInput.stableDown && !buttonInput.longSent && now - buttonInput.pressedAtMs >= BUTTON_LONG_PRESS_MS) {
+    buttonInput.longSent = true;
+    if (buttonInput.pendingShort) {
+      buttonInput.pendingShort = false;
+      buttonPostEvent(BUTTON_GESTURE_SHORT, now, 0);
+    }
+    buttonPostEvent(BUTTON_GESTURE_LONG, now, now - buttonInput.pressedAtMs);
+  } else if (buttonInput.pendingShort && !buttonInput.stableDown && buttonInput.rawDown == buttonInput.stableDown &&
+             (long)(now - buttonInput.pendingUntilMs) >= 0) {
+    buttonInput.pendingShort = false;
+    buttonPostEvent(BUTTON_GESTURE_SHORT, now, 0);
   }
 }
 
-void handleReceivedIR() {
-  // Acessa os dados decodificados da nova API
-  lastReceivedCode = IrReceiver.decodedIRData.decodedRawData;
-  lastReceivedBits = IrReceiver.decodedIRData.numberOfBits;
-  
-  // Detectar protocolo automaticamente
-  lastReceivedProtocol = detectProtocol();
-  
-  // Extrair address e command baseado no protocolo
-  if (lastReceivedProtocol == PROTOCOL_NEC || lastReceivedProtocol == PROTOCOL_SAMSUNG || 
-      lastReceivedProtocol == PROTOCOL_LG || lastReceivedProtocol == PROTOCOL_PANASONIC) {
-    // Protocolos que usam address + command
-    lastReceivedAddress = IrReceiver.decodedIRData.address;
-    lastReceivedCommand = IrReceiver.decodedIRData.command;
-  } else if (lastReceivedProtocol == PROTOCOL_SONY) {
-    // Sony usa apenas command
-    lastReceivedAddress = 0;
-    lastReceivedCommand = IrReceiver.decodedIRData.command;
-  } else if (lastReceivedProtocol == PROTOCOL_RC5 || lastReceivedProtocol == PROTOCOL_RC6) {
-    // RC5/RC6 usam address + command
-    lastReceivedAddress = IrReceiver.decodedIRData.address;
-    lastReceivedCommand = IrReceiver.decodedIRData.command;
-  } else if (lastReceivedProtocol == PROTOCOL_BOSE) {
-    // BoseWave usa apenas command (8 bits), sem address
-    lastReceivedAddress = 0;
-    lastReceivedCommand = IrReceiver.decodedIRData.command;
-  } else {
-    // Protocolo desconhecido - tentar extrair do código raw
-    lastReceivedAddress = (lastReceivedCode >> 16) & 0xFFFF;
-    lastReceivedCommand = lastReceivedCode & 0xFFFF;
+void macroStart() {
+  if (buttonMacro.count == 0) {
+    Log<LOG_LVL_WARN, LOG_BUTTON>::printf("⚠ Macro vazia (configure em /api/button)");
+    return;
   }
-  
-  // ⭐ FILTRO 0x0 - Ignorar ruído IR antes de processar
-  if (lastReceivedCode == 0ULL || lastReceivedCode == 0xFFFFFFFFFFFFFFFFULL) {
-    Serial.printf("⚠ Código inválido ignorado: 0x%llX\n", lastReceivedCode);
+  if (buttonMacro.next < buttonMacro.count) {
+    Log<LOG_LVL_WARN, LOG_BUTTON>::printf("⚠ Macro já em execução");
     return;
   }
-  
-  if (isLearning) {
-    codeProcessed = false;  // Marca como não processado para a interface detectar
-    const char* protocolName = getProtocolName(lastReceivedProtocol);
-    Serial.printf("📥 Código recebido (Modo Aprendizado): Protocolo=%s\n", protocolName);
-    Serial.printf("   Raw: 0x%llX, Bits: %d\n", lastReceivedCode, lastReceivedBits);
-    Serial.printf("   Address: 0x%04X, Command: 0x%04X\n", lastReceivedAddress, lastReceivedCommand);
-    Serial.printf("   decodedIRData.address: 0x%04X, decodedIRData.command: 0x%04X\n",
-                  IrReceiver.decodedIRData.address, IrReceiver.decodedIRData.command);
-  } else {
-    Serial.printf("📥 Código recebido: 0x%llX (%d bits)\n", lastReceivedCode, lastReceivedBits);
+  buttonMacro.next = 0;
+  buttonMacro.nextAtMs = millis();
+  buttonMacro.runs++;
+  Log<LOG_LVL_INFO, LOG_BUTTON>::printf("▶ Macro: %d passo(s)", buttonMacro.count);
+}
+
+// Um passo por volta: o envio ocupa o tempo de ar de um quadro, o resto do loop segue entre passos
+void macroTick(unsigned long now) {
+  if (buttonMacro.next >= buttonMacro.count || (long)(now - buttonMacro.nextAtMs) < 0) {
+    return;
+  }
+  uint8_t id = buttonMacro.steps[buttonMacro.next++];
+  IRCode code;
+  IRPayload payload;
+  bool found = false;
+  bool hasPayload = false;
+  {
+    CodeStoreReader codes;
+    if (id < codes->count) {
+      code = codes->codes[id];
+      hasPayload = codeStoreLoadPayload(*codes.data, code, &payload);
+      found = true;
+    }
   }
+  if (found) {
+    irTxSubmit(code, hasPayload ? &payload : NULL, 0, false);
+  }
+  buttonMacro.nextAtMs = now + MACRO_STEP_GAP_MS;
 }
 
-// Função unificada para enviar código IR baseado no protocolo
-bool sendIRCode(const IRCode& code) {
-  const char* protocolName = getProtocolName(code.protocol);
-  Serial.printf("📤 Enviando código IR: %s - %s (Protocolo: %s)\n", 
-                code.device, code.button, protocolName);
-  Serial.printf("   Detalhes: address=0x%04X, command=0x%04X, bits=%d, repeats=%d\n",
-                code.address, code.command, code.bits, code.repeats);
-  
-  switch(code.protocol) {
-    case PROTOCOL_NEC:
-      Serial.printf("   → Chamando sendNEC(0x%04X, 0x%04X, %d)\n", code.address, code.command, code.repeats);
-      IrSender.sendNEC(code.address, code.command, code.repeats);
-      return true;
-      
-    case PROTOCOL_SAMSUNG: {
-      Serial.printf("   → Chamando sendSamsung(0x%04X, 0x%04X, %d)\n", code.address, code.command, code.repeats);
-      // Samsung pode precisar de repetições para funcionar corretamente
-      // Tentar com 1 repetição se repeats for 0
-      uint8_t samsungRepeats = (code.repeats == 0) ? 1 : code.repeats;
-      IrSender.sendSamsung(code.address, code.command, samsungRepeats);
-      Serial.printf("   ✓ Código Samsung enviado com %d repetição(ões)\n", samsungRepeats);
-      return true;
+// Mantém os ids da macro válidos depois que handleCodeDelete() compacta a lista
+void macroOnCodeDeleted(int id) {
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < buttonMacro.count; i++) {
+    uint8_t step = buttonMacro.steps[i];
+    if (step == id) {
+      continue;
     }
-      
-    case PROTOCOL_SONY:
-      IrSender.sendSony(code.command, code.bits, code.repeats);
-      return true;
-      
-    case PROTOCOL_RC5:
-      IrSender.sendRC5(code.address, code.command, code.repeats);
-      return true;
-      
-    case PROTOCOL_RC6:
-      IrSender.sendRC6(code.address, code.command, code.repeats);
-      return true;
-      
-    case PROTOCOL_PANASONIC:
-      IrSender.sendPanasonic(code.address, code.command, code.repeats);
-      return true;
-      
-    case PROTOCOL_LG:
-      IrSender.sendLG(code.address, code.command, code.repeats);
-      return true;
-      
-    case PROTOCOL_BOSE:
-      // BoseWave usa apenas command (8 bits), sem address
-      // sendBoseWave(uint8_t aCommand, int_fast8_t aNumberOfRepeats)
-      IrSender.sendBoseWave((uint8_t)code.command, code.repeats);
-      return true;
-      
-    case PROTOCOL_UNKNOWN:
-    default:
-      Serial.printf("⚠ Protocolo não suportado: %d, tentando NEC como fallback\n", code.protocol);
-      // Fallback: tentar NEC (compatibilidade)
-      if (code.bits == 32 || code.bits == 0) {
-        IrSender.sendNEC(code.address, code.command, code.repeats);
-        return true;
-      }
-      return false;
+    buttonMacro.steps[kept++] = step > id ? step - 1 : step;
   }
-  return false;  // Fallback final
+  if (kept != buttonMacro.count) {
+    buttonMacro.count = kept;
+    buttonMacro.next = kept;  // Interrompe uma execução em andamento
+  }
+  Preferences buttonPrefs;
+  buttonPrefs.begin("button-config", false);
+  buttonPrefs.putBytes("macro", buttonMacro.steps, buttonMacro.count);
+  buttonPrefs.end();
 }
 
-uint64_t findCode(const char* device, const char* button) {
-  // Validação de segurança: verificar limites
-  if (!device || !button || codeCount < 0 || codeCount > MAX_CODES) {
-    return 0ULL;
+void saveButtonConfig() {
+  Preferences buttonPrefs;
+  buttonPrefs.begin("button-config", false);
+  buttonPrefs.putBytes("actions", buttonInput.actions, BUTTON_GESTURE_COUNT);
+  buttonPrefs.putBytes("macro", buttonMacro.steps, buttonMacro.count);
+  buttonPrefs.end();
+}
+
+void setupButton() {
+  memcpy(buttonInput.actions, BUTTON_DEFAULT_ACTIONS, sizeof(buttonInput.actions));
+  Preferences buttonPrefs;
+  buttonPrefs.begin("button-config", true);
+  if (buttonPrefs.getBytesLength("actions") == BUTTON_GESTURE_COUNT) {
+    buttonPrefs.getBytes("actions", buttonInput.actions, BUTTON_GESTURE_COUNT);
   }
-  
-  for (int i = 0; i < codeCount && i < MAX_CODES; i++) {
-    if (strcmp(storedCodes[i].device, device) == 0 &&
-        strcmp(storedCodes[i].button, button) == 0) {
-      return storedCodes[i].code;
+  buttonMacro.count = (uint8_t)buttonPrefs.getBytes("macro", buttonMacro.steps, MAX_MACRO_STEPS);
+  buttonPrefs.end();
+  for (uint8_t gesture = 0; gesture < BUTTON_GESTURE_COUNT; gesture++) {
+    if (buttonInput.actions[gesture] >= BUTTON_ACTION_COUNT) {
+      buttonInput.actions[gesture] = BUTTON_ACTION_NONE;
     }
   }
-  return 0ULL;
+  buttonMacro.next = buttonMacro.count;
+
+  pinMode(BUTTON_LEARNING, INPUT_PULLUP);
+  buttonInput.rawDown = buttonInput.stableDown = digitalRead(BUTTON_LEARNING) == LOW;
+  // Botão já pressionado no boot não vira gesto: espera soltar
+  buttonInput.longSent = buttonInput.stableDown;
+  attachInterrupt(digitalPinToInterrupt(BUTTON_LEARNING), onButtonEdge, buttonInput.rawDown ? ONHIGH : ONLOW);
 }
 
-int findCodeIndex(const char* device, const char* button) {
-  // Validação de segurança: verificar limites
-  if (!device || !button || codeCount < 0 || codeCount > MAX_CODES) {
-    return -1;
+// Lado da loopTask: debounce e reconhecimento de gestos
+void buttonScanTick() {
+  buttonScan(millis());
+  if (buttonInput.rawDown || buttonInput.stableDown || buttonInput.pendingShort) {
+    powerHold(POWER_BUTTON_HOLD_MS);  // Sem light sleep no meio do gesto
   }
-  
-  for (int i = 0; i < codeCount && i < MAX_CODES; i++) {
-    if (strcmp(storedCodes[i].device, device) == 0 &&
-        strcmp(storedCodes[i].button, button) == 0) {
-      return i;
+}
+
+// Consome a fila de gestos e executa as ações; na netTask com DUAL_CORE_TASKS, já que as ações
+// mexem no WiFi e nos códigos salvos
+void buttonDispatch() {
+  ButtonEvent event;
+  while (buttonInput.events.pop(event)) {
+    uint8_t gesture = event.gesture;
+    uint8_t action = buttonInput.actions[gesture];
+    Log<LOG_LVL_INFO, LOG_BUTTON>::printf("🔘 Toque %s: %s", buttonGestureName(gesture), buttonActionName(action));
+    switch (action) {
+      case BUTTON_ACTION_LEARN:
+        toggleLearningMode();
+        break;
+      case BUTTON_ACTION_CONFIG_AP:
+        configApOpen(CONFIG_AP_BUTTON, CONFIG_AP_WINDOW_MS);
+        break;
+      case BUTTON_ACTION_MACRO:
+        macroStart();
+        break;
+      default:
+        break;
     }
   }
-  return -1;
+  macroTick(millis());
 }
 
-void toggleLearningMode() {
-  isLearning = !isLearning;
-  
-  if (isLearning) {
-    Serial.println("✓ Modo aprendizado ATIVADO (via botão físico)");
-  } else {
-    Serial.println("✗ Modo aprendizado DESATIVADO");
+// ============================================================================
+// FUNÇÕES - TASKS
+// ============================================================================
+
+#if DUAL_CORE_TASKS
+// Fase da netTask: mesmo histograma de /api/metrics; o heap é atribuído a ela (heapTrackedTask)
+void netRunPhase(LoopPhase phase, void (*body)()) {
+  currentHeapTag = LOOP_PHASE_HEAP_TAGS[phase];
+  unsigned long startUs = micros();
+  body();
+  loopPhaseRecord(phase, (uint32_t)(micros() - startUs));
+  currentHeapTag = HEAP_TAG_LOOP;
+}
+
+
+// A netTask sempre bloqueia ao menos 1 tick: o IDLE do core 0 precisa rodar (watchdog de tasks)
+void netIdle() {
+  if (!irRxQueue.empty() || !buttonInput.events.empty()) {
+    return;
+  }
+  uint16_t waitMs = POWER_PROFILES[power.profile].idleWaitMs;
+  unsigned long startUs = micros();
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs > 0 ? waitMs : 1));
+  taskStats[TASK_NET].idleUs += micros() - startUs;
+}
+
+// Uma volta da rede: corpo da netTask ou, se ela não pôde ser criada, parte do loop()
+void netStep() {
+  sampleHeapIfDue();
+  netRunPhase(LOOP_PHASE_HTTP, netServeClients);
+  netRunPhase(LOOP_PHASE_WIFI, wifiTick);  // Máquina de estados do WiFi (conexão/reconexão sem bloquear)
+  irRxDrain();
+  buttonDispatch();
+}
+
+void netTaskMain(void* parameter) {
+  (void)parameter;
+  taskStats[TASK_NET].core = (int8_t)xPortGetCoreID();
+  for (;;) {
+    taskStats[TASK_NET].loops++;
+    netStep();
+    netIdle();
+  }
+}
+#endif
+
+// Esvazia a fila na Serial; acordada por notificação a cada linha, sem timer (não atrapalha o light sleep)
+void logTaskMain(void* parameter) {
+  (void)parameter;
+  LogLine line;
+  uint32_t droppedSeen = 0;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    while (logQueue.pop(line, NULL)) {
+      Serial.println(line.text);
+      __atomic_fetch_add(&logStats.written, 1, __ATOMIC_RELAXED);
+    }
+    uint32_t dropped = 0;
+    for (int i = 0; i < LOG_LEVEL_COUNT; i++) {
+      dropped += __atomic_load_n(&logStats.dropped[i], __ATOMIC_RELAXED);
+    }
+    if (dropped != droppedSeen) {
+      Serial.printf("⚠ Log: %u linha(s) descartada(s), fila cheia\n", (unsigned)(dropped - droppedSeen));
+      droppedSeen = dropped;
+    }
+  }
+}
+
+// Último passo do setup(): daqui em diante os logs passam pela fila
+void setupLogger() {
+  TaskHandle_t task = NULL;
+  if (xTaskCreatePinnedToCore(logTaskMain, "log", LOG_TASK_STACK, NULL, LOG_TASK_PRIORITY, &task, tskNO_AFFINITY) != pdPASS) {
+    Log<LOG_LVL_ERROR, LOG_SYS>::printf("✗ Falha ao criar a task de log, Serial síncrona");
+    return;
   }
+  __atomic_store_n(&logTask, task, __ATOMIC_RELEASE);
+}
+
+// Fim do setup(): com DUAL_CORE_TASKS a rede sai do loop() para a netTask
+void setupTasks() {
+  irTxQueue.init();
+  irHoldQueue.init();
+  taskStats[TASK_LOOP].core = (int8_t)xPortGetCoreID();
+  taskStats[TASK_NET].core = -1;
+  resetTaskStats();
+#if DUAL_CORE_TASKS
+  if (xTaskCreatePinnedToCore(netTaskMain, "net", NET_TASK_STACK, NULL, NET_TASK_PRIORITY, &netTask, NET_TASK_CORE) != pdPASS) {
+    netTask = NULL;  // loop() assume a rede: sem ela o aparelho ficaria sem HTTP nem WiFi
+    Log<LOG_LVL_ERROR, LOG_SYS>::printf("✗ Falha ao criar a netTask, rede no loop()");
+    return;
+  }
+  heapTrackedTask = netTask;
+  Log<LOG_LVL_INFO, LOG_SYS>::printf("✓ Tasks: rede no core %d, IR/botão no core %d", (int)NET_TASK_CORE, (int)xPortGetCoreID());
+#endif
 }
 
 // ============================================================================
-// FUNÇÕES - CONFIG / WIFI
+// FUNÇÕES AUXILIARES - TRATAMENTO DE ERROS E RESPOSTAS JSON
 // ============================================================================
 
-// Salvar credenciais WiFi no Preferences
-void saveWiFiCredentials(const char* ssid, const char* password) {
-  wifiPrefs.begin("wifi-config", false);
-  wifiPrefs.putString("ssid", ssid);
-  wifiPrefs.putString("password", password);
-  wifiPrefs.putBool("configured", true);
-  wifiPrefs.end();
-  Serial.println("✓ Credenciais WiFi salvas");
+JsonWriter::JsonWriter(int statusCode, const char* type) {
+  length = 0;
+  bytes = 0;
+  startCycles = ESP.getCycleCount();
+  status = statusCode;
+  contentType = type;
+  arrays = 0;
+  depth = 0;
+  comma = false;
+  streaming = false;
+  finished = false;
 }
 
-// Carregar credenciais WiFi do Preferences
-bool loadWiFiCredentials(char* ssid, char* password, int maxLen) {
-  wifiPrefs.begin("wifi-config", true);
-  bool configured = wifiPrefs.getBool("configured", false);
-  
-  if (configured) {
-    String ssidStr = wifiPrefs.getString("ssid", "");
-    String passStr = wifiPrefs.getString("password", "");
-    
-    if (ssidStr.length() > 0 && ssidStr.length() < maxLen) {
-      strncpy(ssid, ssidStr.c_str(), maxLen - 1);
-      ssid[maxLen - 1] = '\0';
-      
-      if (passStr.length() < maxLen) {
-        strncpy(password, passStr.c_str(), maxLen - 1);
-        password[maxLen - 1] = '\0';
-      } else {
-        password[0] = '\0';
-      }
-      
-      wifiPrefs.end();
-      return true;
+JsonWriter::~JsonWriter() {
+  finish();
+}
+
+void JsonWriter::flush() {
+  if (!streaming) {
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server.send(status, contentType, "");
+    streaming = true;
+  }
+  server.sendContent(buffer, length);
+  jsonWriterStats.writes++;
+  length = 0;
+}
+
+void JsonWriter::write(const char* data, size_t size) {
+  bytes += size;
+  while (size > 0) {
+    if (length == JSON_WRITER_BUFFER) {
+      flush();
+    }
+    size_t chunk = JSON_WRITER_BUFFER - length;
+    if (chunk > size) {
+      chunk = size;
     }
+    memcpy(buffer + length, data, chunk);
+    length += chunk;
+    data += chunk;
+    size -= chunk;
   }
-  
-  wifiPrefs.end();
-  return false;
 }
 
-// Criar Access Point para configuração inicial
-void startConfigAP() {
-  // Quando em modo AP, o ESP32 cria sua própria rede isolada
-  // O gateway deve ser o próprio IP do ESP32 (não o gateway do roteador)
-  IPAddress AP_IP(AP_IP_OCTET_1, AP_IP_OCTET_2, AP_IP_OCTET_3, AP_IP_OCTET_4);
-  IPAddress gateway(AP_IP);  // Gateway é o próprio ESP32 quando em modo AP
-  IPAddress subnet(255, 255, 255, 0);
-  
-  Serial.println("\n📡 Modo de Configuração - Access Point");
-  Serial.println("  SSID: " + String(AP_SSID));
-  Serial.println("  IP Configurado: " + AP_IP.toString());
-  Serial.println("  Gateway: " + gateway.toString() + " (próprio ESP32)");
-  Serial.println("  Subnet: " + subnet.toString());
-  Serial.println("  ⚠ IMPORTANTE: Conecte seu Mac ao WiFi 'ESP32-ControleRemoto' primeiro!");
-  Serial.println("  Depois acesse: http://" + AP_IP.toString() + "/config");
-  
-  WiFi.mode(WIFI_AP);
-  delay(200);
-  
-  bool apStarted = WiFi.softAP(AP_SSID, AP_PASSWORD);
-  if (!apStarted) {
-    Serial.println("  ✗ ERRO: Falha ao iniciar Access Point!");
-    Serial.println("  Status: " + String(WiFi.status()));
-    return;
+void JsonWriter::separator() {
+  if (comma) {
+    write(",", 1);
   }
-  
-  delay(200);
-  
-  bool configOk = WiFi.softAPConfig(AP_IP, gateway, subnet);
-  if (!configOk) {
-    Serial.println("  ⚠ Aviso: softAPConfig retornou false, mas continuando...");
+  comma = true;
+}
+
+// Aspas, barra e controles escapados; UTF-8 passa intacto. Trechos sem escape saem de uma vez.
+void JsonWriter::writeString(const char* text) {
+  write("\"", 1);
+  const char* run = text;
+  for (const char* p = text; *p != '\0'; p++) {
+    unsigned char c = (unsigned char)*p;
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      continue;
+    }
+    write(run, p - run);
+    run = p + 1;
+    char escape[7] = {'\\', (char)c, 0};
+    size_t escapeLength = 2;
+    switch (c) {
+      case '"': case '\\': break;
+      case '\n': escape[1] = 'n'; break;
+      case '\r': escape[1] = 'r'; break;
+      case '\t': escape[1] = 't'; break;
+      case '\b': escape[1] = 'b'; break;
+      case '\f': escape[1] = 'f'; break;
+      default:
+        snprintf(escape, sizeof(escape), "\\u%04x", c);
+        escapeLength = 6;
+    }
+    write(escape, escapeLength);
+  }
+  write(run, strlen(run));
+  write("\"", 1);
+}
+
+void JsonWriter::writeKey(const char* key) {
+  separator();
+  writeString(key);
+  write(":", 1);
+}
+
+void JsonWriter::writeUnsigned(unsigned long long value) {
+  char digits[20];
+  size_t pos = sizeof(digits);
+  do {
+    digits[--pos] = (char)('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  write(digits + pos, sizeof(digits) - pos);
+}
+
+void JsonWriter::writeSigned(long long value) {
+  if (value < 0) {
+    write("-", 1);
+    writeUnsigned(0ULL - (unsigned long long)value);
+  } else {
+    writeUnsigned((unsigned long long)value);
   }
-  
-  delay(200);
-  
-  IPAddress actualIP = WiFi.softAPIP();
-  Serial.println("\n  ✓ AP iniciado com sucesso!");
-  Serial.println("  ✓ IP Real do AP: " + actualIP.toString());
-  Serial.println("  ✓ MAC do AP: " + WiFi.softAPmacAddress());
-  Serial.println("  ✓ Clientes conectados: " + String(WiFi.softAPgetStationNum()));
-  
-  // Verificar se o IP está correto
-  if (actualIP != AP_IP) {
-    Serial.println("  ⚠ ATENÇÃO: IP real (" + actualIP.toString() + ") difere do configurado (" + AP_IP.toString() + ")");
-    Serial.println("  Use o IP real para acessar: http://" + actualIP.toString() + "/config");
+}
+
+void JsonWriter::writeValue(const char* value) {
+  if (value == NULL) {
+    write("null", 4);
+  } else {
+    writeString(value);
   }
-  Serial.println("");
 }
 
-// Conectar ao WiFi usando credenciais salvas
-bool connectToWiFi(const char* ssid, const char* password, bool showProgress = true) {
-  // Desabilitar AP temporariamente para melhor conexão
-  WiFi.mode(WIFI_STA);
-  WiFi.disconnect();
-  delay(100);
-  
-  WiFi.begin(ssid, password);
-  
-  if (showProgress) {
-    Serial.println("\n✓ Conectando na rede WiFi...");
-    Serial.println("  SSID: " + String(ssid));
-    Serial.println("  Aguarde (pode levar até 30 segundos)...");
+void JsonWriter::writeValue(const String& value) {
+  writeString(value.c_str());
+}
+
+void JsonWriter::writeValue(bool value) {
+  if (value) {
+    write("true", 4);
+  } else {
+    write("false", 5);
   }
-  
-  int attempts = 0;
-  const int maxAttempts = 60;  // Aumentado para 30 segundos (60 * 500ms)
-  
-  while (WiFi.status() != WL_CONNECTED && attempts < maxAttempts) {
-    delay(500);
-    if (showProgress && attempts % 4 == 0) {
-      Serial.print(".");
-    }
-    attempts++;
-    yield();  // Permitir que outras tarefas rodem
+}
+
+// NaN/infinito não existem em JSON
+void JsonWriter::writeValue(double value) {
+  if (isnan(value) || isinf(value)) {
+    write("null", 4);
+    return;
   }
-  
-  if (WiFi.status() == WL_CONNECTED) {
-    if (showProgress) {
-      Serial.println("\n✓ Conectado com sucesso!");
-      Serial.println("  IP: " + WiFi.localIP().toString());
-      Serial.println("  MAC: " + WiFi.macAddress());
-      Serial.println("  RSSI: " + String(WiFi.RSSI()) + " dBm");
-      Serial.println("  Acesse: http://" + WiFi.localIP().toString() + " no navegador\n");
-    }
-    wifiConfigured = true;
-    return true;
+  char text[24];
+  int n = snprintf(text, sizeof(text), "%.7g", value);
+  write(text, n);
+}
+
+void JsonWriter::writeValue(const IPAddress& value) {
+  char text[18];
+  int n = snprintf(text, sizeof(text), "\"%u.%u.%u.%u\"", value[0], value[1], value[2], value[3]);
+  write(text, n);
+}
+
+void JsonWriter::beginObject(const char* key) {
+  if (key != NULL) {
+    writeKey(key);
   } else {
-    if (showProgress) {
-      Serial.println("\n✗ Falha ao conectar WiFi!");
-      Serial.println("  Status: " + String(WiFi.status()));
-      Serial.println("  Verifique SSID e Senha");
-      Serial.println("  Acesse http://192.168.4.1/config para reconfigurar\n");
-    }
-    wifiConfigured = false;
-    return false;
+    separator();
   }
+  write("{", 1);
+  if (depth < JSON_WRITER_MAX_DEPTH) {
+    arrays &= ~(1U << depth);
+  }
+  depth++;
+  comma = false;
 }
 
-// Configurar WiFi (tenta carregar credenciais ou cria AP)
-void setupWiFi() {
-  char ssid[MAX_SSID_LENGTH + 1];
-  char password[MAX_PASSWORD_LENGTH + 1];
-  
-  // Tentar carregar credenciais salvas
-  if (loadWiFiCredentials(ssid, password, MAX_SSID_LENGTH + 1)) {
-    Serial.println("📡 Credenciais WiFi encontradas, tentando conectar...");
-    // Tentar conectar
-    if (connectToWiFi(ssid, password)) {
-      // Conectado com sucesso - criar AP também para permitir reconfiguração
-      Serial.println("📡 Iniciando modo híbrido (STA + AP) para permitir reconfiguração...");
-      WiFi.mode(WIFI_AP_STA);  // Modo híbrido
-      delay(100);
-      WiFi.softAP(AP_SSID, AP_PASSWORD);
-      IPAddress AP_IP(AP_IP_OCTET_1, AP_IP_OCTET_2, AP_IP_OCTET_3, AP_IP_OCTET_4);
-      IPAddress gateway(AP_IP_OCTET_1, AP_IP_OCTET_2, AP_IP_OCTET_3, 1);
-      IPAddress subnet(255, 255, 255, 0);
-      delay(100);
-      WiFi.softAPConfig(AP_IP, gateway, subnet);
-      delay(100);
-      Serial.println("  ✓ Modo híbrido ativo - AP disponível em " + WiFi.softAPIP().toString());
-      Serial.println("  ✓ WiFi conectado em: " + WiFi.localIP().toString() + "\n");
-      return;
-    }
-    // Se falhar, continuar para criar AP
-    Serial.println("⚠ Falha na conexão, iniciando modo AP para configuração...");
+void JsonWriter::beginArray(const char* key) {
+  if (key != NULL) {
+    writeKey(key);
   } else {
-    Serial.println("📡 Nenhuma credencial WiFi encontrada, iniciando modo AP...");
+    separator();
   }
-  
-  // Se não houver credenciais ou conexão falhou, criar AP
-  startConfigAP();
-  wifiConfigured = false;
+  write("[", 1);
+  if (depth < JSON_WRITER_MAX_DEPTH) {
+    arrays |= 1U << depth;
+  }
+  depth++;
+  comma = false;
 }
 
-// Verificar e reconectar WiFi se necessário
-void checkWiFiConnection() {
-  unsigned long now = millis();
-  
-  // Verificar apenas a cada intervalo definido
-  if (now - lastWiFiCheck < WIFI_CHECK_INTERVAL) {
+void JsonWriter::end() {
+  if (depth == 0) {
     return;
   }
-  
-  lastWiFiCheck = now;
-  
-  // Se não está conectado e deveria estar
-  if (WiFi.status() != WL_CONNECTED && wifiConfigured) {
-    Serial.println("⚠ WiFi desconectado, tentando reconectar...");
-    
-    char ssid[MAX_SSID_LENGTH + 1];
-    char password[MAX_PASSWORD_LENGTH + 1];
-    
-    if (loadWiFiCredentials(ssid, password, MAX_SSID_LENGTH + 1)) {
-      // Se estiver em modo AP, manter modo híbrido
-      if (WiFi.getMode() == WIFI_AP) {
-        WiFi.mode(WIFI_AP_STA);
-        delay(100);
-        WiFi.softAP(AP_SSID, AP_PASSWORD);
-      }
-      WiFi.disconnect();
-      delay(100);
-      connectToWiFi(ssid, password, false);  // Reconexão silenciosa
-      
-      // Se reconectou, garantir modo híbrido
-      if (WiFi.status() == WL_CONNECTED && WiFi.getMode() != WIFI_AP_STA) {
-        WiFi.mode(WIFI_AP_STA);
-        delay(100);
-        WiFi.softAP(AP_SSID, AP_PASSWORD);
-      }
-    }
+  depth--;
+  write((arrays >> depth) & 1 ? "]" : "}", 1);
+  comma = true;
+}
+
+void JsonWriter::endLine() {
+  while (depth > 0) {
+    end();
   }
+  write("\n", 1);
+  comma = false;
 }
 
-// ============================================================================
-// FUNÇÕES AUXILIARES - TRATAMENTO DE ERROS E RESPOSTAS JSON
-// ============================================================================
+// Fecha o que ficou aberto e envia; o destrutor chama se o handler não chamou
+void JsonWriter::finish() {
+  if (finished) {
+    return;
+  }
+  finished = true;
+  while (depth > 0) {
+    end();
+  }
+  if (streaming) {
+    if (length > 0) {
+      server.sendContent(buffer, length);
+      jsonWriterStats.writes++;
+    }
+    server.sendContent("", 0);  // Fim do chunked
+    jsonWriterStats.chunked++;
+  } else {
+    server.send_P(status, contentType, buffer, length);
+    jsonWriterStats.writes++;
+  }
+  uint32_t cycles = ESP.getCycleCount() - startCycles;
+  jsonWriterStats.responses++;
+  jsonWriterStats.bytes += bytes;
+  jsonWriterStats.cycles += cycles;
+  if (bytes > jsonWriterStats.maxBytes) {
+    jsonWriterStats.maxBytes = bytes;
+  }
+  if (cycles > jsonWriterStats.maxCycles) {
+    jsonWriterStats.maxCycles = cycles;
+  }
+}
 
 // Função auxiliar para enviar resposta JSON de erro padronizada
 void sendJsonError(int code, const char* message) {
-  char buffer[200];
-  snprintf(buffer, sizeof(buffer), "{\"status\":\"error\",\"message\":\"%s\"}", message);
-  server.send(code, "application/json", buffer);
+  JsonWriter json(code);
+  json.beginObject();
+  json.field("status", "error");
+  json.field("message", message);
+  json.end();
 }
 
 // Função auxiliar para enviar resposta JSON de sucesso padronizada
 void sendJsonSuccess(const char* message = "success") {
-  char buffer[150];
-  snprintf(buffer, sizeof(buffer), "{\"status\":\"success\",\"message\":\"%s\"}", message);
-  server.send(200, "application/json", buffer);
+  JsonWriter json(200);
+  json.beginObject();
+  json.field("status", "success");
+  json.field("message", message);
+  json.end();
+}
+
+// key NULL: o estado é o próprio objeto raiz da resposta
+void wifiStatusToJson(JsonWriter& json, const char* key) {
+  unsigned long now = millis();
+  json.beginObject(key);
+  json.field("state", wifiStateName(wifiManager.state));
+  json.field("state_ms", now - wifiManager.stateSinceMs);
+  json.field("configured", wifiConfigured);
+  json.field("networks", wifiNetworkCount);
+  const WiFiNetwork* network = wifiManager.network >= 0 ? &wifiNetworks[wifiManager.network] : nullptr;
+  json.field("ssid", network ? network->ssid : "");
+  json.field("attempt", wifiManager.attempt);
+  json.field("last_reason", wifiManager.lastReason);
+  json.field("connects", wifiManager.connects);
+  json.field("disconnects", wifiManager.disconnects);
+  json.field("fast_join", wifiManager.fastJoin);
+  json.field("cached_channel", wifiManager.link.valid ? wifiManager.link.channel : 0);
+  if (network && network->staticIp.ip != 0) {
+    json.field("static_ip", IPAddress(network->staticIp.ip));
+  }
+  json.field("ap", configApReasonName(configAp.reason));
+  if (wifiManager.state == WIFI_STATE_BACKOFF) {
+    long retryIn = (long)(wifiManager.nextAttemptMs - now);
+    json.field("retry_in_ms", retryIn > 0 ? retryIn : 0);
+  }
+  if (wifiManager.state == WIFI_STATE_CONNECTED) {
+    json.field("ip", WiFi.localIP());
+    json.field("rssi", WiFi.RSSI());
+  }
+  json.end();
 }
 
 // ============================================================================
@@ -642,7 +4216,8 @@ void sendJsonSuccess(const char* message = "success") {
 // ============================================================================
 
 void handleRoot() {
-  String html = R"(
+  HeapScope heapScope(HEAP_TAG_PAGE_ROOT);
+  static const char html[] PROGMEM = R"(
 <!DOCTYPE html>
 <html>
 <head>
@@ -962,6 +4537,51 @@ void handleRoot() {
       });
     }
     
+    // Botão segurado (volume/canal): o ESP32 repete o código no ritmo do protocolo enquanto
+    // chegam keep-alives; o stop só sai depois da resposta do start, para não chegar antes dele
+    let hold = null;
+    
+    function startHold(id, btn) {
+      stopHold();
+      const h = { btn: btn, timer: null };
+      hold = h;
+      btn.style.opacity = '0.6';
+      h.started = fetch('/api/hold/start', {
+        method: 'POST',
+        headers: { 'Content-Type': 'application/json' },
+        body: JSON.stringify({ id: id })
+      })
+      .then(r => r.json())
+      .then(data => {
+        if (data.status !== 'holding') {
+          if (data.message === 'hold_not_supported') {
+            sendCode(id);  // Ar-condicionado e afins: envio único
+          } else {
+            updateStatus('✗ Erro ao enviar código: ' + (data.message || 'erro desconhecido'), false);
+          }
+          return;
+        }
+        updateStatus('✓ Código IR enviado! Segure o botão para repetir.', true);
+        if (hold === h) {
+          h.timer = setInterval(() => fetch('/api/hold/keep', { method: 'POST' }), data.timeout_ms / 3);
+        }
+      })
+      .catch(e => {
+        updateStatus('✗ Erro de conexão ao enviar código', false);
+      });
+    }
+    
+    function stopHold() {
+      if (!hold) return;
+      const h = hold;
+      hold = null;
+      h.btn.style.opacity = '1';
+      h.started.then(() => {
+        clearInterval(h.timer);
+        fetch('/api/hold/stop', { method: 'POST' });
+      });
+    }
+    
     let capturedCodeData = null;
     let learnPollInterval = null;
     
@@ -1068,12 +4688,33 @@ void handleRoot() {
         return;
       }
       
+      postLearnSave(device, button, null);
+    }
+    
+    // onDuplicate: null na 1ª tentativa; 'merge' se o usuário aceitar renomear o código já salvo
+    function postLearnSave(device, button, onDuplicate) {
+      const body = { device: device, button: button };
+      if (onDuplicate) {
+        body.on_duplicate = onDuplicate;
+      }
       fetch('/api/learn/save', {
         method: 'POST',
         headers: { 'Content-Type': 'application/json' },
-        body: JSON.stringify({ device: device, button: button })
+        body: JSON.stringify(body)
       })
       .then(r => {
+        if (r.status === 409) {
+          return r.json().then(dup => {
+            const existing = dup.existing.device + ' - ' + dup.existing.button;
+            if (confirm('Este código já está salvo como "' + existing + '".\n\nOK: renomear para "' +
+                        device + ' - ' + button + '"\nCancelar: manter como está')) {
+              postLearnSave(device, button, 'merge');
+            } else {
+              closeModal();
+            }
+            return null;
+          });
+        }
         if (!r.ok) {
           return r.json().then(err => {
             throw new Error(err.message || 'Erro HTTP ' + r.status);
@@ -1082,6 +4723,9 @@ void handleRoot() {
         return r.json();
       })
       .then(data => {
+        if (!data) {
+          return;
+        }
         if (data.status === 'success') {
           updateStatus('✓ Código salvo: ' + device + ' - ' + button, true);
           closeModal();
@@ -1133,15 +4777,15 @@ void handleRoot() {
       btn.id = 'code-btn-' + code.id;
       btn.style.flex = '1';
       btn.textContent = '📤 ' + (code.device || 'Equipamento') + ' - ' + (code.button || 'Botão');
-      btn.title = 'Clique para ENVIAR este código IR';
-      btn.onclick = () => {
-        btn.style.opacity = '0.6';
-        btn.disabled = true;
-        sendCode(code.id);
-        setTimeout(() => {
-          btn.style.opacity = '1';
-          btn.disabled = false;
-        }, 500);
+      btn.title = 'Clique para ENVIAR este código IR (segure para repetir)';
+      btn.onpointerdown = (e) => {
+        e.preventDefault();
+        startHold(code.id, btn);
+      };
+      btn.onpointerup = btn.onpointerleave = btn.onpointercancel = () => stopHold();
+      btn.oncontextmenu = (e) => e.preventDefault();  // Toque longo no celular
+      btn.onclick = (e) => {
+        if (e.detail === 0) sendCode(code.id);  // Enter/Espaço no teclado
       };
       
       const editBtn = document.createElement('button');
@@ -1281,100 +4925,168 @@ void handleRoot() {
 </html>
 )";
   
-  server.send(200, "text/html", html);
+  server.send_P(200, "text/html", html, sizeof(html) - 1);
 }
 
 void handleStatus() {
-  DynamicJsonDocument doc(500);
-  doc["status"] = "ok";
-  doc["learning_mode"] = isLearning;
-  doc["codes_stored"] = codeCount;
-  doc["wifi_connected"] = (WiFi.status() == WL_CONNECTED);
-  doc["wifi_configured"] = wifiConfigured;
-  doc["wifi_mac"] = WiFi.macAddress();
+  HeapScope heapScope(HEAP_TAG_API_STATUS);
+  bool connected = WiFi.status() == WL_CONNECTED;
+  JsonWriter json(200);
+  json.beginObject();
+  json.field("status", "ok");
+  json.field("learning_mode", isLearning);
+  {
+    CodeStoreReader codes;
+    json.field("codes_stored", codes->count);
+  }
+  json.field("wifi_connected", connected);
+  json.field("wifi_configured", wifiConfigured);
+  json.field("wifi_state", wifiStateName(wifiManager.state));
+  uint8_t mac[6];
+  WiFi.macAddress(mac);
+  char macStr[18];
+  snprintf(macStr, sizeof(macStr), "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+  json.field("wifi_mac", macStr);
   
-  if (WiFi.status() == WL_CONNECTED) {
-    doc["wifi_ip"] = WiFi.localIP().toString();
-    doc["wifi_ssid"] = WiFi.SSID();
-    doc["wifi_rssi"] = WiFi.RSSI();
-    doc["wifi_gateway"] = WiFi.gatewayIP().toString();
-    doc["wifi_subnet"] = WiFi.subnetMask().toString();
+  if (connected) {
+    json.field("wifi_ip", WiFi.localIP());
+    json.field("wifi_ssid", WiFi.SSID());
+    json.field("wifi_rssi", WiFi.RSSI());
+    json.field("wifi_gateway", WiFi.gatewayIP());
+    json.field("wifi_subnet", WiFi.subnetMask());
   } else {
-    doc["wifi_ip"] = "";
-    doc["wifi_ssid"] = "";
-    doc["wifi_rssi"] = 0;
-    doc["wifi_gateway"] = "";
-    doc["wifi_subnet"] = "";
+    json.field("wifi_ip", "");
+    json.field("wifi_ssid", "");
+    json.field("wifi_rssi", 0);
+    json.field("wifi_gateway", "");
+    json.field("wifi_subnet", "");
   }
-  
-  String response;
-  serializeJson(doc, response);
-  server.send(200, "application/json", response);
+
+  // Tempo de reconexão: da queda (evento STA_DISCONNECTED) até o GOT_IP
+  json.beginObject("wifi_reconnect");
+  json.field("count", wifiManager.reconnects);
+  json.field("last_ms", wifiManager.lastReconnectMs);
+  json.field("avg_ms", wifiManager.reconnects ? wifiManager.totalReconnectMs / wifiManager.reconnects : 0);
+  json.field("max_ms", wifiManager.maxReconnectMs);
+  json.field("last_fast_join", wifiManager.lastReconnectFast);
+  json.field("boot_connect_ms", wifiManager.bootConnectMs);
+  if (wifiManager.droppedAtMs != 0) {
+    json.field("down_ms", millis() - wifiManager.droppedAtMs);
+  }
+  json.end();
+
+  // Qualidade do enlace. O IDF 4.4 não expõe a taxa PHY negociada em tempo real:
+  // phy_max_mbps é o teto nominal do modo/largura de banda do AP atual
+  json.beginObject("wifi_quality");
+  json.field("attempts", wifiManager.attempts);
+  json.field("failed_attempts", wifiManager.failedAttempts);
+  json.field("disconnects", wifiManager.disconnects);
+  json.field("roams", wifiManager.roams);
+  json.field("last_roam_ms", wifiManager.lastRoamMs);
+  wifi_ap_record_t apInfo;
+  if (connected && esp_wifi_sta_get_ap_info(&apInfo) == ESP_OK) {
+    json.field("rssi", apInfo.rssi);
+    json.field("rssi_avg", (int)lroundf(wifiManager.rssiAvg));
+    json.field("rssi_min", wifiManager.rssiMin);
+    json.field("bssid", WiFi.BSSIDstr());
+    json.field("channel", apInfo.primary);
+    wifi_bandwidth_t bandwidth = WIFI_BW_HT20;
+    esp_wifi_get_bandwidth(WIFI_IF_STA, &bandwidth);
+    if (apInfo.phy_11n) {
+      json.field("phy_mode", "11n");
+      json.field("bandwidth_mhz", bandwidth == WIFI_BW_HT40 ? 40 : 20);
+      json.field("phy_max_mbps", bandwidth == WIFI_BW_HT40 ? 150 : 72);  // 1 fluxo, GI curto
+    } else if (apInfo.phy_11g) {
+      json.field("phy_mode", "11g");
+      json.field("phy_max_mbps", 54);
+    } else {
+      json.field("phy_mode", "11b");
+      json.field("phy_max_mbps", 11);
+    }
+  }
+  json.end();
+  json.end();
 }
 
 void handleLearnStart() {
+  HeapScope heapScope(HEAP_TAG_API_LEARN);
   isLearning = true;
   lastReceivedCode = 0;
   codeProcessed = true;  // Reset flag ao iniciar modo aprendizado
-  Serial.println("✓ Modo aprendizado ATIVADO");
-  server.send(200, "application/json", "{\"status\":\"learning_started\"}");
+  Log<LOG_LVL_INFO, LOG_IR>::printf("✓ Modo aprendizado ATIVADO");
+  JsonWriter json(200);
+  json.beginObject();
+  json.field("status", "learning_started");
+  json.end();
 }
 
 void handleLearnStop() {
+  HeapScope heapScope(HEAP_TAG_API_LEARN);
   isLearning = false;
-  Serial.println("✗ Modo aprendizado DESATIVADO");
-  server.send(200, "application/json", "{\"status\":\"learning_stopped\"}");
+  Log<LOG_LVL_INFO, LOG_IR>::printf("✗ Modo aprendizado DESATIVADO");
+  JsonWriter json(200);
+  json.beginObject();
+  json.field("status", "learning_stopped");
+  json.end();
 }
 
 void handleLearnCaptured() {
+  HeapScope heapScope(HEAP_TAG_API_LEARN);
   // Retorna o último código capturado se houver e não foi processado
-  if (!isLearning) {
-    server.send(200, "application/json", "{\"captured\":false}");
-    return;
-  }
-  
-  if (lastReceivedCode != 0ULL && !codeProcessed) {
-    DynamicJsonDocument doc(300);
-    doc["captured"] = true;
-    doc["code"] = String((uint32_t)lastReceivedCode, HEX);
+  JsonWriter json(200);
+  json.beginObject();
+  if (isLearning && lastReceivedCode != 0ULL && !codeProcessed) {
+    json.field("captured", true);
+    char codeShort[12];
+    snprintf(codeShort, sizeof(codeShort), "%x", (unsigned)(uint32_t)lastReceivedCode);
+    json.field("code", codeShort);
     char codeStr[20];
-    sprintf(codeStr, "0x%llX", lastReceivedCode);
-    doc["code_hex"] = codeStr;
-    doc["protocol"] = getProtocolName(lastReceivedProtocol);
-    doc["protocol_id"] = (int)lastReceivedProtocol;
-    doc["bits"] = lastReceivedBits;
-    
-    String response;
-    serializeJson(doc, response);
-    server.send(200, "application/json", response);
+    sprintf(codeStr, "0x%llX", (unsigned long long)lastReceivedCode);
+    json.field("code_hex", codeStr);
+    json.field("protocol", getProtocolName(lastReceivedProtocol));
+    json.field("protocol_id", (int)lastReceivedProtocol);
+    bool longFrame = protocolInfo(lastReceivedProtocol).fields == IR_FIELDS_PAYLOAD;
+    json.field("bits", longFrame ? lastReceivedPayload.bits : lastReceivedBits);
   } else {
-    server.send(200, "application/json", "{\"captured\":false}");
+    json.field("captured", false);
   }
+  json.end();
 }
 
 void handleLearnSave() {
-  Serial.println("📝 handleLearnSave chamado");
+  HeapScope heapScope(HEAP_TAG_API_LEARN);
+  Log<LOG_LVL_DEBUG, LOG_HTTP>::printf("📝 handleLearnSave chamado");
   
   if (!server.hasArg("plain")) {
-    Serial.println("✗ Erro: sem dados no body");
+    Log<LOG_LVL_ERROR, LOG_HTTP>::printf("✗ Erro: sem dados no body");
     sendJsonError(400, "no_data");
     return;
   }
 
-  String body = server.arg("plain");
-  Serial.printf("📥 Body recebido: %s\n", body.c_str());
-
-  StaticJsonDocument<300> doc;
-  DeserializationError error = deserializeJson(doc, body);
+  JsonDocument doc(&requestArena);
+  DeserializationError error;
+  {
+    // Só o parse usa a String do WebServer; ela é solta antes de gravar no Preferences
+    String body = server.arg("plain");
+    Log<LOG_LVL_DEBUG, LOG_HTTP>::printf("📥 Body recebido: %s", body.c_str());
+    error = deserializeJson(doc, body);
+  }
   
   if (error) {
-    Serial.printf("✗ Erro ao parsear JSON: %s\n", error.c_str());
+    Log<LOG_LVL_ERROR, LOG_HTTP>::printf("✗ Erro ao parsear JSON: %s", error.c_str());
     sendJsonError(400, "json_parse_error");
     return;
   }
 
   const char* devicePtr = doc["device"] | "Controle";
   const char* buttonPtr = doc["button"] | "";
+  // Código já gravado com a mesma assinatura: "reject" (padrão) responde 409 com a entrada existente,
+  // "merge" dá o nome novo à entrada existente (mantém o id) e "alias" grava outra entrada mesmo assim
+  const char* onDuplicate = doc["on_duplicate"] | "reject";
+  if (strcmp(onDuplicate, "reject") != 0 && strcmp(onDuplicate, "merge") != 0 && strcmp(onDuplicate, "alias") != 0) {
+    sendJsonError(400, "invalid_on_duplicate");
+    return;
+  }
   
   char device[20];
   char button[30];
@@ -1386,7 +5098,7 @@ void handleLearnSave() {
   } else {
     strncpy(device, "Controle", MAX_DEVICE_NAME);
     device[MAX_DEVICE_NAME] = '\0';
-    Serial.println("⚠ Device vazio, usando padrão: 'Controle'");
+    Log<LOG_LVL_WARN, LOG_HTTP>::printf("⚠ Device vazio, usando padrão: 'Controle'");
   }
   
   // Copiar e validar button
@@ -1398,7 +5110,7 @@ void handleLearnSave() {
     if (namePtr && strlen(namePtr) > 0) {
       strncpy(button, namePtr, MAX_BUTTON_NAME);
       button[MAX_BUTTON_NAME] = '\0';
-      Serial.printf("⚠ Button vazio, usando 'name': '%s'\n", button);
+      Log<LOG_LVL_WARN, LOG_HTTP>::printf("⚠ Button vazio, usando 'name': '%s'", button);
     } else {
       button[0] = '\0';
     }
@@ -1406,19 +5118,90 @@ void handleLearnSave() {
     button[0] = '\0';
   }
   
-  Serial.printf("📋 Device: '%s', Button: '%s'\n", device, button);
+  Log<LOG_LVL_DEBUG, LOG_HTTP>::printf("📋 Device: '%s', Button: '%s'", device, button);
   
   // Validar se button ainda está vazio
   if (strlen(button) == 0) {
-    Serial.println("✗ Erro: button está vazio após processamento");
+    Log<LOG_LVL_ERROR, LOG_HTTP>::printf("✗ Erro: button está vazio após processamento");
     sendJsonError(400, "button_required");
     return;
   }
   
+  Log<LOG_LVL_DEBUG, LOG_HTTP>::printf("🔍 Verificando lastReceivedCode: 0x%llX", (unsigned long long)lastReceivedCode);
+  if (lastReceivedCode == 0ULL) {
+    Log<LOG_LVL_ERROR, LOG_HTTP>::printf("✗ Erro: nenhum código capturado (lastReceivedCode = 0)");
+    sendJsonError(400, "no_code_captured");
+    return;
+  }
+
+  CodeStoreWriter store;
+  int codeCount = store->count;
+
+  // Antes do limite: reaprender um código com o armazenamento cheio ainda acha a entrada existente
+  IRCode captured;
+  memset(&captured, 0, sizeof(captured));
+  captured.code = lastReceivedCode;
+  captured.bits = lastReceivedBits;
+  captured.protocol = lastReceivedProtocol;
+  captured.address = lastReceivedAddress;
+  captured.command = lastReceivedCommand;
+  int existing = findCodeBySignature(*store.data, captured);
+  if (existing >= 0 && protocolInfo(captured.protocol).fields == IR_FIELDS_PAYLOAD &&
+      !codeStorePayloadEquals(*store.data, store->codes[existing], lastReceivedPayload)) {
+    existing = -1;  // Só o hash coincidiu
+  }
+  if (existing >= 0) {
+    codeStore.duplicates++;
+    IRCode& code = store->codes[existing];
+    if (strcmp(onDuplicate, "merge") == 0) {
+      Log<LOG_LVL_INFO, LOG_HTTP>::printf("✓ Código já gravado (ID %d: %s - %s), renomeado para %s - %s",
+                                          existing, code.device, code.button, device, button);
+      strncpy(code.device, device, MAX_DEVICE_NAME);
+      code.device[MAX_DEVICE_NAME] = '\0';
+      strncpy(code.button, button, MAX_BUTTON_NAME);
+      code.button[MAX_BUTTON_NAME] = '\0';
+      code.code = captured.code;  // Mesmo sinal: guarda a captura mais recente
+      saveCodesToPreferences(*store.data);
+      store.publish();
+      codeProcessed = true;
+      lastReceivedCode = 0;
+      lastReceivedProtocol = PROTOCOL_UNKNOWN;
+      lastReceivedAddress = 0;
+      lastReceivedCommand = 0;
+      JsonWriter json(200);
+      json.beginObject();
+      json.field("status", "success");
+      json.field("merged", true);
+      json.field("id", existing);
+      json.field("code_count", codeCount);
+      json.end();
+      return;
+    }
+    if (strcmp(onDuplicate, "alias") != 0) {
+      Log<LOG_LVL_WARN, LOG_HTTP>::printf("⚠ Código já gravado (ID %d: %s - %s)", existing, code.device, code.button);
+      JsonWriter json(409);
+      json.beginObject();
+      json.field("status", "duplicate");
+      json.field("message", "duplicate_code");
+      json.beginObject("existing");
+      json.field("id", existing);
+      json.field("device", code.device);
+      json.field("button", code.button);
+      json.field("protocol", getProtocolName(code.protocol));
+      json.end();
+      json.end();
+      return;
+    }
+  }
+
   // Validação de segurança: verificar limites antes de adicionar
   if (codeCount >= MAX_CODES) {
-    Serial.printf("✗ Erro: limite de códigos atingido (%d)\n", MAX_CODES);
-    server.send(400, "application/json", "{\"status\":\"limit\",\"message\":\"max_codes_reached\"}");
+    Log<LOG_LVL_ERROR, LOG_HTTP>::printf("✗ Erro: limite de códigos atingido (%d)", MAX_CODES);
+    JsonWriter json(400);
+    json.beginObject();
+    json.field("status", "limit");
+    json.field("message", "max_codes_reached");
+    json.end();
     return;
   }
   
@@ -1427,48 +5210,56 @@ void handleLearnSave() {
     codeCount = 0;  // Reset se corrompido
   }
 
-  Serial.printf("🔍 Verificando lastReceivedCode: 0x%llX\n", lastReceivedCode);
-  if (lastReceivedCode == 0ULL) {
-    Serial.println("✗ Erro: nenhum código capturado (lastReceivedCode = 0)");
-    sendJsonError(400, "no_code_captured");
-    return;
-  }
-  
   // Salvar código antes de resetar
   uint64_t savedCode = lastReceivedCode;
   
   // Validação de segurança: garantir que não excede limites
+  IRCode& newCode = store->codes[codeCount];
   if (codeCount >= 0 && codeCount < MAX_CODES) {
-    storedCodes[codeCount].code = savedCode;
-    storedCodes[codeCount].bits = lastReceivedBits;
+    newCode.code = savedCode;
+    newCode.bits = lastReceivedBits;
     
     // ⭐ NOVO: Salvar protocolo e dados relacionados
-    storedCodes[codeCount].protocol = lastReceivedProtocol;
-    storedCodes[codeCount].address = lastReceivedAddress;
-    storedCodes[codeCount].command = lastReceivedCommand;
-    storedCodes[codeCount].repeats = 0;  // Padrão: sem repetições
+    newCode.protocol = lastReceivedProtocol;
+    newCode.address = lastReceivedAddress;
+    newCode.command = lastReceivedCommand;
+    newCode.repeats = 0;  // Padrão: sem repetições
+    newCode.payload = 0;
+    if (protocolInfo(newCode.protocol).fields == IR_FIELDS_PAYLOAD &&
+        !codeStoreAddPayload(*store.data, newCode, lastReceivedPayload)) {
+      Log<LOG_LVL_ERROR, LOG_HTTP>::printf("✗ Erro: sem espaço para o quadro longo (%u de %u bytes usados)",
+                                           (unsigned)store->payloadUsed, (unsigned)CODE_PAYLOAD_POOL_SIZE);
+      JsonWriter json(400);
+      json.beginObject();
+      json.field("status", "limit");
+      json.field("message", "payload_pool_full");
+      json.end();
+      return;
+    }
     
     // Validação de tamanho de strings antes de copiar
-    strncpy(storedCodes[codeCount].device, device, MAX_DEVICE_NAME);
-    storedCodes[codeCount].device[MAX_DEVICE_NAME] = '\0';
+    strncpy(newCode.device, device, MAX_DEVICE_NAME);
+    newCode.device[MAX_DEVICE_NAME] = '\0';
     
-    strncpy(storedCodes[codeCount].button, button, MAX_BUTTON_NAME);
-    storedCodes[codeCount].button[MAX_BUTTON_NAME] = '\0';
+    strncpy(newCode.button, button, MAX_BUTTON_NAME);
+    newCode.button[MAX_BUTTON_NAME] = '\0';
   } else {
-    Serial.println("✗ Erro crítico: codeCount inválido ao salvar!");
+    Log<LOG_LVL_ERROR, LOG_HTTP>::printf("✗ Erro crítico: codeCount inválido ao salvar!");
     sendJsonError(500, "internal_error");
     return;
   }
   
   const char* protocolName = getProtocolName(lastReceivedProtocol);
-  Serial.printf("💾 Salvando código no índice %d (Protocolo: %s)\n", codeCount, protocolName);
-  Serial.printf("   Dados salvos: address=0x%04X, command=0x%04X, bits=%d\n",
-                 storedCodes[codeCount].address, storedCodes[codeCount].command, storedCodes[codeCount].bits);
+  Log<LOG_LVL_DEBUG, LOG_HTTP>::printf("💾 Salvando código no índice %d (Protocolo: %s)", codeCount, protocolName);
+  Log<LOG_LVL_DEBUG, LOG_HTTP>::printf("   Dados salvos: address=0x%04X, command=0x%04X, bits=%d",
+                                       newCode.address, newCode.command, newCode.bits);
   codeCount++;
+  store->count = codeCount;
   
   // Salvar no Preferences
-  saveCodesToPreferences();
-  Serial.println("✓ Preferences atualizado");
+  saveCodesToPreferences(*store.data);
+  store.publish();
+  Log<LOG_LVL_DEBUG, LOG_HTTP>::printf("✓ Preferences atualizado");
   
   // Marca como processado após salvar e reseta para próximo código
   codeProcessed = true;
@@ -1477,56 +5268,66 @@ void handleLearnSave() {
   lastReceivedAddress = 0;
   lastReceivedCommand = 0;
 
-  Serial.printf("✓ Código salvo: %s - %s (Protocolo: %s, 0x%llX)\n", 
-                device, button, protocolName, savedCode);
+  Log<LOG_LVL_INFO, LOG_HTTP>::printf("✓ Código salvo: %s - %s (Protocolo: %s, 0x%llX)", 
+                                      device, button, protocolName, (unsigned long long)savedCode);
   
   // Retornar informações para atualização automática da interface
-  DynamicJsonDocument response(200);
-  response["status"] = "success";
-  response["code_count"] = codeCount;
-  String responseStr;
-  serializeJson(response, responseStr);
-  Serial.println("📤 Enviando resposta: " + responseStr);
-  server.send(200, "application/json", responseStr);
+  Log<LOG_LVL_DEBUG, LOG_HTTP>::printf("📤 Enviando resposta: code_count=%d", codeCount);
+  JsonWriter json(200);
+  json.beginObject();
+  json.field("status", "success");
+  json.field("code_count", codeCount);
+  if (existing >= 0) {
+    json.field("alias_of", existing);
+  }
+  json.end();
 }
 
 void handleListCodes() {
-  DynamicJsonDocument doc(8192);  // Aumentado para suportar mais códigos
-  JsonArray array = doc.to<JsonArray>();
+  HeapScope heapScope(HEAP_TAG_API_CODES);
+  JsonWriter json(200);
+  json.beginArray();
 
-  // Validação de segurança: garantir limites válidos
-  int safeCount = (codeCount > MAX_CODES) ? MAX_CODES : codeCount;
-  safeCount = (safeCount < 0) ? 0 : safeCount;
+  {
+    // Os únicos escritores são handlers HTTP, na mesma task: segurar o leitor durante os flushes não trava ninguém
+    CodeStoreReader codes;
+    // Validação de segurança: garantir limites válidos
+    int safeCount = (codes->count > MAX_CODES) ? MAX_CODES : codes->count;
+    safeCount = (safeCount < 0) ? 0 : safeCount;
 
-  for (int i = 0; i < safeCount; i++) {
-    if (storedCodes[i].code != 0ULL) {  // Filtro para códigos válidos
-      JsonObject obj = array.createNestedObject();
-      obj["id"] = i;
-      obj["name"] = String(storedCodes[i].device) + " - " + String(storedCodes[i].button);
-      obj["device"] = storedCodes[i].device;
-      obj["button"] = storedCodes[i].button;
-      obj["protocol"] = getProtocolName(storedCodes[i].protocol);
-      obj["protocol_id"] = (int)storedCodes[i].protocol;
-      // Retornar code como string hex para evitar problemas com uint64_t no JSON
-      char codeStr[20];
-      sprintf(codeStr, "0x%llX", storedCodes[i].code);
-      obj["code"] = codeStr;
+    for (int i = 0; i < safeCount; i++) {
+      const IRCode& code = codes->codes[i];
+      if (code.code != 0ULL) {  // Filtro para códigos válidos
+        json.beginObject();
+        json.field("id", i);
+        char name[MAX_DEVICE_NAME + MAX_BUTTON_NAME + 4];
+        snprintf(name, sizeof(name), "%s - %s", code.device, code.button);
+        json.field("name", name);
+        json.field("device", code.device);
+        json.field("button", code.button);
+        json.field("protocol", getProtocolName(code.protocol));
+        json.field("protocol_id", (int)code.protocol);
+        // Retornar code como string hex para evitar problemas com uint64_t no JSON
+        char codeStr[20];
+        sprintf(codeStr, "0x%llX", (unsigned long long)code.code);
+        json.field("code", codeStr);
+        json.end();
+      }
     }
   }
 
-  String response;
-  serializeJson(doc, response);
-  server.send(200, "application/json", response);
+  json.end();
 }
 
 // Handler para editar código
 void handleCodeEdit() {
+  HeapScope heapScope(HEAP_TAG_API_CODES);
   if (!server.hasArg("plain")) {
     sendJsonError(400, "no_data");
     return;
   }
 
-  StaticJsonDocument<300> doc;
+  JsonDocument doc(&requestArena);
   DeserializationError error = deserializeJson(doc, server.arg("plain"));
   
   if (error) {
@@ -1539,7 +5340,8 @@ void handleCodeEdit() {
   const char* buttonPtr = doc["button"] | "";
   
   // Validação
-  if (id < 0 || id >= codeCount || id >= MAX_CODES) {
+  CodeStoreWriter store;
+  if (id < 0 || id >= store->count || id >= MAX_CODES) {
     sendJsonError(404, "invalid_id");
     return;
   }
@@ -1550,27 +5352,30 @@ void handleCodeEdit() {
   }
   
   // Atualizar código
-  strncpy(storedCodes[id].device, devicePtr, MAX_DEVICE_NAME);
-  storedCodes[id].device[MAX_DEVICE_NAME] = '\0';
+  IRCode& code = store->codes[id];
+  strncpy(code.device, devicePtr, MAX_DEVICE_NAME);
+  code.device[MAX_DEVICE_NAME] = '\0';
   
-  strncpy(storedCodes[id].button, buttonPtr, MAX_BUTTON_NAME);
-  storedCodes[id].button[MAX_BUTTON_NAME] = '\0';
+  strncpy(code.button, buttonPtr, MAX_BUTTON_NAME);
+  code.button[MAX_BUTTON_NAME] = '\0';
   
   // Salvar no Preferences
-  saveCodesToPreferences();
+  saveCodesToPreferences(*store.data);
+  store.publish();
   
-  Serial.printf("✓ Código editado: ID %d -> %s - %s\n", id, devicePtr, buttonPtr);
+  Log<LOG_LVL_INFO, LOG_HTTP>::printf("✓ Código editado: ID %d -> %s - %s", id, devicePtr, buttonPtr);
   sendJsonSuccess("code_updated");
 }
 
 // Handler para deletar código (atualizado)
 void handleCodeDelete() {
+  HeapScope heapScope(HEAP_TAG_API_CODES);
   if (!server.hasArg("plain")) {
     sendJsonError(400, "no_data");
     return;
   }
 
-  StaticJsonDocument<200> doc;
+  JsonDocument doc(&requestArena);
   DeserializationError error = deserializeJson(doc, server.arg("plain"));
   
   if (error) {
@@ -1581,48 +5386,414 @@ void handleCodeDelete() {
   int id = doc["id"] | -1;
 
   // Validação de segurança: verificar limites antes de deletar
+  CodeStoreWriter store;
+  int codeCount = store->count;
   if (id >= 0 && id < codeCount && codeCount > 0 && codeCount <= MAX_CODES) {
-    // Mover códigos para preencher o espaço
+    // Mover códigos para preencher o espaço (na cópia fora de leitura)
+    codeStoreRemovePayload(*store.data, store->codes[id]);
     for (int i = id; i < codeCount - 1 && i < MAX_CODES - 1; i++) {
-      storedCodes[i] = storedCodes[i + 1];
+      store->codes[i] = store->codes[i + 1];
     }
     codeCount--;
     if (codeCount < 0) codeCount = 0;  // Proteção contra underflow
+    store->count = codeCount;
     
     // Salvar no Preferences
-    saveCodesToPreferences();
+    saveCodesToPreferences(*store.data);
+    store.publish();
+    macroOnCodeDeleted(id);
     
-    Serial.printf("✓ Código removido (ID: %d)\n", id);
+    Log<LOG_LVL_INFO, LOG_HTTP>::printf("✓ Código removido (ID: %d)", id);
     sendJsonSuccess("code_deleted");
   } else {
     sendJsonError(400, "invalid_id");
   }
 }
 
+// Quadro longo no NDJSON: tempos na ordem de DistanceWidthTimingInfoStruct e os bytes em hex
+void irPayloadToJson(JsonWriter& json, const IRPayload& payload) {
+  char hex[IR_PAYLOAD_MAX_BYTES * 2 + 1];
+  uint16_t bytes = (payload.bits + 7) / 8;
+  for (uint16_t i = 0; i < bytes; i++) {
+    snprintf(hex + i * 2, 3, "%02x", payload.data[i]);
+  }
+  hex[bytes * 2] = '\0';
+  json.beginObject("payload");
+  json.field("bits", payload.bits);
+  json.field("msb_first", (payload.flags & IRDATA_FLAGS_IS_MSB_FIRST) != 0);
+  json.beginArray("timing");
+  json.add(payload.timing.HeaderMarkMicros);
+  json.add(payload.timing.HeaderSpaceMicros);
+  json.add(payload.timing.OneMarkMicros);
+  json.add(payload.timing.OneSpaceMicros);
+  json.add(payload.timing.ZeroMarkMicros);
+  json.add(payload.timing.ZeroSpaceMicros);
+  json.end();
+  json.field("data", hex);
+  json.end();
+}
+
+// Inverso de irPayloadToJson() (importação)
+bool irPayloadFromJson(JsonObject object, IRPayload* payload) {
+  memset(payload, 0, sizeof(*payload));
+  JsonArray timing = object["timing"].as<JsonArray>();
+  const char* hex = object["data"] | "";
+  int bits = object["bits"] | 0;
+  if (bits <= 0 || bits > IR_PAYLOAD_MAX_BYTES * 8 || timing.size() != 6 ||
+      strlen(hex) != (size_t)((bits + 7) / 8) * 2) {
+    return false;
+  }
+  payload->bits = (uint16_t)bits;
+  payload->flags = (object["msb_first"] | false) ? IRDATA_FLAGS_IS_MSB_FIRST : 0;
+  payload->timing.HeaderMarkMicros = timing[0] | 0;
+  payload->timing.HeaderSpaceMicros = timing[1] | 0;
+  payload->timing.OneMarkMicros = timing[2] | 0;
+  payload->timing.OneSpaceMicros = timing[3] | 0;
+  payload->timing.ZeroMarkMicros = timing[4] | 0;
+  payload->timing.ZeroSpaceMicros = timing[5] | 0;
+  for (int i = 0; hex[i * 2] != '\0'; i++) {
+    char byteHex[3] = {hex[i * 2], hex[i * 2 + 1], '\0'};
+    char* end;
+    payload->data[i] = (uint8_t)strtoul(byteHex, &end, 16);
+    if (*end != '\0') {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Handler de exportação (GET /api/codes/export): NDJSON com cabeçalho, um código por linha
+// (na ordem dos IDs, que a macro referencia) e a configuração do botão. Sai em chunked direto do leitor.
+void handleCodesExport() {
+  HeapScope heapScope(HEAP_TAG_API_CODES);
+  server.sendHeader("Content-Disposition", "attachment; filename=\"ir-codes.ndjson\"");
+  JsonWriter json(200, "application/x-ndjson");
+  CodeStoreReader codes;
+
+  json.beginObject();
+  json.field("type", "header");
+  json.field("format", CODES_EXPORT_FORMAT);
+  json.field("version", CODES_EXPORT_VERSION);
+  json.field("count", codes->count);
+  json.field("max_codes", MAX_CODES);
+  json.endLine();
+
+  char hex[20];
+  for (int i = 0; i < codes->count; i++) {
+    const IRCode& code = codes->codes[i];
+    snprintf(hex, sizeof(hex), "0x%llX", (unsigned long long)code.code);
+    json.beginObject();
+    json.field("type", "code");
+    json.field("id", i);
+    json.field("device", code.device);
+    json.field("button", code.button);
+    json.field("protocol", getProtocolName(code.protocol));
+    json.field("code", hex);
+    json.field("bits", code.bits);
+    json.field("address", code.address);
+    json.field("command", code.command);
+    json.field("repeats", code.repeats);
+    IRPayload payload;
+    if (codeStoreLoadPayload(*codes.data, code, &payload)) {
+      irPayloadToJson(json, payload);
+    }
+    json.endLine();
+  }
+
+  json.beginObject();
+  json.field("type", "button");
+  json.beginObject("actions");
+  for (uint8_t gesture = 0; gesture < BUTTON_GESTURE_COUNT; gesture++) {
+    json.field(buttonGestureName(gesture), buttonActionName(buttonInput.actions[gesture]));
+  }
+  json.end();
+  json.beginArray("macro");
+  for (uint8_t i = 0; i < buttonMacro.count; i++) {
+    json.add(buttonMacro.steps[i]);
+  }
+  json.end();
+  json.endLine();
+  json.finish();  // Ainda com o leitor registrado
+}
+
+// Uma linha do NDJSON de importação; o primeiro erro fica em codeImport e o resto do corpo é ignorado
+void codesImportLine(CodeImport& import) {
+  import.lines++;
+  RequestArenaScope arenaScope;  // Declarado antes do documento: volta depois de ele liberar os blocos
+  JsonDocument doc(&requestArena);
+  if (deserializeJson(doc, (const char*)import.line, import.lineLength)) {
+    import.error = "json_parse_error";
+    return;
+  }
+  const char* type = doc["type"] | "";
+
+  if (!import.header) {
+    if (strcmp(type, "header") != 0 || strcmp(doc["format"] | "", CODES_EXPORT_FORMAT) != 0) {
+      import.error = "missing_header";
+      return;
+    }
+    int version = doc["version"] | 0;
+    if (version < 1 || version > CODES_EXPORT_VERSION) {
+      import.error = "unsupported_version";
+      return;
+    }
+    import.expected = doc["count"] | -1;
+    import.header = true;
+    return;
+  }
+
+  if (strcmp(type, "code") == 0) {
+    CodeStoreData& staging = import.staging;
+    if (staging.count >= MAX_CODES) {
+      import.error = "too_many_codes";
+      return;
+    }
+    const char* device = doc["device"] | "";
+    const char* button = doc["button"] | "";
+    if (device[0] == '\0' || button[0] == '\0' ||
+        strlen(device) > MAX_DEVICE_NAME || strlen(button) > MAX_BUTTON_NAME) {
+      import.error = "invalid_name";
+      return;
+    }
+    IRCode& code = staging.codes[staging.count];
+    memset(&code, 0, sizeof(code));
+    if (!protocolFromName(doc["protocol"] | "", &code.protocol)) {
+      import.error = "invalid_protocol";
+      return;
+    }
+    const char* hex = doc["code"] | "";
+    code.code = strtoull(hex, NULL, 16);
+    if (code.code == 0ULL) {
+      import.error = "invalid_code";
+      return;
+    }
+    strcpy(code.device, device);
+    strcpy(code.button, button);
+    code.bits = doc["bits"] | 32;
+    code.address = doc["address"] | 0;
+    code.command = doc["command"] | 0;
+    code.repeats = doc["repeats"] | 0;
+    if (protocolInfo(code.protocol).fields == IR_FIELDS_PAYLOAD) {
+      IRPayload payload;
+      if (!irPayloadFromJson(doc["payload"], &payload)) {
+        import.error = "invalid_payload";
+        return;
+      }
+      if (!codeStoreAddPayload(staging, code, payload)) {
+        import.error = "payload_pool_full";
+        return;
+      }
+      uint32_t hash = irPayloadHash(payload);  // Identidade usada pela detecção de duplicatas
+      code.address = hash >> 16;
+      code.command = hash & 0xFFFF;
+    }
+    staging.count++;
+    return;
+  }
+
+  if (strcmp(type, "button") == 0) {
+    JsonObject actions = doc["actions"].as<JsonObject>();
+    for (uint8_t gesture = 0; gesture < BUTTON_GESTURE_COUNT; gesture++) {
+      const char* name = actions[buttonGestureName(gesture)];
+      if (!name) {
+        continue;  // Fica o padrão
+      }
+      int action = buttonActionFromName(name);
+      if (action < 0) {
+        import.error = "invalid_action";
+        return;
+      }
+      import.actions[gesture] = (uint8_t)action;
+    }
+    JsonArray macro = doc["macro"].as<JsonArray>();
+    if (macro.size() > MAX_MACRO_STEPS) {
+      import.error = "invalid_macro";
+      return;
+    }
+    import.macroCount = 0;
+    for (JsonVariant step : macro) {
+      int id = step | -1;
+      if (id < 0 || id >= MAX_CODES) {
+        import.error = "invalid_macro";
+        return;
+      }
+      import.macro[import.macroCount++] = (uint8_t)id;
+    }
+    import.button = true;
+    return;
+  }
+
+  import.error = "invalid_line";
+}
+
+// Corpo do POST /api/codes/import, em pedaços (HTTPRaw): nunca passa por server.arg("plain").
+// O estado e a cópia em montagem ficam na arena do pedido, liberados no fim.
+void handleCodesImportBody() {
+  HeapScope heapScope(HEAP_TAG_API_CODES);
+  HTTPRaw& raw = server.raw();
+  if (raw.status == RAW_START) {
+    codeImport = (CodeImport*)requestArena.allocate(sizeof(CodeImport));
+    if (codeImport == NULL) {
+      Log<LOG_LVL_ERROR, LOG_HTTP>::printf("✗ Sem memória para a importação (%u bytes)", (unsigned)sizeof(CodeImport));
+      return;
+    }
+    memset(codeImport, 0, sizeof(CodeImport));
+    codeImport->expected = -1;
+    memcpy(codeImport->actions, BUTTON_DEFAULT_ACTIONS, sizeof(codeImport->actions));
+    codeImport->startUs = micros();
+    return;
+  }
+  if (codeImport == NULL) {
+    return;
+  }
+  CodeImport& import = *codeImport;
+  if (raw.status == RAW_ABORTED) {
+    Log<LOG_LVL_WARN, LOG_HTTP>::printf("⚠ Importação interrompida após %u bytes", (unsigned)raw.totalSize);
+    requestArena.deallocate(codeImport);
+    codeImport = NULL;
+    return;
+  }
+  import.bytes = raw.totalSize;
+
+  // RAW_END: última linha sem '\n'
+  const uint8_t* data = raw.buf;
+  size_t size = raw.status == RAW_WRITE ? raw.currentSize : 0;
+  bool flushLast = raw.status == RAW_END;
+  for (size_t i = 0; i <= size && import.error == NULL; i++) {
+    bool lineEnd = i == size ? flushLast : data[i] == '\n';
+    if (i == size && !lineEnd) {
+      break;
+    }
+    if (!lineEnd) {
+      if (import.lineLength >= CODE_IMPORT_LINE_MAX) {
+        import.error = "line_too_long";
+        break;
+      }
+      import.line[import.lineLength++] = (char)data[i];
+      continue;
+    }
+    if (import.lineLength > 0 && import.line[import.lineLength - 1] == '\r') {
+      import.lineLength--;
+    }
+    if (import.lineLength > 0) {
+      codesImportLine(import);
+    }
+    import.lineLength = 0;
+  }
+  if (import.error != NULL && import.errorLine == 0) {
+    import.errorLine = import.lines;
+  }
+}
+
+// Handler da importação (POST /api/codes/import), chamado depois do corpo inteiro: troca o
+// armazenamento de uma vez (uma publicação e uma gravação no Preferences) ou não muda nada
+void handleCodesImport() {
+  HeapScope heapScope(HEAP_TAG_API_CODES);
+  if (codeImport == NULL) {
+    sendJsonError(400, "no_data");
+    return;
+  }
+  CodeImport& import = *codeImport;
+  if (import.error == NULL) {
+    if (!import.header) {
+      import.error = "missing_header";
+    } else if (import.expected >= 0 && import.expected != import.staging.count) {
+      import.error = "count_mismatch";  // Corpo truncado
+    }
+    for (uint8_t i = 0; import.error == NULL && i < import.macroCount; i++) {
+      if (import.macro[i] >= import.staging.count) {
+        import.error = "invalid_macro";
+      }
+    }
+  }
+
+  if (import.error != NULL) {
+    Log<LOG_LVL_WARN, LOG_HTTP>::printf("✗ Importação recusada: %s (linha %u)", import.error, (unsigned)import.errorLine);
+    JsonWriter json(400);
+    json.beginObject();
+    json.field("status", "error");
+    json.field("message", import.error);
+    if (import.errorLine != 0) {
+      json.field("line", import.errorLine);
+    }
+    json.end();
+  } else {
+    {
+      CodeStoreWriter store;
+      codeStoreCopy(*store.data, import.staging);
+      saveCodesToPreferences(*store.data);
+      store.publish();
+    }
+    // Sem linha de botão, a macro antiga apontaria para IDs de outro armazenamento
+    if (import.button) {
+      memcpy(buttonInput.actions, import.actions, sizeof(buttonInput.actions));
+      buttonInput.pendingShort = false;
+    }
+    memcpy(buttonMacro.steps, import.macro, import.macroCount);
+    buttonMacro.count = import.macroCount;
+    buttonMacro.next = import.macroCount;
+    saveButtonConfig();
+
+    unsigned long elapsedMs = (micros() - import.startUs) / 1000;
+    Log<LOG_LVL_INFO, LOG_HTTP>::printf("✓ %d códigos importados (%u bytes, %lu ms)",
+                                        import.staging.count, (unsigned)import.bytes, elapsedMs);
+    JsonWriter json(200);
+    json.beginObject();
+    json.field("status", "success");
+    json.field("code_count", import.staging.count);
+    json.field("macro_steps", import.macroCount);
+    json.field("bytes", import.bytes);
+    json.field("elapsed_ms", elapsedMs);
+    json.end();
+  }
+  requestArena.deallocate(codeImport);
+  codeImport = NULL;
+}
+
 
 void handleCodeSend() {
+  unsigned long requestStartUs = micros();
+  TraceScope traceScope(requestStartUs);
+  HeapScope heapScope(HEAP_TAG_API_SEND);
+  
   if (!server.hasArg("plain")) {
     sendJsonError(400, "no_data");
     return;
   }
 
-  StaticJsonDocument<300> doc;
+  unsigned long parseStartUs = micros();
+  JsonDocument doc(&requestArena);
   DeserializationError error = deserializeJson(doc, server.arg("plain"));
+  traceSpan(TRACE_JSON_PARSE, parseStartUs, micros());
   
   if (error) {
     sendJsonError(400, "json_parse_error");
     return;
   }
 
+  unsigned long lookupStartUs = micros();
   uint64_t codeToSend = 0ULL;
+  IRCode codeToSendObj;
+  IRPayload payload;
+  bool found = false;
+  bool hasPayload = false;
   
   // Aceita tanto "id" quanto "code" diretamente
   if (doc.containsKey("id")) {
     int id = doc["id"].as<int>();
-    // Validação de segurança: verificar limites
-    if (id >= 0 && id < codeCount && id < MAX_CODES && codeCount <= MAX_CODES) {
-      codeToSend = storedCodes[id].code;
-      Serial.printf("Enviando código por ID %d: 0x%llX\n", id, codeToSend);
+    {
+      // Copia o código inteiro de uma vez: o leitor sai antes da espera pela emissão
+      CodeStoreReader codes;
+      // Validação de segurança: verificar limites
+      if (id >= 0 && id < codes->count && id < MAX_CODES) {
+        codeToSendObj = codes->codes[id];
+        hasPayload = codeStoreLoadPayload(*codes.data, codeToSendObj, &payload);
+        found = true;
+      }
+    }
+    if (found) {
+      codeToSend = codeToSendObj.code;
+      Log<LOG_LVL_DEBUG, LOG_HTTP>::printf("Enviando código por ID %d: 0x%llX", id, (unsigned long long)codeToSend);
     } else {
       sendJsonError(404, "invalid_id");
       return;
@@ -1635,7 +5806,7 @@ void handleCodeSend() {
     } else {
       codeToSend = doc["code"].as<uint64_t>();
     }
-    Serial.printf("Enviando código direto: 0x%llX\n", codeToSend);
+    Log<LOG_LVL_DEBUG, LOG_HTTP>::printf("Enviando código direto: 0x%llX", (unsigned long long)codeToSend);
   } else {
     sendJsonError(400, "id_or_code_required");
     return;
@@ -1645,21 +5816,10 @@ void handleCodeSend() {
     sendJsonError(400, "invalid_code");
     return;
   }
-
-  // Buscar código completo do storage para ter protocolo
-  IRCode codeToSendObj;
-  bool found = false;
-  
-  if (doc.containsKey("id")) {
-    int id = doc["id"].as<int>();
-    if (id >= 0 && id < codeCount && id < MAX_CODES) {
-      codeToSendObj = storedCodes[id];
-      found = true;
-    }
-  }
-  
-  // Se não encontrou por ID, criar objeto temporário (fallback para NEC)
+
+  // Se não veio por ID, criar objeto temporário (fallback para NEC)
   if (!found) {
+    memset(&codeToSendObj, 0, sizeof(codeToSendObj));  // Sem device/button: o log mostra vazio
     codeToSendObj.code = codeToSend;
     codeToSendObj.protocol = PROTOCOL_NEC;  // Fallback
     codeToSendObj.address = (codeToSend >> 16) & 0xFFFF;
@@ -1667,17 +5827,88 @@ void handleCodeSend() {
     codeToSendObj.bits = 32;
     codeToSendObj.repeats = 0;
   }
+  traceSpan(TRACE_CODE_LOOKUP, lookupStartUs, micros());
   
-  if (sendIRCode(codeToSendObj)) {
+  IRTxResult result = irTxSubmit(codeToSendObj, hasPayload ? &payload : NULL, requestStartUs, true);
+  unsigned long responseStartUs = micros();
+  if (result == IR_TX_SENT) {
     sendJsonSuccess("code_sent");
+  } else if (result == IR_TX_BUSY) {
+    sendJsonError(503, "tx_queue_full");
+  } else if (result == IR_TX_TIMEOUT) {
+    sendJsonError(504, "tx_timeout");
   } else {
     sendJsonError(500, "failed_to_send");
   }
+  traceSpan(TRACE_HTTP_RESPONSE, responseStartUs, micros());
+}
+
+// Handler do botão segurado (POST /api/hold/start {"id": N}): quadro inicial e repetições no período
+// do protocolo até /api/hold/stop. A UI manda /api/hold/keep enquanto o botão está apertado.
+void handleHoldStart() {
+  unsigned long requestStartUs = micros();
+  HeapScope heapScope(HEAP_TAG_API_SEND);
+  if (!server.hasArg("plain")) {
+    sendJsonError(400, "no_data");
+    return;
+  }
+  JsonDocument doc(&requestArena);
+  if (deserializeJson(doc, server.arg("plain"))) {
+    sendJsonError(400, "json_parse_error");
+    return;
+  }
+  if (!doc.containsKey("id")) {
+    sendJsonError(400, "id_required");
+    return;
+  }
+  uint8_t periodMs = 0;
+  const char* error = irHoldBegin(doc["id"].as<int>(), requestStartUs, &periodMs);
+  if (error != NULL) {
+    int code = 400;
+    if (strcmp(error, "invalid_id") == 0) {
+      code = 404;
+    } else if (strcmp(error, "hold_queue_full") == 0) {
+      code = 503;
+    }
+    sendJsonError(code, error);
+    return;
+  }
+  JsonWriter json(200);
+  json.beginObject();
+  json.field("status", "holding");
+  json.field("period_ms", periodMs);
+  json.field("timeout_ms", IR_HOLD_TIMEOUT_MS);
+  json.end();
+}
+
+void handleHoldKeep() {
+  HeapScope heapScope(HEAP_TAG_API_SEND);
+  if (!irHoldSubmit(IR_HOLD_KEEP, NULL, 0)) {
+    sendJsonError(503, "hold_queue_full");
+    return;
+  }
+  JsonWriter json(200);
+  json.beginObject();
+  json.field("status", "holding");
+  json.end();
+}
+
+void handleHoldStop() {
+  HeapScope heapScope(HEAP_TAG_API_SEND);
+  if (!irHoldSubmit(IR_HOLD_END, NULL, 0)) {
+    sendJsonError(503, "hold_queue_full");
+    return;
+  }
+  JsonWriter json(200);
+  json.beginObject();
+  json.field("status", "hold_stopped");
+  json.end();
 }
 
 // Handler para página de configuração WiFi
 void handleWiFiConfig() {
-  String html = R"(
+  HeapScope heapScope(HEAP_TAG_PAGE_CONFIG);
+  static const char html[] PROGMEM = R"(
 <!DOCTYPE html>
 <html>
 <head>
@@ -1787,6 +6018,28 @@ void handleWiFiConfig() {
     .btn-secondary:hover {
       background: #5a6268;
     }
+    .scan-list {
+      max-height: 180px;
+      overflow-y: auto;
+      border: 2px solid #ddd;
+      border-radius: 8px;
+      margin-bottom: 8px;
+    }
+    .scan-item {
+      padding: 8px 12px;
+      cursor: pointer;
+      display: flex;
+      justify-content: space-between;
+      font-size: 14px;
+      border-bottom: 1px solid #eee;
+    }
+    .scan-item:hover {
+      background: #f0f3ff;
+    }
+    .scan-meta {
+      color: #888;
+      font-size: 12px;
+    }
   </style>
 </head>
 <body>
@@ -1800,6 +6053,12 @@ void handleWiFiConfig() {
     </div>
     
     <form id='wifiForm'>
+      <div class='form-group'>
+        <label>Redes próximas:</label>
+        <div id='scanList' class='scan-list'><div class='scan-item'>Carregando...</div></div>
+        <button type='button' class='btn-secondary' onclick='loadScan(true)'>🔍 Procurar redes</button>
+      </div>
+      
       <div class='form-group'>
         <label for='ssid'>Nome da Rede (SSID):</label>
         <input type='text' id='ssid' name='ssid' required maxlength='32' autofocus>
@@ -1810,6 +6069,16 @@ void handleWiFiConfig() {
         <input type='password' id='password' name='password' maxlength='64'>
       </div>
       
+      <div class='form-group'>
+        <label for='static_ip'>IP fixo (opcional, vazio = DHCP):</label>
+        <input type='text' id='static_ip' name='static_ip' placeholder='192.168.1.50'>
+      </div>
+      
+      <div class='form-group'>
+        <label for='gateway'>Gateway (obrigatório com IP fixo):</label>
+        <input type='text' id='gateway' name='gateway' placeholder='192.168.1.1'>
+      </div>
+      
       <button type='submit'>Conectar</button>
       <button type='button' class='btn-secondary' onclick='reconnectWiFi()'>🔄 Reconectar WiFi</button>
     </form>
@@ -1851,6 +6120,65 @@ void handleWiFiConfig() {
         document.getElementById('infoBox').style.display = 'none';
       });
     
+    // Redes próximas: o ESP32 responde com o cache e varre em segundo plano; enquanto
+    // "scanning" for true, consulta de novo sem pedir outra varredura
+    function loadScan(refresh) {
+      fetch('/api/wifi/scan' + (refresh ? '?refresh=1' : ''))
+        .then(r => r.json())
+        .then(data => {
+          const list = document.getElementById('scanList');
+          list.innerHTML = '';
+          data.networks.forEach(net => {
+            const item = document.createElement('div');
+            item.className = 'scan-item';
+            const name = document.createElement('span');
+            name.textContent = (net.auth === 'open' ? '🔓 ' : '🔒 ') + net.ssid + (net.saved ? ' ✓' : '');
+            const meta = document.createElement('span');
+            meta.className = 'scan-meta';
+            meta.textContent = net.rssi + ' dBm · canal ' + net.channel;
+            item.appendChild(name);
+            item.appendChild(meta);
+            item.onclick = () => {
+              document.getElementById('ssid').value = net.ssid;
+              document.getElementById('password').focus();
+            };
+            list.appendChild(item);
+          });
+          if (data.scanning) {
+            if (!data.networks.length) list.innerHTML = "<div class='scan-item'>⏳ Procurando redes...</div>";
+            setTimeout(() => loadScan(false), 1500);
+          } else if (!data.networks.length) {
+            list.innerHTML = "<div class='scan-item'>Nenhuma rede encontrada</div>";
+          }
+        })
+        .catch(() => {});
+    }
+    loadScan(false);
+    
+    // A conexão roda em segundo plano no ESP32: acompanhar por /api/wifi/status
+    function waitForWiFi(statusDiv) {
+      const startedAt = Date.now();
+      const poll = () => {
+        fetch('/api/wifi/status')
+          .then(r => r.json())
+          .then(wifi => {
+            if (wifi.state === 'connected') {
+              statusDiv.textContent = '✓ Conectado! IP: ' + wifi.ip + ' — acesse http://' + wifi.ip;
+              statusDiv.className = 'status success';
+              setTimeout(() => location.reload(), 5000);
+            } else if (wifi.state === 'backoff' || Date.now() - startedAt > 30000) {
+              statusDiv.textContent = '⚠ Falha ao conectar (motivo ' + wifi.last_reason + '). Verifique SSID e senha; o ESP32 continua tentando e o AP segue ativo.';
+              statusDiv.className = 'status warning';
+            } else {
+              statusDiv.textContent = '⏳ Conectando em "' + wifi.ssid + '" (tentativa ' + wifi.attempt + ')...';
+              setTimeout(poll, 1000);
+            }
+          })
+          .catch(() => setTimeout(poll, 1000));  // AP pode oscilar ao trocar de canal
+      };
+      poll();
+    }
+    
     function reconnectWiFi() {
       const statusDiv = document.getElementById('status');
       statusDiv.textContent = '🔄 Reconectando...';
@@ -1860,10 +6188,8 @@ void handleWiFiConfig() {
       fetch('/api/wifi/reconnect', { method: 'POST' })
         .then(r => r.json())
         .then(data => {
-          if (data.status === 'success') {
-            statusDiv.textContent = '✓ Reconectado! IP: ' + data.ip;
-            statusDiv.className = 'status success';
-            setTimeout(() => location.reload(), 2000);
+          if (data.status === 'connecting') {
+            waitForWiFi(statusDiv);
           } else {
             statusDiv.textContent = '✗ ' + (data.message || 'Erro ao reconectar');
             statusDiv.className = 'status error';
@@ -1889,24 +6215,24 @@ void handleWiFiConfig() {
         return;
       }
       
-      statusDiv.textContent = '⏳ Conectando (pode levar até 30 segundos)...';
+      statusDiv.textContent = '⏳ Enviando credenciais...';
       statusDiv.className = 'status';
       statusDiv.style.display = 'block';
       
       fetch('/api/wifi/config', {
         method: 'POST',
         headers: { 'Content-Type': 'application/json' },
-        body: JSON.stringify({ ssid: ssid, password: password })
+        body: JSON.stringify({
+          ssid: ssid,
+          password: password,
+          static_ip: document.getElementById('static_ip').value.trim(),
+          gateway: document.getElementById('gateway').value.trim()
+        })
       })
       .then(r => r.json())
       .then(data => {
-        if (data.status === 'success') {
-          statusDiv.textContent = '✓ ' + data.message;
-          statusDiv.className = 'status success';
-          setTimeout(() => {
-            statusDiv.textContent = 'Aguarde alguns segundos e acesse: http://' + data.ip;
-            setTimeout(() => location.reload(), 3000);
-          }, 2000);
+        if (data.status === 'connecting') {
+          waitForWiFi(statusDiv);
         } else {
           statusDiv.textContent = '⚠ ' + (data.message || 'Erro desconhecido');
           statusDiv.className = 'status warning';
@@ -1921,119 +6247,795 @@ void handleWiFiConfig() {
 </body>
 </html>
 )";
-  server.send(200, "text/html", html);
+  server.send_P(200, "text/html", html, sizeof(html) - 1);
 }
 
-// Handler para salvar configuração WiFi
+// Handler para salvar configuração WiFi: adiciona a rede ou atualiza a de mesmo SSID
+// {"ssid","password","priority"?,"static_ip"?,"gateway"?,"subnet"?,"dns"?}
 void handleWiFiConfigSave() {
+  HeapScope heapScope(HEAP_TAG_API_WIFI);
   if (!server.hasArg("plain")) {
-    server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"no_data\"}");
+    sendJsonError(400, "no_data");
     return;
   }
 
-  String body = server.arg("plain");
-  StaticJsonDocument<300> doc;
-  DeserializationError error = deserializeJson(doc, body);
+  // String temporária do WebServer: solta logo após o parse
+  JsonDocument doc(&requestArena);
+  DeserializationError error = deserializeJson(doc, server.arg("plain"));
   
   if (error) {
-    server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"json_parse_error\"}");
+    sendJsonError(400, "json_parse_error");
     return;
   }
 
-  String ssid = doc["ssid"] | "";
-  String password = doc["password"] | "";
+  const char* ssid = doc["ssid"] | "";
+  const char* password = doc["password"] | "";
   
   // Validação de segurança: verificar tamanho
-  if (ssid.length() == 0 || ssid.length() > MAX_SSID_LENGTH) {
-    server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"invalid_ssid\"}");
+  if (ssid[0] == '\0' || strlen(ssid) > MAX_SSID_LENGTH) {
+    sendJsonError(400, "invalid_ssid");
     return;
   }
   
-  if (password.length() > MAX_PASSWORD_LENGTH) {
-    server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"password_too_long\"}");
+  if (strlen(password) > MAX_PASSWORD_LENGTH) {
+    sendJsonError(400, "password_too_long");
     return;
   }
-  
-  // Salvar credenciais
-  saveWiFiCredentials(ssid.c_str(), password.c_str());
-  Serial.println("💾 Credenciais salvas, tentando conectar...");
-  
-  // Tentar conectar (força reconexão completa)
-  WiFi.disconnect();
-  delay(500);
-  
-  bool connected = connectToWiFi(ssid.c_str(), password.c_str());
-  
-  DynamicJsonDocument response(300);
-  if (connected) {
-    // Ativar modo híbrido para permitir reconfiguração
-    WiFi.mode(WIFI_AP_STA);
-    delay(100);
-    WiFi.softAP(AP_SSID, AP_PASSWORD);
-    IPAddress AP_IP(AP_IP_OCTET_1, AP_IP_OCTET_2, AP_IP_OCTET_3, AP_IP_OCTET_4);
-    IPAddress gateway(AP_IP_OCTET_1, AP_IP_OCTET_2, AP_IP_OCTET_3, 1);
-    IPAddress subnet(255, 255, 255, 0);
-    WiFi.softAPConfig(AP_IP, gateway, subnet);
-    
-    response["status"] = "success";
-    response["ip"] = WiFi.localIP().toString();
-    response["mac"] = WiFi.macAddress();
-    response["rssi"] = WiFi.RSSI();
-    response["message"] = "WiFi configurado com sucesso! IP: " + WiFi.localIP().toString();
+
+  int index = findWiFiNetwork(ssid);
+  if (index < 0 && wifiNetworkCount >= WIFI_MAX_NETWORKS) {
+    sendJsonError(507, "network_list_full");
+    return;
+  }
+  WiFiNetwork network;
+  if (index >= 0) {
+    network = wifiNetworks[index];
   } else {
-    // Se falhar, manter AP ativo
-    if (WiFi.getMode() != WIFI_AP && WiFi.getMode() != WIFI_AP_STA) {
-      startConfigAP();
+    memset(&network, 0, sizeof(network));
+    strncpy(network.ssid, ssid, MAX_SSID_LENGTH);
+    // Rede nova entra como a preferida
+    int maxPriority = 0;
+    for (int i = 0; i < wifiNetworkCount; i++) {
+      maxPriority = max(maxPriority, (int)wifiNetworks[i].priority);
     }
-    response["status"] = "warning";
-    response["message"] = "Credenciais salvas, mas falha ao conectar. Verifique SSID e senha. O AP continua ativo para nova tentativa.";
+    network.priority = (uint8_t)min(maxPriority + 1, 255);
   }
-  
-  String responseStr;
-  serializeJson(response, responseStr);
-  server.send(200, "application/json", responseStr);
+  // Rede existente sem "password" mantém a senha (ex: só mudar a prioridade)
+  if (index < 0 || doc.containsKey("password")) {
+    memset(network.password, 0, sizeof(network.password));
+    strncpy(network.password, password, MAX_PASSWORD_LENGTH);
+  }
+  if (doc.containsKey("priority")) {
+    int priority = doc["priority"] | 0;
+    if (priority < 0 || priority > 255) {
+      sendJsonError(400, "invalid_priority");
+      return;
+    }
+    network.priority = (uint8_t)priority;
+  }
+
+  // IP fixo opcional: static_ip vazio volta ao DHCP; ausente mantém o da rede
+  const char* staticIpStr = doc["static_ip"] | "";
+  if (staticIpStr[0] != '\0') {
+    IPAddress ip, gateway, subnet(255, 255, 255, 0), dns;
+    const char* subnetStr = doc["subnet"] | "";
+    const char* dnsStr = doc["dns"] | "";
+    if (!ip.fromString(staticIpStr) || !gateway.fromString(doc["gateway"] | "") ||
+        (subnetStr[0] != '\0' && !subnet.fromString(subnetStr)) ||
+        (dnsStr[0] != '\0' && !dns.fromString(dnsStr))) {
+      sendJsonError(400, "invalid_ip");
+      return;
+    }
+    network.staticIp.ip = (uint32_t)ip;
+    network.staticIp.gateway = (uint32_t)gateway;
+    network.staticIp.subnet = (uint32_t)subnet;
+    network.staticIp.dns = dnsStr[0] != '\0' ? (uint32_t)dns : (uint32_t)gateway;
+  } else if (doc.containsKey("static_ip")) {
+    memset(&network.staticIp, 0, sizeof(network.staticIp));
+  }
+
+  // Salvar credenciais
+  if (index < 0) {
+    index = wifiNetworkCount++;
+  }
+  wifiNetworks[index] = network;
+  saveWiFiNetworks();
+  Log<LOG_LVL_INFO, LOG_WIFI>::printf("💾 Rede '%s' salva (prioridade %u), conectando em segundo plano...", network.ssid, network.priority);
+
+  wifiConfigured = true;
+  wifiStartConnect();
+
+  // Resposta imediata: o resultado é acompanhado por GET /api/wifi/status
+  JsonWriter json(202);
+  json.beginObject();
+  json.field("status", "connecting");
+  json.field("message", "Credenciais salvas, conectando...");
+  wifiStatusToJson(json, "wifi");
+  json.end();
 }
 
 // Handler para forçar reconexão WiFi
 void handleWiFiReconnect() {
-  Serial.println("🔄 Reconexão WiFi solicitada via API...");
-  
-  char ssid[MAX_SSID_LENGTH + 1];
-  char password[MAX_PASSWORD_LENGTH + 1];
+  HeapScope heapScope(HEAP_TAG_API_WIFI);
+  Log<LOG_LVL_INFO, LOG_WIFI>::printf("🔄 Reconexão WiFi solicitada via API...");
   
-  DynamicJsonDocument response(300);
-  
-  if (loadWiFiCredentials(ssid, password, MAX_SSID_LENGTH + 1)) {
-    WiFi.disconnect();
-    delay(500);
-    
-    bool connected = connectToWiFi(ssid, password);
-    
-    if (connected) {
-      // Ativar modo híbrido
-      WiFi.mode(WIFI_AP_STA);
-      delay(100);
-      WiFi.softAP(AP_SSID, AP_PASSWORD);
-      IPAddress AP_IP(AP_IP_OCTET_1, AP_IP_OCTET_2, AP_IP_OCTET_3, AP_IP_OCTET_4);
-      IPAddress gateway(AP_IP_OCTET_1, AP_IP_OCTET_2, AP_IP_OCTET_3, 1);
-      IPAddress subnet(255, 255, 255, 0);
-      WiFi.softAPConfig(AP_IP, gateway, subnet);
-      
-      response["status"] = "success";
-      response["ip"] = WiFi.localIP().toString();
-      response["message"] = "Reconectado com sucesso";
+  if (!wifiConfigured) {
+    sendJsonError(200, "Nenhuma credencial WiFi configurada");
+    return;
+  }
+
+  wifiStartConnect();
+
+  JsonWriter json(202);
+  json.beginObject();
+  json.field("status", "connecting");
+  json.field("message", "Reconectando...");
+  wifiStatusToJson(json, "wifi");
+  json.end();
+}
+
+// Handler do AP de configuração (GET/POST /api/wifi/ap)
+// POST {"enable":true,"minutes":10} abre por uma janela; {"enable":false} fecha (exige STA conectada)
+void handleWiFiAP() {
+  HeapScope heapScope(HEAP_TAG_API_WIFI);
+  bool closeAfterResponse = false;
+  if (server.method() == HTTP_POST) {
+    JsonDocument request(&requestArena);
+    if (!server.hasArg("plain") || deserializeJson(request, server.arg("plain"))) {
+      sendJsonError(400, "json_parse_error");
+      return;
+    }
+    if (request["enable"] | true) {
+      unsigned long minutes = request["minutes"] | (unsigned long)(CONFIG_AP_WINDOW_MS / 60000);
+      configApOpen(CONFIG_AP_API, min(minutes, 240UL) * 60000UL);
+    } else if (!wifiConfigured) {
+      sendJsonError(409, "no_credentials");
+      return;
+    } else if (wifiManager.state != WIFI_STATE_CONNECTED) {
+      sendJsonError(409, "sta_not_connected");
+      return;
     } else {
-      response["status"] = "error";
-      response["message"] = "Falha ao reconectar";
+      closeAfterResponse = configAp.reason != CONFIG_AP_OFF;
+    }
+  }
+
+  JsonWriter json(200);
+  unsigned long now = millis();
+  bool active = configAp.reason != CONFIG_AP_OFF && !closeAfterResponse;
+  json.beginObject();
+  json.field("active", active);
+  json.field("reason", configApReasonName(active ? configAp.reason : (uint8_t)CONFIG_AP_OFF));
+  json.field("opens", configAp.opens);
+  if (active) {
+    json.field("ip", WiFi.softAPIP());
+    json.field("clients", WiFi.softAPgetStationNum());
+    json.field("open_ms", now - configAp.openedAtMs);
+    if (configAp.reason != CONFIG_AP_NO_CREDENTIALS && configAp.reason != CONFIG_AP_STA_FAILURE) {
+      long closesIn = (long)(configAp.closeAtMs - now);
+      json.field("min_close_in_ms", closesIn > 0 ? closesIn : 0);
+    }
+  }
+  json.finish();
+
+  // Depois da resposta: quem chamou pelo próprio AP ainda recebe o resultado
+  if (closeAfterResponse) {
+    configApClose();
+  }
+}
+
+// Handler do estado da conexão WiFi (GET /api/wifi/status)
+void handleWiFiStatus() {
+  HeapScope heapScope(HEAP_TAG_API_WIFI);
+  JsonWriter json(200);
+  wifiStatusToJson(json, NULL);
+}
+
+// Handler das redes próximas (GET /api/wifi/scan): responde na hora com o cache.
+// Varre em segundo plano se o cache estiver vazio/velho ou com ?refresh=1; "scanning" diz
+// à página para consultar de novo.
+void handleWiFiScan() {
+  HeapScope heapScope(HEAP_TAG_API_WIFI);
+  unsigned long now = millis();
+  bool stale = wifiScanCache.updatedAtMs == 0 || now - wifiScanCache.updatedAtMs > WIFI_SCAN_CACHE_TTL_MS;
+  if (stale || server.arg("refresh") == "1") {
+    wifiRequestScan();
+  }
+
+  JsonWriter json(200);
+  json.beginObject();
+  json.field("scanning", wifiScanCache.running || wifiManager.roamScan || wifiManager.state == WIFI_STATE_SCANNING);
+  if (wifiScanCache.updatedAtMs != 0) {
+    json.field("age_ms", now - wifiScanCache.updatedAtMs);
+    json.field("updated_ms", wifiScanCache.updatedAtMs);
+  }
+  json.field("found", wifiScanCache.found);
+  json.beginArray("networks");
+  for (int i = 0; i < wifiScanCache.count; i++) {
+    const WiFiScanEntry& entry = wifiScanCache.entries[i];
+    json.beginObject();
+    json.field("ssid", entry.ssid);
+    json.field("rssi", entry.rssi);
+    json.field("channel", entry.channel);
+    json.field("auth", wifiAuthName(entry.auth));
+    if (findWiFiNetwork(entry.ssid) >= 0) {
+      json.field("saved", true);
+    }
+    json.end();
+  }
+  json.end();
+  json.end();
+}
+
+// Handler do botão físico (GET/POST /api/button). POST aceita as ações por gesto e a macro:
+// {"short":"learn","long":"config_ap","double":"macro","macro":[0,3,5]} (ids de /api/codes)
+void handleButton() {
+  HeapScope heapScope(HEAP_TAG_API_STATUS);
+  if (server.method() == HTTP_POST) {
+    JsonDocument request(&requestArena);
+    if (!server.hasArg("plain") || deserializeJson(request, server.arg("plain"))) {
+      sendJsonError(400, "json_parse_error");
+      return;
+    }
+    uint8_t actions[BUTTON_GESTURE_COUNT];
+    memcpy(actions, buttonInput.actions, sizeof(actions));
+    for (uint8_t gesture = 0; gesture < BUTTON_GESTURE_COUNT; gesture++) {
+      const char* name = request[buttonGestureName(gesture)];
+      if (!name) {
+        continue;
+      }
+      int action = buttonActionFromName(name);
+      if (action < 0) {
+        sendJsonError(400, "invalid_action");
+        return;
+      }
+      actions[gesture] = (uint8_t)action;
+    }
+    if (request.containsKey("macro")) {
+      JsonArray macro = request["macro"].as<JsonArray>();
+      if (!request["macro"].is<JsonArray>() || macro.size() > MAX_MACRO_STEPS) {
+        sendJsonError(400, "invalid_macro");
+        return;
+      }
+      int codeCount;
+      {
+        CodeStoreReader codes;
+        codeCount = codes->count;
+      }
+      for (JsonVariant step : macro) {
+        int id = step | -1;
+        if (id < 0 || id >= codeCount) {
+          sendJsonError(400, "invalid_macro");
+          return;
+        }
+      }
+      uint8_t count = 0;
+      for (JsonVariant step : macro) {
+        buttonMacro.steps[count++] = step.as<uint8_t>();
+      }
+      buttonMacro.count = count;
+      buttonMacro.next = count;
+    }
+    memcpy(buttonInput.actions, actions, sizeof(actions));
+    buttonInput.pendingShort = false;  // Com o duplo desligado, o curto não espera mais a janela
+    saveButtonConfig();
+  }
+
+  JsonWriter json(200);
+  json.beginObject();
+  json.beginObject("actions");
+  for (uint8_t gesture = 0; gesture < BUTTON_GESTURE_COUNT; gesture++) {
+    json.field(buttonGestureName(gesture), buttonActionName(buttonInput.actions[gesture]));
+  }
+  json.end();
+  json.beginArray("macro");
+  for (uint8_t i = 0; i < buttonMacro.count; i++) {
+    json.add(buttonMacro.steps[i]);
+  }
+  json.end();
+  json.field("macro_running", buttonMacro.next < buttonMacro.count);
+  json.field("macro_runs", buttonMacro.runs);
+  json.field("pressed", buttonInput.stableDown);
+  json.field("long_press_ms", BUTTON_LONG_PRESS_MS);
+  json.field("double_press_ms", BUTTON_DOUBLE_PRESS_MS);
+  json.field("debounce_ms", BUTTON_DEBOUNCE_MS);
+  json.beginObject("stats");
+  json.field("edges", buttonInput.edgesTotal);
+  json.field("transitions", buttonInput.transitions);
+  json.field("edge_overflows", (uint32_t)buttonInput.edgeOverflows);
+  json.field("event_overflows", buttonInput.events.drops);
+  for (uint8_t gesture = 0; gesture < BUTTON_GESTURE_COUNT; gesture++) {
+    json.field(buttonGestureName(gesture), buttonInput.gestures[gesture]);
+  }
+  json.end();
+  json.end();
+}
+
+// Handler do perfil de energia (GET/POST /api/power). POST {"profile":"balanced"} troca e grava.
+// wake_latency traz, por perfil, o tempo da borda no GPIO até o loop() tratar o evento.
+void handlePower() {
+  HeapScope heapScope(HEAP_TAG_API_STATUS);
+  if (server.method() == HTTP_POST) {
+    JsonDocument request(&requestArena);
+    if (!server.hasArg("plain") || deserializeJson(request, server.arg("plain"))) {
+      sendJsonError(400, "json_parse_error");
+      return;
+    }
+    const char* name = request["profile"] | "";
+    int profile = -1;
+    for (int i = 0; i < POWER_PROFILE_COUNT; i++) {
+      if (strcmp(POWER_PROFILES[i].name, name) == 0) {
+        profile = i;
+      }
+    }
+    if (profile < 0) {
+      sendJsonError(400, "invalid_profile");
+      return;
+    }
+    powerApply((uint8_t)profile);
+    savePowerProfile();
+  }
+
+  JsonWriter json(200);
+  const PowerProfileConfig& profile = POWER_PROFILES[power.profile];
+  json.beginObject();
+  json.field("profile", profile.name);
+  json.field("wifi_sleep", profile.wifiSleep == WIFI_PS_NONE ? "none" : (profile.wifiSleep == WIFI_PS_MIN_MODEM ? "min_modem" : "max_modem"));
+  json.field("cpu_max_mhz", profile.maxMhz);
+  json.field("cpu_min_mhz", profile.minMhz);
+  json.field("cpu_mhz", ESP.getCpuFreqMHz());
+  json.field("light_sleep", power.lightSleep);
+  if (power.pmError != ESP_OK) {
+    json.field("pm_error", power.pmError);
+  }
+  json.field("idle_wait_ms", profile.idleWaitMs);
+  unsigned long sinceUs = micros() - power.profileSinceUs;
+  json.field("idle_pct", sinceUs ? (float)(power.idleUs * 100.0 / sinceUs) : 0.0f);
+  json.field("awake_hold", power.awakeLockHeld);
+  json.beginArray("profiles");
+  for (int i = 0; i < POWER_PROFILE_COUNT; i++) {
+    json.add(POWER_PROFILES[i].name);
+  }
+  json.end();
+  json.beginObject("wakes");
+  for (uint8_t source = 0; source < POWER_WAKE_SOURCE_COUNT; source++) {
+    json.field(powerWakeSourceName(source), power.wakes[source]);
+  }
+  json.end();
+  json.beginObject("wake_latency");
+  for (int i = 0; i < POWER_PROFILE_COUNT; i++) {
+    json.beginObject(POWER_PROFILES[i].name);
+    for (uint8_t source = 0; source < POWER_WAKE_SOURCE_COUNT; source++) {
+      if (power.wakeLatency[i][source].count != 0) {
+        histogramToJson(json, powerWakeSourceName(source), power.wakeLatency[i][source]);
+      }
+    }
+    json.end();
+  }
+  json.end();
+  json.end();
+}
+
+// Nível de log em tempo de execução: {"level":"warn"} em todas as categorias e/ou
+// {"categories":{"ir":"debug"}}. Níveis acima de LOG_MAX_LEVEL não existem no binário.
+void handleLog() {
+  HeapScope heapScope(HEAP_TAG_API_STATUS);
+  if (server.method() == HTTP_POST) {
+    JsonDocument request(&requestArena);
+    if (!server.hasArg("plain") || deserializeJson(request, server.arg("plain"))) {
+      sendJsonError(400, "json_parse_error");
+      return;
+    }
+    uint8_t levels[LOG_CATEGORY_COUNT];
+    memcpy(levels, logLevels, sizeof(levels));
+    if (request.containsKey("level")) {
+      int level = logLevelFromName(request["level"] | "");
+      if (level < 0) {
+        sendJsonError(400, "invalid_level");
+        return;
+      }
+      memset(levels, level, sizeof(levels));
+    }
+    JsonObject categories = request["categories"].as<JsonObject>();
+    size_t matched = 0;
+    for (int i = 0; i < LOG_CATEGORY_COUNT; i++) {
+      if (!categories.containsKey(LOG_CATEGORY_NAMES[i])) {
+        continue;
+      }
+      int level = logLevelFromName(categories[LOG_CATEGORY_NAMES[i]] | "");
+      if (level < 0) {
+        sendJsonError(400, "invalid_level");
+        return;
+      }
+      levels[i] = (uint8_t)level;
+      matched++;
+    }
+    if (matched != categories.size()) {
+      sendJsonError(400, "invalid_category");
+      return;
+    }
+    for (int i = 0; i < LOG_CATEGORY_COUNT; i++) {
+      if (levels[i] > LOG_MAX_LEVEL || (levels[i] != LOG_LVL_NONE && ((LOG_CATEGORY_MASK >> i) & 1) == 0)) {
+        sendJsonError(400, "level_not_compiled");
+        return;
+      }
+    }
+    for (int i = 0; i < LOG_CATEGORY_COUNT; i++) {
+      __atomic_store_n(&logLevels[i], levels[i], __ATOMIC_RELAXED);
+    }
+  }
+
+  JsonWriter json(200);
+  json.beginObject();
+  json.field("async", logTask != NULL);
+  json.field("max_level", LOG_LEVEL_NAMES[LOG_MAX_LEVEL]);
+  json.beginObject("categories");
+  for (int i = 0; i < LOG_CATEGORY_COUNT; i++) {
+    json.field(LOG_CATEGORY_NAMES[i], ((LOG_CATEGORY_MASK >> i) & 1) ? LOG_LEVEL_NAMES[logLevels[i]] : "compiled_out");
+  }
+  json.end();
+  json.field("written", logStats.written);
+  json.field("truncated", logStats.truncated);
+  json.beginObject("dropped");
+  for (int i = LOG_LVL_ERROR; i < LOG_LEVEL_COUNT; i++) {
+    json.field(LOG_LEVEL_NAMES[i], logStats.dropped[i]);
+  }
+  json.end();
+  json.beginObject("queue");
+  json.field("size", LOG_QUEUE_SIZE);
+  json.field("high_water", logQueue.highWater);
+  json.end();
+  json.end();
+}
+
+// Handler da lista de redes salvas (GET /api/wifi/networks), sem as senhas
+void handleWiFiNetworks() {
+  HeapScope heapScope(HEAP_TAG_API_WIFI);
+  JsonWriter json(200);
+  json.beginObject();
+  json.field("count", wifiNetworkCount);
+  json.field("max", WIFI_MAX_NETWORKS);
+  json.beginArray("networks");
+  for (int i = 0; i < wifiNetworkCount; i++) {
+    json.beginObject();
+    json.field("ssid", wifiNetworks[i].ssid);
+    json.field("priority", wifiNetworks[i].priority);
+    json.field("active", i == wifiManager.network && wifiManager.state == WIFI_STATE_CONNECTED);
+    if (wifiNetworks[i].staticIp.ip != 0) {
+      json.field("static_ip", IPAddress(wifiNetworks[i].staticIp.ip));
+    }
+    json.end();
+  }
+  json.end();
+  json.end();
+}
+
+// Handler para remover uma rede salva (POST /api/wifi/networks/delete {"ssid"})
+void handleWiFiNetworkDelete() {
+  HeapScope heapScope(HEAP_TAG_API_WIFI);
+  JsonDocument request(&requestArena);
+  if (!server.hasArg("plain") || deserializeJson(request, server.arg("plain"))) {
+    sendJsonError(400, "json_parse_error");
+    return;
+  }
+  int index = findWiFiNetwork(request["ssid"] | "");
+  if (index < 0) {
+    sendJsonError(404, "network_not_found");
+    return;
+  }
+  bool wasCurrent = index == wifiManager.network;
+  for (int i = index; i < wifiNetworkCount - 1; i++) {
+    wifiNetworks[i] = wifiNetworks[i + 1];
+  }
+  wifiNetworkCount--;
+  if (wifiManager.network > index) {
+    wifiManager.network--;
+  }
+  saveWiFiNetworks();
+  sendJsonSuccess("network_deleted");
+
+  // Depois da resposta: a conexão atual pode cair
+  if (wifiNetworkCount == 0) {
+    wifiConfigured = false;
+    wifiManager.network = -1;
+    WiFi.disconnect();
+    wifiSetState(WIFI_STATE_IDLE);
+    configApOpen(CONFIG_AP_NO_CREDENTIALS, 0);
+  } else if (wasCurrent) {
+    wifiManager.network = -1;
+    wifiStartConnect();
+  }
+}
+
+void stallToJson(JsonWriter& json, const char* key, const StallRecord& stall) {
+  json.beginObject(key);
+  json.field("phase", loopPhaseName(stall.phase));
+  json.field("duration_us", stall.durationUs);
+  json.field("uptime_ms", stall.uptimeMs);
+  json.end();
+}
+
+// Handler de telemetria (GET /api/metrics)
+void handleMetrics() {
+  HeapScope heapScope(HEAP_TAG_API_METRICS);
+  JsonWriter json(200);
+  json.beginObject();
+  json.field("uptime_ms", millis());
+  json.field("window_ms", millis() - telemetryResetAt);
+
+  json.beginObject("ir_tx");
+  histogramToJson(json, "queue_wait", irTxQueueWait);
+  json.beginArray("protocols");
+  for (int slot = 0; slot < PROTOCOL_SLOTS; slot++) {
+    const IRTxStats& stats = irTxStats[slot];
+    if (stats.sends == 0) {
+      continue;  // Apenas protocolos usados desde o último reset
+    }
+    json.beginObject();
+    json.field("protocol", IR_PROTOCOLS[slot].name);
+    json.field("sends", stats.sends);
+    json.field("frames", stats.frames);
+    json.field("repeats", stats.repeats);
+    json.field("failures", stats.failures);
+    json.field("fallbacks", stats.fallbacks);
+    json.field("airtime_us", stats.airtimeUs);
+    histogramToJson(json, "duration", stats.duration);
+    json.end();
+  }
+  json.end();
+  json.end();
+
+  json.beginObject("ir_hold");
+  json.field("active", irHold.active);
+  json.field("holds", irHoldStats.holds);
+  json.field("repeats", irHoldStats.repeats);
+  json.field("keep_alives", irHoldStats.keepAlives);
+  json.field("releases", irHoldStats.releases);
+  json.field("timeouts", irHoldStats.timeouts);
+  json.field("late", irHoldStats.late);
+  json.field("late_threshold_us", IR_HOLD_LATE_US);
+  histogramToJson(json, "start", irHoldStats.start);
+  histogramToJson(json, "interval", irHoldStats.interval);
+  histogramToJson(json, "lateness", irHoldStats.lateness);
+  json.end();
+
+  json.beginObject("ir_rx");
+  json.field("frames", irRxStats.frames);
+  json.field("noise_rejects", irRxStats.noiseRejects);
+  json.field("unknown", irRxStats.decoded[protocolSlot(PROTOCOL_UNKNOWN)]);
+  json.field("repeats", irRxStats.repeats);
+  json.field("overflows", irRxStats.overflows);
+  json.beginArray("decoded");
+  for (int slot = 0; slot < PROTOCOL_SLOTS; slot++) {
+    if (irRxStats.decoded[slot] == 0) {
+      continue;
+    }
+    json.beginObject();
+    json.field("protocol", IR_PROTOCOLS[slot].name);
+    json.field("frames", irRxStats.decoded[slot]);
+    json.end();
+  }
+  json.end();
+  histogramToJson(json, "inter_frame", irRxStats.interFrame);
+  histogramToJson(json, "decode", irRxStats.decode);
+  histogramToJson(json, "decode_to_handle", irRxStats.decodeToHandle);
+  json.end();
+
+  json.beginObject("loop");
+  json.field("loops", loopProfiler.loops);
+  json.field("stall_threshold_us", LOOP_STALL_THRESHOLD_US);
+  json.field("stalls", loopProfiler.stalls);
+  histogramToJson(json, "period", loopProfiler.period);
+  json.beginArray("phases");
+  for (int i = 0; i < LOOP_PHASE_COUNT; i++) {
+    json.beginObject();
+    json.field("phase", loopPhaseName(i));
+    histogramToJson(json, "duration", loopProfiler.phases[i]);
+    json.end();
+  }
+  json.end();
+  if (loopProfiler.lastStall.durationUs != 0) {
+    stallToJson(json, "last_stall", loopProfiler.lastStall);
+  }
+  json.end();
+
+  // Ocupação por task e filas entre elas; com DUAL_CORE_TASKS=0 (ou sem a netTask) só a loopTask existe
+  json.beginObject("tasks");
+  json.field("mode", DUAL_CORE_TASKS ? (netTask ? "dual_core" : "net_in_loop") : "single_loop");
+  unsigned long windowUs = micros() - taskStatsSinceUs;
+  static const char* const TASK_NAMES[TASK_SLOT_COUNT] = {"loop", "net"};
+  for (int i = 0; i < TASK_SLOT_COUNT; i++) {
+    if (taskStats[i].core < 0) {
+      continue;
+    }
+    json.beginObject(TASK_NAMES[i]);
+    json.field("core", taskStats[i].core);
+    json.field("loops", i == TASK_LOOP ? loopProfiler.loops : taskStats[i].loops);
+    json.field("busy_pct", windowUs ? (float)(100.0 - taskStats[i].idleUs * 100.0 / windowUs) : 0.0f);
+    json.end();
+  }
+  json.beginObject("queues");
+  json.beginObject("ir_rx");
+  json.field("size", IR_RX_QUEUE_SIZE);
+  json.field("high_water", irRxQueue.highWater);
+  json.field("drops", irRxQueue.drops);
+  json.end();
+  json.beginObject("ir_tx");
+  json.field("size", IR_TX_QUEUE_SIZE);
+  json.field("high_water", irTxQueue.highWater);
+  json.field("drops", irTxQueue.drops);
+  json.end();
+  json.beginObject("ir_hold");
+  json.field("size", IR_HOLD_QUEUE_SIZE);
+  json.field("high_water", irHoldQueue.highWater);
+  json.field("drops", irHoldQueue.drops);
+  json.end();
+  json.beginObject("button");
+  json.field("size", BUTTON_EVENT_QUEUE_SIZE);
+  json.field("high_water", buttonInput.events.highWater);
+  json.field("drops", buttonInput.events.drops);
+  json.end();
+  json.end();
+  json.end();
+
+  json.beginObject("code_store");
+  json.field("version", __atomic_load_n(&codeStore.version, __ATOMIC_RELAXED));
+  json.field("readers", __atomic_load_n(&codeStore.readers[0], __ATOMIC_RELAXED) +
+                        __atomic_load_n(&codeStore.readers[1], __ATOMIC_RELAXED));
+  json.field("writer_waits", codeStore.writerWaits);
+  json.field("writer_wait_max_us", codeStore.writerWaitMaxUs);
+  json.field("duplicates", codeStore.duplicates);
+  {
+    CodeStoreReader codes;
+    json.field("payload_bytes", codes->payloadUsed);
+  }
+  json.field("payload_pool", CODE_PAYLOAD_POOL_SIZE);
+  json.end();
+
+  // Respostas anteriores a esta; ciclos da CPU da criação do writer ao último byte entregue ao socket
+  json.beginObject("json_writer");
+  json.field("buffer", JSON_WRITER_BUFFER);
+  json.field("responses", jsonWriterStats.responses);
+  json.field("chunked", jsonWriterStats.chunked);
+  json.field("writes", jsonWriterStats.writes);
+  json.field("bytes", jsonWriterStats.bytes);
+  json.field("max_bytes", jsonWriterStats.maxBytes);
+  json.field("avg_cycles", jsonWriterStats.responses ? (uint32_t)(jsonWriterStats.cycles / jsonWriterStats.responses) : 0);
+  json.field("max_cycles", jsonWriterStats.maxCycles);
+  json.end();
+
+  json.beginObject("boot");
+  json.field("count", persistentLoop.bootCount);
+  json.field("reset_reason", resetReasonName(bootResetReason));
+  json.field("stalls_total", persistentLoop.stallCount);
+  if (previousBootLoopValid) {
+    json.beginObject("previous");
+    json.field("phase_in_progress", loopPhaseName(previousBootLoop.phaseInProgress));
+    json.field("phase_started_at_ms", previousBootLoop.phaseStartedAtMs);
+    if (previousBootLoop.lastStall.durationUs != 0) {
+      stallToJson(json, "last_stall", previousBootLoop.lastStall);
+    }
+    json.end();
+  }
+  json.end();
+  json.end();
+}
+
+// Handler do heap (GET /api/heap): estado atual, amostras para tendência e saldo por subsistema
+void handleHeap() {
+  HeapScope heapScope(HEAP_TAG_API_METRICS);
+  uint32_t freeBytes = ESP.getFreeHeap();
+  uint32_t largestBlock = ESP.getMaxAllocHeap();
+  
+  JsonWriter json(200);
+  json.beginObject();
+  json.field("uptime_ms", millis());
+  json.field("window_ms", millis() - telemetryResetAt);
+  json.field("size", ESP.getHeapSize());
+  json.field("free", freeBytes);
+  json.field("min_free", ESP.getMinFreeHeap());
+  json.field("largest_block", largestBlock);
+  json.field("fragmentation_pct", heapFragmentation(freeBytes, largestBlock));
+  json.field("alloc_tracking", (bool)HEAP_ALLOC_TRACKING);
+  json.field("sample_interval_ms", HEAP_SAMPLE_INTERVAL);
+
+  // Amostras da mais antiga para a mais recente
+  json.beginArray("samples");
+  int first = (heapSampleHead - heapSampleCount + HEAP_SAMPLE_COUNT) % HEAP_SAMPLE_COUNT;
+  for (int i = 0; i < heapSampleCount; i++) {
+    const HeapSample& sample = heapSamples[(first + i) % HEAP_SAMPLE_COUNT];
+    json.beginArray();
+    json.add(sample.uptimeS);
+    json.add(sample.freeBytes);
+    json.add(sample.minFreeBytes);
+    json.add(sample.largestBlock);
+    json.end();
+  }
+  json.end();
+
+  json.beginArray("subsystems");
+  for (int tag = 0; tag < HEAP_TAG_COUNT; tag++) {
+    const HeapTagStats& stats = heapTagStats[tag];
+    if (stats.allocs == 0 && stats.frees == 0 && stats.scopes == 0) {
+      continue;
     }
+    json.beginObject();
+    json.field("subsystem", heapTagName(tag));
+    json.field("allocs", stats.allocs);
+    json.field("frees", stats.frees);
+    json.field("reallocs", stats.reallocs);
+    json.field("failures", stats.failures);
+    json.field("bytes", stats.bytes);
+    json.field("scopes", stats.scopes);
+    json.field("retained_bytes", stats.retainedBytes);
+    json.field("largest_block_drop", stats.largestDrop);
+    json.end();
+  }
+  json.end();
+
+  // allocs: blocos dos handlers que antes eram malloc/free; fallbacks ainda foram para o heap
+  json.beginObject("request_arena");
+  json.field("size", requestArena.base != NULL ? REQUEST_ARENA_SIZE : 0);
+  json.field("high_water", requestArena.highWater);
+  json.field("requests", requestArena.requests);
+  json.field("allocs", requestArena.allocs);
+  json.field("in_place", requestArena.inPlace);
+  json.field("max_request_blocks", requestArena.maxRequestBlocks);
+  json.field("fallbacks", requestArena.fallbacks);
+  json.field("fallback_bytes", requestArena.fallbackBytes);
+  json.end();
+  json.end();
+}
+
+// Handler dos traces recentes (GET /api/trace, ?format=chrome para chrome://tracing / Perfetto)
+void handleTrace() {
+  HeapScope heapScope(HEAP_TAG_API_METRICS);
+  bool chrome = server.arg("format") == "chrome";
+  uint32_t count = (traceSpanTotal < TRACE_SPAN_COUNT) ? traceSpanTotal : TRACE_SPAN_COUNT;
+  uint32_t first = traceSpanTotal - count;
+
+  // ~100 bytes por span: passa do buffer e sai em chunked, sem montar o documento inteiro
+  JsonWriter json(200);
+  json.beginObject();
+  if (chrome) {
+    json.field("displayTimeUnit", "ms");
   } else {
-    response["status"] = "error";
-    response["message"] = "Nenhuma credencial WiFi configurada";
+    json.field("spans_total", traceSpanTotal);
+    json.field("capacity", TRACE_SPAN_COUNT);
   }
+  json.beginArray(chrome ? "traceEvents" : "spans");
   
-  String responseStr;
-  serializeJson(response, responseStr);
-  server.send(200, "application/json", responseStr);
+  // Do mais antigo para o mais recente
+  for (uint32_t i = 0; i < count; i++) {
+    const TraceSpan& span = traceSpans[(first + i) % TRACE_SPAN_COUNT];
+    json.beginObject();
+    json.field("name", traceSpanName(span.name));
+    if (chrome) {
+      json.field("cat", "firmware");
+      json.field("ph", "X");
+      json.field("ts", span.startUs);
+      json.field("dur", span.durationUs);
+      json.field("pid", 1);
+      json.field("tid", 1);
+      json.beginObject("args");
+      json.field("trace", span.traceId);
+      json.end();
+    } else {
+      json.field("trace", span.traceId);
+      json.field("start_us", span.startUs);
+      json.field("dur_us", span.durationUs);
+    }
+    json.end();
+  }
+  json.end();
+  json.end();
+}
+
+// Handler para zerar a telemetria (POST /api/metrics/reset)
+void handleMetricsReset() {
+  HeapScope heapScope(HEAP_TAG_API_METRICS);
+  resetTelemetry();
+  Log<LOG_LVL_INFO, LOG_SYS>::printf("✓ Métricas de telemetria zeradas");
+  sendJsonSuccess("metrics_reset");
 }
 
 void setupRoutes() {
@@ -2041,15 +7043,36 @@ void setupRoutes() {
   server.on("/config", HTTP_GET, handleWiFiConfig);
   server.on("/api/wifi/config", HTTP_POST, handleWiFiConfigSave);
   server.on("/api/wifi/reconnect", HTTP_POST, handleWiFiReconnect);
+  server.on("/api/wifi/status", HTTP_GET, handleWiFiStatus);
+  server.on("/api/wifi/networks", HTTP_GET, handleWiFiNetworks);
+  server.on("/api/wifi/scan", HTTP_GET, handleWiFiScan);
+  server.on("/api/wifi/networks/delete", HTTP_POST, handleWiFiNetworkDelete);
+  server.on("/api/wifi/ap", HTTP_GET, handleWiFiAP);
+  server.on("/api/wifi/ap", HTTP_POST, handleWiFiAP);
   server.on("/api/status", HTTP_GET, handleStatus);
+  server.on("/api/power", HTTP_GET, handlePower);
+  server.on("/api/power", HTTP_POST, handlePower);
+  server.on("/api/log", HTTP_GET, handleLog);
+  server.on("/api/log", HTTP_POST, handleLog);
+  server.on("/api/button", HTTP_GET, handleButton);
+  server.on("/api/button", HTTP_POST, handleButton);
   server.on("/api/learn/start", HTTP_POST, handleLearnStart);
   server.on("/api/learn/stop", HTTP_POST, handleLearnStop);
   server.on("/api/learn/save", HTTP_POST, handleLearnSave);
   server.on("/api/learn/captured", HTTP_GET, handleLearnCaptured);
   server.on("/api/codes", HTTP_GET, handleListCodes);
+  server.on("/api/codes/export", HTTP_GET, handleCodesExport);
+  server.on("/api/codes/import", HTTP_POST, handleCodesImport, handleCodesImportBody);
   server.on("/api/code/send", HTTP_POST, handleCodeSend);
+  server.on("/api/hold/start", HTTP_POST, handleHoldStart);
+  server.on("/api/hold/keep", HTTP_POST, handleHoldKeep);
+  server.on("/api/hold/stop", HTTP_POST, handleHoldStop);
   server.on("/api/code/edit", HTTP_POST, handleCodeEdit);
   server.on("/api/code/delete", HTTP_POST, handleCodeDelete);
+  server.on("/api/metrics", HTTP_GET, handleMetrics);
+  server.on("/api/metrics/reset", HTTP_POST, handleMetricsReset);
+  server.on("/api/heap", HTTP_GET, handleHeap);
+  server.on("/api/trace", HTTP_GET, handleTrace);
 }
 
 // ============================================================================
@@ -2059,6 +7082,11 @@ void setupRoutes() {
 void setup() {
   Serial.begin(115200);
   delay(1000);
+  initLogger();
+
+  initLoopProfiler();
+  heapTrackedTask = xTaskGetCurrentTaskHandle();
+  initRequestArena();
 
   Serial.println("\n\n");
   Serial.println("╔════════════════════════════════════════╗");
@@ -2066,8 +7094,6 @@ void setup() {
   Serial.println("║         Iniciando Sistema...           ║");
   Serial.println("╚════════════════════════════════════════╝\n");
 
-  pinMode(BUTTON_LEARNING, INPUT_PULLUP);
-
   // Emissor: OUTPUT e LOW no boot. IrSender.begin() não toca no pino; LEDC é anexado no 1º send().
   pinMode(IR_EMITTER_PIN, OUTPUT);
   digitalWrite(IR_EMITTER_PIN, LOW);
@@ -2079,9 +7105,12 @@ void setup() {
   IrReceiver.begin(IR_RECEIVER_PIN, false);
   
   // Preferences é inicializado dentro de loadCodesFromPreferences()
+  initCodeStore();
   loadCodesFromPreferences();
 
   setupWiFi();
+  setupPower();  // Depois do WiFi: o modem sleep só vale com o driver iniciado
+  setupButton();  // Depois da energia: a ISR acorda a task do loop
   
   // Aguardar um pouco para garantir que o AP esteja totalmente iniciado
   delay(500);
@@ -2090,6 +7119,9 @@ void setup() {
 
   server.begin();
   Serial.println("✓ Servidor Web iniciado na porta 80");
+  if (holdUdp.begin(IR_HOLD_UDP_PORT)) {
+    Serial.println("✓ Botão segurado por UDP na porta " + String(IR_HOLD_UDP_PORT));
+  }
   
   // Mostrar informações finais de rede
   Serial.println("\n════════════════════════════════════════");
@@ -2125,37 +7157,54 @@ void setup() {
   Serial.println("✓ Receptor IR ativo no GPIO 14");
   Serial.println("✓ Emissor IR ativo no GPIO " + String(IR_EMITTER_PIN) + " (IrSender.begin)");
   Serial.println();
+
+#if LOOP_WDT_ENABLED
+  enableLoopWDT();
+  Serial.println("✓ Watchdog da loopTask ativo");
+#endif
+  setupTasks();
+  setupLogger();
+  persistentLoop.phaseInProgress = LOOP_PHASE_NONE;
+  currentHeapTag = HEAP_TAG_LOOP;
 }
 
 void loop() {
-  server.handleClient();
+  loopProfilerTick();
+  powerTick();
 
-  // Verificar e reconectar WiFi se necessário (Fase 1 - Correção Crítica)
-  checkWiFiConnection();
+#if !DUAL_CORE_TASKS
+  sampleHeapIfDue();
 
-  // Nova API: IrReceiver.decode() retorna true se houver dados
-  if (IrReceiver.decode()) {
-    handleReceivedIR();
-    IrReceiver.resume(); // Habilita recepção do próximo sinal
-  }
+  loopPhaseBegin(LOOP_PHASE_HTTP);
+  netServeClients();
+  loopPhaseEnd();
 
-  static unsigned long lastButtonCheck = 0;
-  const unsigned long debounceDelay = 50;
-  
-  if (digitalRead(BUTTON_LEARNING) == LOW) {
-    unsigned long now = millis();
-    if (now - lastButtonCheck > debounceDelay) {
-      lastButtonCheck = now;
-      if (digitalRead(BUTTON_LEARNING) == LOW) {
-        toggleLearningMode();
-        while (digitalRead(BUTTON_LEARNING) == LOW) {
-          yield();
-          delay(10);
-        }
-        delay(500);
-      }
-    }
+  // Máquina de estados do WiFi (conexão/reconexão sem bloquear)
+  loopPhaseBegin(LOOP_PHASE_WIFI);
+  wifiTick();
+  loopPhaseEnd();
+#endif
+
+  loopPhaseBegin(LOOP_PHASE_IR);
+  irRxPoll();
+#if DUAL_CORE_TASKS
+  irTxDrain();
+#endif
+  irHoldTick();
+  loopPhaseEnd();
+
+  loopPhaseBegin(LOOP_PHASE_BUTTON);
+  buttonScanTick();
+#if !DUAL_CORE_TASKS
+  buttonDispatch();
+#endif
+  loopPhaseEnd();
+
+#if DUAL_CORE_TASKS
+  if (netTask == NULL) {
+    netStep();  // setupTasks() não criou a netTask
   }
+#endif
   
-  yield();
+  powerIdle();
 }